@@ -4,7 +4,10 @@
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
+#include <algorithm>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -16,6 +19,22 @@
 #include <utils/camera.h>
 #include <utils/texture.h>
 #include <utils/model.h>
+#include <utils/jobs.h>
+#include <utils/scene.h>
+#include <utils/occlusion.h>
+#include <utils/indirect.h>
+#include <utils/meshlet.h>
+#include <utils/capture.h>
+#include <utils/texture_stream.h>
+#include <utils/memory.h>
+#include <utils/softraster.h>
+#include <utils/particles.h>
+#include <utils/resources.h>
+#include <utils/frustum.h>
+#include <utils/animation.h>
+#include <utils/bvh.h>
+#include <utils/lightmap.h>
+#include <utils/world.h>
 #include <common/figures.h>
 
 const unsigned int W = 1440;
@@ -76,9 +95,83 @@ void process_input(GLFWwindow* window)
 	camera.update();
 }
 
-int main()
+static void usage()
 {
-	Window window(W, H);
+	printf("usage: main [--headless] [--frames N] [--capture PATH] [--format raw|png|y4m] [--fps N] [--renderer gl|cpu] [--threads N] [--animated PATH] [--crowd N] [--particles N] [--particle-update feedback|compute] [--placements N] [--ray-benchmark N] [--lightmap PATH] [--scene DIR] [--world-radius R] [--upload-budget MB] [--world-budget MB]\n");
+	printf("  --animated loads a skinned model, textures next to it, and draws --crowd instances of it\n");
+	printf("  --placements adds N more instances of the model, sharing its buffers and textures\n");
+	printf("  --ray-benchmark traces N random primary rays against the scene hierarchy on the first frame and prints the rate\n");
+	printf("  --lightmap draws the model with PATH.png and PATH.bin from the baker in place of the directional light\n");
+	printf("  --scene streams the world in DIR around the camera, tiles within --world-radius, uploading at most --upload-budget per frame\n");
+	printf("  --particles simulates N GPU particles, the GPU update throughput is printed at exit\n");
+	printf("  PATH \"-\" writes to stdout, \"|command\" pipes into command, png paths are printf patterns for the frame number\n");
+}
+
+int main(int argc, char** argv)
+{
+	bool headless = false;
+	unsigned int frameLimit = 0, captureFps = 60;
+	const char* capturePath = NULL;
+	CaptureFormat captureFormat = CAPTURE_Y4M;
+	bool cpuRenderer = false;
+	unsigned int threadCount = 0;
+	const char* animatedPath = NULL;
+	int crowdSize = 100;
+	int particleCount = 0;
+	// compute when GL 4.3 is there unless asked otherwise
+	int particleUpdate = -1;
+	int placementCount = 0;
+	unsigned int rayBenchmark = 0;
+	const char* lightmapPath = NULL;
+	const char* scenePath = NULL;
+	float worldRadius = 40.0f;
+	int uploadBudgetMB = 4, worldBudgetMB = 1024;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--headless") == 0)
+			headless = true;
+		else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+			frameLimit = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc)
+			capturePath = argv[++i];
+		else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc && parseCaptureFormat(argv[i + 1], captureFormat))
+			++i;
+		else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc)
+			captureFps = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--renderer") == 0 && i + 1 < argc && (strcmp(argv[i + 1], "gl") == 0 || strcmp(argv[i + 1], "cpu") == 0))
+			cpuRenderer = strcmp(argv[++i], "cpu") == 0;
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			threadCount = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--animated") == 0 && i + 1 < argc)
+			animatedPath = argv[++i];
+		else if (strcmp(argv[i], "--crowd") == 0 && i + 1 < argc)
+			crowdSize = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--particles") == 0 && i + 1 < argc)
+			particleCount = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--particle-update") == 0 && i + 1 < argc && (strcmp(argv[i + 1], "feedback") == 0 || strcmp(argv[i + 1], "compute") == 0))
+			particleUpdate = strcmp(argv[++i], "compute") == 0;
+		else if (strcmp(argv[i], "--placements") == 0 && i + 1 < argc)
+			placementCount = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--ray-benchmark") == 0 && i + 1 < argc)
+			rayBenchmark = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--lightmap") == 0 && i + 1 < argc)
+			lightmapPath = argv[++i];
+		else if (strcmp(argv[i], "--scene") == 0 && i + 1 < argc)
+			scenePath = argv[++i];
+		else if (strcmp(argv[i], "--world-radius") == 0 && i + 1 < argc)
+			worldRadius = atof(argv[++i]);
+		else if (strcmp(argv[i], "--upload-budget") == 0 && i + 1 < argc)
+			uploadBudgetMB = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--world-budget") == 0 && i + 1 < argc)
+			worldBudgetMB = atoi(argv[++i]);
+		else
+		{
+			usage();
+			return -1;
+		}
+	}
+
+	Window window(W, H, !headless);
 	if (window.raw == NULL)
 	{
 		printf("Failed to create GLFW window\n");
@@ -93,8 +186,35 @@ int main()
 		return -1;
 	}
 
-	Model mdl;
-	loadModel(mdl, "../resources/backpack/backpack.obj", "../resources/backpack/");
+	jobs::ScopedPool pool(threadCount);
+
+	ResourceManager resources;
+	initResources(resources);
+	ModelHandle backpack = acquireModel(resources, "../resources/backpack/backpack.obj", "../resources/backpack/", (streamingSupported() ? MODEL_STREAM_TEXTURES : 0) | MODEL_BUILD_BVH);
+	if (backpack == NO_MODEL)
+		return -1;
+	Model &mdl = getModel(resources, backpack);
+	// before anything copies or drops the mesh data, it gets new vertices
+	if (lightmapPath && !applyLightmap(mdl, lightmapPath))
+		printf("Warning: drawing without the lightmap\n");
+
+	Model animated;
+	if (animatedPath)
+	{
+		std::string path = animatedPath;
+		std::string directory = path.find('/') == std::string::npos ? "./" : path.substr(0, path.rfind('/') + 1);
+		if (!loadModel(animated, animatedPath, directory.c_str()))
+			return -1;
+		if (animated.skeleton.names.empty())
+			printf("Warning: %s has no bones, it is drawn in its bind pose\n", animatedPath);
+	}
+
+	int textureBudgetMB = 256;
+	TextureStreamer streamer;
+	initStreamer(streamer, (size_t)textureBudgetMB << 20);
+	resources.streamer = &streamer;
+	if (streamingSupported())
+		addStreamedModel(streamer, mdl);
 
 	// Setup Dear ImGui context
     IMGUI_CHECKVERSION();
@@ -111,16 +231,29 @@ int main()
 
 	unsigned int combinedVS = shader::loadFromFile("./src/shaders/phong_combined_vertex.glsl", GL_VERTEX_SHADER);
 	unsigned int combinedFS = shader::loadFromFile("./src/shaders/phong_combined_fragment.glsl", GL_FRAGMENT_SHADER);
+	unsigned int skinnedVS = shader::loadFromFile("./src/shaders/phong_skinned_vertex.glsl", GL_VERTEX_SHADER);
 	unsigned int phongvs = shader::loadFromFile("./src/shaders/phong_vertex.glsl", GL_VERTEX_SHADER);
 	unsigned int lightFS = shader::loadFromFile("./src/shaders/light_fragment.glsl", GL_FRAGMENT_SHADER);
 
 	unsigned int objPhongShader = shader::createProgram(combinedVS, combinedFS);
 	unsigned int lightShader = shader::createProgram(phongvs, lightFS);
+	unsigned int skinnedShader = shader::createProgram(skinnedVS, combinedFS);
+
+	unsigned int particleVS = shader::loadFromFile("./src/shaders/particle_vertex.glsl", GL_VERTEX_SHADER);
+	unsigned int particleFS = shader::loadFromFile("./src/shaders/particle_fragment.glsl", GL_FRAGMENT_SHADER);
+	unsigned int particleShader = shader::createProgram(particleVS, particleFS);
+	glDeleteShader(particleVS);
+	glDeleteShader(particleFS);
 
 	glDeleteShader(phongvs);
 	glDeleteShader(combinedVS);
+	glDeleteShader(skinnedVS);
 	glDeleteShader(combinedFS);
 	glDeleteShader(lightFS);
+
+	unsigned int cullProgram = 0;
+	if (indirectSupported())
+		cullProgram = createCullProgram();
 	
 	/*
 	unsigned int container_tex = texture::loadTexture("./textures/container2.png", false);
@@ -136,6 +269,10 @@ int main()
 	glBindVertexArray(VAO);
 	glBindBuffer(GL_ARRAY_BUFFER, VBO);
 	glBufferData(GL_ARRAY_BUFFER, sizeof(figures::cube_with_normals_and_tex_coords), figures::cube_with_normals_and_tex_coords, GL_STATIC_DRAW);
+	{
+		memory::ScopedOwner owner("light cubes");
+		memory::allocate(memory::VERTEX_BUFFER, VBO, sizeof(figures::cube_with_normals_and_tex_coords));
+	}
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
 	glEnableVertexAttribArray(0);
 	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
@@ -151,6 +288,47 @@ int main()
 	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 	glEnable(GL_DEPTH_TEST);
 
+	// a hidden window's default framebuffer may have no pixels, render offscreen
+	unsigned int offscreenFBO = 0, offscreenColor = 0, offscreenDepth = 0;
+	if (headless)
+	{
+		glGenFramebuffers(1, &offscreenFBO);
+		glGenRenderbuffers(1, &offscreenColor);
+		glGenRenderbuffers(1, &offscreenDepth);
+		glBindRenderbuffer(GL_RENDERBUFFER, offscreenColor);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, W, H);
+		glBindRenderbuffer(GL_RENDERBUFFER, offscreenDepth);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, W, H);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+		glBindFramebuffer(GL_FRAMEBUFFER, offscreenFBO);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, offscreenColor);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, offscreenDepth);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			printf("Error: offscreen framebuffer incomplete\n");
+		glViewport(0, 0, W, H);
+		// batch renders run as fast as the capture keeps up
+		glfwSwapInterval(0);
+	}
+
+	Capture capture;
+	capture.active = false;
+	if (capturePath && !startCapture(capture, W, H, captureFormat, capturePath, captureFps))
+	{
+		shutdownStreamer(streamer);
+		return -1;
+	}
+	// after the last step that can fail, returning with the loader thread
+	// running would terminate
+	WorldStreamer world;
+	bool hasWorld = scenePath != NULL;
+	if (hasWorld && !openWorld(world, scenePath, worldRadius, (size_t)uploadBudgetMB << 20, (size_t)worldBudgetMB << 20))
+	{
+		stopCapture(capture);
+		shutdownStreamer(streamer);
+		return -1;
+	}
+	unsigned int frameCount = 0;
+
 	ImVec4 clearColor = ImVec4(0.2, 0.2, 0.2, 1.0f);
 	ImVec4 rotationByAxis(0.0f, 0.0f, 0.0f, 1.0f);
 	ImVec4 scale(1.0f, 1.0f, 1.0f, 1.0f);
@@ -196,6 +374,82 @@ int main()
 		glm::vec3(-1.3f,  1.0f, -1.5f)
 	};
 
+	Scene scene;
+	unsigned int modelEntity = createInstance(scene, resources, backpack, glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(1.0f));
+	unsigned int lightEntities[2];
+	lightEntities[0] = createEntity(scene, glm::vec3(pointLightPos.x, pointLightPos.y, pointLightPos.z), glm::vec3(0.0f), glm::vec3(0.2f), NO_RENDERABLE);
+	lightEntities[1] = createEntity(scene, glm::vec3(spotLightPos.x, spotLightPos.y, spotLightPos.z), glm::vec3(0.0f), glm::vec3(0.2f), NO_RENDERABLE);
+	// extra placements of the same model on a grid behind it
+	std::vector<unsigned int> placements;
+	float placementSpacing;
+	{
+		glm::vec3 boundsMin, boundsMax;
+		modelBounds(mdl, boundsMin, boundsMax);
+		placementSpacing = 1.5f * std::max(boundsMax.x - boundsMin.x, boundsMax.z - boundsMin.z);
+	}
+
+	bool occlusionCulling = false;
+	OcclusionBuffer occlusion;
+	initOcclusion(occlusion, 320, 192);
+	std::vector<unsigned int> occluders;
+	selectOccluders(mdl, 8, occluders);
+	// only the occluders need their CPU-side copies, the CPU renderer needs
+	// all. The backpack is shared through the resource manager, so this only
+	// happens while the references are main's acquire and modelEntity; the
+	// BVH keeps its own triangles, and the release is recorded on the model
+	// for later acquires.
+	if (!cpuRenderer && resources.slots[backpack].references == 2)
+	{
+		std::vector<unsigned char> keep(mdl.meshes.size(), 0);
+		for (unsigned int i = 0; i < occluders.size(); ++i)
+			keep[occluders[i]] = 1;
+		releaseModelData(mdl, keep);
+	}
+	std::vector<unsigned char> visibleMeshes;
+
+	bool gpuDriven = false, validateGpuCulling = false;
+	IndirectModel indirect;
+	if (indirectSupported())
+		initIndirect(indirect, mdl);
+	unsigned int gpuVisible = 0, cpuVisible = 0, cullMismatches = 0;
+
+	bool meshletCulling = false;
+	MeshletCuller meshletCuller;
+
+	SoftRenderer softRenderer;
+	SoftTextures softTextures;
+	if (cpuRenderer)
+	{
+		initSoftRenderer(softRenderer, W, H);
+		loadSoftTextures(softTextures, mdl);
+	}
+
+	Crowd crowd;
+	bool hasCrowd = !animated.skeleton.names.empty();
+	int crowdBuilt = -1;
+	float crowdSpacing = 1.0f;
+	if (hasCrowd)
+	{
+		initCrowd(crowd);
+		glm::vec3 boundsMin, boundsMax;
+		modelBounds(animated, boundsMin, boundsMax);
+		crowdSpacing = 1.2f * std::max(boundsMax.x - boundsMin.x, boundsMax.z - boundsMin.z);
+	}
+
+	ParticleSystem particles;
+	ParticleEmitter emitter = defaultEmitter();
+	bool particleCompute = particleComputeSupported() && particleUpdate != 0;
+	bool particleBuiltCompute = particleCompute;
+	unsigned int particleUpdateProgram = createParticleUpdateProgram(particleCompute);
+	initParticles(particles, std::max(particleCount, 0), particleCompute, emitter);
+
+	// picking and the ray benchmark rebuild the top level on demand, the mesh
+	// hierarchies were built by loadModel
+	SceneBvh sceneBvh;
+	bool mouseWasDown = false, hasPick = false;
+	RayHit pick;
+
+	double renderStart = glfwGetTime();
 	while (!glfwWindowShouldClose(window.raw))
 	{
 		float currentTime = glfwGetTime();
@@ -204,60 +458,186 @@ int main()
 		process_input(window.raw);
 		glClearColor(clearColor.x, clearColor.y, clearColor.z, clearColor.w);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		resetRenderStats();
 
 		glm::mat4 view(1.0f), proj;
 		view = view * camera.view_matrix();
 		proj = glm::perspective(glm::radians(camera.fov), (float)(W/H), 0.1f, 100.0f);
 
+		while ((int)placements.size() > std::max(placementCount, 0))
+		{
+			destroyInstance(scene, resources, placements.back());
+			placements.pop_back();
+		}
+		while ((int)placements.size() < placementCount)
+		{
+			unsigned int i = placements.size();
+			glm::vec3 position((float)(i % 32) - 15.5f, 0.0f, -1.0f - (float)(i / 32));
+			placements.push_back(createInstance(scene, resources, backpack, position * placementSpacing, glm::vec3(0.0f), glm::vec3(1.0f)));
+		}
+
+		setRotation(scene, modelEntity, glm::vec3(rotationByAxis.x, rotationByAxis.y, rotationByAxis.z));
+		setScale(scene, modelEntity, glm::vec3(scale.x, scale.y, scale.z));
+		setPosition(scene, lightEntities[0], glm::vec3(pointLightPos.x, pointLightPos.y, pointLightPos.z));
+		setPosition(scene, lightEntities[1], glm::vec3(spotLightPos.x, spotLightPos.y, spotLightPos.z));
+
+		if (hasWorld)
+		{
+			world.loadRadius = worldRadius;
+			world.uploadBudget = (size_t)std::max(uploadBudgetMB, 1) << 20;
+			world.memoryBudget = (size_t)std::max(worldBudgetMB, 1) << 20;
+			updateWorld(world, scene, resources, camera.position, deltaTime);
+		}
+		updateTransforms(scene);
+
+		// the BVH instances take the world matrices of this frame
+		if (rayBenchmark)
+		{
+			buildSceneBvh(sceneBvh, scene, resources);
+			BvhBenchmark bench = benchmarkRays(sceneBvh, proj * view, rayBenchmark);
+			printf("rays: %u instances, %u triangles, top level %.2f ms\n", (unsigned int)sceneBvh.instances.size(), sceneBvh.triangles, sceneBvh.buildMs);
+			printf("rays: %u rays, %u hits, closest %.1f ms (%.2f Mrays/s), occluded %.1f ms (%.2f Mrays/s), %u workers\n", bench.rays, bench.hits, bench.closestMs, bench.closestRate, bench.occludedMs, bench.occludedRate, jobs::workerCount());
+			rayBenchmark = 0;
+		}
+
+		bool mouseDown = glfwGetMouseButton(window.raw, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+		if (mouseDown && !mouseWasDown && !ImGui::GetIO().WantCaptureMouse)
+		{
+			double cursorX, cursorY;
+			glfwGetCursorPos(window.raw, &cursorX, &cursorY);
+			buildSceneBvh(sceneBvh, scene, resources);
+			Ray ray = screenRay((float)cursorX, (float)cursorY, (float)W, (float)H, proj * view);
+			pick.t = ray.tMax;
+			hasPick = intersectScene(sceneBvh, ray, pick);
+		}
+		mouseWasDown = mouseDown;
+
+		requestTextureDetail(streamer, mdl, scene.world[modelEntity], camera.position, glm::radians(camera.fov), H);
+		streamer.budgetBytes = (size_t)textureBudgetMB << 20;
+		updateStreamer(streamer);
+
+		if (occlusionCulling)
+		{
+			beginOcclusion(occlusion, proj * view);
+			for (unsigned int i = 0; i < occluders.size(); ++i)
+			{
+				addOccluder(occlusion, mdl.meshes[occluders[i]], scene.world[modelEntity]);
+			}
+			rasterizeOccluders(occlusion);
+			cullMeshes(occlusion, mdl, scene.world[modelEntity], visibleMeshes);
+		}
+
+		Lights lights;
+		lights.directional.direction = glm::vec3(directionalLightDir.x, directionalLightDir.y, directionalLightDir.z);
+		lights.directional.ambient = glm::vec3(directionalLightAmbient.x, directionalLightAmbient.y, directionalLightAmbient.z);
+		lights.directional.diffuse = glm::vec3(directionalLightDiffuse.x, directionalLightDiffuse.y, directionalLightDiffuse.z);
+		lights.directional.specular = glm::vec3(directionalLightSpecular.x, directionalLightSpecular.y, directionalLightSpecular.z);
+
+		lights.point.position = glm::vec3(pointLightPos.x, pointLightPos.y, pointLightPos.z);
+		lights.point.ambient = glm::vec3(pointLightAmbient.x, pointLightAmbient.y, pointLightAmbient.z);
+		lights.point.diffuse = glm::vec3(pointLightDiffuse.x, pointLightDiffuse.y, pointLightDiffuse.z);
+		lights.point.specular = glm::vec3(pointLightSpecular.x, pointLightSpecular.y, pointLightSpecular.z);
+		lights.point.constant = 1.0f;
+		lights.point.linear = attenuationLinear;
+		lights.point.quadratic = attenuationQuadratic;
+		// the streamed world brings its own point lights, the nearest one is used
+		WorldLight worldLight;
+		if (hasWorld && nearestWorldLight(world, camera.position, worldLight))
+		{
+			lights.point.position = worldLight.position;
+			lights.point.diffuse = worldLight.color;
+		}
+
+		lights.spot.position = glm::vec3(spotLightPos.x, spotLightPos.y, spotLightPos.z);
+		lights.spot.direction = glm::vec3(spotLightDir.x, spotLightDir.y, spotLightDir.z);
+		lights.spot.ambient = glm::vec3(spotLightAmbient.x, spotLightAmbient.y, spotLightAmbient.z);
+		lights.spot.diffuse = glm::vec3(spotLightDiffuse.x, spotLightDiffuse.y, spotLightDiffuse.z);
+		lights.spot.specular = glm::vec3(spotLightSpecular.x, spotLightSpecular.y, spotLightSpecular.z);
+		lights.spot.cutoff = glm::cos(glm::radians(cutoffAngle));
+		lights.spot.outerCutoff = glm::cos(glm::radians(outerCutoffAngle));
+		lights.spot.constant = 1.0f;
+		lights.spot.linear = attenuationLinear;
+		lights.spot.quadratic = attenuationQuadratic;
+		lights.shininess = atoi(items[current]);
+
+		if (cpuRenderer)
+		{
+			softClear(softRenderer, glm::vec3(clearColor.x, clearColor.y, clearColor.z));
+			softDrawModel(softRenderer, mdl, softTextures, scene.world[modelEntity], view, proj, lights);
+			// only color is presented, the light cubes below draw on top of it
+			softPresent(softRenderer);
+		}
+		else
 		{
 			unsigned int objShader = objPhongShader;
 			glUseProgram(objShader);
 
-			glUniform1ui(glGetUniformLocation(objShader, "material.shininess"), atoi(items[current]));
-
-			glUniform3f(glGetUniformLocation(objShader, "directionalLight.ambient"), directionalLightAmbient.x, directionalLightAmbient.y, directionalLightAmbient.z);
-			glUniform3f(glGetUniformLocation(objShader, "directionalLight.diffuse"), directionalLightDiffuse.x, directionalLightDiffuse.y, directionalLightDiffuse.z);
-			glUniform3f(glGetUniformLocation(objShader, "directionalLight.specular"), directionalLightSpecular.x, directionalLightSpecular.y, directionalLightSpecular.z);
-			glUniform3f(glGetUniformLocation(objShader, "directionalLightDir"), directionalLightDir.x, directionalLightDir.y, directionalLightDir.z);
-
-			glUniform3f(glGetUniformLocation(objShader, "pointLight.ambient"), pointLightAmbient.x, pointLightAmbient.y, pointLightAmbient.z);
-			glUniform3f(glGetUniformLocation(objShader, "pointLight.diffuse"), pointLightDiffuse.x, pointLightDiffuse.y, pointLightDiffuse.z);
-			glUniform3f(glGetUniformLocation(objShader, "pointLight.specular"), pointLightSpecular.x, pointLightSpecular.y, pointLightSpecular.z);
-			glUniform3f(glGetUniformLocation(objShader, "pointLightPos"), pointLightPos.x, pointLightPos.y, pointLightPos.z);
-			glUniform1f(glGetUniformLocation(objShader, "pointLight.constant"), 1.0f);
-			glUniform1f(glGetUniformLocation(objShader, "pointLight.linear"), attenuationLinear);
-			glUniform1f(glGetUniformLocation(objShader, "pointLight.quadratic"), attenuationQuadratic);
-
-			glUniform3f(glGetUniformLocation(objShader, "spotLight.ambient"), spotLightAmbient.x, spotLightAmbient.y, spotLightAmbient.z);
-			glUniform3f(glGetUniformLocation(objShader, "spotLight.diffuse"), spotLightDiffuse.x, spotLightDiffuse.y, spotLightDiffuse.z);
-			glUniform3f(glGetUniformLocation(objShader, "spotLight.specular"), spotLightSpecular.x, spotLightSpecular.y, spotLightSpecular.z);
-			glUniform3f(glGetUniformLocation(objShader, "spotLightPos"), spotLightPos.x, spotLightPos.y, spotLightPos.z);
-			glUniform3f(glGetUniformLocation(objShader, "spotLightDir"), spotLightDir.x, spotLightDir.y, spotLightDir.z);
-			glUniform1f(glGetUniformLocation(objShader, "spotLight.cutoffAngle"), glm::cos(glm::radians(cutoffAngle)));
-			glUniform1f(glGetUniformLocation(objShader, "spotLight.outerCutoffAngle"), glm::cos(glm::radians(outerCutoffAngle)));
-			glUniform1f(glGetUniformLocation(objShader, "spotLight.constant"), 1.0f);
-			glUniform1f(glGetUniformLocation(objShader, "spotLight.linear"), attenuationLinear);
-			glUniform1f(glGetUniformLocation(objShader, "spotLight.quadratic"), attenuationQuadratic);
+			setLightUniforms(objShader, lights);
 
 			glUniformMatrix4fv(glGetUniformLocation(objShader, "view"), 1, GL_FALSE, glm::value_ptr(view));
 			glUniformMatrix4fv(glGetUniformLocation(objShader, "proj"), 1, GL_FALSE, glm::value_ptr(proj));
 
-			// model
-			glm::mat4 model(1.0f);
-			glm::mat3 normalMatrix = glm::transpose(glm::inverse(view * model));
-			model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f));
-
-			glm::mat4 rotByX = glm::rotate(model, glm::radians(rotationByAxis.x), glm::vec3(1.0f, 0.0f, 0.0f));
-			glm::mat4 rotByY = glm::rotate(model, glm::radians(rotationByAxis.y), glm::vec3(0.0f, 1.0f, 0.0f));
-			glm::mat4 rotByZ = glm::rotate(model, glm::radians(rotationByAxis.z), glm::vec3(0.0f, 0.0f, 1.0f));
-			glm::mat4 rot = rotByZ * rotByY * rotByX;
-			model = rot * model;
-
-			model = glm::scale(model, glm::vec3(scale.x, scale.y, scale.z));
+			// model, view has no scale so its 3x3 is its own inverse transpose
+			glm::mat4 model = scene.world[modelEntity];
+			glm::mat3 normalMatrix = glm::mat3(view) * scene.normal[modelEntity];
 			glUniformMatrix3fv(glGetUniformLocation(objShader, "normalMatrix"), 1, GL_FALSE, glm::value_ptr(normalMatrix));
 			glUniformMatrix4fv(glGetUniformLocation(objShader, "model"), 1, GL_FALSE, glm::value_ptr(model));
 
-			drawModel(mdl, objShader);
+			if (gpuDriven)
+			{
+				cullIndirect(indirect, cullProgram, proj * view * model);
+				if (validateGpuCulling)
+					cullMismatches = validateIndirect(indirect, proj * view * model, gpuVisible, cpuVisible);
+				drawIndirect(indirect, mdl, objShader);
+			}
+			else if (meshletCulling)
+			{
+				// the cone test drops clusters whose triangles all face away, so
+				// GL has to cull back faces too or the image depends on the toggle
+				glEnable(GL_CULL_FACE);
+				cullMeshlets(meshletCuller, mdl, proj * view * model, model, camera.position);
+				drawMeshlets(meshletCuller, mdl, objShader, occlusionCulling ? &visibleMeshes : NULL);
+				glDisable(GL_CULL_FACE);
+			}
+			else
+			{
+				drawModel(mdl, objShader, occlusionCulling ? &visibleMeshes : NULL);
+			}
+
+			// placements and the resident world tiles, all static instances
+			std::vector<unsigned int> instances = placements;
+			for (std::map<unsigned int, WorldTile>::iterator it = world.tiles.begin(); hasWorld && it != world.tiles.end(); ++it)
+				instances.insert(instances.end(), it->second.entities.begin(), it->second.entities.end());
+
+			Frustum frustum;
+			extractFrustum(frustum, proj * view);
+			for (unsigned int i = 0; i < instances.size(); ++i)
+			{
+				unsigned int e = instances[i];
+				if (!boxInFrustum(frustum, scene.worldBoundsMin[e], scene.worldBoundsMax[e]))
+					continue;
+				glm::mat3 placementNormal = glm::mat3(view) * scene.normal[e];
+				glUniformMatrix3fv(glGetUniformLocation(objShader, "normalMatrix"), 1, GL_FALSE, glm::value_ptr(placementNormal));
+				glUniformMatrix4fv(glGetUniformLocation(objShader, "model"), 1, GL_FALSE, glm::value_ptr(scene.world[e]));
+				drawModel(getModel(resources, scene.renderable[e]), objShader);
+			}
+		}
+
+		if (hasCrowd && !cpuRenderer)
+		{
+			if (crowdSize != crowdBuilt)
+			{
+				resizeCrowd(crowd, animated, std::max(crowdSize, 0), crowdSpacing);
+				crowdBuilt = crowdSize;
+			}
+			evaluateCrowd(crowd, animated, deltaTime);
+			uploadCrowd(crowd);
+
+			glUseProgram(skinnedShader);
+			setLightUniforms(skinnedShader, lights);
+			glUniformMatrix4fv(glGetUniformLocation(skinnedShader, "view"), 1, GL_FALSE, glm::value_ptr(view));
+			glUniformMatrix4fv(glGetUniformLocation(skinnedShader, "proj"), 1, GL_FALSE, glm::value_ptr(proj));
+			drawCrowd(crowd, animated, skinnedShader);
 		}
 
 		// draw light positions
@@ -267,26 +647,45 @@ int main()
 		glBindVertexArray(lightVAO);
 		for (unsigned int i = 0; i < 2; ++i)
 		{
-			glm::mat4 model(1.0f);
+			glm::mat4 model = scene.world[lightEntities[i]];
 
 			if (i == 0)
 			{
-				model = glm::translate(model, glm::vec3(pointLightPos.x, pointLightPos.y, pointLightPos.z));
 				glUniform3f(glGetUniformLocation(lightShader, "color"), pointLightDiffuse.x, pointLightDiffuse.y, pointLightDiffuse.z);
 			}
 			else
 			{
-				model = glm::translate(model, glm::vec3(spotLightPos.x, spotLightPos.y, spotLightPos.z));
 				glUniform3f(glGetUniformLocation(lightShader, "color"), spotLightDiffuse.x, spotLightDiffuse.y, spotLightDiffuse.z);
 			}
-			
-			model = glm::scale(model, glm::vec3(0.2f));
 
 			glUniformMatrix4fv(glGetUniformLocation(lightShader, "model"), 1, GL_FALSE, glm::value_ptr(model));
 
 			glDrawArrays(GL_TRIANGLES, 0, 36);
 		}
 
+		if (!cpuRenderer)
+		{
+			if (particleCount != (int)particles.count || particleCompute != particleBuiltCompute)
+			{
+				destroyParticles(particles);
+				if (particleCompute != particleBuiltCompute)
+				{
+					glDeleteProgram(particleUpdateProgram);
+					particleUpdateProgram = createParticleUpdateProgram(particleCompute);
+					particleBuiltCompute = particleCompute;
+				}
+				initParticles(particles, std::max(particleCount, 0), particleCompute, emitter);
+			}
+			updateParticles(particles, particleUpdateProgram, emitter, deltaTime);
+			drawParticles(particles, particleShader, emitter, view, proj);
+		}
+
+		// before the UI, so it never ends up in the frames
+		captureFrame(capture);
+		frameCount++;
+		if (frameLimit && frameCount >= frameLimit)
+			glfwSetWindowShouldClose(window.raw, 1);
+
 		// imgui
 		ImGui_ImplOpenGL3_NewFrame();
 		ImGui_ImplGlfw_NewFrame();
@@ -297,11 +696,74 @@ int main()
 		ImGui::ColorEdit3("clear color", (float*)&clearColor);
 		ImGui::Combo("shininess", &current, items, IM_ARRAYSIZE(items));
 		ImGui::Checkbox("rotate boxes", (bool*)&shouldRotate);
+		ImGui::Checkbox("occlusion culling", &occlusionCulling);
+		ImGui::Checkbox("meshlet culling", &meshletCulling);
+		if (streamingSupported())
+		{
+			ImGui::SliderInt("texture budget MB", &textureBudgetMB, 1, 1024);
+			ImGui::Text("textures: %.1f MB resident, top mip %d, %u loads, %u evictions, %u pending", streamer.stats.residentBytes / 1048576.0f, mdl.textureTopLevel, streamer.stats.loads, streamer.stats.evictions, streamer.stats.pending);
+		}
+		if (hasCrowd)
+		{
+			ImGui::SliderInt("crowd", &crowdSize, 0, 1000);
+			ImGui::Text("animation: %u characters, %u joints, evaluate %.3f ms, upload %.3f ms", crowd.stats.characters, crowd.stats.joints, crowd.stats.evaluateMs, crowd.stats.uploadMs);
+		}
+		if (indirectSupported())
+		{
+			ImGui::Checkbox("GPU-driven draws", &gpuDriven);
+			ImGui::Checkbox("validate GPU culling", &validateGpuCulling);
+		}
+
+		if (ImGui::CollapsingHeader("Particles"))
+		{
+			ImGui::SliderInt("particles", &particleCount, 0, 1000000);
+			if (particleComputeSupported())
+				ImGui::Checkbox("compute update", &particleCompute);
+			ImGui::InputFloat3("emitter position", (float*)&emitter.position);
+			ImGui::SliderFloat("emitter spread", &emitter.spread, 0.0f, 3.14f);
+			ImGui::SliderFloat("emitter speed", &emitter.speed, 0.0f, 20.0f);
+			ImGui::SliderFloat("particle lifetime", &emitter.lifetime, 0.1f, 10.0f);
+			ImGui::SliderFloat("particle size", &emitter.size, 0.005f, 0.2f);
+			ImGui::Text("particles: %u, GPU update %.3f ms, draw %.3f ms, %.1f M particles/s", particles.count, particles.stats.updateMs, particles.stats.drawMs, particleThroughput(particles.stats));
+		}
 
 		if (ImGui::CollapsingHeader("Model"))
 		{
 			ImGui::InputFloat3("model scale", (float*)&scale);
 			ImGui::InputFloat3("model rotation by axis", (float*)&rotationByAxis);
+			ImGui::SliderInt("placements", &placementCount, 0, 1000);
+			if (hasPick)
+				ImGui::Text("picked: entity %u, mesh %u, triangle %u at t %.3f", pick.entity, pick.mesh, pick.triangle, pick.t);
+			else
+				ImGui::Text("picked: nothing, click the scene to pick");
+			ImGui::Text("resources: %u models loaded, %u references, %u loads, %u shared, %u unloads", resources.stats.loaded, resources.stats.references, resources.stats.loads, resources.stats.hits, resources.stats.unloads);
+		}
+
+		if (hasWorld && ImGui::CollapsingHeader("World"))
+		{
+			ImGui::SliderFloat("world radius", &worldRadius, 0.0f, 200.0f);
+			ImGui::SliderFloat("prefetch seconds", &world.prefetchSeconds, 0.0f, 10.0f);
+			ImGui::SliderInt("upload budget (MB)", &uploadBudgetMB, 1, 64);
+			ImGui::SliderInt("world budget (MB)", &worldBudgetMB, 64, 8192);
+			ImGui::Text("tiles: %u wanted, %u resident, %u queued, %u uploading, %u loads, %u unloads%s", world.stats.wanted, world.stats.resident, world.stats.queued, world.stats.loaded, world.stats.tileLoads, world.stats.tileUnloads, world.stats.overBudget ? ", over budget" : "");
+			ImGui::Text("upload: %.2f MB in %.3f ms this frame, worst %.3f ms", world.stats.uploadedBytes / 1048576.0f, world.stats.uploadMs, world.stats.maxUploadMs);
+		}
+
+		if (ImGui::CollapsingHeader("Memory"))
+		{
+			memory::Usage usage = memory::total();
+			ImGui::Text("total: %.2f MB current, %.2f MB peak, %u allocations", usage.currentTotal / 1048576.0f, usage.peakTotal / 1048576.0f, usage.allocations);
+			for (int c = 0; c < memory::CATEGORY_COUNT; ++c)
+				ImGui::Text("  %s: %.2f MB, peak %.2f MB", memory::categoryName((memory::Category)c), usage.current[c] / 1048576.0f, usage.peak[c] / 1048576.0f);
+
+			std::vector<std::string> ownerNames;
+			std::vector<memory::Usage> ownerUsages;
+			memory::owners(ownerNames, ownerUsages);
+			for (unsigned int i = 0; i < ownerNames.size(); ++i)
+				ImGui::Text("%s: %.2f MB, peak %.2f MB", ownerNames[i].c_str(), ownerUsages[i].currentTotal / 1048576.0f, ownerUsages[i].peakTotal / 1048576.0f);
+
+			if (ImGui::Button("dump to memory.txt"))
+				memory::dump("memory.txt");
 		}
 
 		if (ImGui::CollapsingHeader("DirectionalLight"))
@@ -334,27 +796,81 @@ int main()
 			ImGui::SliderFloat("spot outer cutoff angle", &outerCutoffAngle, 5.0f, 25.0f);
 		}
 
+		if (cpuRenderer)
+			ImGui::Text("CPU renderer: %u triangles, %u tile entries, transform %.2f ms, bin %.2f ms, raster %.2f ms", softRenderer.stats.triangles, softRenderer.stats.binned, softRenderer.stats.transformMs, softRenderer.stats.binMs, softRenderer.stats.rasterMs);
+		ImGui::Text("draw calls: %u, texture binds: %u (%u with per-mesh binds)", renderStats.drawCalls, renderStats.textureBinds, renderStats.perMeshTextureBinds);
+		jobs::Stats jobStats = jobs::stats();
+		if (occlusionCulling)
+			ImGui::Text("occlusion: %u/%u meshes occluded, %u occluder triangles, raster %.3f ms, test %.3f ms", occlusion.stats.occluded, occlusion.stats.tested, occlusion.stats.occluderTriangles, occlusion.stats.rasterizeMs, occlusion.stats.testMs);
+		if (meshletCulling && !gpuDriven)
+			ImGui::Text("meshlets: %u triangles submitted of %u, %u/%u clusters back-facing, %u off screen, %.3f ms", meshletCuller.stats.trianglesSubmitted, meshletCuller.stats.trianglesTotal, meshletCuller.stats.backfacing, meshletCuller.stats.meshlets, meshletCuller.stats.offscreen, meshletCuller.stats.cullMs);
+		if (gpuDriven && validateGpuCulling)
+			ImGui::Text("GPU culling: %u/%u meshes visible, CPU reference %u, %u mismatches", gpuVisible, indirect.meshCount, cpuVisible, cullMismatches);
+		if (capture.active)
+		{
+			CaptureStats stats = captureStats(capture);
+			ImGui::Text("capture: %u captured, %u written, %u readback stalls, %u writer stalls", stats.captured, stats.written, stats.readbackStalls, stats.writerStalls);
+		}
+		ImGui::Text("jobs: %u workers, %llu executed, %llu stolen", jobStats.workers, jobStats.executed, jobStats.stolen);
 		ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
 		ImGui::End();
 
 		ImGui::Render();
-		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+		if (!headless)
+			ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 
 		glfwSwapBuffers(window.raw);
 		glfwPollEvents();
 	}
+	if (frameCount)
+		printf("%s renderer: %u frames, %.3f ms/frame, %u workers\n", cpuRenderer ? "cpu" : "gl", frameCount, (glfwGetTime() - renderStart) * 1000.0 / frameCount, jobs::workerCount());
+	if (particles.stats.measuredFrames)
+		printf("particles: %u (%s update), GPU update %.3f ms, draw %.3f ms per frame, %.1f M particles/s\n", particles.count, particles.compute ? "compute" : "feedback", particles.stats.updateTotalMs / particles.stats.measuredFrames, particles.stats.drawTotalMs / particles.stats.measuredFrames, particleThroughput(particles.stats));
+	if (hasWorld)
+		printf("world: %u tiles resident, %u loads, %u unloads, worst upload %.3f ms\n", world.stats.resident, world.stats.tileLoads, world.stats.tileUnloads, world.stats.maxUploadMs);
+	stopCapture(capture);
+	shutdownStreamer(streamer);
+	if (headless)
+	{
+		glDeleteFramebuffers(1, &offscreenFBO);
+		glDeleteRenderbuffers(1, &offscreenColor);
+		glDeleteRenderbuffers(1, &offscreenDepth);
+	}
+
 	// Cleanup
 	ImGui_ImplOpenGL3_Shutdown();
 	ImGui_ImplGlfw_Shutdown();
 	ImGui::DestroyContext();
 
-	destroyModel(mdl);
+	for (unsigned int i = 0; i < placements.size(); ++i)
+		destroyInstance(scene, resources, placements[i]);
+	destroyInstance(scene, resources, modelEntity);
+	if (hasWorld)
+		closeWorld(world, scene, resources);
+	releaseModel(resources, backpack);
+	destroyResources(resources);
+	if (hasCrowd)
+		destroyCrowd(crowd);
+	destroyParticles(particles);
+	glDeleteProgram(particleUpdateProgram);
+	glDeleteProgram(particleShader);
+	if (animatedPath)
+		destroyModel(animated);
+	if (cpuRenderer)
+		destroySoftRenderer(softRenderer);
+	if (indirectSupported())
+	{
+		destroyIndirect(indirect);
+		glDeleteProgram(cullProgram);
+	}
 
 	glDeleteVertexArrays(1, &VAO);
+	memory::release(memory::VERTEX_BUFFER, VBO);
 	glDeleteBuffers(1, &VBO);
 	glDeleteVertexArrays(1, &lightVAO);
 	glDeleteProgram(objPhongShader);
 	glDeleteProgram(lightShader);
+	glDeleteProgram(skinnedShader);
 
 	return 0;
 }
@@ -0,0 +1,57 @@
+#version 430 core
+layout (local_size_x = 64) in;
+
+// must match MeshRecord in indirect.h
+struct MeshRecord
+{
+	vec4 boundsMin;
+	vec4 boundsMax;
+	uint indexCount;
+	uint firstIndex;
+	int baseVertex;
+	uint pad;
+};
+
+// DrawElementsIndirectCommand
+struct DrawCommand
+{
+	uint count;
+	uint instanceCount;
+	uint firstIndex;
+	int baseVertex;
+	uint baseInstance;
+};
+
+layout (std430, binding = 0) readonly buffer Meshes { MeshRecord meshes[]; };
+layout (std430, binding = 1) writeonly buffer Commands { DrawCommand commands[]; };
+layout (std430, binding = 2) buffer Count { uint drawCount; };
+
+// object space planes of the model-view-projection, normals point inside
+uniform vec4 planes[6];
+uniform uint meshCount;
+
+bool boxInFrustum(vec3 boundsMin, vec3 boundsMax)
+{
+	for (int i = 0; i < 6; ++i)
+	{
+		vec3 p = mix(boundsMin, boundsMax, greaterThan(planes[i].xyz, vec3(0.0)));
+		if (dot(planes[i].xyz, p) + planes[i].w < 0.0)
+			return false;
+	}
+	return true;
+}
+
+void main()
+{
+	uint id = gl_GlobalInvocationID.x;
+	if (id >= meshCount)
+		return;
+
+	MeshRecord mesh = meshes[id];
+	if (!boxInFrustum(mesh.boundsMin.xyz, mesh.boundsMax.xyz))
+		return;
+
+	// baseInstance carries the mesh id to the per-instance material attribute
+	uint slot = atomicAdd(drawCount, 1u);
+	commands[slot] = DrawCommand(mesh.indexCount, 1u, mesh.firstIndex, mesh.baseVertex, id);
+}
@@ -0,0 +1,58 @@
+// Appended after particle_update_vertex.glsl or particle_compute.glsl, which
+// declare updateParticle. Must stay free of a #version line.
+uniform float deltaTime;
+uniform uint frameSeed;
+uniform vec3 emitterPosition;
+// half angle of the emission cone around +y, in radians
+uniform float emitterSpread;
+uniform float emitterSpeed;
+uniform float lifetime;
+uniform vec3 gravity;
+uniform float drag;
+uniform float floorHeight;
+
+uint hash(uint x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352dU;
+	x ^= x >> 15;
+	x *= 0x846ca68bU;
+	x ^= x >> 16;
+	return x;
+}
+
+float random(inout uint state)
+{
+	state = hash(state);
+	return float(state) * (1.0 / 4294967295.0);
+}
+
+// positionLife.w is the remaining life in seconds, velocitySpawned.w is
+// negative until the first respawn so initial particles stay hidden
+void updateParticle(inout vec4 positionLife, inout vec4 velocitySpawned, uint id)
+{
+	positionLife.w -= deltaTime;
+	if (positionLife.w <= 0.0)
+	{
+		uint state = hash(id) ^ frameSeed;
+		float phi = 6.2831853 * random(state);
+		float cosTheta = mix(1.0, cos(emitterSpread), random(state));
+		float sinTheta = sqrt(max(0.0, 1.0 - cosTheta * cosTheta));
+		vec3 direction = vec3(cos(phi) * sinTheta, cosTheta, sin(phi) * sinTheta);
+		positionLife = vec4(emitterPosition, lifetime * mix(0.5, 1.0, random(state)));
+		velocitySpawned = vec4(direction * emitterSpeed * mix(0.75, 1.0, random(state)), 1.0);
+		return;
+	}
+
+	vec3 velocity = velocitySpawned.xyz + gravity * deltaTime;
+	velocity *= max(0.0, 1.0 - drag * deltaTime);
+	vec3 position = positionLife.xyz + velocity * deltaTime;
+	if (position.y < floorHeight && velocity.y < 0.0)
+	{
+		position.y = floorHeight;
+		velocity.y *= -0.5;
+		velocity.xz *= 0.8;
+	}
+	positionLife.xyz = position;
+	velocitySpawned.xyz = velocity;
+}
@@ -0,0 +1,30 @@
+#version 430 core
+layout (local_size_x = 256) in;
+
+// Particle in utils/particles.h, updated in place
+struct Particle
+{
+	vec4 positionLife;
+	vec4 velocitySpawned;
+};
+
+layout (std430, binding = 0) buffer Particles
+{
+	Particle particles[];
+};
+
+uniform uint particleCount;
+
+// particle_common.glsl
+void updateParticle(inout vec4 positionLife, inout vec4 velocitySpawned, uint id);
+
+void main()
+{
+	uint id = gl_GlobalInvocationID.x;
+	if (id >= particleCount)
+		return;
+
+	Particle particle = particles[id];
+	updateParticle(particle.positionLife, particle.velocitySpawned, id);
+	particles[id] = particle;
+}
@@ -0,0 +1,19 @@
+#version 330 core
+in vec2 Corner;
+in float Age;
+
+out vec4 FragColor;
+
+uniform vec3 startColor;
+uniform vec3 endColor;
+
+void main()
+{
+	float distance2 = dot(Corner, Corner);
+	if (distance2 > 1.0)
+		discard;
+
+	// premultiplied, blended additively
+	float alpha = (1.0 - distance2) * (1.0 - Age);
+	FragColor = vec4(mix(startColor, endColor, Age) * alpha, alpha);
+}
@@ -0,0 +1,17 @@
+#version 330 core
+// Particle in utils/particles.h, captured interleaved by transform feedback
+layout (location = 0) in vec4 aPositionLife;
+layout (location = 1) in vec4 aVelocitySpawned;
+
+out vec4 PositionLife;
+out vec4 VelocitySpawned;
+
+// particle_common.glsl
+void updateParticle(inout vec4 positionLife, inout vec4 velocitySpawned, uint id);
+
+void main()
+{
+	PositionLife = aPositionLife;
+	VelocitySpawned = aVelocitySpawned;
+	updateParticle(PositionLife, VelocitySpawned, uint(gl_VertexID));
+}
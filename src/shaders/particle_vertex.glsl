@@ -0,0 +1,25 @@
+#version 330 core
+// one camera facing quad per instance, read straight from the state buffer
+layout (location = 0) in vec2 aCorner;
+layout (location = 1) in vec4 aPositionLife;
+layout (location = 2) in vec4 aVelocitySpawned;
+
+out vec2 Corner;
+out float Age;
+
+uniform mat4 view;
+uniform mat4 proj;
+uniform float size;
+uniform float lifetime;
+
+void main()
+{
+	Corner = aCorner;
+	Age = 1.0 - clamp(aPositionLife.w / lifetime, 0.0, 1.0);
+
+	// particles that never spawned collapse to a degenerate quad
+	float radius = aVelocitySpawned.w > 0.0 ? size : 0.0;
+	vec4 viewPos = view * vec4(aPositionLife.xyz, 1.0);
+	viewPos.xy += aCorner * radius;
+	gl_Position = proj * viewPos;
+}
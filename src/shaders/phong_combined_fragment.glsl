@@ -1,7 +1,9 @@
 #version 330 core
+// must match MAX_MATERIALS in utils/model.h
+#define MAX_MATERIALS 64
+
 struct Material {
-	sampler2D diffuse_0;
-	sampler2D specular_0;
+	sampler2DArray textures;
 	sampler2D emission;
 	uint shininess;
 };
@@ -37,17 +39,26 @@ struct SpotLight {
 };
 
 in vec2 TexCoords;
+in vec2 LightmapCoords;
 in vec3 Normal;
 in vec3 FragPos;
+flat in int MaterialIndex;
 
 out vec4 FragColor;
 
 uniform Material material;
+// diffuse and specular layer per material, -1 when missing
+uniform ivec2 materialLayers[MAX_MATERIALS];
 uniform DirectionalLight directionalLight;
 uniform PointLight pointLight;
 uniform SpotLight spotLight;
+// baked sun in rgb and ambient occlusion in a, see utils/lightmap.h; when
+// set it stands in for the directional light
+uniform bool useLightmap;
+uniform sampler2D lightmap;
 
 vec3 calcDirectionalLight(DirectionalLight, vec3, vec3);
+vec3 calcBakedLight(DirectionalLight);
 vec3 calcPointLight(PointLight, vec3, vec3);
 vec3 calcSpotLight(SpotLight, vec3, vec3, vec3);
 
@@ -56,10 +67,13 @@ vec3 calcDiffuseComponent(vec3, vec3, vec3);
 vec3 calcSpecularComponent(vec3, vec3, vec3);
 vec3 calcEmissionComponent();
 
+vec3 diffuseSample();
+vec3 specularSample();
+
 void main()
 {
 	vec3 norm = normalize(Normal);
-	vec3 directional = calcDirectionalLight(directionalLight, DirectionalLightDir, norm);
+	vec3 directional = useLightmap ? calcBakedLight(directionalLight) : calcDirectionalLight(directionalLight, DirectionalLightDir, norm);
 	vec3 point = calcPointLight(pointLight, PointLightPos, norm);
 	vec3 spot = calcSpotLight(spotLight, SpotLightPos, SpotLightDir, norm);
 	vec3 emission = calcEmissionComponent();
@@ -70,7 +84,7 @@ void main()
 vec3 calcDiffuseComponent(vec3 diffuse, vec3 lightDirection, vec3 norm)
 {
 	float diff = max(dot(norm, lightDirection), 0.0);
-	vec3 diffuseColor = (vec3(texture(material.diffuse_0, TexCoords)) * diff) * diffuse;
+	vec3 diffuseColor = (diffuseSample() * diff) * diffuse;
 
 	return diffuseColor;
 }
@@ -80,7 +94,7 @@ vec3 calcSpecularComponent(vec3 specular, vec3 lightDirection, vec3 norm)
 	vec3 viewDirection = normalize(-FragPos);
 	vec3 reflectDirection = reflect(-lightDirection, norm);
 	float spec = pow(max(dot(viewDirection, reflectDirection), 0.0), material.shininess);
-	vec3 specularIntensity = texture(material.specular_0, TexCoords).rgb;
+	vec3 specularIntensity = specularSample();
 	vec3 specularColor = (specularIntensity * spec) * specular;
 
 	return specularColor;
@@ -88,12 +102,24 @@ vec3 calcSpecularComponent(vec3 specular, vec3 lightDirection, vec3 norm)
 
 vec3 calcAmbientComponent(vec3 ambient)
 {
-	return vec3(texture(material.diffuse_0, TexCoords)) * ambient;
+	return diffuseSample() * ambient;
+}
+
+vec3 diffuseSample()
+{
+	int layer = materialLayers[MaterialIndex].x;
+	return layer < 0 ? vec3(1.0) : texture(material.textures, vec3(TexCoords, layer)).rgb;
+}
+
+vec3 specularSample()
+{
+	int layer = materialLayers[MaterialIndex].y;
+	return layer < 0 ? vec3(0.0) : texture(material.textures, vec3(TexCoords, layer)).rgb;
 }
 
 vec3 calcEmissionComponent()
 {
-	vec3 specularIntensity = texture(material.specular_0, TexCoords).rgb;
+	vec3 specularIntensity = specularSample();
 	vec3 showEmission = step(vec3(1.0), vec3(1.0) - specularIntensity);
 	vec3 emissionColor = texture(material.emission, TexCoords).rgb * showEmission;
 
@@ -129,6 +155,13 @@ vec3 calcDirectionalLight(DirectionalLight light, vec3 lightDir, vec3 norm)
 	return ambientColor + diffuseColor + specularColor;
 }
 
+// the ambient term is occluded and the sun shadowed, its specular is dropped
+vec3 calcBakedLight(DirectionalLight light)
+{
+	vec4 baked = texture(lightmap, LightmapCoords);
+	return diffuseSample() * (light.ambient * baked.a + baked.rgb);
+}
+
 vec3 calcSpotLight(SpotLight light, vec3 lightPos, vec3 lightDir, vec3 norm)
 {
 	float distance = length(lightPos - FragPos);
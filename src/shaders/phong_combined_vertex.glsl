@@ -2,10 +2,16 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+// per-instance attribute on the indirect path, a constant attribute value otherwise
+layout (location = 3) in int aMaterialIndex;
+// baked by tools/baker.cpp, see utils/lightmap.h; unused without a lightmap
+layout (location = 6) in vec2 aLightmapCoords;
 
 out vec3 Normal;
 out vec3 FragPos;
 out vec2 TexCoords;
+out vec2 LightmapCoords;
+flat out int MaterialIndex;
 
 uniform vec3 pointLightPos;
 out vec3 PointLightPos;
@@ -30,9 +36,11 @@ void main()
 	FragPos = vec3(view * model * vec4(aPos, 1.0));
 	Normal = normalMatrix * aNormal;
 	TexCoords = aTexCoords;
+	LightmapCoords = aLightmapCoords;
+	MaterialIndex = aMaterialIndex;
 
 	PointLightPos = vec3(view * vec4(pointLightPos, 1.0));
-	DirectionalLightDir = normalMatrix * normalize(-directionalLightDir);
+	DirectionalLightDir = mat3(view) * normalize(-directionalLightDir);
 	SpotLightPos = vec3(view  * vec4(spotLightPos, 1.0));
-	SpotLightDir = normalMatrix * normalize(-spotLightDir);
+	SpotLightDir = mat3(view) * normalize(-spotLightDir);
 }
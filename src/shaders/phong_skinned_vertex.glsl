@@ -0,0 +1,65 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 3) in int aMaterialIndex;
+// SkinVertex in utils/animation.h, weights are normalized bytes
+layout (location = 4) in uvec4 aJoints;
+layout (location = 5) in vec4 aWeights;
+
+out vec3 Normal;
+out vec3 FragPos;
+out vec2 TexCoords;
+// skinned meshes are never lightmapped
+out vec2 LightmapCoords;
+flat out int MaterialIndex;
+
+uniform vec3 pointLightPos;
+out vec3 PointLightPos;
+
+uniform vec3 directionalLightDir;
+out vec3 DirectionalLightDir;
+
+uniform vec3 spotLightPos;
+out vec3 SpotLightPos;
+
+uniform vec3 spotLightDir;
+out vec3 SpotLightDir;
+
+// three texels, the rows of a 3x4 matrix, per joint, jointCount joints per
+// instance; the instance's world transform is already part of its palette
+uniform samplerBuffer palette;
+uniform int jointCount;
+uniform mat4 view;
+uniform mat4 proj;
+
+mat4 jointMatrix(uint joint)
+{
+	int texel = (gl_InstanceID * jointCount + int(joint)) * 3;
+	vec4 row0 = texelFetch(palette, texel);
+	vec4 row1 = texelFetch(palette, texel + 1);
+	vec4 row2 = texelFetch(palette, texel + 2);
+	return transpose(mat4(row0, row1, row2, vec4(0.0, 0.0, 0.0, 1.0)));
+}
+
+void main()
+{
+	mat4 skin = aWeights.x * jointMatrix(aJoints.x)
+		+ aWeights.y * jointMatrix(aJoints.y)
+		+ aWeights.z * jointMatrix(aJoints.z)
+		+ aWeights.w * jointMatrix(aJoints.w);
+	vec4 worldPos = skin * vec4(aPos, 1.0);
+
+	gl_Position = proj * view * worldPos;
+	FragPos = vec3(view * worldPos);
+	// joints carry rotation and uniform scale only, normalized per fragment
+	Normal = mat3(view) * mat3(skin) * aNormal;
+	TexCoords = aTexCoords;
+	LightmapCoords = vec2(0.0);
+	MaterialIndex = aMaterialIndex;
+
+	PointLightPos = vec3(view * vec4(pointLightPos, 1.0));
+	DirectionalLightDir = mat3(view) * normalize(-directionalLightDir);
+	SpotLightPos = vec3(view  * vec4(spotLightPos, 1.0));
+	SpotLightDir = mat3(view) * normalize(-spotLightDir);
+}
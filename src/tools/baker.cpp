@@ -0,0 +1,105 @@
+// Offline lightmap baker, see utils/lightmap.h. Loads a model without a GL
+// context, charts it, traces the sun and ambient occlusion on every core
+// and writes OUT.png and OUT.bin for main --lightmap OUT.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <utils/model.h>
+#include <utils/resources.h>
+#include <utils/scene.h>
+#include <utils/bvh.h>
+#include <utils/jobs.h>
+#include <utils/lightmap.h>
+
+static void usage()
+{
+	printf("usage: baker MODEL OUT [--size N] [--sun X Y Z] [--sun-color R G B] [--sun-samples N] [--sun-radius DEGREES] [--ao-samples N] [--ao-distance D] [--threads N]\n");
+	printf("  writes OUT.png, sun light in rgb and ambient occlusion in alpha, and OUT.bin with the lightmap coordinates\n");
+	printf("  --sun is the way the light travels, like the directional light of main\n");
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 3)
+	{
+		usage();
+		return -1;
+	}
+	const char* modelPath = argv[1];
+	const char* outPath = argv[2];
+	LightmapSettings settings = defaultLightmapSettings();
+	unsigned int threadCount = 0;
+	for (int i = 3; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+			settings.size = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--sun") == 0 && i + 3 < argc)
+		{
+			settings.sunDirection = glm::vec3(atof(argv[i + 1]), atof(argv[i + 2]), atof(argv[i + 3]));
+			i += 3;
+		}
+		else if (strcmp(argv[i], "--sun-color") == 0 && i + 3 < argc)
+		{
+			settings.sunColor = glm::vec3(atof(argv[i + 1]), atof(argv[i + 2]), atof(argv[i + 3]));
+			i += 3;
+		}
+		else if (strcmp(argv[i], "--sun-samples") == 0 && i + 1 < argc)
+			settings.sunSamples = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--sun-radius") == 0 && i + 1 < argc)
+			settings.sunRadius = atof(argv[++i]);
+		else if (strcmp(argv[i], "--ao-samples") == 0 && i + 1 < argc)
+			settings.aoSamples = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--ao-distance") == 0 && i + 1 < argc)
+			settings.aoDistance = atof(argv[++i]);
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			threadCount = atoi(argv[++i]);
+		else
+		{
+			usage();
+			return -1;
+		}
+	}
+	if (settings.size <= 0 || glm::length(settings.sunDirection) == 0.0f)
+	{
+		usage();
+		return -1;
+	}
+
+	jobs::ScopedPool pool(threadCount);
+
+	// the same loader as main, minus the GL uploads and the textures
+	ResourceManager resources;
+	initResources(resources);
+	ModelHandle handle = acquireModel(resources, modelPath, "", MODEL_NO_GPU | MODEL_BUILD_BVH);
+	if (handle == NO_MODEL)
+		return -1;
+	Model &model = getModel(resources, handle);
+
+	LightmapLayout layout;
+	if (!buildLightmapLayout(layout, model, settings.size))
+		return -1;
+	unsigned int vertexCount = 0;
+	for (unsigned int i = 0; i < layout.meshes.size(); ++i)
+		vertexCount += layout.meshes[i].remap.size();
+	printf("charts: %u in %dx%d, %.1f texels per unit, %u vertices after splits\n", layout.charts, layout.width, layout.height, layout.texelsPerUnit, vertexCount);
+
+	Scene scene;
+	unsigned int entity = createInstance(scene, resources, handle, glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(1.0f));
+	updateTransforms(scene);
+	SceneBvh bvh;
+	buildSceneBvh(bvh, scene, resources);
+
+	std::vector<unsigned char> pixels;
+	LightmapStats stats = bakeLightmap(layout, model, bvh, settings, pixels);
+	printf("bake: %u texels, raster %.1f ms, %llu rays in %.1f ms, %.2f Mrays/s, %u workers\n", stats.texels, stats.rasterMs, stats.rays, stats.bakeMs, stats.rate, jobs::workerCount());
+
+	bool written = writeLightmap(outPath, layout, pixels);
+	if (written)
+		printf("wrote %s.png and %s.bin\n", outPath, outPath);
+
+	destroyInstance(scene, resources, entity);
+	releaseModel(resources, handle);
+	destroyResources(resources);
+	return written ? 0 : -1;
+}
@@ -0,0 +1,132 @@
+// Job system microbenchmarks, see utils/jobs.h: the cost of spawning and
+// finishing an empty job, and the scaling of a parallelFor workload from one
+// worker to every hardware thread.
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <utils/jobs.h>
+
+// children per root, well below the per worker job pool
+static const unsigned int SPAWN_BATCH = 1024;
+
+static double elapsedMs(std::chrono::high_resolution_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+static void emptyJob(jobs::Job*, const void*)
+{
+}
+
+// ns per job for create, run and wait, batched under roots
+static double spawnCost(unsigned int jobCount)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	for (unsigned int done = 0; done < jobCount; done += SPAWN_BATCH)
+	{
+		jobs::Job* root = jobs::create(emptyJob);
+		for (unsigned int i = 0; i < SPAWN_BATCH; ++i)
+			jobs::run(jobs::createChild(root, emptyJob));
+		jobs::run(root);
+		jobs::wait(root);
+	}
+	unsigned int spawned = (jobCount + SPAWN_BATCH - 1) / SPAWN_BATCH * (SPAWN_BATCH + 1);
+	return elapsedMs(start) * 1e6 / spawned;
+}
+
+struct Workload
+{
+	std::vector<float> values;
+	unsigned int iterations;
+};
+
+// a few hundred cycles of dependent math per element, no memory traffic
+static void workRange(unsigned int first, unsigned int last, void* context)
+{
+	Workload* work = (Workload*)context;
+	for (unsigned int i = first; i < last; ++i)
+	{
+		float x = (float)i;
+		for (unsigned int k = 0; k < work->iterations; ++k)
+			x = std::sqrt(x * 1.0001f + 1.0f);
+		work->values[i] = x;
+	}
+}
+
+static void usage()
+{
+	printf("usage: jobbench [--max-workers N] [--jobs N] [--items N] [--grain N]\n");
+	printf("  --max-workers defaults to the hardware threads, scaling runs 1, 2, 4... up to it\n");
+}
+
+int main(int argc, char** argv)
+{
+	unsigned int maxWorkers = std::thread::hardware_concurrency();
+	unsigned int jobCount = 1 << 20;
+	unsigned int items = 1 << 20;
+	unsigned int grain = 256;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--max-workers") == 0 && i + 1 < argc)
+			maxWorkers = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc)
+			jobCount = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--items") == 0 && i + 1 < argc)
+			items = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--grain") == 0 && i + 1 < argc)
+			grain = atoi(argv[++i]);
+		else
+		{
+			usage();
+			return -1;
+		}
+	}
+	if (maxWorkers == 0)
+		maxWorkers = 1;
+
+	std::vector<unsigned int> counts;
+	for (unsigned int workers = 1; workers < maxWorkers; workers *= 2)
+		counts.push_back(workers);
+	counts.push_back(maxWorkers);
+
+	Workload work;
+	work.values.resize(items);
+	work.iterations = 64;
+
+	double baseMs = 0.0;
+	for (unsigned int c = 0; c < counts.size(); ++c)
+	{
+		jobs::ScopedPool pool(counts[c]);
+		// warm up the threads and the pools
+		spawnCost(SPAWN_BATCH * 4);
+		double spawnNs = spawnCost(jobCount);
+
+		jobs::parallelFor(items, grain, workRange, &work);
+		// every element is written once, a negative one was skipped
+		std::fill(work.values.begin(), work.values.end(), -1.0f);
+		auto start = std::chrono::high_resolution_clock::now();
+		jobs::parallelFor(items, grain, workRange, &work);
+		double forMs = elapsedMs(start);
+		unsigned int missed = std::count_if(work.values.begin(), work.values.end(), [](float value) { return value < 0.0f; });
+		if (missed)
+		{
+			printf("jobs: %u workers, parallelFor skipped %u of %u items\n", counts[c], missed, items);
+			return -1;
+		}
+		if (c == 0)
+			baseMs = forMs;
+
+		jobs::Stats stats = jobs::stats();
+		printf("jobs: %2u workers, spawn %.1f ns/job, parallelFor %.2f ms (%.2fx, %.0f%% efficiency), %llu stolen\n",
+			counts[c], spawnNs, forMs, baseMs / forMs, 100.0 * baseMs / forMs / counts[c], stats.stolen);
+	}
+	// keeps the workload from being optimized away
+	printf("checksum %.3f\n", work.values[items / 2]);
+	return 0;
+}
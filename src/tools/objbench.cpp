@@ -0,0 +1,160 @@
+// OBJ import benchmark: loads the same files through the native loader
+// (utils/objloader.cpp) and through Assimp and prints both rates. Without
+// files it writes grid meshes of 1 MB to 1 GB and loads those. Both runs
+// use MODEL_NO_GPU, so they time the parse and the shared mesh setup.
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+
+#include <utils/model.h>
+#include <utils/jobs.h>
+
+static long long fileSize(const char* path)
+{
+	struct stat info;
+	if (stat(path, &info) != 0)
+		return -1;
+	return info.st_size;
+}
+
+// a square grid with positions, texture coordinates and normals, about
+// 190 bytes per vertex
+static bool writeGrid(const char* path, long long targetBytes)
+{
+	FILE* file = fopen(path, "w");
+	if (!file)
+	{
+		printf("Failed to write %s\n", path);
+		return false;
+	}
+	int side = std::max(2, (int)std::sqrt(targetBytes / 190.0));
+	for (int z = 0; z < side; ++z)
+	{
+		for (int x = 0; x < side; ++x)
+		{
+			float height = 0.25f * std::sin(x * 0.1f) * std::cos(z * 0.1f);
+			fprintf(file, "v %f %f %f\n", x * 0.01f, height, z * 0.01f);
+			fprintf(file, "vt %f %f\n", x / (float)(side - 1), z / (float)(side - 1));
+			fprintf(file, "vn %f %f %f\n", 0.0f, 1.0f, 0.0f);
+		}
+	}
+	for (int z = 0; z + 1 < side; ++z)
+	{
+		for (int x = 0; x + 1 < side; ++x)
+		{
+			int a = z * side + x + 1, b = a + 1, c = a + side, d = c + 1;
+			fprintf(file, "f %d/%d/%d %d/%d/%d %d/%d/%d\n", a, a, a, c, c, c, b, b, b);
+			fprintf(file, "f %d/%d/%d %d/%d/%d %d/%d/%d\n", b, b, b, c, c, c, d, d, d);
+		}
+	}
+	fclose(file);
+	return true;
+}
+
+// ms, negative when the load fails
+static double timeLoad(const char* path, const char* texturesDir, unsigned int flags)
+{
+	Model model;
+	auto start = std::chrono::high_resolution_clock::now();
+	bool loaded = loadModel(model, path, texturesDir, flags | MODEL_NO_GPU);
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	destroyModel(model);
+	return loaded ? ms : -1.0;
+}
+
+static void usage()
+{
+	printf("usage: objbench [FILE.obj...] [--sizes MB,MB...] [--dir DIR] [--threads N] [--skip-assimp]\n");
+	printf("  without files, writes DIR/objbench_<MB>mb.obj for every size (default 1,10,100,1000 in .) and loads those\n");
+	printf("  generated files are kept and reused by later runs\n");
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<std::string> files;
+	std::vector<int> sizes;
+	std::string directory = ".";
+	unsigned int threadCount = 0;
+	bool assimp = true;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--sizes") == 0 && i + 1 < argc)
+		{
+			for (char* size = strtok(argv[++i], ","); size; size = strtok(NULL, ","))
+				sizes.push_back(atoi(size));
+		}
+		else if (strcmp(argv[i], "--dir") == 0 && i + 1 < argc)
+			directory = argv[++i];
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			threadCount = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--skip-assimp") == 0)
+			assimp = false;
+		else if (argv[i][0] != '-')
+			files.push_back(argv[i]);
+		else
+		{
+			usage();
+			return -1;
+		}
+	}
+
+	if (files.empty())
+	{
+		if (sizes.empty())
+		{
+			sizes.push_back(1);
+			sizes.push_back(10);
+			sizes.push_back(100);
+			sizes.push_back(1000);
+		}
+		for (unsigned int i = 0; i < sizes.size(); ++i)
+		{
+			char name[64];
+			snprintf(name, sizeof(name), "/objbench_%dmb.obj", sizes[i]);
+			std::string path = directory + name;
+			if (fileSize(path.c_str()) < 0)
+			{
+				printf("writing %s\n", path.c_str());
+				if (!writeGrid(path.c_str(), (long long)sizes[i] << 20))
+					return -1;
+			}
+			files.push_back(path);
+		}
+	}
+
+	jobs::ScopedPool pool(threadCount);
+	std::vector<double> nativeMs(files.size(), -1.0), assimpMs(files.size(), -1.0);
+	for (unsigned int i = 0; i < files.size(); ++i)
+	{
+		const std::string &path = files[i];
+		std::string texturesDir = path.find('/') == std::string::npos ? "./" : path.substr(0, path.rfind('/') + 1);
+		nativeMs[i] = timeLoad(path.c_str(), texturesDir.c_str(), 0);
+		if (assimp)
+			assimpMs[i] = timeLoad(path.c_str(), texturesDir.c_str(), MODEL_FORCE_ASSIMP);
+	}
+
+	printf("\n%-40s %10s %12s %12s %12s %12s %8s\n", "file", "MB", "native ms", "native MB/s", "assimp ms", "assimp MB/s", "speedup");
+	for (unsigned int i = 0; i < files.size(); ++i)
+	{
+		double megabytes = fileSize(files[i].c_str()) / 1048576.0;
+		printf("%-40s %10.1f", files[i].c_str(), megabytes);
+		if (nativeMs[i] >= 0.0)
+			printf(" %12.1f %12.1f", nativeMs[i], megabytes * 1000.0 / nativeMs[i]);
+		else
+			printf(" %12s %12s", "failed", "-");
+		if (assimpMs[i] >= 0.0)
+			printf(" %12.1f %12.1f", assimpMs[i], megabytes * 1000.0 / assimpMs[i]);
+		else
+			printf(" %12s %12s", assimp ? "failed" : "skipped", "-");
+		if (nativeMs[i] > 0.0 && assimpMs[i] > 0.0)
+			printf(" %7.2fx", assimpMs[i] / nativeMs[i]);
+		printf("\n");
+	}
+	printf("%u workers\n", jobs::workerCount());
+	return 0;
+}
@@ -0,0 +1,129 @@
+// CPU rasterizer benchmark, see utils/softraster.h: draws a model from main's
+// start view and times only the transform, bin and raster stages, without
+// the clear, ImGui, capture or the upload and blit that main's exit frame
+// time includes. Runs without a GL context.
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <utils/model.h>
+#include <utils/softraster.h>
+#include <utils/jobs.h>
+
+// main's default lights, see the light settings in main.cpp
+static Lights defaultLights()
+{
+	Lights lights;
+	lights.directional.direction = glm::vec3(-0.2f, -1.0f, -0.3f);
+	lights.directional.ambient = glm::vec3(0.2f);
+	lights.directional.diffuse = glm::vec3(0.0f);
+	lights.directional.specular = glm::vec3(1.0f);
+	lights.point.position = glm::vec3(0.0f, 2.0f, -2.0f);
+	lights.point.ambient = glm::vec3(0.2f);
+	lights.point.diffuse = glm::vec3(0.5f, 0.0f, 0.0f);
+	lights.point.specular = glm::vec3(1.0f);
+	lights.point.constant = 1.0f;
+	lights.point.linear = 0.09f;
+	lights.point.quadratic = 0.032f;
+	lights.spot.position = glm::vec3(0.0f, 0.0f, 2.0f);
+	lights.spot.direction = glm::vec3(0.0f, 0.0f, -1.0f);
+	lights.spot.ambient = glm::vec3(0.0f);
+	lights.spot.diffuse = glm::vec3(0.0f, 0.5f, 0.0f);
+	lights.spot.specular = glm::vec3(1.0f);
+	lights.spot.cutoff = glm::cos(glm::radians(12.5f));
+	lights.spot.outerCutoff = glm::cos(glm::radians(17.5f));
+	lights.spot.constant = 1.0f;
+	lights.spot.linear = 0.09f;
+	lights.spot.quadratic = 0.032f;
+	lights.shininess = 32;
+	return lights;
+}
+
+static void usage()
+{
+	printf("usage: softbench [MODEL] [--size WxH] [--frames N] [--threads N] [--spin DEGREES]\n");
+	printf("  MODEL defaults to the backpack, its textures are read from the model's directory\n");
+	printf("  --spin turns the model every frame so the binning sees changing coverage\n");
+}
+
+int main(int argc, char** argv)
+{
+	const char* path = "../resources/backpack/backpack.obj";
+	int width = 1440, height = 900;
+	unsigned int frames = 300;
+	unsigned int threadCount = 0;
+	float spin = 0.0f;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+		{
+			if (sscanf(argv[++i], "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0)
+			{
+				usage();
+				return -1;
+			}
+		}
+		else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+			frames = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			threadCount = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--spin") == 0 && i + 1 < argc)
+			spin = atof(argv[++i]);
+		else if (argv[i][0] != '-')
+			path = argv[i];
+		else
+		{
+			usage();
+			return -1;
+		}
+	}
+	if (frames == 0)
+		frames = 1;
+
+	jobs::ScopedPool pool(threadCount);
+	std::string file = path;
+	std::string texturesDir = file.find('/') == std::string::npos ? "./" : file.substr(0, file.rfind('/') + 1);
+	Model model;
+	if (!loadModel(model, path, texturesDir.c_str(), MODEL_NO_GPU))
+		return -1;
+	// loadModel builds the materials with the texture array, skipped here
+	assignMaterials(model);
+	SoftTextures textures;
+	loadSoftTextures(textures, model);
+
+	SoftRenderer renderer;
+	initSoftRenderer(renderer, width, height);
+	Lights lights = defaultLights();
+	// main's camera at the start, 45 degrees from (0, 0, 10) down -z
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 10.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	glm::mat4 proj = glm::perspective(glm::radians(45.0f), (float)width / height, 0.1f, 100.0f);
+
+	double transformMs = 0.0, binMs = 0.0, rasterMs = 0.0, wallMs = 0.0;
+	unsigned int warmup = frames < 10 ? 1 : 10;
+	for (unsigned int frame = 0; frame < warmup + frames; ++frame)
+	{
+		glm::mat4 transform = glm::rotate(glm::mat4(1.0f), glm::radians(spin * frame), glm::vec3(0.0f, 1.0f, 0.0f));
+		softClear(renderer, glm::vec3(0.1f));
+		auto start = std::chrono::steady_clock::now();
+		softDrawModel(renderer, model, textures, transform, view, proj, lights);
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		if (frame < warmup)
+			continue;
+		transformMs += renderer.stats.transformMs;
+		binMs += renderer.stats.binMs;
+		rasterMs += renderer.stats.rasterMs;
+		wallMs += ms;
+	}
+
+	printf("softraster: %s at %dx%d, %u triangles, %u tile entries, %u workers\n", path, width, height, renderer.stats.triangles, renderer.stats.binned, jobs::workerCount());
+	printf("softraster: transform %.3f ms, bin %.3f ms, raster %.3f ms, draw %.3f ms/frame (%.1f FPS) over %u frames\n",
+		transformMs / frames, binMs / frames, rasterMs / frames, wallMs / frames, 1000.0 * frames / wallMs, frames);
+
+	destroySoftRenderer(renderer);
+	destroyModel(model);
+	return 0;
+}
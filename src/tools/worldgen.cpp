@@ -0,0 +1,45 @@
+// Writes a test world for main --scene, see utils/world.h: a square grid of
+// tiles, each placing random instances of one model and one point light.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <utils/world.h>
+
+static void usage()
+{
+	printf("usage: worldgen OUT MODEL TEXTURES [--tiles N] [--tile-size S] [--instances N]\n");
+	printf("  writes OUT/world.txt and N x N tile files placing MODEL, textures from the TEXTURES directory\n");
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 4)
+	{
+		usage();
+		return -1;
+	}
+	int tiles = 32;
+	float tileSize = 20.0f;
+	unsigned int instances = 8;
+	for (int i = 4; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--tiles") == 0 && i + 1 < argc)
+			tiles = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--tile-size") == 0 && i + 1 < argc)
+			tileSize = atof(argv[++i]);
+		else if (strcmp(argv[i], "--instances") == 0 && i + 1 < argc)
+			instances = atoi(argv[++i]);
+		else
+		{
+			usage();
+			return -1;
+		}
+	}
+	if (tiles <= 0 || tileSize <= 0.0f)
+	{
+		usage();
+		return -1;
+	}
+	return writeTestWorld(argv[1], tiles, tileSize, argv[2], argv[3], instances) ? 0 : -1;
+}
@@ -0,0 +1,637 @@
+#include <glad/glad.h>
+
+#include "animation.h"
+#include "model.h"
+#include "jobs.h"
+#include "memory.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+struct Quat
+{
+	float x, y, z, w;
+};
+
+static JointMatrix identityJoint()
+{
+	JointMatrix m;
+	memset(&m, 0, sizeof(m));
+	m.rows[0][0] = m.rows[1][1] = m.rows[2][2] = 1.0f;
+	return m;
+}
+
+JointMatrix toJointMatrix(const glm::mat4 &matrix)
+{
+	// glm is column major
+	JointMatrix m;
+	for (int row = 0; row < 3; ++row)
+	{
+		for (int column = 0; column < 4; ++column)
+			m.rows[row][column] = matrix[column][row];
+	}
+	return m;
+}
+
+static JointMatrix fromAssimp(const aiMatrix4x4 &a)
+{
+	JointMatrix m = { {
+		{ a.a1, a.a2, a.a3, a.a4 },
+		{ a.b1, a.b2, a.b3, a.b4 },
+		{ a.c1, a.c2, a.c3, a.c4 } } };
+	return m;
+}
+
+// out = a * b, both affine
+static inline void multiply(const JointMatrix &a, const JointMatrix &b, JointMatrix &out)
+{
+#ifdef __SSE2__
+	__m128 b0 = _mm_loadu_ps(b.rows[0]);
+	__m128 b1 = _mm_loadu_ps(b.rows[1]);
+	__m128 b2 = _mm_loadu_ps(b.rows[2]);
+	__m128 b3 = _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f);
+	for (int i = 0; i < 3; ++i)
+	{
+		__m128 row = _mm_loadu_ps(a.rows[i]);
+		__m128 r = _mm_mul_ps(_mm_shuffle_ps(row, row, _MM_SHUFFLE(0, 0, 0, 0)), b0);
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(row, row, _MM_SHUFFLE(1, 1, 1, 1)), b1));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(row, row, _MM_SHUFFLE(2, 2, 2, 2)), b2));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(row, row, _MM_SHUFFLE(3, 3, 3, 3)), b3));
+		_mm_storeu_ps(out.rows[i], r);
+	}
+#else
+	JointMatrix r;
+	for (int i = 0; i < 3; ++i)
+	{
+		for (int j = 0; j < 4; ++j)
+		{
+			r.rows[i][j] = a.rows[i][0] * b.rows[0][j] + a.rows[i][1] * b.rows[1][j] + a.rows[i][2] * b.rows[2][j];
+		}
+		r.rows[i][3] += a.rows[i][3];
+	}
+	out = r;
+#endif
+}
+
+// rotation, then uniform scale, then translation
+static inline void composeJoint(const float* q, const float* translationScale, JointMatrix &out)
+{
+	float x = q[0], y = q[1], z = q[2], w = q[3], s = translationScale[3];
+	out.rows[0][0] = (1.0f - 2.0f * (y * y + z * z)) * s;
+	out.rows[0][1] = 2.0f * (x * y - z * w) * s;
+	out.rows[0][2] = 2.0f * (x * z + y * w) * s;
+	out.rows[0][3] = translationScale[0];
+	out.rows[1][0] = 2.0f * (x * y + z * w) * s;
+	out.rows[1][1] = (1.0f - 2.0f * (x * x + z * z)) * s;
+	out.rows[1][2] = 2.0f * (y * z - x * w) * s;
+	out.rows[1][3] = translationScale[1];
+	out.rows[2][0] = 2.0f * (x * z - y * w) * s;
+	out.rows[2][1] = 2.0f * (y * z + x * w) * s;
+	out.rows[2][2] = (1.0f - 2.0f * (x * x + y * y)) * s;
+	out.rows[2][3] = translationScale[2];
+}
+
+// blends two frames of one joint, nlerp for the rotation
+static inline void poseJoint(const short* r0, const short* r1, const float* t0, const float* t1, float alpha, JointMatrix &out)
+{
+	float q[4], ts[4];
+#ifdef __SSE2__
+	__m128 scale = _mm_set1_ps(1.0f / 32767.0f);
+	__m128i packed0 = _mm_loadl_epi64((const __m128i*)r0);
+	__m128i packed1 = _mm_loadl_epi64((const __m128i*)r1);
+	// sign extend the 16 bit components to 32
+	__m128 q0 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(packed0, packed0), 16)), scale);
+	__m128 q1 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(packed1, packed1), 16)), scale);
+	__m128 a = _mm_set1_ps(alpha);
+	__m128 blended = _mm_add_ps(q0, _mm_mul_ps(_mm_sub_ps(q1, q0), a));
+
+	__m128 squares = _mm_mul_ps(blended, blended);
+	__m128 sum = _mm_add_ps(squares, _mm_shuffle_ps(squares, squares, _MM_SHUFFLE(2, 3, 0, 1)));
+	sum = _mm_add_ps(sum, _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(1, 0, 3, 2)));
+	_mm_storeu_ps(q, _mm_div_ps(blended, _mm_sqrt_ps(sum)));
+
+	__m128 ts0 = _mm_loadu_ps(t0), ts1 = _mm_loadu_ps(t1);
+	_mm_storeu_ps(ts, _mm_add_ps(ts0, _mm_mul_ps(_mm_sub_ps(ts1, ts0), a)));
+#else
+	float length = 0.0f;
+	for (int i = 0; i < 4; ++i)
+	{
+		float q0 = r0[i] * (1.0f / 32767.0f), q1 = r1[i] * (1.0f / 32767.0f);
+		q[i] = q0 + (q1 - q0) * alpha;
+		length += q[i] * q[i];
+		ts[i] = t0[i] + (t1[i] - t0[i]) * alpha;
+	}
+	length = std::sqrt(length);
+	for (int i = 0; i < 4; ++i)
+		q[i] /= length;
+#endif
+	composeJoint(q, ts, out);
+}
+
+static void collectNodes(const aiNode* node, std::vector<const aiNode*> &nodes)
+{
+	nodes.push_back(node);
+	for (unsigned int i = 0; i < node->mNumChildren; ++i)
+	{
+		collectNodes(node->mChildren[i], nodes);
+	}
+}
+
+int findJoint(const Skeleton &skeleton, const char* name)
+{
+	for (unsigned int i = 0; i < skeleton.names.size(); ++i)
+	{
+		if (skeleton.names[i] == name)
+			return i;
+	}
+	return -1;
+}
+
+void importSkeleton(Skeleton &skeleton, const aiScene* scene)
+{
+	skeleton = Skeleton();
+
+	bool skinned = false;
+	for (unsigned int i = 0; i < scene->mNumMeshes; ++i)
+	{
+		skinned = skinned || scene->mMeshes[i]->mNumBones > 0;
+	}
+	if (!skinned)
+		return;
+
+	std::vector<const aiNode*> nodes;
+	collectNodes(scene->mRootNode, nodes);
+	for (unsigned int i = 0; i < nodes.size(); ++i)
+	{
+		int parent = -1;
+		for (unsigned int j = 0; j < i; ++j)
+		{
+			if (nodes[j] == nodes[i]->mParent)
+				parent = j;
+		}
+
+		skeleton.names.push_back(nodes[i]->mName.C_Str());
+		skeleton.parents.push_back(parent);
+		skeleton.bindLocal.push_back(fromAssimp(nodes[i]->mTransformation));
+		skeleton.inverseBind.push_back(identityJoint());
+	}
+
+	for (unsigned int i = 0; i < scene->mNumMeshes; ++i)
+	{
+		const aiMesh* mesh = scene->mMeshes[i];
+		for (unsigned int b = 0; b < mesh->mNumBones; ++b)
+		{
+			int joint = findJoint(skeleton, mesh->mBones[b]->mName.C_Str());
+			if (joint >= 0)
+				skeleton.inverseBind[joint] = fromAssimp(mesh->mBones[b]->mOffsetMatrix);
+		}
+	}
+}
+
+void importSkin(SkinVertex* skin, const aiMesh* mesh, const Skeleton &skeleton, int node)
+{
+	// the strongest SKIN_INFLUENCES weights per vertex
+	std::vector<float> weights(mesh->mNumVertices * SKIN_INFLUENCES, 0.0f);
+	for (unsigned int i = 0; i < mesh->mNumVertices; ++i)
+	{
+		for (unsigned int k = 0; k < SKIN_INFLUENCES; ++k)
+		{
+			skin[i].joints[k] = 0;
+			skin[i].weights[k] = 0;
+		}
+	}
+
+	for (unsigned int b = 0; b < mesh->mNumBones; ++b)
+	{
+		const aiBone* bone = mesh->mBones[b];
+		int joint = findJoint(skeleton, bone->mName.C_Str());
+		if (joint < 0)
+			continue;
+
+		for (unsigned int i = 0; i < bone->mNumWeights; ++i)
+		{
+			unsigned int vertex = bone->mWeights[i].mVertexId;
+			float* w = &weights[vertex * SKIN_INFLUENCES];
+			unsigned int weakest = 0;
+			for (unsigned int k = 1; k < SKIN_INFLUENCES; ++k)
+			{
+				if (w[k] < w[weakest])
+					weakest = k;
+			}
+			if (bone->mWeights[i].mWeight > w[weakest])
+			{
+				w[weakest] = bone->mWeights[i].mWeight;
+				skin[vertex].joints[weakest] = joint;
+			}
+		}
+	}
+
+	for (unsigned int i = 0; i < mesh->mNumVertices; ++i)
+	{
+		const float* w = &weights[i * SKIN_INFLUENCES];
+		float sum = 0.0f;
+		unsigned int strongest = 0;
+		for (unsigned int k = 0; k < SKIN_INFLUENCES; ++k)
+		{
+			sum += w[k];
+			if (w[k] > w[strongest])
+				strongest = k;
+		}
+
+		if (sum <= 0.0f)
+		{
+			// rigid, follows the node the mesh hangs from
+			skin[i].joints[0] = node < 0 ? 0 : node;
+			skin[i].weights[0] = 255;
+			continue;
+		}
+
+		int total = 0;
+		for (unsigned int k = 0; k < SKIN_INFLUENCES; ++k)
+		{
+			skin[i].weights[k] = (unsigned char)(w[k] / sum * 255.0f + 0.5f);
+			total += skin[i].weights[k];
+		}
+		// rounding error goes to the strongest influence
+		skin[i].weights[strongest] += 255 - total;
+	}
+}
+
+static void decompose(const JointMatrix &m, Quat &rotation, float* translationScale)
+{
+	float sx = std::sqrt(m.rows[0][0] * m.rows[0][0] + m.rows[1][0] * m.rows[1][0] + m.rows[2][0] * m.rows[2][0]);
+	float sy = std::sqrt(m.rows[0][1] * m.rows[0][1] + m.rows[1][1] * m.rows[1][1] + m.rows[2][1] * m.rows[2][1]);
+	float sz = std::sqrt(m.rows[0][2] * m.rows[0][2] + m.rows[1][2] * m.rows[1][2] + m.rows[2][2] * m.rows[2][2]);
+	float r[3][3];
+	for (int i = 0; i < 3; ++i)
+	{
+		r[i][0] = m.rows[i][0] / sx;
+		r[i][1] = m.rows[i][1] / sy;
+		r[i][2] = m.rows[i][2] / sz;
+	}
+
+	float trace = r[0][0] + r[1][1] + r[2][2];
+	if (trace > 0.0f)
+	{
+		float s = 0.5f / std::sqrt(trace + 1.0f);
+		rotation.w = 0.25f / s;
+		rotation.x = (r[2][1] - r[1][2]) * s;
+		rotation.y = (r[0][2] - r[2][0]) * s;
+		rotation.z = (r[1][0] - r[0][1]) * s;
+	}
+	else if (r[0][0] > r[1][1] && r[0][0] > r[2][2])
+	{
+		float s = 2.0f * std::sqrt(1.0f + r[0][0] - r[1][1] - r[2][2]);
+		rotation.w = (r[2][1] - r[1][2]) / s;
+		rotation.x = 0.25f * s;
+		rotation.y = (r[0][1] + r[1][0]) / s;
+		rotation.z = (r[0][2] + r[2][0]) / s;
+	}
+	else if (r[1][1] > r[2][2])
+	{
+		float s = 2.0f * std::sqrt(1.0f + r[1][1] - r[0][0] - r[2][2]);
+		rotation.w = (r[0][2] - r[2][0]) / s;
+		rotation.x = (r[0][1] + r[1][0]) / s;
+		rotation.y = 0.25f * s;
+		rotation.z = (r[1][2] + r[2][1]) / s;
+	}
+	else
+	{
+		float s = 2.0f * std::sqrt(1.0f + r[2][2] - r[0][0] - r[1][1]);
+		rotation.w = (r[1][0] - r[0][1]) / s;
+		rotation.x = (r[0][2] + r[2][0]) / s;
+		rotation.y = (r[1][2] + r[2][1]) / s;
+		rotation.z = 0.25f * s;
+	}
+
+	translationScale[0] = m.rows[0][3];
+	translationScale[1] = m.rows[1][3];
+	translationScale[2] = m.rows[2][3];
+	translationScale[3] = (sx + sy + sz) / 3.0f;
+}
+
+static aiVector3D sampleVector(const aiVectorKey* keys, unsigned int count, double time, aiVector3D fallback)
+{
+	if (count == 0)
+		return fallback;
+	if (count == 1 || time <= keys[0].mTime)
+		return keys[0].mValue;
+
+	unsigned int i = 0;
+	while (i + 2 < count && keys[i + 1].mTime < time)
+		i++;
+	double span = keys[i + 1].mTime - keys[i].mTime;
+	float alpha = span > 0.0 ? (float)std::min(1.0, (time - keys[i].mTime) / span) : 0.0f;
+
+	const aiVector3D &a = keys[i].mValue, &b = keys[i + 1].mValue;
+	aiVector3D result = { a.x + (b.x - a.x) * alpha, a.y + (b.y - a.y) * alpha, a.z + (b.z - a.z) * alpha };
+	return result;
+}
+
+static Quat slerp(Quat a, Quat b, float alpha)
+{
+	float cosine = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+	if (cosine < 0.0f)
+	{
+		cosine = -cosine;
+		b.x = -b.x;
+		b.y = -b.y;
+		b.z = -b.z;
+		b.w = -b.w;
+	}
+
+	float wa = 1.0f - alpha, wb = alpha;
+	if (cosine < 0.9999f)
+	{
+		float angle = std::acos(cosine), sine = std::sin(angle);
+		wa = std::sin(wa * angle) / sine;
+		wb = std::sin(wb * angle) / sine;
+	}
+	Quat result = { a.x * wa + b.x * wb, a.y * wa + b.y * wb, a.z * wa + b.z * wb, a.w * wa + b.w * wb };
+	return result;
+}
+
+static Quat sampleRotation(const aiQuatKey* keys, unsigned int count, double time, Quat fallback)
+{
+	if (count == 0)
+		return fallback;
+
+	unsigned int i = 0;
+	while (i + 2 < count && keys[i + 1].mTime < time)
+		i++;
+	const aiQuaternion &first = keys[i].mValue;
+	Quat a = { first.x, first.y, first.z, first.w };
+	if (count == 1 || time <= keys[0].mTime)
+		return a;
+
+	const aiQuaternion &second = keys[i + 1].mValue;
+	Quat b = { second.x, second.y, second.z, second.w };
+	double span = keys[i + 1].mTime - keys[i].mTime;
+	float alpha = span > 0.0 ? (float)std::min(1.0, (time - keys[i].mTime) / span) : 0.0f;
+	return slerp(a, b, alpha);
+}
+
+void importAnimations(std::vector<Animation> &animations, const Skeleton &skeleton, const aiScene* scene)
+{
+	unsigned int jointCount = skeleton.names.size();
+	if (jointCount == 0)
+		return;
+
+	std::vector<Quat> bindRotations(jointCount);
+	std::vector<float> bindTranslations(jointCount * 4);
+	for (unsigned int j = 0; j < jointCount; ++j)
+	{
+		decompose(skeleton.bindLocal[j], bindRotations[j], &bindTranslations[j * 4]);
+	}
+
+	for (unsigned int a = 0; a < scene->mNumAnimations; ++a)
+	{
+		const aiAnimation* source = scene->mAnimations[a];
+		double ticksPerSecond = source->mTicksPerSecond > 0.0 ? source->mTicksPerSecond : 25.0;
+
+		Animation animation;
+		animation.name = source->mName.C_Str();
+		animation.duration = (float)(source->mDuration / ticksPerSecond);
+		animation.frameCount = std::max(2u, (unsigned int)std::ceil(animation.duration * ANIMATION_SAMPLE_RATE) + 1);
+		animation.jointCount = jointCount;
+		animation.rotations.resize(animation.frameCount * jointCount * 4);
+		animation.translations.resize(animation.frameCount * jointCount * 4);
+
+		std::vector<const aiNodeAnim*> channels(jointCount, (const aiNodeAnim*)NULL);
+		for (unsigned int c = 0; c < source->mNumChannels; ++c)
+		{
+			int joint = findJoint(skeleton, source->mChannels[c]->mNodeName.C_Str());
+			if (joint >= 0)
+				channels[joint] = source->mChannels[c];
+		}
+
+		std::vector<Quat> previous(bindRotations);
+		for (unsigned int f = 0; f < animation.frameCount; ++f)
+		{
+			double time = std::min((double)f / ANIMATION_SAMPLE_RATE, (double)animation.duration) * ticksPerSecond;
+			for (unsigned int j = 0; j < jointCount; ++j)
+			{
+				size_t offset = ((size_t)f * jointCount + j) * 4;
+				float* translation = &animation.translations[offset];
+				Quat rotation = bindRotations[j];
+				memcpy(translation, &bindTranslations[j * 4], 4 * sizeof(float));
+
+				const aiNodeAnim* channel = channels[j];
+				if (channel)
+				{
+					aiVector3D bindPosition = { translation[0], translation[1], translation[2] };
+					aiVector3D bindScale = { translation[3], translation[3], translation[3] };
+					aiVector3D position = sampleVector(channel->mPositionKeys, channel->mNumPositionKeys, time, bindPosition);
+					aiVector3D scale = sampleVector(channel->mScalingKeys, channel->mNumScalingKeys, time, bindScale);
+					rotation = sampleRotation(channel->mRotationKeys, channel->mNumRotationKeys, time, rotation);
+					translation[0] = position.x;
+					translation[1] = position.y;
+					translation[2] = position.z;
+					translation[3] = (scale.x + scale.y + scale.z) / 3.0f;
+				}
+
+				float length = std::sqrt(rotation.x * rotation.x + rotation.y * rotation.y + rotation.z * rotation.z + rotation.w * rotation.w);
+				float sign = (rotation.x * previous[j].x + rotation.y * previous[j].y + rotation.z * previous[j].z + rotation.w * previous[j].w) < 0.0f ? -1.0f : 1.0f;
+				float scale = length > 0.0f ? sign / length : 1.0f;
+				rotation.x *= scale;
+				rotation.y *= scale;
+				rotation.z *= scale;
+				rotation.w *= scale;
+				previous[j] = rotation;
+
+				short* packed = &animation.rotations[offset];
+				packed[0] = (short)std::floor(rotation.x * 32767.0f + 0.5f);
+				packed[1] = (short)std::floor(rotation.y * 32767.0f + 0.5f);
+				packed[2] = (short)std::floor(rotation.z * 32767.0f + 0.5f);
+				packed[3] = (short)std::floor(rotation.w * 32767.0f + 0.5f);
+			}
+		}
+
+		animations.push_back(animation);
+	}
+}
+
+void initCrowd(Crowd &crowd)
+{
+	glGenBuffers(1, &crowd.paletteBuffer);
+	glBindBuffer(GL_TEXTURE_BUFFER, crowd.paletteBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, sizeof(JointMatrix), NULL, GL_STREAM_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	glGenTextures(1, &crowd.paletteTexture);
+	glBindTexture(GL_TEXTURE_BUFFER, crowd.paletteTexture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, crowd.paletteBuffer);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+	crowd.paletteBytes = 0;
+	memset(&crowd.stats, 0, sizeof(crowd.stats));
+}
+
+void destroyCrowd(Crowd &crowd)
+{
+	memory::release(memory::OTHER_BUFFER, crowd.paletteBuffer);
+	glDeleteTextures(1, &crowd.paletteTexture);
+	glDeleteBuffers(1, &crowd.paletteBuffer);
+	crowd.paletteTexture = crowd.paletteBuffer = 0;
+}
+
+void resizeCrowd(Crowd &crowd, const Model &model, unsigned int count, float spacing)
+{
+	unsigned int jointCount = model.skeleton.names.size();
+	// texture buffers only have to hold 65536 texels
+	GLint maxTexels = 65536;
+	glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+	if (jointCount > 0 && (size_t)count * jointCount * 3 > (size_t)maxTexels)
+	{
+		count = maxTexels / (jointCount * 3);
+		printf("Warning: palette buffer holds %u characters at most\n", count);
+	}
+
+	unsigned int side = (unsigned int)std::ceil(std::sqrt((float)count));
+	crowd.instances.resize(count);
+	crowd.transforms.resize(count);
+	crowd.palettes.resize((size_t)count * jointCount);
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		AnimationInstance &instance = crowd.instances[i];
+		instance.animation = model.animations.empty() ? 0 : i % model.animations.size();
+		// spread the phases so the crowd doesn't move in lockstep
+		instance.time = model.animations.empty() ? 0.0f : model.animations[instance.animation].duration * ((i * 2654435761u) >> 16 & 0xffff) / 65536.0f;
+		instance.speed = 1.0f;
+
+		float x = ((int)(i % side) - (int)side / 2) * spacing;
+		float z = ((int)(i / side) - (int)side / 2) * spacing;
+		crowd.transforms[i] = glm::mat4(1.0f);
+		crowd.transforms[i][3] = glm::vec4(x, 0.0f, -z, 1.0f);
+	}
+}
+
+struct CrowdEvaluate
+{
+	Crowd* crowd;
+	const Model* model;
+};
+
+static void evaluateInstances(unsigned int first, unsigned int last, void* context)
+{
+	CrowdEvaluate &evaluate = *(CrowdEvaluate*)context;
+	Crowd &crowd = *evaluate.crowd;
+	const Skeleton &skeleton = evaluate.model->skeleton;
+	const std::vector<Animation> &animations = evaluate.model->animations;
+	unsigned int jointCount = skeleton.names.size();
+
+	std::vector<JointMatrix> globals(jointCount);
+	for (unsigned int i = first; i < last; ++i)
+	{
+		const AnimationInstance &instance = crowd.instances[i];
+		JointMatrix world = toJointMatrix(crowd.transforms[i]);
+		JointMatrix* palette = &crowd.palettes[(size_t)i * jointCount];
+
+		const Animation* animation = instance.animation < animations.size() ? &animations[instance.animation] : NULL;
+		const short *rotations0 = NULL, *rotations1 = NULL;
+		const float *translations0 = NULL, *translations1 = NULL;
+		float alpha = 0.0f;
+		if (animation)
+		{
+			float frame = instance.time * ANIMATION_SAMPLE_RATE;
+			unsigned int frame0 = std::min((unsigned int)frame, animation->frameCount - 2);
+			alpha = std::min(1.0f, std::max(0.0f, frame - frame0));
+			rotations0 = &animation->rotations[(size_t)frame0 * jointCount * 4];
+			rotations1 = rotations0 + jointCount * 4;
+			translations0 = &animation->translations[(size_t)frame0 * jointCount * 4];
+			translations1 = translations0 + jointCount * 4;
+		}
+
+		for (unsigned int j = 0; j < jointCount; ++j)
+		{
+			JointMatrix local;
+			if (animation)
+				poseJoint(rotations0 + j * 4, rotations1 + j * 4, translations0 + j * 4, translations1 + j * 4, alpha, local);
+			else
+				local = skeleton.bindLocal[j];
+
+			int parent = skeleton.parents[j];
+			multiply(parent < 0 ? world : globals[parent], local, globals[j]);
+			multiply(globals[j], skeleton.inverseBind[j], palette[j]);
+		}
+	}
+}
+
+static float elapsedMs(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void evaluateCrowd(Crowd &crowd, const Model &model, float deltaTime)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (unsigned int i = 0; i < crowd.instances.size(); ++i)
+	{
+		AnimationInstance &instance = crowd.instances[i];
+		if (instance.animation >= model.animations.size())
+			continue;
+		float duration = model.animations[instance.animation].duration;
+		instance.time = duration > 0.0f ? std::fmod(instance.time + deltaTime * instance.speed, duration) : 0.0f;
+	}
+
+	CrowdEvaluate evaluate;
+	evaluate.crowd = &crowd;
+	evaluate.model = &model;
+	jobs::parallelFor(crowd.instances.size(), 16, evaluateInstances, &evaluate);
+
+	crowd.stats.characters = crowd.instances.size();
+	crowd.stats.joints = crowd.palettes.size();
+	crowd.stats.evaluateMs = elapsedMs(start);
+}
+
+void uploadCrowd(Crowd &crowd)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	size_t bytes = crowd.palettes.size() * sizeof(JointMatrix);
+	glBindBuffer(GL_TEXTURE_BUFFER, crowd.paletteBuffer);
+	// orphan the old storage, the GPU may still be reading last frame's palettes
+	glBufferData(GL_TEXTURE_BUFFER, std::max(bytes, sizeof(JointMatrix)), NULL, GL_STREAM_DRAW);
+	if (bytes)
+		glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, crowd.palettes.data());
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	if (bytes != crowd.paletteBytes)
+	{
+		memory::ScopedOwner owner("crowd palettes");
+		memory::allocate(memory::OTHER_BUFFER, crowd.paletteBuffer, std::max(bytes, sizeof(JointMatrix)));
+		crowd.paletteBytes = bytes;
+	}
+	crowd.stats.uploadMs = elapsedMs(start);
+}
+
+void drawCrowd(Crowd &crowd, Model &model, unsigned int shader)
+{
+	if (crowd.instances.empty())
+		return;
+
+	glUseProgram(shader);
+	bindMaterials(model, shader);
+	glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT_PALETTE);
+	glBindTexture(GL_TEXTURE_BUFFER, crowd.paletteTexture);
+	glUniform1i(glGetUniformLocation(shader, "palette"), TEXTURE_UNIT_PALETTE);
+	glUniform1i(glGetUniformLocation(shader, "jointCount"), model.skeleton.names.size());
+
+	for (unsigned int i = 0; i < model.meshes.size(); ++i)
+	{
+		Mesh &mesh = model.meshes[i];
+		if (mesh.skinVbo == 0)
+			continue;
+		glVertexAttribI1i(3, mesh.material);
+		glBindVertexArray(mesh.vao);
+		glDrawElementsInstanced(GL_TRIANGLES, mesh.indexCount, GL_UNSIGNED_INT, 0, crowd.instances.size());
+		renderStats.drawCalls++;
+	}
+	glBindVertexArray(0);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT_MATERIALS);
+}
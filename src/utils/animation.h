@@ -0,0 +1,108 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <vector>
+#include <string>
+#include <glm/glm.hpp>
+#include <assimp/scene.h>
+
+struct Model;
+
+// must match phong_skinned_vertex.glsl
+const unsigned int SKIN_INFLUENCES = 4;
+// animations are resampled to this many frames per second on import
+const float ANIMATION_SAMPLE_RATE = 30.0f;
+
+// Bone influences of one vertex, a second vertex buffer next to the
+// Vertex one. Weights are in 1/255 and add up to 255.
+struct SkinVertex
+{
+	unsigned short joints[SKIN_INFLUENCES];
+	unsigned char weights[SKIN_INFLUENCES];
+};
+
+// 3x4 row major affine matrix, three texels of the palette buffer
+struct JointMatrix
+{
+	float rows[3][4];
+};
+
+// Every node of the imported hierarchy is a joint, parents come before
+// their children. Meshes without bones are bound to their own node.
+struct Skeleton
+{
+	std::vector<std::string> names;
+	std::vector<int> parents;
+	// node transform relative to its parent, the pose without an animation
+	std::vector<JointMatrix> bindLocal;
+	// mesh space to joint space, identity for nodes no bone refers to
+	std::vector<JointMatrix> inverseBind;
+};
+
+// Joint tracks resampled to ANIMATION_SAMPLE_RATE, so all joints share one
+// time grid and a pose is two frames and a blend factor, no key search.
+// Rotations are quantized to 16 bits per component, consecutive frames in
+// the same hemisphere so a plain lerp takes the short way. Scale is kept
+// uniform, in the w of the translation.
+struct Animation
+{
+	std::string name;
+	float duration;
+	unsigned int frameCount;
+	unsigned int jointCount;
+	// frameCount * jointCount * 4, x y z w
+	std::vector<short> rotations;
+	// frameCount * jointCount * 4, x y z scale
+	std::vector<float> translations;
+};
+
+struct AnimationInstance
+{
+	unsigned int animation;
+	float time;
+	float speed;
+};
+
+struct AnimationStats
+{
+	unsigned int characters;
+	unsigned int joints;
+	float evaluateMs;
+	float uploadMs;
+};
+
+// Many instances of one skinned model. The world transform is folded into
+// the palette, instance i uses joints [i * jointCount, (i + 1) * jointCount)
+// of the texture buffer, so the whole crowd is one instanced draw per mesh.
+struct Crowd
+{
+	std::vector<AnimationInstance> instances;
+	std::vector<glm::mat4> transforms;
+	std::vector<JointMatrix> palettes;
+	unsigned int paletteBuffer, paletteTexture;
+	size_t paletteBytes;
+	AnimationStats stats;
+};
+
+JointMatrix toJointMatrix(const glm::mat4 &matrix);
+int findJoint(const Skeleton &skeleton, const char* name);
+
+// import helpers for loadModel, the skeleton is empty when no mesh has bones
+void importSkeleton(Skeleton &skeleton, const aiScene* scene);
+void importAnimations(std::vector<Animation> &animations, const Skeleton &skeleton, const aiScene* scene);
+// node is the joint of the node holding the mesh, used when it has no bones
+void importSkin(SkinVertex* skin, const aiMesh* mesh, const Skeleton &skeleton, int node);
+
+void initCrowd(Crowd &crowd);
+void destroyCrowd(Crowd &crowd);
+// lays count instances out on a grid `spacing` apart, cycling through the animations
+void resizeCrowd(Crowd &crowd, const Model &model, unsigned int count, float spacing);
+// advances every instance and evaluates its palette on the job system
+void evaluateCrowd(Crowd &crowd, const Model &model, float deltaTime);
+// all palettes in one buffer upload
+void uploadCrowd(Crowd &crowd);
+// needs a program built from phong_skinned_vertex.glsl, with view, proj
+// and the lights already set
+void drawCrowd(Crowd &crowd, Model &model, unsigned int shader);
+
+#endif
@@ -0,0 +1,75 @@
+#include "arena.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <sys/resource.h>
+
+void initArena(Arena &arena, size_t size)
+{
+	arena.base = size > 0 ? (char*)malloc(size) : NULL;
+	arena.size = arena.base != NULL ? size : 0;
+	arena.used = 0;
+	arena.peak = 0;
+	arena.allocations = 0;
+}
+
+void destroyArena(Arena &arena)
+{
+	free(arena.base);
+	arena.base = NULL;
+	arena.size = 0;
+	arena.used = 0;
+}
+
+void resetArena(Arena &arena)
+{
+	arena.used = 0;
+}
+
+void* arenaAlloc(Arena &arena, size_t size, size_t alignment)
+{
+	size_t offset = (arena.used + alignment - 1) & ~(alignment - 1);
+	if (offset + size > arena.size)
+		return NULL;
+
+	arena.used = offset + size;
+	if (arena.used > arena.peak)
+		arena.peak = arena.used;
+	arena.allocations++;
+
+	return arena.base + offset;
+}
+
+static std::atomic<unsigned long long> allocationCount(0);
+
+unsigned long long heapAllocations()
+{
+	return allocationCount.load(std::memory_order_relaxed);
+}
+
+long peakResidentKB()
+{
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+
+	// kilobytes on linux
+	return usage.ru_maxrss;
+}
+
+#ifdef COUNT_ALLOCATIONS
+void* operator new(size_t size)
+{
+	allocationCount.fetch_add(1, std::memory_order_relaxed);
+	void* p = malloc(size > 0 ? size : 1);
+	if (p == NULL)
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+#endif
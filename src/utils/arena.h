@@ -0,0 +1,35 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+
+// Linear allocator backed by one heap block. Allocations are never freed
+// individually, the whole arena is reset or destroyed at once.
+struct Arena
+{
+	char* base;
+	size_t size;
+	size_t used;
+	size_t peak;
+	unsigned int allocations;
+};
+
+void initArena(Arena &arena, size_t size);
+void destroyArena(Arena &arena);
+void resetArena(Arena &arena);
+// returns NULL when the arena is exhausted
+void* arenaAlloc(Arena &arena, size_t size, size_t alignment = 16);
+
+template<typename T>
+T* arenaAlloc(Arena &arena, size_t count)
+{
+	return (T*)arenaAlloc(arena, count * sizeof(T), alignof(T) > 16 ? alignof(T) : 16);
+}
+
+// number of global operator new calls so far, only counted
+// when built with -DCOUNT_ALLOCATIONS (0 otherwise)
+unsigned long long heapAllocations();
+// peak resident set size of the process in kilobytes
+long peakResidentKB();
+
+#endif
@@ -0,0 +1,1002 @@
+#include "bvh.h"
+#include "model.h"
+#include "resources.h"
+#include "scene.h"
+#include "jobs.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static const unsigned int BVH_BINS = 16;
+// small nodes do not gain from fine bins, resetting and sweeping them dominates
+static const unsigned int BVH_SMALL_BINS = 8;
+static const unsigned int BVH_SMALL_NODE = 64;
+// ranges with more primitives are built by a job of their own
+static const unsigned int BVH_PARALLEL_SPLIT = 4096;
+// deeper nodes split at the median, which bounds the depth and the stacks
+static const unsigned int BVH_MAX_DEPTH = 48;
+static const unsigned int BVH_STACK = 256;
+static const int BVH_EMPTY = -1;
+
+static float elapsedMs(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// ---- build ----
+
+// A primitive box and its index, 32 bytes. The build partitions these in
+// place, so every level reads them in memory order.
+struct BuildPrim
+{
+	float boundsMin[3];
+	unsigned int index;
+	float boundsMax[3];
+	float pad;
+};
+
+// binary node, count == 0 means inner with children left and left + 1
+struct BuildNode
+{
+	glm::vec3 boundsMin, boundsMax;
+	// bounds of the primitive centers, what the bins divide
+	glm::vec3 centroidMin, centroidMax;
+	unsigned int first, count;
+	unsigned int left;
+};
+
+struct BuildContext
+{
+	BuildPrim* prims;
+	// 2n - 1 preallocated, handed out in pairs
+	std::vector<BuildNode> nodes;
+	std::atomic<unsigned int> nodeCount;
+};
+
+struct BuildTask
+{
+	BuildContext* context;
+	unsigned int node;
+	unsigned int depth;
+};
+
+// xyz used, four floats each for SSE loads and stores
+struct Bin
+{
+	float boundsMin[4], boundsMax[4];
+	float centroidMin[4], centroidMax[4];
+	unsigned int count;
+};
+
+static void emptyBin(Bin &bin)
+{
+	for (unsigned int i = 0; i < 4; ++i)
+	{
+		bin.boundsMin[i] = bin.centroidMin[i] = FLT_MAX;
+		bin.boundsMax[i] = bin.centroidMax[i] = -FLT_MAX;
+	}
+	bin.count = 0;
+}
+
+static inline void mergeBin(Bin &into, const Bin &bin)
+{
+#ifdef __SSE2__
+	_mm_storeu_ps(into.boundsMin, _mm_min_ps(_mm_loadu_ps(into.boundsMin), _mm_loadu_ps(bin.boundsMin)));
+	_mm_storeu_ps(into.boundsMax, _mm_max_ps(_mm_loadu_ps(into.boundsMax), _mm_loadu_ps(bin.boundsMax)));
+	_mm_storeu_ps(into.centroidMin, _mm_min_ps(_mm_loadu_ps(into.centroidMin), _mm_loadu_ps(bin.centroidMin)));
+	_mm_storeu_ps(into.centroidMax, _mm_max_ps(_mm_loadu_ps(into.centroidMax), _mm_loadu_ps(bin.centroidMax)));
+#else
+	for (unsigned int i = 0; i < 3; ++i)
+	{
+		into.boundsMin[i] = std::min(into.boundsMin[i], bin.boundsMin[i]);
+		into.boundsMax[i] = std::max(into.boundsMax[i], bin.boundsMax[i]);
+		into.centroidMin[i] = std::min(into.centroidMin[i], bin.centroidMin[i]);
+		into.centroidMax[i] = std::max(into.centroidMax[i], bin.centroidMax[i]);
+	}
+#endif
+	into.count += bin.count;
+}
+
+static float halfArea(const float* boundsMin, const float* boundsMax)
+{
+	float x = std::max(boundsMax[0] - boundsMin[0], 0.0f);
+	float y = std::max(boundsMax[1] - boundsMin[1], 0.0f);
+	float z = std::max(boundsMax[2] - boundsMin[2], 0.0f);
+	return x * y + y * z + z * x;
+}
+
+static float halfArea(glm::vec3 boundsMin, glm::vec3 boundsMax)
+{
+	return halfArea(&boundsMin.x, &boundsMax.x);
+}
+
+// bin of the primitive center on every axis. Binning and partitioning both
+// go through here, so they always agree.
+static inline void primBins(const BuildPrim &prim, const float* origin, const float* scale, unsigned int binCount, unsigned int* bins)
+{
+	for (unsigned int axis = 0; axis < 3; ++axis)
+	{
+		float centroid = (prim.boundsMin[axis] + prim.boundsMax[axis]) * 0.5f;
+		bins[axis] = std::min(binCount - 1, (unsigned int)std::max(0.0f, (centroid - origin[axis]) * scale[axis]));
+	}
+}
+
+static inline void addToBin(Bin &bin, const BuildPrim &prim)
+{
+#ifdef __SSE2__
+	__m128 primMin = _mm_loadu_ps(prim.boundsMin);
+	__m128 primMax = _mm_loadu_ps(prim.boundsMax);
+	__m128 centroid = _mm_mul_ps(_mm_add_ps(primMin, primMax), _mm_set1_ps(0.5f));
+	_mm_storeu_ps(bin.boundsMin, _mm_min_ps(_mm_loadu_ps(bin.boundsMin), primMin));
+	_mm_storeu_ps(bin.boundsMax, _mm_max_ps(_mm_loadu_ps(bin.boundsMax), primMax));
+	_mm_storeu_ps(bin.centroidMin, _mm_min_ps(_mm_loadu_ps(bin.centroidMin), centroid));
+	_mm_storeu_ps(bin.centroidMax, _mm_max_ps(_mm_loadu_ps(bin.centroidMax), centroid));
+#else
+	for (unsigned int i = 0; i < 3; ++i)
+	{
+		float centroid = (prim.boundsMin[i] + prim.boundsMax[i]) * 0.5f;
+		bin.boundsMin[i] = std::min(bin.boundsMin[i], prim.boundsMin[i]);
+		bin.boundsMax[i] = std::max(bin.boundsMax[i], prim.boundsMax[i]);
+		bin.centroidMin[i] = std::min(bin.centroidMin[i], centroid);
+		bin.centroidMax[i] = std::max(bin.centroidMax[i], centroid);
+	}
+#endif
+	bin.count++;
+}
+
+static void rangeBin(const BuildContext &context, unsigned int first, unsigned int count, Bin &bin)
+{
+	emptyBin(bin);
+	for (unsigned int i = first; i < first + count; ++i)
+		addToBin(bin, context.prims[i]);
+}
+
+static void setRange(BuildNode &node, const Bin &bin, unsigned int first)
+{
+	node.boundsMin = glm::vec3(bin.boundsMin[0], bin.boundsMin[1], bin.boundsMin[2]);
+	node.boundsMax = glm::vec3(bin.boundsMax[0], bin.boundsMax[1], bin.boundsMax[2]);
+	node.centroidMin = glm::vec3(bin.centroidMin[0], bin.centroidMin[1], bin.centroidMin[2]);
+	node.centroidMax = glm::vec3(bin.centroidMax[0], bin.centroidMax[1], bin.centroidMax[2]);
+	node.first = first;
+	node.count = bin.count;
+}
+
+struct CentroidLess
+{
+	unsigned int axis;
+	bool operator()(const BuildPrim &a, const BuildPrim &b) const
+	{
+		return a.boundsMin[axis] + a.boundsMax[axis] < b.boundsMin[axis] + b.boundsMax[axis];
+	}
+};
+
+struct LeftOfPlane
+{
+	const float* origin;
+	const float* scale;
+	unsigned int binCount, axis, bin;
+	bool operator()(const BuildPrim &prim) const
+	{
+		unsigned int bins[3];
+		primBins(prim, origin, scale, binCount, bins);
+		return bins[axis] <= bin;
+	}
+};
+
+// returns false when the node stays a leaf. One pass bins the primitives
+// on all three axes, the child bounds then come from the bins.
+static bool splitNode(BuildContext &context, const BuildNode &node, unsigned int depth, BuildNode &left, BuildNode &right)
+{
+	unsigned int first = node.first, count = node.count;
+	if (count <= 1)
+		return false;
+
+	BuildPrim* prims = context.prims;
+	glm::vec3 centroidExtent = node.centroidMax - node.centroidMin;
+	unsigned int binCount = count <= BVH_SMALL_NODE ? BVH_SMALL_BINS : BVH_BINS;
+	float origin[3], scale[3];
+	for (unsigned int axis = 0; axis < 3; ++axis)
+	{
+		origin[axis] = node.centroidMin[axis];
+		scale[axis] = centroidExtent[axis] > 0.0f ? binCount / centroidExtent[axis] : 0.0f;
+	}
+
+	float bestCost = FLT_MAX;
+	unsigned int bestAxis = 0, bestBin = 0;
+	Bin bins[3][BVH_BINS];
+	if (depth < BVH_MAX_DEPTH)
+	{
+		for (unsigned int axis = 0; axis < 3; ++axis)
+		{
+			for (unsigned int b = 0; b < binCount; ++b)
+				emptyBin(bins[axis][b]);
+		}
+		for (unsigned int i = first; i < first + count; ++i)
+		{
+			unsigned int index[3];
+			primBins(prims[i], origin, scale, binCount, index);
+			for (unsigned int axis = 0; axis < 3; ++axis)
+				addToBin(bins[axis][index[axis]], prims[i]);
+		}
+
+		for (unsigned int axis = 0; axis < 3; ++axis)
+		{
+			if (scale[axis] == 0.0f)
+				continue;
+
+			// areas and counts right of every plane, then sweep from the left
+			float rightArea[BVH_BINS];
+			unsigned int rightCount[BVH_BINS];
+			Bin sweep;
+			emptyBin(sweep);
+			for (unsigned int b = binCount - 1; b > 0; --b)
+			{
+				mergeBin(sweep, bins[axis][b]);
+				rightArea[b] = halfArea(sweep.boundsMin, sweep.boundsMax);
+				rightCount[b] = sweep.count;
+			}
+
+			emptyBin(sweep);
+			for (unsigned int b = 0; b + 1 < binCount; ++b)
+			{
+				mergeBin(sweep, bins[axis][b]);
+				if (sweep.count == 0 || rightCount[b + 1] == 0)
+					continue;
+				float cost = halfArea(sweep.boundsMin, sweep.boundsMax) * sweep.count + rightArea[b + 1] * rightCount[b + 1];
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestBin = b;
+				}
+			}
+		}
+	}
+
+	if (bestCost < FLT_MAX)
+	{
+		// intersecting a primitive costs about as much as one traversal step
+		float nodeArea = halfArea(node.boundsMin, node.boundsMax);
+		if (count <= BVH_MAX_LEAF && count * nodeArea <= nodeArea + bestCost)
+			return false;
+
+		LeftOfPlane plane = { origin, scale, binCount, bestAxis, bestBin };
+		unsigned int middle = std::partition(prims + first, prims + first + count, plane) - prims;
+
+		Bin leftBin, rightBin;
+		emptyBin(leftBin);
+		emptyBin(rightBin);
+		for (unsigned int b = 0; b < binCount; ++b)
+			mergeBin(b <= bestBin ? leftBin : rightBin, bins[bestAxis][b]);
+		setRange(left, leftBin, first);
+		setRange(right, rightBin, middle);
+		return true;
+	}
+
+	if (count <= BVH_MAX_LEAF)
+		return false;
+
+	// all centers in one spot or too deep, halve by count
+	unsigned int widest = centroidExtent.x > centroidExtent.y ? (centroidExtent.x > centroidExtent.z ? 0 : 2) : (centroidExtent.y > centroidExtent.z ? 1 : 2);
+	unsigned int middle = first + count / 2;
+	CentroidLess less = { widest };
+	std::nth_element(prims + first, prims + middle, prims + first + count, less);
+
+	Bin bin;
+	rangeBin(context, first, middle - first, bin);
+	setRange(left, bin, first);
+	rangeBin(context, middle, first + count - middle, bin);
+	setRange(right, bin, middle);
+	return true;
+}
+
+// builds the subtree below task.node, handing large children to jobs of
+// their own when there is a job to parent them to
+static void buildSubtree(jobs::Job* job, BuildTask task);
+
+static void buildJob(jobs::Job* job, const void* data)
+{
+	buildSubtree(job, *(const BuildTask*)data);
+}
+
+static void buildSubtree(jobs::Job* job, BuildTask task)
+{
+	BuildContext &context = *task.context;
+	std::vector<BuildTask> stack(1, task);
+	while (!stack.empty())
+	{
+		BuildTask current = stack.back();
+		stack.pop_back();
+
+		BuildNode left, right;
+		if (!splitNode(context, context.nodes[current.node], current.depth, left, right))
+			continue;
+
+		unsigned int children = context.nodeCount.fetch_add(2);
+		context.nodes[children] = left;
+		context.nodes[children + 1] = right;
+		context.nodes[current.node].left = children;
+		context.nodes[current.node].count = 0;
+
+		for (unsigned int i = 0; i < 2; ++i)
+		{
+			BuildTask child = { &context, children + i, current.depth + 1 };
+			if (job && context.nodes[child.node].count >= BVH_PARALLEL_SPLIT)
+				jobs::run(jobs::createChild(job, buildJob, child));
+			else
+				stack.push_back(child);
+		}
+	}
+}
+
+static void writeChild(BvhNode &out, unsigned int slot, glm::vec3 boundsMin, glm::vec3 boundsMax, int code)
+{
+	out.minX[slot] = boundsMin.x;
+	out.minY[slot] = boundsMin.y;
+	out.minZ[slot] = boundsMin.z;
+	out.maxX[slot] = boundsMax.x;
+	out.maxY[slot] = boundsMax.y;
+	out.maxZ[slot] = boundsMax.z;
+	out.children[slot] = code;
+}
+
+static int leafCode(unsigned int first, unsigned int count)
+{
+	return ~(int)(first << 4 | count);
+}
+
+// pulls grandchildren up until the node has BVH_WIDTH children, always
+// opening the inner child with the largest surface
+static unsigned int collapse(const std::vector<BuildNode> &nodes, unsigned int index, std::vector<BvhNode> &out)
+{
+	unsigned int slots[BVH_WIDTH];
+	unsigned int slotCount = 2;
+	slots[0] = nodes[index].left;
+	slots[1] = nodes[index].left + 1;
+	while (slotCount < BVH_WIDTH)
+	{
+		int open = -1;
+		float largest = -1.0f;
+		for (unsigned int i = 0; i < slotCount; ++i)
+		{
+			const BuildNode &child = nodes[slots[i]];
+			float area = halfArea(child.boundsMin, child.boundsMax);
+			if (child.count == 0 && area > largest)
+			{
+				largest = area;
+				open = i;
+			}
+		}
+		if (open < 0)
+			break;
+		unsigned int opened = slots[open];
+		slots[open] = nodes[opened].left;
+		slots[slotCount++] = nodes[opened].left + 1;
+	}
+
+	unsigned int outIndex = out.size();
+	out.push_back(BvhNode());
+	for (unsigned int i = 0; i < BVH_WIDTH; ++i)
+	{
+		if (i >= slotCount)
+		{
+			writeChild(out[outIndex], i, glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX), BVH_EMPTY);
+			continue;
+		}
+		const BuildNode &child = nodes[slots[i]];
+		int code = child.count ? leafCode(child.first, child.count) : (int)collapse(nodes, slots[i], out);
+		// out may have grown, index again
+		writeChild(out[outIndex], i, child.boundsMin, child.boundsMax, code);
+	}
+	return outIndex;
+}
+
+// four-wide hierarchy over the primitives, which are left in leaf order
+static void buildHierarchy(std::vector<BvhNode> &out, std::vector<BuildPrim> &prims)
+{
+	unsigned int count = prims.size();
+	out.clear();
+	if (count == 0)
+		return;
+
+	BuildContext context;
+	context.prims = prims.data();
+	context.nodes.resize(2 * count - 1);
+	context.nodeCount = 1;
+
+	BuildNode &root = context.nodes[0];
+	Bin bin;
+	rangeBin(context, 0, count, bin);
+	setRange(root, bin, 0);
+	root.left = 0;
+
+	BuildTask task = { &context, 0, 0 };
+	if (jobs::workerCount() > 1 && jobs::onWorker() && count >= BVH_PARALLEL_SPLIT)
+	{
+		jobs::Job* job = jobs::create(buildJob, task);
+		jobs::run(job);
+		jobs::wait(job);
+	}
+	else
+	{
+		buildSubtree(NULL, task);
+	}
+
+	out.reserve(context.nodeCount / 2 + 1);
+	if (root.count)
+	{
+		// a single leaf still gets an inner root
+		out.push_back(BvhNode());
+		writeChild(out[0], 0, root.boundsMin, root.boundsMax, leafCode(0, root.count));
+		for (unsigned int i = 1; i < BVH_WIDTH; ++i)
+			writeChild(out[0], i, glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX), BVH_EMPTY);
+	}
+	else
+	{
+		collapse(context.nodes, 0, out);
+	}
+}
+
+static void setPrim(BuildPrim &prim, unsigned int index, glm::vec3 boundsMin, glm::vec3 boundsMax)
+{
+	for (unsigned int i = 0; i < 3; ++i)
+	{
+		prim.boundsMin[i] = boundsMin[i];
+		prim.boundsMax[i] = boundsMax[i];
+	}
+	prim.index = index;
+	prim.pad = 0.0f;
+}
+
+struct TriangleContext
+{
+	const Vertex* vertices;
+	const unsigned int* indices;
+	BuildPrim* prims;
+	BvhTriangle* triangles;
+};
+
+static void triangleBounds(unsigned int first, unsigned int last, void* data)
+{
+	TriangleContext* context = (TriangleContext*)data;
+	for (unsigned int i = first; i < last; ++i)
+	{
+		const glm::vec3 &a = context->vertices[context->indices[i * 3]].position;
+		const glm::vec3 &b = context->vertices[context->indices[i * 3 + 1]].position;
+		const glm::vec3 &c = context->vertices[context->indices[i * 3 + 2]].position;
+		setPrim(context->prims[i], i, glm::min(a, glm::min(b, c)), glm::max(a, glm::max(b, c)));
+	}
+}
+
+static void writeTriangles(unsigned int first, unsigned int last, void* data)
+{
+	TriangleContext* context = (TriangleContext*)data;
+	for (unsigned int i = first; i < last; ++i)
+	{
+		unsigned int triangle = context->prims[i].index;
+		const glm::vec3 &a = context->vertices[context->indices[triangle * 3]].position;
+		const glm::vec3 &b = context->vertices[context->indices[triangle * 3 + 1]].position;
+		const glm::vec3 &c = context->vertices[context->indices[triangle * 3 + 2]].position;
+		BvhTriangle &out = context->triangles[i];
+		out.v0 = a;
+		out.edge1 = b - a;
+		out.edge2 = c - a;
+		out.index = triangle;
+	}
+}
+
+void buildMeshBvh(MeshBvh &bvh, const Vertex* vertices, const unsigned int* indices, unsigned int indexCount)
+{
+	unsigned int triangleCount = indexCount / 3;
+	std::vector<BuildPrim> prims(triangleCount);
+	bvh.triangles.resize(triangleCount);
+	TriangleContext context = { vertices, indices, prims.data(), bvh.triangles.data() };
+	jobs::parallelFor(triangleCount, 16384, triangleBounds, &context);
+
+	buildHierarchy(bvh.nodes, prims);
+	jobs::parallelFor(triangleCount, 16384, writeTriangles, &context);
+
+	bvh.boundsMin = glm::vec3(0.0f);
+	bvh.boundsMax = glm::vec3(0.0f);
+	if (!bvh.nodes.empty())
+	{
+		const BvhNode &root = bvh.nodes[0];
+		bvh.boundsMin = glm::vec3(FLT_MAX);
+		bvh.boundsMax = glm::vec3(-FLT_MAX);
+		for (unsigned int i = 0; i < BVH_WIDTH; ++i)
+		{
+			if (root.children[i] == BVH_EMPTY)
+				continue;
+			bvh.boundsMin = glm::min(bvh.boundsMin, glm::vec3(root.minX[i], root.minY[i], root.minZ[i]));
+			bvh.boundsMax = glm::max(bvh.boundsMax, glm::vec3(root.maxX[i], root.maxY[i], root.maxZ[i]));
+		}
+	}
+}
+
+size_t bvhBytes(const MeshBvh &bvh)
+{
+	return bvh.nodes.capacity() * sizeof(BvhNode) + bvh.triangles.capacity() * sizeof(BvhTriangle);
+}
+
+// ---- traversal ----
+
+struct TraversalRay
+{
+	glm::vec3 origin, direction, inverse;
+	float tMin;
+#ifdef __SSE2__
+	__m128 originX, originY, originZ;
+	__m128 inverseX, inverseY, inverseZ;
+#endif
+};
+
+static void prepareRay(TraversalRay &out, glm::vec3 origin, glm::vec3 direction, float tMin)
+{
+	out.origin = origin;
+	out.direction = direction;
+	out.tMin = tMin;
+	for (unsigned int i = 0; i < 3; ++i)
+	{
+		// keeps 0 * inf out of the slab tests
+		float d = std::fabs(direction[i]) < 1e-20f ? std::copysign(1e-20f, direction[i]) : direction[i];
+		out.inverse[i] = 1.0f / d;
+	}
+#ifdef __SSE2__
+	out.originX = _mm_set1_ps(origin.x);
+	out.originY = _mm_set1_ps(origin.y);
+	out.originZ = _mm_set1_ps(origin.z);
+	out.inverseX = _mm_set1_ps(out.inverse.x);
+	out.inverseY = _mm_set1_ps(out.inverse.y);
+	out.inverseZ = _mm_set1_ps(out.inverse.z);
+#endif
+}
+
+// bit i set when the ray enters child i before tMax, entry distances in entry
+static inline unsigned int intersectChildren(const BvhNode &node, const TraversalRay &ray, float tMax, float* entry)
+{
+#ifdef __SSE2__
+	__m128 x0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minX), ray.originX), ray.inverseX);
+	__m128 x1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxX), ray.originX), ray.inverseX);
+	__m128 y0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minY), ray.originY), ray.inverseY);
+	__m128 y1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxY), ray.originY), ray.inverseY);
+	__m128 z0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minZ), ray.originZ), ray.inverseZ);
+	__m128 z1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxZ), ray.originZ), ray.inverseZ);
+
+	__m128 tNear = _mm_max_ps(_mm_max_ps(_mm_min_ps(x0, x1), _mm_min_ps(y0, y1)), _mm_max_ps(_mm_min_ps(z0, z1), _mm_set1_ps(ray.tMin)));
+	__m128 tFar = _mm_min_ps(_mm_min_ps(_mm_max_ps(x0, x1), _mm_max_ps(y0, y1)), _mm_min_ps(_mm_max_ps(z0, z1), _mm_set1_ps(tMax)));
+	_mm_storeu_ps(entry, tNear);
+	return _mm_movemask_ps(_mm_cmple_ps(tNear, tFar));
+#else
+	unsigned int mask = 0;
+	for (unsigned int i = 0; i < BVH_WIDTH; ++i)
+	{
+		float x0 = (node.minX[i] - ray.origin.x) * ray.inverse.x, x1 = (node.maxX[i] - ray.origin.x) * ray.inverse.x;
+		float y0 = (node.minY[i] - ray.origin.y) * ray.inverse.y, y1 = (node.maxY[i] - ray.origin.y) * ray.inverse.y;
+		float z0 = (node.minZ[i] - ray.origin.z) * ray.inverse.z, z1 = (node.maxZ[i] - ray.origin.z) * ray.inverse.z;
+		float tNear = std::max(std::max(std::min(x0, x1), std::min(y0, y1)), std::max(std::min(z0, z1), ray.tMin));
+		float tFar = std::min(std::min(std::max(x0, x1), std::max(y0, y1)), std::min(std::max(z0, z1), tMax));
+		entry[i] = tNear;
+		if (tNear <= tFar)
+			mask |= 1 << i;
+	}
+	return mask;
+#endif
+}
+
+static inline unsigned int overlapChildren(const BvhNode &node, glm::vec3 boxMin, glm::vec3 boxMax)
+{
+#ifdef __SSE2__
+	__m128 outside = _mm_or_ps(_mm_cmpgt_ps(_mm_loadu_ps(node.minX), _mm_set1_ps(boxMax.x)), _mm_cmplt_ps(_mm_loadu_ps(node.maxX), _mm_set1_ps(boxMin.x)));
+	outside = _mm_or_ps(outside, _mm_or_ps(_mm_cmpgt_ps(_mm_loadu_ps(node.minY), _mm_set1_ps(boxMax.y)), _mm_cmplt_ps(_mm_loadu_ps(node.maxY), _mm_set1_ps(boxMin.y))));
+	outside = _mm_or_ps(outside, _mm_or_ps(_mm_cmpgt_ps(_mm_loadu_ps(node.minZ), _mm_set1_ps(boxMax.z)), _mm_cmplt_ps(_mm_loadu_ps(node.maxZ), _mm_set1_ps(boxMin.z))));
+	return ~_mm_movemask_ps(outside) & 0xf;
+#else
+	unsigned int mask = 0;
+	for (unsigned int i = 0; i < BVH_WIDTH; ++i)
+	{
+		bool outside = node.minX[i] > boxMax.x || node.maxX[i] < boxMin.x
+			|| node.minY[i] > boxMax.y || node.maxY[i] < boxMin.y
+			|| node.minZ[i] > boxMax.z || node.maxZ[i] < boxMin.z;
+		if (!outside)
+			mask |= 1 << i;
+	}
+	return mask;
+#endif
+}
+
+// two sided Moller-Trumbore, t in (tMin, tMax)
+static inline bool intersectTriangle(const BvhTriangle &triangle, const TraversalRay &ray, float tMax, float &t, float &u, float &v)
+{
+	glm::vec3 p = glm::cross(ray.direction, triangle.edge2);
+	float det = glm::dot(triangle.edge1, p);
+	if (std::fabs(det) < 1e-20f)
+		return false;
+	float inverseDet = 1.0f / det;
+	glm::vec3 s = ray.origin - triangle.v0;
+	u = glm::dot(s, p) * inverseDet;
+	if (u < 0.0f || u > 1.0f)
+		return false;
+	glm::vec3 q = glm::cross(s, triangle.edge1);
+	v = glm::dot(ray.direction, q) * inverseDet;
+	if (v < 0.0f || u + v > 1.0f)
+		return false;
+	t = glm::dot(triangle.edge2, q) * inverseDet;
+	return t > ray.tMin && t < tMax;
+}
+
+struct StackEntry
+{
+	int code;
+	float entry;
+};
+
+// pushes the hit children far to near, so the nearest is popped first
+static inline void pushChildren(const BvhNode &node, unsigned int mask, const float* entry, StackEntry* stack, unsigned int &top)
+{
+	StackEntry hits[BVH_WIDTH];
+	unsigned int hitCount = 0;
+	for (unsigned int i = 0; i < BVH_WIDTH; ++i)
+	{
+		if (!(mask & (1 << i)) || node.children[i] == BVH_EMPTY)
+			continue;
+		StackEntry hit = { node.children[i], entry[i] };
+		unsigned int j = hitCount++;
+		for (; j > 0 && hits[j - 1].entry < hit.entry; --j)
+			hits[j] = hits[j - 1];
+		hits[j] = hit;
+	}
+	for (unsigned int i = 0; i < hitCount; ++i)
+		stack[top++] = hits[i];
+}
+
+// closest hit below tMax, or any hit when hit is NULL
+static bool traverseMesh(const MeshBvh &bvh, const TraversalRay &ray, float &tMax, RayHit* hit)
+{
+	if (bvh.nodes.empty())
+		return false;
+
+	StackEntry stack[BVH_STACK];
+	unsigned int top = 0;
+	StackEntry root = { 0, ray.tMin };
+	stack[top++] = root;
+	bool found = false;
+	while (top)
+	{
+		StackEntry current = stack[--top];
+		if (current.entry > tMax)
+			continue;
+
+		if (current.code < 0)
+		{
+			unsigned int bits = ~current.code;
+			unsigned int first = bits >> 4, last = first + (bits & 15);
+			for (unsigned int i = first; i < last; ++i)
+			{
+				float t, u, v;
+				if (!intersectTriangle(bvh.triangles[i], ray, tMax, t, u, v))
+					continue;
+				if (!hit)
+					return true;
+				tMax = t;
+				hit->t = t;
+				hit->u = u;
+				hit->v = v;
+				hit->triangle = bvh.triangles[i].index;
+				found = true;
+			}
+			continue;
+		}
+
+		const BvhNode &node = bvh.nodes[current.code];
+		float entry[BVH_WIDTH];
+		unsigned int mask = intersectChildren(node, ray, tMax, entry);
+		pushChildren(node, mask, entry, stack, top);
+	}
+	return found;
+}
+
+bool intersectMesh(const MeshBvh &bvh, const Ray &ray, RayHit &hit)
+{
+	TraversalRay traversal;
+	prepareRay(traversal, ray.origin, ray.direction, ray.tMin);
+	float tMax = std::min(ray.tMax, hit.t);
+	return traverseMesh(bvh, traversal, tMax, &hit);
+}
+
+bool occludedMesh(const MeshBvh &bvh, const Ray &ray)
+{
+	TraversalRay traversal;
+	prepareRay(traversal, ray.origin, ray.direction, ray.tMin);
+	float tMax = ray.tMax;
+	return traverseMesh(bvh, traversal, tMax, NULL);
+}
+
+void overlapMesh(const MeshBvh &bvh, glm::vec3 boxMin, glm::vec3 boxMax, std::vector<unsigned int> &triangles)
+{
+	if (bvh.nodes.empty())
+		return;
+
+	int stack[BVH_STACK];
+	unsigned int top = 0;
+	stack[top++] = 0;
+	while (top)
+	{
+		int code = stack[--top];
+		if (code < 0)
+		{
+			unsigned int bits = ~code;
+			unsigned int first = bits >> 4, last = first + (bits & 15);
+			for (unsigned int i = first; i < last; ++i)
+			{
+				const BvhTriangle &triangle = bvh.triangles[i];
+				glm::vec3 b = triangle.v0 + triangle.edge1, c = triangle.v0 + triangle.edge2;
+				glm::vec3 triangleMin = glm::min(triangle.v0, glm::min(b, c));
+				glm::vec3 triangleMax = glm::max(triangle.v0, glm::max(b, c));
+				if (triangleMin.x <= boxMax.x && triangleMax.x >= boxMin.x
+					&& triangleMin.y <= boxMax.y && triangleMax.y >= boxMin.y
+					&& triangleMin.z <= boxMax.z && triangleMax.z >= boxMin.z)
+					triangles.push_back(triangle.index);
+			}
+			continue;
+		}
+
+		const BvhNode &node = bvh.nodes[code];
+		unsigned int mask = overlapChildren(node, boxMin, boxMax);
+		for (unsigned int i = 0; i < BVH_WIDTH; ++i)
+		{
+			if ((mask & (1 << i)) && node.children[i] != BVH_EMPTY)
+				stack[top++] = node.children[i];
+		}
+	}
+}
+
+// ---- scene ----
+
+static void transformBounds(const glm::mat4 &m, glm::vec3 boundsMin, glm::vec3 boundsMax, glm::vec3 &outMin, glm::vec3 &outMax)
+{
+	glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+	glm::vec3 extent = (boundsMax - boundsMin) * 0.5f;
+	glm::vec3 worldCenter = glm::vec3(m * glm::vec4(center, 1.0f));
+	glm::vec3 worldExtent;
+	for (unsigned int i = 0; i < 3; ++i)
+		worldExtent[i] = std::fabs(m[0][i]) * extent.x + std::fabs(m[1][i]) * extent.y + std::fabs(m[2][i]) * extent.z;
+	outMin = worldCenter - worldExtent;
+	outMax = worldCenter + worldExtent;
+}
+
+void buildSceneBvh(SceneBvh &bvh, const Scene &scene, ResourceManager &resources)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::vector<BvhInstance> instances;
+	bvh.triangles = 0;
+	for (unsigned int e = 0; e < entityCount(scene); ++e)
+	{
+		if (!scene.alive[e] || scene.renderable[e] == NO_MODEL)
+			continue;
+		const Model &model = getModel(resources, scene.renderable[e]);
+		glm::mat4 inverse = glm::inverse(scene.world[e]);
+		for (unsigned int m = 0; m < model.meshes.size(); ++m)
+		{
+			const MeshBvh &mesh = model.meshes[m].bvh;
+			if (mesh.nodes.empty())
+				continue;
+			BvhInstance instance;
+			instance.world = scene.world[e];
+			instance.inverse = inverse;
+			instance.bvh = &mesh;
+			instance.entity = e;
+			instance.mesh = m;
+			transformBounds(instance.world, mesh.boundsMin, mesh.boundsMax, instance.boundsMin, instance.boundsMax);
+			instances.push_back(instance);
+			bvh.triangles += mesh.triangles.size();
+		}
+	}
+
+	std::vector<BuildPrim> prims(instances.size());
+	for (unsigned int i = 0; i < instances.size(); ++i)
+		setPrim(prims[i], i, instances[i].boundsMin, instances[i].boundsMax);
+	buildHierarchy(bvh.nodes, prims);
+
+	bvh.instances.resize(instances.size());
+	for (unsigned int i = 0; i < instances.size(); ++i)
+		bvh.instances[i] = instances[prims[i].index];
+	bvh.buildMs = elapsedMs(start);
+}
+
+// the ray is moved into each instance's object space, an affine transform
+// keeps t, so the hits of all instances compare directly
+static bool traverseScene(const SceneBvh &bvh, const Ray &ray, RayHit* hit)
+{
+	if (bvh.nodes.empty())
+		return false;
+
+	TraversalRay world;
+	prepareRay(world, ray.origin, ray.direction, ray.tMin);
+	float tMax = hit ? std::min(ray.tMax, hit->t) : ray.tMax;
+
+	StackEntry stack[BVH_STACK];
+	unsigned int top = 0;
+	StackEntry root = { 0, ray.tMin };
+	stack[top++] = root;
+	bool found = false;
+	while (top)
+	{
+		StackEntry current = stack[--top];
+		if (current.entry > tMax)
+			continue;
+
+		if (current.code < 0)
+		{
+			unsigned int bits = ~current.code;
+			unsigned int first = bits >> 4, last = first + (bits & 15);
+			for (unsigned int i = first; i < last; ++i)
+			{
+				const BvhInstance &instance = bvh.instances[i];
+				TraversalRay local;
+				prepareRay(local, glm::vec3(instance.inverse * glm::vec4(ray.origin, 1.0f)), glm::vec3(instance.inverse * glm::vec4(ray.direction, 0.0f)), ray.tMin);
+				if (!traverseMesh(*instance.bvh, local, tMax, hit))
+					continue;
+				if (!hit)
+					return true;
+				hit->entity = instance.entity;
+				hit->mesh = instance.mesh;
+				found = true;
+			}
+			continue;
+		}
+
+		const BvhNode &node = bvh.nodes[current.code];
+		float entry[BVH_WIDTH];
+		unsigned int mask = intersectChildren(node, world, tMax, entry);
+		pushChildren(node, mask, entry, stack, top);
+	}
+	return found;
+}
+
+bool intersectScene(const SceneBvh &bvh, const Ray &ray, RayHit &hit)
+{
+	return traverseScene(bvh, ray, &hit);
+}
+
+bool occludedScene(const SceneBvh &bvh, const Ray &ray)
+{
+	return traverseScene(bvh, ray, NULL);
+}
+
+bool segmentBlocked(const SceneBvh &bvh, glm::vec3 from, glm::vec3 to)
+{
+	Ray ray;
+	ray.origin = from;
+	ray.direction = to - from;
+	// a little off both ends, so the surfaces the points lie on do not count
+	ray.tMin = 1e-4f;
+	ray.tMax = 1.0f - 1e-4f;
+	return occludedScene(bvh, ray);
+}
+
+void overlapScene(const SceneBvh &bvh, glm::vec3 boxMin, glm::vec3 boxMax, std::vector<BoxHit> &hits)
+{
+	if (bvh.nodes.empty())
+		return;
+
+	std::vector<unsigned int> triangles;
+	int stack[BVH_STACK];
+	unsigned int top = 0;
+	stack[top++] = 0;
+	while (top)
+	{
+		int code = stack[--top];
+		if (code < 0)
+		{
+			unsigned int bits = ~code;
+			unsigned int first = bits >> 4, last = first + (bits & 15);
+			for (unsigned int i = first; i < last; ++i)
+			{
+				const BvhInstance &instance = bvh.instances[i];
+				glm::vec3 localMin, localMax;
+				transformBounds(instance.inverse, boxMin, boxMax, localMin, localMax);
+				triangles.clear();
+				overlapMesh(*instance.bvh, localMin, localMax, triangles);
+				for (unsigned int t = 0; t < triangles.size(); ++t)
+				{
+					BoxHit hit = { instance.entity, instance.mesh, triangles[t] };
+					hits.push_back(hit);
+				}
+			}
+			continue;
+		}
+
+		const BvhNode &node = bvh.nodes[code];
+		unsigned int mask = overlapChildren(node, boxMin, boxMax);
+		for (unsigned int i = 0; i < BVH_WIDTH; ++i)
+		{
+			if ((mask & (1 << i)) && node.children[i] != BVH_EMPTY)
+				stack[top++] = node.children[i];
+		}
+	}
+}
+
+Ray screenRay(float x, float y, float width, float height, const glm::mat4 &viewProj)
+{
+	glm::mat4 inverse = glm::inverse(viewProj);
+	float ndcX = 2.0f * x / width - 1.0f;
+	float ndcY = 1.0f - 2.0f * y / height;
+	glm::vec4 nearPoint = inverse * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+	glm::vec4 farPoint = inverse * glm::vec4(ndcX, ndcY, 1.0f, 1.0f);
+
+	Ray ray;
+	ray.origin = glm::vec3(nearPoint) / nearPoint.w;
+	ray.direction = glm::vec3(farPoint) / farPoint.w - ray.origin;
+	ray.tMin = 0.0f;
+	ray.tMax = 1.0f;
+	return ray;
+}
+
+// ---- benchmark ----
+
+struct BenchmarkContext
+{
+	const SceneBvh* bvh;
+	glm::mat4 viewProj;
+	bool occlusion;
+	std::atomic<unsigned int> hits;
+};
+
+static void benchmarkRange(unsigned int first, unsigned int last, void* data)
+{
+	BenchmarkContext* context = (BenchmarkContext*)data;
+	unsigned int hits = 0;
+	// same pixels for both passes
+	unsigned int state = first * 2654435761u + 1;
+	for (unsigned int i = first; i < last; ++i)
+	{
+		state = state * 1664525u + 1013904223u;
+		float x = (state >> 8) * (1.0f / 16777216.0f);
+		state = state * 1664525u + 1013904223u;
+		float y = (state >> 8) * (1.0f / 16777216.0f);
+		Ray ray = screenRay(x, y, 1.0f, 1.0f, context->viewProj);
+		if (context->occlusion)
+		{
+			hits += occludedScene(*context->bvh, ray);
+		}
+		else
+		{
+			RayHit hit;
+			hit.t = ray.tMax;
+			hits += intersectScene(*context->bvh, ray, hit);
+		}
+	}
+	context->hits += hits;
+}
+
+BvhBenchmark benchmarkRays(const SceneBvh &bvh, const glm::mat4 &viewProj, unsigned int count)
+{
+	BvhBenchmark result;
+	result.rays = count;
+
+	BenchmarkContext context;
+	context.bvh = &bvh;
+	context.viewProj = viewProj;
+	context.occlusion = false;
+	context.hits = 0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	jobs::parallelFor(count, 1024, benchmarkRange, &context);
+	result.closestMs = elapsedMs(start);
+	result.hits = context.hits;
+
+	context.occlusion = true;
+	start = std::chrono::steady_clock::now();
+	jobs::parallelFor(count, 1024, benchmarkRange, &context);
+	result.occludedMs = elapsedMs(start);
+
+	result.closestRate = result.closestMs > 0.0 ? count / (result.closestMs * 1000.0) : 0.0;
+	result.occludedRate = result.occludedMs > 0.0 ? count / (result.occludedMs * 1000.0) : 0.0;
+	return result;
+}
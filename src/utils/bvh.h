@@ -0,0 +1,129 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+struct Vertex;
+struct Scene;
+struct ResourceManager;
+
+// Bounding volume hierarchies for ray, segment and box queries on the CPU.
+// Every mesh gets its own hierarchy over its triangles (built by loadModel
+// with MODEL_BUILD_BVH), and a top-level one over the placed meshes of a
+// scene refers to them through the instance transforms, so placing a model
+// many times does not copy its triangles.
+//
+// Both are built as binary trees with a binned surface area heuristic, then
+// collapsed into four-wide nodes whose child boxes are tested with one SSE
+// instruction per slab.
+
+const unsigned int BVH_WIDTH = 4;
+// most primitives a leaf may hold
+const unsigned int BVH_MAX_LEAF = 4;
+
+// Child boxes as structure of arrays. children[i] >= 0 is an inner node, a
+// negative one is ~(first << 4 | count) into the primitives, count 0 for an
+// unused slot whose box is empty.
+struct BvhNode
+{
+	float minX[BVH_WIDTH], minY[BVH_WIDTH], minZ[BVH_WIDTH];
+	float maxX[BVH_WIDTH], maxY[BVH_WIDTH], maxZ[BVH_WIDTH];
+	int children[BVH_WIDTH];
+};
+
+// precomputed for the Moller-Trumbore test, in leaf order
+struct BvhTriangle
+{
+	glm::vec3 v0, edge1, edge2;
+	// index of the triangle in the mesh index buffer, / 3
+	unsigned int index;
+};
+
+struct MeshBvh
+{
+	// nodes[0] is the root, empty for a mesh without triangles
+	std::vector<BvhNode> nodes;
+	std::vector<BvhTriangle> triangles;
+	glm::vec3 boundsMin, boundsMax;
+};
+
+// one mesh of a placed model
+struct BvhInstance
+{
+	glm::mat4 world, inverse;
+	const MeshBvh* bvh;
+	unsigned int entity, mesh;
+	glm::vec3 boundsMin, boundsMax;
+};
+
+// instances are reordered into leaf order
+struct SceneBvh
+{
+	std::vector<BvhNode> nodes;
+	std::vector<BvhInstance> instances;
+	unsigned int triangles;
+	float buildMs;
+};
+
+struct Ray
+{
+	glm::vec3 origin;
+	// need not be normalized, t is in units of it
+	glm::vec3 direction;
+	float tMin, tMax;
+};
+
+struct RayHit
+{
+	float t;
+	// barycentrics of the second and third vertex
+	float u, v;
+	unsigned int triangle;
+	// entity and mesh, only set by scene queries
+	unsigned int entity, mesh;
+};
+
+struct BoxHit
+{
+	unsigned int entity, mesh, triangle;
+};
+
+struct BvhBenchmark
+{
+	unsigned int rays;
+	unsigned int hits;
+	double closestMs, occludedMs;
+	// millions of rays per second
+	double closestRate, occludedRate;
+};
+
+// spreads the build over the job system
+void buildMeshBvh(MeshBvh &bvh, const Vertex* vertices, const unsigned int* indices, unsigned int indexCount);
+size_t bvhBytes(const MeshBvh &bvh);
+
+// closest hit in (tMin, min(tMax, hit.t)), hit.t has to start at tMax or
+// above. Triangles are hit from both sides.
+bool intersectMesh(const MeshBvh &bvh, const Ray &ray, RayHit &hit);
+// any hit in (tMin, tMax), stops at the first one
+bool occludedMesh(const MeshBvh &bvh, const Ray &ray);
+// triangles whose bounds overlap the box, appended to triangles
+void overlapMesh(const MeshBvh &bvh, glm::vec3 boxMin, glm::vec3 boxMax, std::vector<unsigned int> &triangles);
+
+// every live entity whose renderable is a model with mesh hierarchies
+void buildSceneBvh(SceneBvh &bvh, const Scene &scene, ResourceManager &resources);
+bool intersectScene(const SceneBvh &bvh, const Ray &ray, RayHit &hit);
+bool occludedScene(const SceneBvh &bvh, const Ray &ray);
+// line of sight, true when anything lies between from and to
+bool segmentBlocked(const SceneBvh &bvh, glm::vec3 from, glm::vec3 to);
+// triangles whose bounds overlap the box, conservative for rotated
+// instances: the box is tested as its bounds in object space
+void overlapScene(const SceneBvh &bvh, glm::vec3 boxMin, glm::vec3 boxMax, std::vector<BoxHit> &hits);
+
+// through pixel (x, y) from the top left, for picking
+Ray screenRay(float x, float y, float width, float height, const glm::mat4 &viewProj);
+// count primary rays through random pixels, closest hit and occlusion, on
+// every worker
+BvhBenchmark benchmarkRays(const SceneBvh &bvh, const glm::mat4 &viewProj, unsigned int count);
+
+#endif
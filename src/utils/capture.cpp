@@ -0,0 +1,327 @@
+#include "capture.h"
+#include "png.h"
+#include "memory.h"
+
+#include <chrono>
+#include <cstring>
+#include <unistd.h>
+
+static void toRgb(const unsigned char* pixels, int width, int height, std::vector<unsigned char> &rgb)
+{
+	// GL rows are bottom to top
+	rgb.resize(width * height * 3);
+	for (int y = 0; y < height; ++y)
+	{
+		const unsigned char* src = pixels + (size_t)(height - 1 - y) * width * 4;
+		unsigned char* dest = &rgb[y * width * 3];
+		for (int x = 0; x < width; ++x)
+		{
+			dest[x * 3] = src[x * 4];
+			dest[x * 3 + 1] = src[x * 4 + 1];
+			dest[x * 3 + 2] = src[x * 4 + 2];
+		}
+	}
+}
+
+// BT.601 studio range, chroma averaged over 2x2 pixels
+static void toYuv420(const std::vector<unsigned char> &rgb, int width, int height, std::vector<unsigned char> &yuv)
+{
+	int chromaWidth = (width + 1) / 2, chromaHeight = (height + 1) / 2;
+	yuv.resize(width * height + chromaWidth * chromaHeight * 2);
+	unsigned char* planeY = &yuv[0];
+	unsigned char* planeU = planeY + width * height;
+	unsigned char* planeV = planeU + chromaWidth * chromaHeight;
+
+	for (int i = 0; i < width * height; ++i)
+	{
+		int r = rgb[i * 3], g = rgb[i * 3 + 1], b = rgb[i * 3 + 2];
+		planeY[i] = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+	}
+
+	for (int cy = 0; cy < chromaHeight; ++cy)
+	{
+		for (int cx = 0; cx < chromaWidth; ++cx)
+		{
+			int r = 0, g = 0, b = 0, count = 0;
+			for (int y = cy * 2; y < cy * 2 + 2 && y < height; ++y)
+			{
+				for (int x = cx * 2; x < cx * 2 + 2 && x < width; ++x)
+				{
+					const unsigned char* p = &rgb[(y * width + x) * 3];
+					r += p[0];
+					g += p[1];
+					b += p[2];
+					count++;
+				}
+			}
+			r /= count;
+			g /= count;
+			b /= count;
+			planeU[cy * chromaWidth + cx] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+			planeV[cy * chromaWidth + cx] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+		}
+	}
+}
+
+static void writeFrame(Capture &capture, const CaptureFrame &frame, std::vector<unsigned char> &rgb, std::vector<unsigned char> &encoded)
+{
+	toRgb(frame.pixels, capture.width, capture.height, rgb);
+
+	if (capture.format == CAPTURE_RAW)
+	{
+		fwrite(rgb.data(), 1, rgb.size(), capture.out);
+	}
+	else if (capture.format == CAPTURE_Y4M)
+	{
+		toYuv420(rgb, capture.width, capture.height, encoded);
+		fputs("FRAME\n", capture.out);
+		fwrite(encoded.data(), 1, encoded.size(), capture.out);
+	}
+	else if (capture.out)
+	{
+		encodePng(rgb.data(), capture.width, capture.height, 3, encoded);
+		fwrite(encoded.data(), 1, encoded.size(), capture.out);
+	}
+	else
+	{
+		char path[1024];
+		snprintf(path, sizeof(path), capture.path.c_str(), frame.number);
+		writePng(path, rgb.data(), capture.width, capture.height, 3);
+	}
+}
+
+static void writerLoop(Capture* capture)
+{
+	std::vector<unsigned char> rgb, encoded;
+	for (;;)
+	{
+		CaptureFrame frame;
+		{
+			std::unique_lock<std::mutex> lock(capture->mutex);
+			while (capture->queue.empty() && !capture->stopping)
+				capture->ready.wait(lock);
+			if (capture->queue.empty())
+				break;
+			frame = capture->queue.front();
+			capture->queue.pop_front();
+		}
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		writeFrame(*capture, frame, rgb, encoded);
+		float ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		{
+			std::lock_guard<std::mutex> lock(capture->mutex);
+			capture->written[frame.slot] = true;
+			capture->stats.written++;
+			capture->stats.encodeMs += ms;
+		}
+		capture->ready.notify_all();
+	}
+}
+
+bool parseCaptureFormat(const char* name, CaptureFormat &format)
+{
+	if (strcmp(name, "raw") == 0)
+		format = CAPTURE_RAW;
+	else if (strcmp(name, "png") == 0)
+		format = CAPTURE_PNG;
+	else if (strcmp(name, "y4m") == 0)
+		format = CAPTURE_Y4M;
+	else
+		return false;
+	return true;
+}
+
+bool startCapture(Capture &capture, int width, int height, CaptureFormat format, const char* path, unsigned int fps)
+{
+	capture.width = width;
+	capture.height = height;
+	capture.format = format;
+	capture.fps = fps;
+	capture.path = path;
+	capture.out = NULL;
+	capture.isPipe = false;
+	capture.active = false;
+
+	if (path[0] == '|')
+	{
+		capture.out = popen(path + 1, "w");
+		capture.isPipe = true;
+	}
+	else if (strcmp(path, "-") == 0)
+	{
+		// keep the real stdout for the stream and send the app's own printf
+		// output to stderr, so log lines can't end up inside the video
+		fflush(stdout);
+		capture.out = fdopen(dup(fileno(stdout)), "wb");
+		dup2(fileno(stderr), fileno(stdout));
+	}
+	else if (format != CAPTURE_PNG)
+	{
+		capture.out = fopen(path, "wb");
+	}
+
+	if (format != CAPTURE_PNG && capture.out == NULL)
+	{
+		printf("Error: Can't open capture output '%s'.\n", path);
+		return false;
+	}
+
+	if (format == CAPTURE_Y4M)
+		fprintf(capture.out, "YUV4MPEG2 W%d H%d F%u:1 Ip A1:1 C420jpeg\n", width, height, fps);
+
+	size_t frameSize = (size_t)width * height * 4;
+	glGenBuffers(CAPTURE_RING, capture.pbos);
+	for (unsigned int i = 0; i < CAPTURE_RING; ++i)
+	{
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, capture.pbos[i]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, frameSize, NULL, GL_STREAM_READ);
+		capture.fences[i] = 0;
+		capture.written[i] = false;
+		memory::ScopedOwner owner("capture");
+		memory::allocate(memory::OTHER_BUFFER, capture.pbos[i], frameSize);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	capture.tail = 0;
+	capture.mapped = 0;
+	capture.head = 0;
+	capture.pending = 0;
+	capture.nextNumber = 0;
+	capture.stopping = false;
+	memset(&capture.stats, 0, sizeof(capture.stats));
+	capture.writer = std::thread(writerLoop, &capture);
+	capture.active = true;
+	return true;
+}
+
+// maps the oldest pending readback and hands it to the writer, false if its
+// fence has not signalled yet and wait is false
+static bool collectFrame(Capture &capture, bool wait)
+{
+	unsigned int slot = capture.head;
+	GLenum status = glClientWaitSync(capture.fences[slot], 0, 0);
+	if (status == GL_TIMEOUT_EXPIRED)
+	{
+		if (!wait)
+			return false;
+		capture.stats.readbackStalls++;
+		do
+			status = glClientWaitSync(capture.fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+		while (status == GL_TIMEOUT_EXPIRED);
+	}
+	glDeleteSync(capture.fences[slot]);
+	capture.fences[slot] = 0;
+
+	// stays mapped while the writer reads it, nothing else uses the buffer
+	size_t frameSize = (size_t)capture.width * capture.height * 4;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, capture.pbos[slot]);
+	CaptureFrame frame;
+	frame.pixels = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frameSize, GL_MAP_READ_BIT);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	frame.number = capture.numbers[slot];
+	frame.slot = slot;
+
+	{
+		std::lock_guard<std::mutex> lock(capture.mutex);
+		if (frame.pixels)
+			capture.queue.push_back(frame);
+		else
+			capture.written[slot] = true;
+	}
+	capture.ready.notify_all();
+
+	capture.head = (capture.head + 1) % CAPTURE_RING;
+	capture.pending--;
+	capture.mapped++;
+	return true;
+}
+
+// unmaps the slots the writer is done with, oldest first; with wait, blocks
+// until at least the oldest one is done
+static void releaseWritten(Capture &capture, bool wait)
+{
+	std::unique_lock<std::mutex> lock(capture.mutex);
+	if (wait)
+	{
+		capture.stats.writerStalls++;
+		while (!capture.written[capture.tail])
+			capture.ready.wait(lock);
+	}
+	while (capture.mapped > 0 && capture.written[capture.tail])
+	{
+		capture.written[capture.tail] = false;
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, capture.pbos[capture.tail]);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		capture.tail = (capture.tail + 1) % CAPTURE_RING;
+		capture.mapped--;
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void captureFrame(Capture &capture)
+{
+	if (!capture.active)
+		return;
+
+	releaseWritten(capture, false);
+	while (capture.pending > 0 && collectFrame(capture, false))
+		;
+	// a full ring frees a slot only through the writer
+	while (capture.mapped + capture.pending == CAPTURE_RING)
+	{
+		if (capture.mapped == 0)
+			collectFrame(capture, true);
+		else
+			releaseWritten(capture, true);
+	}
+
+	unsigned int slot = (capture.head + capture.pending) % CAPTURE_RING;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, capture.pbos[slot]);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glReadPixels(0, 0, capture.width, capture.height, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	capture.fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	capture.numbers[slot] = capture.nextNumber++;
+	capture.pending++;
+	capture.stats.captured++;
+}
+
+void stopCapture(Capture &capture)
+{
+	if (!capture.active)
+		return;
+
+	while (capture.pending > 0)
+		collectFrame(capture, true);
+
+	{
+		std::lock_guard<std::mutex> lock(capture.mutex);
+		capture.stopping = true;
+	}
+	capture.ready.notify_all();
+	capture.writer.join();
+	releaseWritten(capture, false);
+
+	if (capture.isPipe)
+		pclose(capture.out);
+	else if (capture.out)
+		fclose(capture.out);
+	capture.out = NULL;
+
+	for (unsigned int i = 0; i < CAPTURE_RING; ++i)
+		memory::release(memory::OTHER_BUFFER, capture.pbos[i]);
+	glDeleteBuffers(CAPTURE_RING, capture.pbos);
+	capture.active = false;
+
+	printf("capture: %u frames written, %u readback stalls, %u writer stalls, %.2f ms encode per frame\n",
+		capture.stats.written, capture.stats.readbackStalls, capture.stats.writerStalls,
+		capture.stats.written ? capture.stats.encodeMs / capture.stats.written : 0.0f);
+}
+
+CaptureStats captureStats(Capture &capture)
+{
+	std::lock_guard<std::mutex> lock(capture.mutex);
+	return capture.stats;
+}
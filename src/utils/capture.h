@@ -0,0 +1,91 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdio>
+#include <glad/glad.h>
+
+// Frame capture without stalling the render loop. Every frame is read into
+// the next pixel buffer object of a ring and fenced; a buffer is mapped only
+// once its fence has signalled, a few frames later. The mapped buffer itself
+// goes to a writer thread that converts and encodes straight from it, and
+// comes back to be unmapped, so the render thread never touches the pixels.
+// Buffers with the writer stay in the ring, which bounds memory if the disk
+// can't keep up.
+const unsigned int CAPTURE_RING = 8;
+
+enum CaptureFormat
+{
+	// packed RGB rows, top to bottom
+	CAPTURE_RAW,
+	// one file per frame, the path is a printf pattern for the frame number
+	CAPTURE_PNG,
+	// YUV4MPEG2 4:2:0 stream, readable by ffmpeg and most players
+	CAPTURE_Y4M
+};
+
+struct CaptureStats
+{
+	unsigned int captured;
+	unsigned int written;
+	// the render thread had to wait, for the GPU or for the writer
+	unsigned int readbackStalls;
+	unsigned int writerStalls;
+	float encodeMs;
+};
+
+struct CaptureFrame
+{
+	// mapped pixel buffer of the slot
+	const unsigned char* pixels;
+	unsigned int number;
+	unsigned int slot;
+};
+
+struct Capture
+{
+	int width, height;
+	CaptureFormat format;
+	unsigned int fps;
+	std::string path;
+	// stream output for raw and y4m, or png when writing to a pipe
+	FILE* out;
+	bool isPipe;
+
+	unsigned int pbos[CAPTURE_RING];
+	GLsync fences[CAPTURE_RING];
+	unsigned int numbers[CAPTURE_RING];
+	// the ring in order: mapped slots with the writer from tail, then
+	// pending readbacks from head
+	unsigned int tail, mapped;
+	unsigned int head, pending;
+	// set by the writer, the render thread unmaps the slot
+	bool written[CAPTURE_RING];
+	unsigned int nextNumber;
+
+	std::thread writer;
+	std::mutex mutex;
+	std::condition_variable ready;
+	std::deque<CaptureFrame> queue;
+	bool stopping;
+	bool active;
+
+	CaptureStats stats;
+};
+
+// path "-" writes to stdout, "|command" pipes into command
+bool startCapture(Capture &capture, int width, int height, CaptureFormat format, const char* path, unsigned int fps = 60);
+// reads the bound read framebuffer, call before drawing any UI
+void captureFrame(Capture &capture);
+// waits for every pending frame to be written
+void stopCapture(Capture &capture);
+// the writer updates the stats, this copies them under its lock
+CaptureStats captureStats(Capture &capture);
+bool parseCaptureFormat(const char* name, CaptureFormat &format);
+
+#endif
@@ -0,0 +1,42 @@
+#include "frustum.h"
+
+void extractFrustum(Frustum &frustum, const glm::mat4 &matrix)
+{
+	glm::vec4 rowX(matrix[0][0], matrix[1][0], matrix[2][0], matrix[3][0]);
+	glm::vec4 rowY(matrix[0][1], matrix[1][1], matrix[2][1], matrix[3][1]);
+	glm::vec4 rowZ(matrix[0][2], matrix[1][2], matrix[2][2], matrix[3][2]);
+	glm::vec4 rowW(matrix[0][3], matrix[1][3], matrix[2][3], matrix[3][3]);
+
+	frustum.planes[0] = rowW + rowX;
+	frustum.planes[1] = rowW - rowX;
+	frustum.planes[2] = rowW + rowY;
+	frustum.planes[3] = rowW - rowY;
+	frustum.planes[4] = rowW + rowZ;
+	frustum.planes[5] = rowW - rowZ;
+}
+
+bool boxInFrustum(const Frustum &frustum, glm::vec3 boundsMin, glm::vec3 boundsMax)
+{
+	for (unsigned int i = 0; i < 6; ++i)
+	{
+		const glm::vec4 &plane = frustum.planes[i];
+		// corner furthest along the plane normal
+		glm::vec3 p(plane.x > 0.0f ? boundsMax.x : boundsMin.x, plane.y > 0.0f ? boundsMax.y : boundsMin.y, plane.z > 0.0f ? boundsMax.z : boundsMin.z);
+		if (plane.x * p.x + plane.y * p.y + plane.z * p.z + plane.w < 0.0f)
+			return false;
+	}
+	return true;
+}
+
+bool sphereInFrustum(const Frustum &frustum, glm::vec3 center, float radius)
+{
+	for (unsigned int i = 0; i < 6; ++i)
+	{
+		const glm::vec4 &plane = frustum.planes[i];
+		float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+		// planes are not normalized, scale the radius instead
+		if (distance < -radius * glm::length(glm::vec3(plane)))
+			return false;
+	}
+	return true;
+}
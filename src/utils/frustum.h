@@ -0,0 +1,17 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+// Planes of a projection matrix, xyz is the normal pointing inside. Taken
+// from a model-view-projection they are in that model's object space.
+struct Frustum
+{
+	glm::vec4 planes[6];
+};
+
+void extractFrustum(Frustum &frustum, const glm::mat4 &matrix);
+bool boxInFrustum(const Frustum &frustum, glm::vec3 boundsMin, glm::vec3 boundsMax);
+bool sphereInFrustum(const Frustum &frustum, glm::vec3 center, float radius);
+
+#endif
@@ -0,0 +1,270 @@
+#include <glad/glad.h>
+#include <cstddef>
+
+#include "indirect.h"
+#include "frustum.h"
+#include "memory.h"
+#include "shader.h"
+
+bool indirectSupported()
+{
+#ifdef GL_VERSION_4_3
+	return GLAD_GL_VERSION_4_3 != 0;
+#else
+	return false;
+#endif
+}
+
+// a glad generated for 3.3 has none of the calls below; indirectSupported()
+// is false then and the GPU-driven path is never used
+#ifdef GL_VERSION_4_3
+unsigned int createCullProgram()
+{
+	unsigned int cs = shader::loadFromFile("./src/shaders/cull_compute.glsl", GL_COMPUTE_SHADER);
+	unsigned int program = shader::createComputeProgram(cs);
+	glDeleteShader(cs);
+	return program;
+}
+
+
+void initIndirect(IndirectModel &indirect, const Model &model)
+{
+	indirect.meshCount = model.meshes.size();
+	indirect.records.resize(indirect.meshCount);
+
+	unsigned int vertexCount = 0, indexCount = 0;
+	std::vector<int> materials(indirect.meshCount);
+	for (unsigned int i = 0; i < indirect.meshCount; ++i)
+	{
+		const Mesh &mesh = model.meshes[i];
+		MeshRecord &record = indirect.records[i];
+		record.boundsMin = glm::vec4(mesh.boundsMin, 1.0f);
+		record.boundsMax = glm::vec4(mesh.boundsMax, 1.0f);
+		record.indexCount = mesh.indexCount;
+		record.firstIndex = indexCount;
+		record.baseVertex = vertexCount;
+		record.pad = 0;
+		materials[i] = mesh.material;
+
+		vertexCount += mesh.vertexCount;
+		indexCount += mesh.indexCount;
+	}
+
+	glGenVertexArrays(1, &indirect.vao);
+	glGenBuffers(1, &indirect.vbo);
+	glGenBuffers(1, &indirect.ebo);
+	glGenBuffers(1, &indirect.meshBuffer);
+	glGenBuffers(1, &indirect.commandBuffer);
+	glGenBuffers(1, &indirect.countBuffer);
+	glGenBuffers(1, &indirect.materialBuffer);
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, indirect.vbo);
+	glBufferData(GL_COPY_WRITE_BUFFER, vertexCount * sizeof(Vertex), NULL, GL_STATIC_DRAW);
+	for (unsigned int i = 0; i < indirect.meshCount; ++i)
+	{
+		const Mesh &mesh = model.meshes[i];
+		glBindBuffer(GL_COPY_READ_BUFFER, mesh.vbo);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, indirect.records[i].baseVertex * sizeof(Vertex), mesh.vertexCount * sizeof(Vertex));
+	}
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, indirect.ebo);
+	glBufferData(GL_COPY_WRITE_BUFFER, indexCount * sizeof(unsigned int), NULL, GL_STATIC_DRAW);
+	for (unsigned int i = 0; i < indirect.meshCount; ++i)
+	{
+		const Mesh &mesh = model.meshes[i];
+		glBindBuffer(GL_COPY_READ_BUFFER, mesh.ebo);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, indirect.records[i].firstIndex * sizeof(unsigned int), mesh.indexCount * sizeof(unsigned int));
+	}
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, indirect.meshBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, indirect.meshCount * sizeof(MeshRecord), indirect.records.data(), GL_STATIC_DRAW);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, indirect.commandBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, indirect.meshCount * sizeof(DrawCommand), NULL, GL_DYNAMIC_COPY);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, indirect.countBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(unsigned int), NULL, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	glBindVertexArray(indirect.vao);
+
+	glBindBuffer(GL_ARRAY_BUFFER, indirect.vbo);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, textureCoords));
+
+	glBindBuffer(GL_ARRAY_BUFFER, indirect.materialBuffer);
+	glBufferData(GL_ARRAY_BUFFER, materials.size() * sizeof(int), materials.data(), GL_STATIC_DRAW);
+	glEnableVertexAttribArray(3);
+	glVertexAttribIPointer(3, 1, GL_INT, sizeof(int), (void*)0);
+	glVertexAttribDivisor(3, 1);
+
+	// laid out like the vertices, the meshes keep theirs next to them
+	indirect.lightmapBuffer = 0;
+	if (model.lightmap)
+	{
+		glGenBuffers(1, &indirect.lightmapBuffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, indirect.lightmapBuffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, vertexCount * sizeof(glm::vec2), NULL, GL_STATIC_DRAW);
+		for (unsigned int i = 0; i < indirect.meshCount; ++i)
+		{
+			const Mesh &mesh = model.meshes[i];
+			glBindBuffer(GL_COPY_READ_BUFFER, mesh.lightmapVbo);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, indirect.records[i].baseVertex * sizeof(glm::vec2), mesh.vertexCount * sizeof(glm::vec2));
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, indirect.lightmapBuffer);
+		glEnableVertexAttribArray(6);
+		glVertexAttribPointer(6, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), (void*)0);
+	}
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indirect.ebo);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	memory::ScopedOwner owner(model.name + " (indirect)");
+	memory::allocate(memory::VERTEX_BUFFER, indirect.vbo, vertexCount * sizeof(Vertex));
+	memory::allocate(memory::INDEX_BUFFER, indirect.ebo, indexCount * sizeof(unsigned int));
+	memory::allocate(memory::OTHER_BUFFER, indirect.meshBuffer, indirect.meshCount * sizeof(MeshRecord));
+	memory::allocate(memory::OTHER_BUFFER, indirect.commandBuffer, indirect.meshCount * sizeof(DrawCommand));
+	memory::allocate(memory::OTHER_BUFFER, indirect.countBuffer, sizeof(unsigned int));
+	memory::allocate(memory::VERTEX_BUFFER, indirect.materialBuffer, materials.size() * sizeof(int));
+	if (indirect.lightmapBuffer)
+		memory::allocate(memory::VERTEX_BUFFER, indirect.lightmapBuffer, vertexCount * sizeof(glm::vec2));
+}
+
+void destroyIndirect(IndirectModel &indirect)
+{
+	memory::release(memory::VERTEX_BUFFER, indirect.vbo);
+	memory::release(memory::INDEX_BUFFER, indirect.ebo);
+	memory::release(memory::OTHER_BUFFER, indirect.meshBuffer);
+	memory::release(memory::OTHER_BUFFER, indirect.commandBuffer);
+	memory::release(memory::OTHER_BUFFER, indirect.countBuffer);
+	memory::release(memory::VERTEX_BUFFER, indirect.materialBuffer);
+	if (indirect.lightmapBuffer)
+	{
+		memory::release(memory::VERTEX_BUFFER, indirect.lightmapBuffer);
+		glDeleteBuffers(1, &indirect.lightmapBuffer);
+		indirect.lightmapBuffer = 0;
+	}
+	glDeleteVertexArrays(1, &indirect.vao);
+	glDeleteBuffers(1, &indirect.vbo);
+	glDeleteBuffers(1, &indirect.ebo);
+	glDeleteBuffers(1, &indirect.meshBuffer);
+	glDeleteBuffers(1, &indirect.commandBuffer);
+	glDeleteBuffers(1, &indirect.countBuffer);
+	glDeleteBuffers(1, &indirect.materialBuffer);
+	indirect.records.clear();
+}
+
+void cullIndirect(IndirectModel &indirect, unsigned int cullProgram, const glm::mat4 &mvp)
+{
+	Frustum frustum;
+	extractFrustum(frustum, mvp);
+
+	// culled slots must stay zero-sized draws
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, indirect.commandBuffer);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, indirect.countBuffer);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	glUseProgram(cullProgram);
+	glUniform4fv(glGetUniformLocation(cullProgram, "planes"), 6, &frustum.planes[0].x);
+	glUniform1ui(glGetUniformLocation(cullProgram, "meshCount"), indirect.meshCount);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, indirect.meshBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, indirect.commandBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, indirect.countBuffer);
+	glDispatchCompute((indirect.meshCount + 63) / 64, 1, 1);
+
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void drawIndirect(IndirectModel &indirect, Model &model, unsigned int &shader)
+{
+	glUseProgram(shader);
+	bindMaterials(model, shader);
+
+	// all meshCount slots are submitted, culled ones have zero counts; the
+	// draw count never leaves the GPU, so nothing waits on the cull pass
+	glBindVertexArray(indirect.vao);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect.commandBuffer);
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)0, indirect.meshCount, 0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	glBindVertexArray(0);
+
+	renderStats.drawCalls++;
+}
+
+unsigned int validateIndirect(IndirectModel &indirect, const glm::mat4 &mvp, unsigned int &gpuVisible, unsigned int &cpuVisible)
+{
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+	gpuVisible = 0;
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, indirect.countBuffer);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(unsigned int), &gpuVisible);
+
+	std::vector<DrawCommand> commands(indirect.meshCount);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, indirect.commandBuffer);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, commands.size() * sizeof(DrawCommand), commands.data());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	std::vector<unsigned char> gpu(indirect.meshCount, 0);
+	unsigned int mismatches = 0;
+	for (unsigned int i = 0; i < gpuVisible && i < indirect.meshCount; ++i)
+	{
+		const DrawCommand &command = commands[i];
+		const MeshRecord* record = command.baseInstance < indirect.meshCount ? &indirect.records[command.baseInstance] : NULL;
+		if (!record || gpu[command.baseInstance] || command.count != record->indexCount || command.firstIndex != record->firstIndex || command.baseVertex != record->baseVertex || command.instanceCount != 1)
+		{
+			mismatches++;
+			continue;
+		}
+		gpu[command.baseInstance] = 1;
+	}
+
+	Frustum frustum;
+	extractFrustum(frustum, mvp);
+	cpuVisible = 0;
+	for (unsigned int i = 0; i < indirect.meshCount; ++i)
+	{
+		const MeshRecord &record = indirect.records[i];
+		bool visible = boxInFrustum(frustum, glm::vec3(record.boundsMin), glm::vec3(record.boundsMax));
+		cpuVisible += visible ? 1 : 0;
+		if (visible != (gpu[i] != 0))
+			mismatches++;
+	}
+
+	return mismatches;
+}
+#else
+unsigned int createCullProgram()
+{
+	return 0;
+}
+
+void initIndirect(IndirectModel &indirect, const Model &)
+{
+	indirect = IndirectModel();
+}
+
+void destroyIndirect(IndirectModel &)
+{
+}
+
+void cullIndirect(IndirectModel &, unsigned int, const glm::mat4 &)
+{
+}
+
+void drawIndirect(IndirectModel &, Model &, unsigned int &)
+{
+}
+
+unsigned int validateIndirect(IndirectModel &, const glm::mat4 &, unsigned int &gpuVisible, unsigned int &cpuVisible)
+{
+	gpuVisible = cpuVisible = 0;
+	return 0;
+}
+#endif
@@ -0,0 +1,64 @@
+#ifndef INDIRECT_H
+#define INDIRECT_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "model.h"
+
+// GPU-driven drawing of a whole model. The meshes are merged into one vertex
+// and index buffer, a compute pass frustum-culls their bounds and packs one
+// DrawElementsIndirectCommand per visible mesh, and a single
+// glMultiDrawElementsIndirect draws them, so CPU submission does not grow
+// with the mesh count. Needs GL 4.3.
+
+// std430 layout, must match cull_compute.glsl
+struct MeshRecord
+{
+	glm::vec4 boundsMin;
+	glm::vec4 boundsMax;
+	unsigned int indexCount;
+	unsigned int firstIndex;
+	int baseVertex;
+	unsigned int pad;
+};
+
+struct DrawCommand
+{
+	unsigned int count;
+	unsigned int instanceCount;
+	unsigned int firstIndex;
+	int baseVertex;
+	unsigned int baseInstance;
+};
+
+struct IndirectModel
+{
+	unsigned int vao, vbo, ebo;
+	unsigned int meshBuffer;
+	// meshCount slots, visible draws packed at the front, the rest zeroed
+	unsigned int commandBuffer;
+	// visible draw count written by the cull pass
+	unsigned int countBuffer;
+	// material index per mesh, an instanced attribute fetched through baseInstance
+	unsigned int materialBuffer;
+	// lightmap coordinates at attribute 6, 0 when the model has no lightmap
+	unsigned int lightmapBuffer;
+	unsigned int meshCount;
+	// kept for validation
+	std::vector<MeshRecord> records;
+};
+
+// false on GL below 4.3 and when built against a glad without 4.3
+bool indirectSupported();
+unsigned int createCullProgram();
+// copies the mesh buffers on the GPU, works without CPU-side mesh data
+void initIndirect(IndirectModel &indirect, const Model &model);
+void destroyIndirect(IndirectModel &indirect);
+void cullIndirect(IndirectModel &indirect, unsigned int cullProgram, const glm::mat4 &mvp);
+void drawIndirect(IndirectModel &indirect, Model &model, unsigned int &shader);
+// reads the cull results back and compares them with the same test on the
+// CPU, returns the number of meshes the two disagree on. Stalls the pipeline.
+unsigned int validateIndirect(IndirectModel &indirect, const glm::mat4 &mvp, unsigned int &gpuVisible, unsigned int &cpuVisible);
+
+#endif
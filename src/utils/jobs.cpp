@@ -0,0 +1,377 @@
+#include "jobs.h"
+
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace jobs
+{
+	// both must be powers of two. A pool slot is reused only once its job
+	// and its children are done; a worker with MAX_JOBS jobs alive runs
+	// queued jobs in create() until one finishes, which also bounds its deque.
+	const unsigned int MAX_JOBS = 4096;
+	const unsigned int MASK = MAX_JOBS - 1;
+
+	// Chase-Lev deque, see "Correct and Efficient Work-Stealing for Weak
+	// Memory Models" (Le et al., 2013)
+	struct Deque
+	{
+		std::atomic<long long> top;
+		std::atomic<long long> bottom;
+		std::atomic<Job*> buffer[MAX_JOBS];
+	};
+
+	struct Worker
+	{
+		Deque deque;
+		Job pool[MAX_JOBS];
+		unsigned int allocated;
+		unsigned int random;
+		std::atomic<unsigned long long> executed;
+		std::atomic<unsigned long long> stolen;
+	};
+
+	static std::vector<Worker*> workers;
+	static std::vector<std::thread> threads;
+	static std::atomic<bool> running(false);
+
+	// count of queued jobs, lets idle workers sleep instead of spinning
+	static std::atomic<int> pending(0);
+	static std::atomic<int> sleeping(0);
+	static std::mutex sleepMutex;
+	static std::condition_variable wakeUp;
+
+	static thread_local unsigned int workerIndex = 0;
+	static thread_local bool inPool = false;
+
+	static void push(Deque &deque, Job* job)
+	{
+		long long b = deque.bottom.load(std::memory_order_relaxed);
+		deque.buffer[b & MASK].store(job, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		deque.bottom.store(b + 1, std::memory_order_relaxed);
+	}
+
+	static Job* pop(Deque &deque)
+	{
+		long long b = deque.bottom.load(std::memory_order_relaxed) - 1;
+		deque.bottom.store(b, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		long long t = deque.top.load(std::memory_order_relaxed);
+
+		if (t > b)
+		{
+			deque.bottom.store(b + 1, std::memory_order_relaxed);
+			return NULL;
+		}
+
+		Job* job = deque.buffer[b & MASK].load(std::memory_order_relaxed);
+		if (t == b)
+		{
+			// last job in the deque, race against stealers for it
+			if (!deque.top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+				job = NULL;
+			deque.bottom.store(b + 1, std::memory_order_relaxed);
+		}
+
+		return job;
+	}
+
+	static Job* steal(Deque &deque)
+	{
+		long long t = deque.top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		long long b = deque.bottom.load(std::memory_order_acquire);
+
+		if (t >= b)
+			return NULL;
+
+		Job* job = deque.buffer[t & MASK].load(std::memory_order_relaxed);
+		if (!deque.top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			return NULL;
+
+		return job;
+	}
+
+	static Job* getJob()
+	{
+		Worker* self = workers[workerIndex];
+		Job* job = pop(self->deque);
+		if (job == NULL && workers.size() > 1)
+		{
+			// xorshift, one random victim per attempt
+			self->random ^= self->random << 13;
+			self->random ^= self->random >> 17;
+			self->random ^= self->random << 5;
+			unsigned int victim = self->random % workers.size();
+			if (victim != workerIndex)
+			{
+				job = steal(workers[victim]->deque);
+				if (job != NULL)
+					self->stolen.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+
+		if (job != NULL)
+			pending.fetch_sub(1);
+
+		return job;
+	}
+
+	static void finish(Job* job)
+	{
+		// the owner may reuse the slot as soon as the count reaches zero
+		Job* parent = job->parent;
+		if (job->unfinished.fetch_sub(1) == 1 && parent != NULL)
+			finish(parent);
+	}
+
+	static void execute(Job* job)
+	{
+		job->function(job, job->data);
+		finish(job);
+		workers[workerIndex]->executed.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	static void workerLoop(unsigned int index)
+	{
+		workerIndex = index;
+		inPool = true;
+		while (running.load())
+		{
+			Job* job = getJob();
+			if (job != NULL)
+			{
+				execute(job);
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(sleepMutex);
+			sleeping.fetch_add(1);
+			wakeUp.wait(lock, [] { return pending.load() > 0 || !running.load(); });
+			sleeping.fetch_sub(1);
+		}
+	}
+
+	void init(unsigned int count)
+	{
+		if (count == 0)
+			count = std::thread::hardware_concurrency();
+		if (count == 0)
+			count = 1;
+
+		workers.resize(count);
+		for (unsigned int i = 0; i < count; ++i)
+		{
+			Worker* worker = new Worker;
+			worker->deque.top.store(0);
+			worker->deque.bottom.store(0);
+			worker->allocated = 0;
+			for (unsigned int j = 0; j < MAX_JOBS; ++j)
+				worker->pool[j].unfinished.store(0);
+			worker->random = 2463534242u + i * 7919u;
+			worker->executed.store(0);
+			worker->stolen.store(0);
+			workers[i] = worker;
+		}
+
+		workerIndex = 0;
+		inPool = true;
+		running.store(true);
+		for (unsigned int i = 1; i < count; ++i)
+		{
+			threads.push_back(std::thread(workerLoop, i));
+		}
+	}
+
+	void shutdown()
+	{
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			running.store(false);
+		}
+		wakeUp.notify_all();
+
+		for (unsigned int i = 0; i < threads.size(); ++i)
+		{
+			threads[i].join();
+		}
+		threads.clear();
+
+		for (unsigned int i = 0; i < workers.size(); ++i)
+		{
+			delete workers[i];
+		}
+		workers.clear();
+	}
+
+	ScopedPool::ScopedPool(unsigned int workers)
+	{
+		init(workers);
+	}
+
+	ScopedPool::~ScopedPool()
+	{
+		shutdown();
+	}
+
+	unsigned int workerCount()
+	{
+		return workers.size();
+	}
+
+	bool onWorker()
+	{
+		return inPool;
+	}
+
+	Stats stats()
+	{
+		Stats s;
+		s.workers = workers.size();
+		s.executed = 0;
+		s.stolen = 0;
+		for (unsigned int i = 0; i < workers.size(); ++i)
+		{
+			s.executed += workers[i]->executed.load(std::memory_order_relaxed);
+			s.stolen += workers[i]->stolen.load(std::memory_order_relaxed);
+		}
+
+		return s;
+	}
+
+	Job* create(JobFunction function)
+	{
+		return create(function, NULL, 0);
+	}
+
+	Job* create(JobFunction function, const void* data, size_t size)
+	{
+		Worker* self = workers[workerIndex];
+		Job* job = NULL;
+		for (;;)
+		{
+			for (unsigned int i = 0; i < MAX_JOBS && job == NULL; ++i)
+			{
+				Job* slot = &(self->pool[self->allocated++ & MASK]);
+				if (finished(slot))
+					job = slot;
+			}
+			if (job != NULL)
+				break;
+
+			// every slot is alive, help until one finishes
+			Job* next = getJob();
+			if (next != NULL)
+				execute(next);
+			else
+				std::this_thread::yield();
+		}
+		job->function = function;
+		job->parent = NULL;
+		job->unfinished.store(1);
+		if (size > 0)
+			std::memcpy(job->data, data, size);
+
+		return job;
+	}
+
+	Job* createChild(Job* parent, JobFunction function)
+	{
+		return createChild(parent, function, NULL, 0);
+	}
+
+	Job* createChild(Job* parent, JobFunction function, const void* data, size_t size)
+	{
+		parent->unfinished.fetch_add(1);
+		Job* job = create(function, data, size);
+		job->parent = parent;
+
+		return job;
+	}
+
+	void run(Job* job)
+	{
+		push(workers[workerIndex]->deque, job);
+		pending.fetch_add(1);
+		if (sleeping.load() > 0)
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			wakeUp.notify_one();
+		}
+	}
+
+	bool finished(const Job* job)
+	{
+		return job->unfinished.load() == 0;
+	}
+
+	void wait(const Job* job)
+	{
+		while (!finished(job))
+		{
+			Job* next = getJob();
+			if (next != NULL)
+				execute(next);
+			else
+				std::this_thread::yield();
+		}
+	}
+
+	struct RangeData
+	{
+		unsigned int first;
+		unsigned int last;
+		unsigned int grain;
+		RangeFunction function;
+		void* context;
+	};
+
+	// splits the range in halves until it is small enough,
+	// so idle workers always find large chunks to steal
+	static void rangeJob(Job* job, const void* data)
+	{
+		const RangeData* range = (const RangeData*)data;
+		unsigned int count = range->last - range->first;
+		if (count <= range->grain)
+		{
+			range->function(range->first, range->last, range->context);
+			return;
+		}
+
+		RangeData left = *range;
+		RangeData right = *range;
+		left.last = range->first + count / 2;
+		right.first = left.last;
+		run(createChild(job, rangeJob, left));
+		run(createChild(job, rangeJob, right));
+	}
+
+	void parallelFor(unsigned int count, unsigned int grain, RangeFunction function, void* context)
+	{
+		if (count == 0)
+			return;
+		if (grain == 0)
+			grain = 1;
+
+		if (workers.size() <= 1 || count <= grain || !inPool)
+		{
+			function(0, count, context);
+			return;
+		}
+
+		RangeData range;
+		range.first = 0;
+		range.last = count;
+		range.grain = grain;
+		range.function = function;
+		range.context = context;
+
+		Job* root = create(rangeJob, range);
+		run(root);
+		wait(root);
+	}
+}
@@ -0,0 +1,83 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <atomic>
+#include <cstddef>
+
+// Work-stealing job system.
+//
+// Every worker (the main thread is worker 0) owns a lock-free deque: the owner
+// pushes and pops at the bottom, idle workers steal from the top. A job may be
+// created as a child of another job; waiting on the parent then waits for the
+// whole subtree. Job data is copied into the job itself, so spawning never
+// touches the heap.
+//
+// Threads outside the pool (loader threads) must not create or run jobs;
+// parallelFor called from them runs the whole range inline.
+namespace jobs
+{
+	struct Job;
+	typedef void (*JobFunction)(Job*, const void* data);
+
+	const unsigned int JOB_DATA_SIZE = 64 - sizeof(JobFunction) - sizeof(Job*) - sizeof(std::atomic<int>);
+
+	struct Job
+	{
+		JobFunction function;
+		Job* parent;
+		std::atomic<int> unfinished;
+		char data[JOB_DATA_SIZE];
+	};
+
+	struct Stats
+	{
+		unsigned int workers;
+		unsigned long long executed;
+		unsigned long long stolen;
+	};
+
+	// workers == 0 picks one worker per hardware thread
+	void init(unsigned int workers = 0);
+	void shutdown();
+	// init until the scope ends, so no return leaves joinable workers behind
+	struct ScopedPool
+	{
+		ScopedPool(unsigned int workers = 0);
+		~ScopedPool();
+	};
+	unsigned int workerCount();
+	// true on the pool's threads, the thread that called init included
+	bool onWorker();
+	Stats stats();
+
+	Job* create(JobFunction function);
+	Job* create(JobFunction function, const void* data, size_t size);
+	Job* createChild(Job* parent, JobFunction function);
+	Job* createChild(Job* parent, JobFunction function, const void* data, size_t size);
+
+	void run(Job* job);
+	// executes other jobs while waiting, so it is safe to call from inside a job
+	void wait(const Job* job);
+	bool finished(const Job* job);
+
+	template<typename T>
+	Job* create(JobFunction function, const T& data)
+	{
+		static_assert(sizeof(T) <= JOB_DATA_SIZE, "job data does not fit into the job");
+		return create(function, &data, sizeof(T));
+	}
+
+	template<typename T>
+	Job* createChild(Job* parent, JobFunction function, const T& data)
+	{
+		static_assert(sizeof(T) <= JOB_DATA_SIZE, "job data does not fit into the job");
+		return createChild(parent, function, &data, sizeof(T));
+	}
+
+	// Calls function(first, last, context) over [0, count) split into ranges of
+	// at most `grain` elements, spread over all workers. Blocks until done.
+	typedef void (*RangeFunction)(unsigned int first, unsigned int last, void* context);
+	void parallelFor(unsigned int count, unsigned int grain, RangeFunction function, void* context);
+}
+
+#endif
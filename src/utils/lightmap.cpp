@@ -0,0 +1,692 @@
+#include <glad/glad.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "lightmap.h"
+#include "model.h"
+#include "bvh.h"
+#include "jobs.h"
+#include "png.h"
+#include "texture.h"
+#include "memory.h"
+
+// empty texels around every chart, filled by dilation so bilinear filtering
+// never reads the unlit background
+static const int LIGHTMAP_PADDING = 2;
+// share of the atlas the first packing attempt aims for
+static const float LIGHTMAP_FILL = 0.7f;
+// the texel density shrinks by this much until the charts fit
+static const float LIGHTMAP_SHRINK = 0.9f;
+static const unsigned int LIGHTMAP_ROW_GRAIN = 4;
+static const char LIGHTMAP_MAGIC[4] = { 'L', 'M', 'A', 'P' };
+static const unsigned int LIGHTMAP_VERSION = 1;
+
+static double elapsedMs(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+LightmapSettings defaultLightmapSettings()
+{
+	LightmapSettings settings;
+	settings.size = 1024;
+	// the default directionalLightDir of main.cpp
+	settings.sunDirection = glm::vec3(-0.2f, -1.0f, -0.3f);
+	settings.sunColor = glm::vec3(0.8f);
+	settings.sunSamples = 4;
+	settings.sunRadius = 1.0f;
+	settings.aoSamples = 64;
+	settings.aoDistance = 0.0f;
+	return settings;
+}
+
+// ---- charts ----
+
+// axes 0 to 5 are +x, -x, +y, -y, +z, -z
+struct Chart
+{
+	unsigned int mesh, axis;
+	glm::vec2 boundsMin, boundsMax;
+	int x, y, width, height;
+};
+
+static unsigned int majorAxis(glm::vec3 normal)
+{
+	float x = std::fabs(normal.x), y = std::fabs(normal.y), z = std::fabs(normal.z);
+	if (x >= y && x >= z)
+		return normal.x >= 0.0f ? 0 : 1;
+	if (y >= z)
+		return normal.y >= 0.0f ? 2 : 3;
+	return normal.z >= 0.0f ? 4 : 5;
+}
+
+// position on the plane seen along the axis
+static glm::vec2 project(glm::vec3 position, unsigned int axis)
+{
+	if (axis < 2)
+		return glm::vec2(position.z, position.y);
+	if (axis < 4)
+		return glm::vec2(position.x, position.z);
+	return glm::vec2(position.x, position.y);
+}
+
+static unsigned int findRoot(std::vector<unsigned int> &parents, unsigned int i)
+{
+	while (parents[i] != i)
+	{
+		parents[i] = parents[parents[i]];
+		i = parents[i];
+	}
+	return i;
+}
+
+struct TallerChart
+{
+	const std::vector<Chart>* charts;
+	bool operator()(unsigned int a, unsigned int b) const
+	{
+		return (*charts)[a].height > (*charts)[b].height;
+	}
+};
+
+// shelves of charts sorted by height, false when they overflow the atlas
+static bool packCharts(std::vector<Chart> &charts, int size, float density)
+{
+	std::vector<unsigned int> order(charts.size());
+	for (unsigned int i = 0; i < charts.size(); ++i)
+	{
+		Chart &chart = charts[i];
+		glm::vec2 extent = chart.boundsMax - chart.boundsMin;
+		// one more texel than the extent covers both ends of it
+		chart.width = (int)std::ceil(extent.x * density) + 1 + 2 * LIGHTMAP_PADDING;
+		chart.height = (int)std::ceil(extent.y * density) + 1 + 2 * LIGHTMAP_PADDING;
+		order[i] = i;
+	}
+	TallerChart taller = { &charts };
+	std::sort(order.begin(), order.end(), taller);
+
+	int x = 0, y = 0, shelfHeight = 0;
+	for (unsigned int i = 0; i < order.size(); ++i)
+	{
+		Chart &chart = charts[order[i]];
+		if (chart.width > size)
+			return false;
+		if (x + chart.width > size)
+		{
+			x = 0;
+			y += shelfHeight;
+			shelfHeight = 0;
+		}
+		if (y + chart.height > size)
+			return false;
+		chart.x = x;
+		chart.y = y;
+		x += chart.width;
+		shelfHeight = std::max(shelfHeight, chart.height);
+	}
+	return true;
+}
+
+bool buildLightmapLayout(LightmapLayout &layout, const Model &model, int size)
+{
+	layout.width = size;
+	layout.height = size;
+	layout.meshes.assign(model.meshes.size(), LightmapMesh());
+
+	// Triangles facing the same major axis and sharing a vertex end up in
+	// one chart, so a vertex is in at most one chart per axis and (vertex,
+	// axis) names its lightmap vertex.
+	std::vector<Chart> charts;
+	std::vector<std::vector<unsigned int> > triangleCharts(model.meshes.size());
+	for (unsigned int m = 0; m < model.meshes.size(); ++m)
+	{
+		const Mesh &mesh = model.meshes[m];
+		if (mesh.vertices.empty() && mesh.indexCount)
+		{
+			printf("Error: mesh %u has no CPU-side data to chart\n", m);
+			return false;
+		}
+
+		unsigned int triangleCount = mesh.indices.size() / 3;
+		std::vector<unsigned int> axes(triangleCount), parents(triangleCount);
+		std::vector<unsigned int> firstTriangle(mesh.vertices.size() * 6, ~0u);
+		for (unsigned int t = 0; t < triangleCount; ++t)
+		{
+			const unsigned int* corners = &mesh.indices[t * 3];
+			glm::vec3 a = mesh.vertices[corners[0]].position;
+			glm::vec3 normal = glm::cross(mesh.vertices[corners[1]].position - a, mesh.vertices[corners[2]].position - a);
+			axes[t] = majorAxis(normal);
+			parents[t] = t;
+			for (unsigned int k = 0; k < 3; ++k)
+			{
+				unsigned int &first = firstTriangle[corners[k] * 6 + axes[t]];
+				if (first == ~0u)
+					first = t;
+				else
+					parents[findRoot(parents, t)] = findRoot(parents, first);
+			}
+		}
+
+		std::vector<unsigned int> &chartOf = triangleCharts[m];
+		std::vector<unsigned int> rootCharts(triangleCount, ~0u);
+		chartOf.resize(triangleCount);
+		for (unsigned int t = 0; t < triangleCount; ++t)
+		{
+			unsigned int root = findRoot(parents, t);
+			if (rootCharts[root] == ~0u)
+			{
+				rootCharts[root] = charts.size();
+				Chart chart;
+				chart.mesh = m;
+				chart.axis = axes[t];
+				chart.boundsMin = glm::vec2(1e30f);
+				chart.boundsMax = glm::vec2(-1e30f);
+				charts.push_back(chart);
+			}
+			chartOf[t] = rootCharts[root];
+
+			Chart &chart = charts[chartOf[t]];
+			for (unsigned int k = 0; k < 3; ++k)
+			{
+				glm::vec2 point = project(mesh.vertices[mesh.indices[t * 3 + k]].position, chart.axis);
+				chart.boundsMin = glm::min(chart.boundsMin, point);
+				chart.boundsMax = glm::max(chart.boundsMax, point);
+			}
+		}
+	}
+
+	double area = 0.0;
+	float largest = 0.0f;
+	for (unsigned int i = 0; i < charts.size(); ++i)
+	{
+		glm::vec2 extent = charts[i].boundsMax - charts[i].boundsMin;
+		area += (double)extent.x * extent.y;
+		largest = std::max(largest, std::max(extent.x, extent.y));
+	}
+	float density = area > 0.0 ? (float)std::sqrt(LIGHTMAP_FILL * size * size / area) : (float)size;
+	while (!packCharts(charts, size, density))
+	{
+		// every chart is down to its padding, a smaller density won't help
+		if (largest * density < 1.0f)
+		{
+			printf("Error: %u charts do not fit a %dx%d lightmap\n", (unsigned int)charts.size(), size, size);
+			return false;
+		}
+		density *= LIGHTMAP_SHRINK;
+	}
+	layout.charts = charts.size();
+	layout.texelsPerUnit = density;
+
+	for (unsigned int m = 0; m < model.meshes.size(); ++m)
+	{
+		const Mesh &mesh = model.meshes[m];
+		LightmapMesh &out = layout.meshes[m];
+		out.sourceVertexCount = mesh.vertices.size();
+		out.indices.resize(mesh.indices.size());
+		std::vector<unsigned int> splits(mesh.vertices.size() * 6, ~0u);
+		for (unsigned int i = 0; i < mesh.indices.size(); ++i)
+		{
+			const Chart &chart = charts[triangleCharts[m][i / 3]];
+			unsigned int vertex = mesh.indices[i];
+			unsigned int &split = splits[vertex * 6 + chart.axis];
+			if (split == ~0u)
+			{
+				split = out.remap.size();
+				glm::vec2 origin((float)(chart.x + LIGHTMAP_PADDING) + 0.5f, (float)(chart.y + LIGHTMAP_PADDING) + 0.5f);
+				glm::vec2 texel = origin + (project(mesh.vertices[vertex].position, chart.axis) - chart.boundsMin) * density;
+				out.remap.push_back(vertex);
+				out.coords.push_back(texel / (float)size);
+			}
+			out.indices[i] = split;
+		}
+	}
+	return true;
+}
+
+// ---- baking ----
+
+struct LightmapRaster
+{
+	const LightmapLayout* layout;
+	const Model* model;
+	std::vector<glm::vec3> positions, normals;
+	std::vector<unsigned char> covered;
+};
+
+static float edge(glm::vec2 a, glm::vec2 b, glm::vec2 p)
+{
+	return (b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x);
+}
+
+// charts are disjoint, so meshes never write the same texels
+static void rasterizeMeshes(unsigned int first, unsigned int last, void* data)
+{
+	LightmapRaster &raster = *(LightmapRaster*)data;
+	int width = raster.layout->width, height = raster.layout->height;
+	glm::vec2 size((float)width, (float)height);
+	for (unsigned int m = first; m < last; ++m)
+	{
+		const Mesh &mesh = raster.model->meshes[m];
+		const LightmapMesh &lightmapMesh = raster.layout->meshes[m];
+		for (unsigned int i = 0; i + 2 < lightmapMesh.indices.size(); i += 3)
+		{
+			unsigned int corners[3];
+			glm::vec2 points[3];
+			glm::vec2 boundsMin(1e30f), boundsMax(-1e30f);
+			for (unsigned int k = 0; k < 3; ++k)
+			{
+				corners[k] = lightmapMesh.indices[i + k];
+				points[k] = lightmapMesh.coords[corners[k]] * size;
+				boundsMin = glm::min(boundsMin, points[k]);
+				boundsMax = glm::max(boundsMax, points[k]);
+			}
+			float area = edge(points[0], points[1], points[2]);
+			if (std::fabs(area) < 1e-12f)
+				continue;
+
+			const Vertex &a = mesh.vertices[lightmapMesh.remap[corners[0]]];
+			const Vertex &b = mesh.vertices[lightmapMesh.remap[corners[1]]];
+			const Vertex &c = mesh.vertices[lightmapMesh.remap[corners[2]]];
+			int x0 = std::max(0, (int)std::floor(boundsMin.x)), x1 = std::min(width - 1, (int)std::ceil(boundsMax.x));
+			int y0 = std::max(0, (int)std::floor(boundsMin.y)), y1 = std::min(height - 1, (int)std::ceil(boundsMax.y));
+			for (int y = y0; y <= y1; ++y)
+			{
+				for (int x = x0; x <= x1; ++x)
+				{
+					// texel centers, a little slack keeps shared edges closed
+					glm::vec2 center((float)x + 0.5f, (float)y + 0.5f);
+					float w0 = edge(points[1], points[2], center) / area;
+					float w1 = edge(points[2], points[0], center) / area;
+					float w2 = 1.0f - w0 - w1;
+					if (w0 < -1e-4f || w1 < -1e-4f || w2 < -1e-4f)
+						continue;
+					unsigned int texel = y * width + x;
+					raster.positions[texel] = a.position * w0 + b.position * w1 + c.position * w2;
+					raster.normals[texel] = a.normal * w0 + b.normal * w1 + c.normal * w2;
+					raster.covered[texel] = 1;
+				}
+			}
+		}
+	}
+}
+
+struct LightmapBake
+{
+	const LightmapRaster* raster;
+	const SceneBvh* bvh;
+	LightmapSettings settings;
+	// toward the sun and the plane of its disk
+	glm::vec3 toSun, sunTangent, sunBitangent;
+	float sunSpread;
+	float bias, aoDistance;
+	unsigned char* pixels;
+	std::atomic<unsigned long long> rays;
+};
+
+// seeded per texel, so a bake does not depend on the worker count
+static unsigned int hashTexel(unsigned int x, unsigned int y)
+{
+	unsigned int h = x * 0x8da6b343u ^ y * 0xd8163841u;
+	h ^= h >> 16;
+	h *= 0x7feb352du;
+	h ^= h >> 15;
+	return h | 1;
+}
+
+static float nextRandom(unsigned int &state)
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return (state >> 8) * (1.0f / 16777216.0f);
+}
+
+// any two directions perpendicular to the unit normal and each other
+static void tangentFrame(glm::vec3 normal, glm::vec3 &tangent, glm::vec3 &bitangent)
+{
+	float sign = normal.z >= 0.0f ? 1.0f : -1.0f;
+	float a = -1.0f / (sign + normal.z);
+	float b = normal.x * normal.y * a;
+	tangent = glm::vec3(1.0f + sign * normal.x * normal.x * a, sign * b, -sign * normal.x);
+	bitangent = glm::vec3(b, sign + normal.y * normal.y * a, -normal.y);
+}
+
+static glm::vec2 diskSample(unsigned int &state)
+{
+	float radius = std::sqrt(nextRandom(state));
+	float angle = 6.2831853f * nextRandom(state);
+	return glm::vec2(radius * std::cos(angle), radius * std::sin(angle));
+}
+
+static unsigned char toByte(float value)
+{
+	return (unsigned char)(std::min(std::max(value, 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+
+static void bakeRows(unsigned int first, unsigned int last, void* data)
+{
+	LightmapBake &bake = *(LightmapBake*)data;
+	const LightmapRaster &raster = *bake.raster;
+	const LightmapSettings &settings = bake.settings;
+	unsigned int width = raster.layout->width;
+	unsigned long long rays = 0;
+	for (unsigned int y = first; y < last; ++y)
+	{
+		for (unsigned int x = 0; x < width; ++x)
+		{
+			unsigned int texel = y * width + x;
+			if (!raster.covered[texel])
+				continue;
+
+			glm::vec3 normal = raster.normals[texel];
+			float length = glm::length(normal);
+			if (length == 0.0f)
+				continue;
+			normal /= length;
+
+			Ray ray;
+			ray.origin = raster.positions[texel] + normal * bake.bias;
+			ray.tMin = 0.0f;
+			unsigned int state = hashTexel(x, y);
+
+			float sun = 0.0f;
+			float facing = glm::dot(normal, bake.toSun);
+			if (facing > 0.0f)
+			{
+				ray.tMax = 1e30f;
+				unsigned int lit = 0;
+				for (unsigned int s = 0; s < settings.sunSamples; ++s)
+				{
+					glm::vec2 disk = diskSample(state) * bake.sunSpread;
+					ray.direction = bake.toSun + bake.sunTangent * disk.x + bake.sunBitangent * disk.y;
+					lit += !occludedScene(*bake.bvh, ray);
+				}
+				rays += settings.sunSamples;
+				sun = facing * lit / settings.sunSamples;
+			}
+
+			// cosine weighted, so the open fraction is the occlusion term
+			glm::vec3 tangent, bitangent;
+			tangentFrame(normal, tangent, bitangent);
+			ray.tMax = bake.aoDistance;
+			unsigned int open = 0;
+			for (unsigned int s = 0; s < settings.aoSamples; ++s)
+			{
+				glm::vec2 disk = diskSample(state);
+				float up = std::sqrt(std::max(0.0f, 1.0f - disk.x * disk.x - disk.y * disk.y));
+				ray.direction = tangent * disk.x + bitangent * disk.y + normal * up;
+				open += !occludedScene(*bake.bvh, ray);
+			}
+			rays += settings.aoSamples;
+			float ao = settings.aoSamples ? (float)open / settings.aoSamples : 1.0f;
+
+			unsigned char* pixel = bake.pixels + texel * 4;
+			pixel[0] = toByte(settings.sunColor.x * sun);
+			pixel[1] = toByte(settings.sunColor.y * sun);
+			pixel[2] = toByte(settings.sunColor.z * sun);
+			pixel[3] = toByte(ao);
+		}
+	}
+	bake.rays += rays;
+}
+
+// grows the charts into their padding with the mean of the covered neighbors
+static void dilate(std::vector<unsigned char> &pixels, std::vector<unsigned char> &covered, int width, int height, int passes)
+{
+	std::vector<unsigned char> next;
+	for (int pass = 0; pass < passes; ++pass)
+	{
+		next = covered;
+		for (int y = 0; y < height; ++y)
+		{
+			for (int x = 0; x < width; ++x)
+			{
+				if (covered[y * width + x])
+					continue;
+				unsigned int sum[4] = { 0, 0, 0, 0 }, count = 0;
+				for (int dy = -1; dy <= 1; ++dy)
+				{
+					for (int dx = -1; dx <= 1; ++dx)
+					{
+						int nx = x + dx, ny = y + dy;
+						if (nx < 0 || ny < 0 || nx >= width || ny >= height || !covered[ny * width + nx])
+							continue;
+						for (int c = 0; c < 4; ++c)
+							sum[c] += pixels[(ny * width + nx) * 4 + c];
+						count++;
+					}
+				}
+				if (count == 0)
+					continue;
+				for (int c = 0; c < 4; ++c)
+					pixels[(y * width + x) * 4 + c] = (unsigned char)((sum[c] + count / 2) / count);
+				next[y * width + x] = 1;
+			}
+		}
+		covered.swap(next);
+	}
+}
+
+LightmapStats bakeLightmap(const LightmapLayout &layout, const Model &model, const SceneBvh &bvh, const LightmapSettings &settings, std::vector<unsigned char> &pixels)
+{
+	LightmapStats stats;
+	unsigned int texelCount = layout.width * layout.height;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	LightmapRaster raster;
+	raster.layout = &layout;
+	raster.model = &model;
+	raster.positions.resize(texelCount);
+	raster.normals.resize(texelCount);
+	raster.covered.assign(texelCount, 0);
+	jobs::parallelFor(layout.meshes.size(), 1, rasterizeMeshes, &raster);
+	stats.rasterMs = elapsedMs(start);
+	stats.texels = std::count(raster.covered.begin(), raster.covered.end(), (unsigned char)1);
+
+	glm::vec3 boundsMin, boundsMax;
+	modelBounds(model, boundsMin, boundsMax);
+	float diagonal = glm::length(boundsMax - boundsMin);
+
+	LightmapBake bake;
+	bake.raster = &raster;
+	bake.bvh = &bvh;
+	bake.settings = settings;
+	bake.toSun = -glm::normalize(settings.sunDirection);
+	tangentFrame(bake.toSun, bake.sunTangent, bake.sunBitangent);
+	bake.sunSpread = std::tan(glm::radians(settings.sunRadius));
+	bake.bias = diagonal * 1e-4f;
+	bake.aoDistance = settings.aoDistance > 0.0f ? settings.aoDistance : diagonal * 0.1f;
+	bake.rays = 0;
+	// unlit background
+	pixels.assign(texelCount * 4, 0);
+	bake.pixels = pixels.data();
+
+	start = std::chrono::steady_clock::now();
+	jobs::parallelFor(layout.height, LIGHTMAP_ROW_GRAIN, bakeRows, &bake);
+	stats.bakeMs = elapsedMs(start);
+	stats.rays = bake.rays;
+	stats.rate = stats.bakeMs > 0.0 ? stats.rays / (stats.bakeMs * 1000.0) : 0.0;
+
+	dilate(pixels, raster.covered, layout.width, layout.height, LIGHTMAP_PADDING);
+	return stats;
+}
+
+// ---- files ----
+
+template<typename T>
+static bool writeArray(FILE* file, const std::vector<T> &values)
+{
+	unsigned int count = values.size();
+	return fwrite(&count, sizeof(count), 1, file) == 1 && (count == 0 || fwrite(values.data(), sizeof(T), count, file) == count);
+}
+
+template<typename T>
+static bool readArray(FILE* file, std::vector<T> &values)
+{
+	unsigned int count;
+	if (fread(&count, sizeof(count), 1, file) != 1)
+		return false;
+	values.resize(count);
+	return count == 0 || fread(values.data(), sizeof(T), count, file) == count;
+}
+
+bool writeLightmap(const char* path, const LightmapLayout &layout, const std::vector<unsigned char> &pixels)
+{
+	// PNG rows go top to bottom
+	std::vector<unsigned char> rows(pixels.size());
+	size_t stride = layout.width * 4;
+	for (int y = 0; y < layout.height; ++y)
+		memcpy(&rows[y * stride], &pixels[(layout.height - 1 - y) * stride], stride);
+	std::string pngPath = std::string(path) + ".png";
+	if (!writePng(pngPath.c_str(), rows.data(), layout.width, layout.height, 4))
+	{
+		printf("Error: could not write %s\n", pngPath.c_str());
+		return false;
+	}
+
+	std::string binPath = std::string(path) + ".bin";
+	FILE* file = fopen(binPath.c_str(), "wb");
+	if (file == NULL)
+	{
+		printf("Error: could not write %s\n", binPath.c_str());
+		return false;
+	}
+	unsigned int header[4] = { LIGHTMAP_VERSION, (unsigned int)layout.width, (unsigned int)layout.height, (unsigned int)layout.meshes.size() };
+	bool written = fwrite(LIGHTMAP_MAGIC, 1, 4, file) == 4 && fwrite(header, sizeof(header), 1, file) == 1;
+	for (unsigned int i = 0; written && i < layout.meshes.size(); ++i)
+	{
+		const LightmapMesh &mesh = layout.meshes[i];
+		written = fwrite(&mesh.sourceVertexCount, sizeof(unsigned int), 1, file) == 1
+			&& writeArray(file, mesh.remap) && writeArray(file, mesh.coords) && writeArray(file, mesh.indices);
+	}
+	fclose(file);
+	if (!written)
+		printf("Error: could not write %s\n", binPath.c_str());
+	return written;
+}
+
+bool readLightmapLayout(const char* path, LightmapLayout &layout)
+{
+	std::string binPath = std::string(path) + ".bin";
+	FILE* file = fopen(binPath.c_str(), "rb");
+	if (file == NULL)
+	{
+		printf("Error: could not open %s\n", binPath.c_str());
+		return false;
+	}
+	char magic[4];
+	unsigned int header[4];
+	bool read = fread(magic, 1, 4, file) == 4 && memcmp(magic, LIGHTMAP_MAGIC, 4) == 0
+		&& fread(header, sizeof(header), 1, file) == 1 && header[0] == LIGHTMAP_VERSION;
+	if (read)
+	{
+		layout.width = header[1];
+		layout.height = header[2];
+		layout.meshes.resize(header[3]);
+		layout.charts = 0;
+		layout.texelsPerUnit = 0.0f;
+	}
+	for (unsigned int i = 0; read && i < layout.meshes.size(); ++i)
+	{
+		LightmapMesh &mesh = layout.meshes[i];
+		read = fread(&mesh.sourceVertexCount, sizeof(unsigned int), 1, file) == 1
+			&& readArray(file, mesh.remap) && readArray(file, mesh.coords) && readArray(file, mesh.indices)
+			&& mesh.remap.size() == mesh.coords.size();
+	}
+	fclose(file);
+	if (!read)
+		printf("Error: %s is not a lightmap layout\n", binPath.c_str());
+	return read;
+}
+
+// ---- runtime ----
+
+bool applyLightmap(Model &model, const char* path)
+{
+	if (model.cpuDataReleased)
+	{
+		printf("Error: %s dropped its CPU-side mesh data, a lightmap can only be applied before\n", model.name.c_str());
+		return false;
+	}
+	LightmapLayout layout;
+	if (!readLightmapLayout(path, layout))
+		return false;
+	bool matches = layout.meshes.size() == model.meshes.size();
+	for (unsigned int i = 0; matches && i < model.meshes.size(); ++i)
+	{
+		const Mesh &mesh = model.meshes[i];
+		const LightmapMesh &lightmapMesh = layout.meshes[i];
+		matches = mesh.skinVbo == 0 && lightmapMesh.sourceVertexCount == mesh.vertices.size() && lightmapMesh.indices.size() == mesh.indices.size();
+		for (unsigned int j = 0; matches && j < lightmapMesh.remap.size(); ++j)
+			matches = lightmapMesh.remap[j] < mesh.vertices.size();
+		for (unsigned int j = 0; matches && j < lightmapMesh.indices.size(); ++j)
+			matches = lightmapMesh.indices[j] < lightmapMesh.remap.size();
+	}
+	if (!matches)
+	{
+		printf("Error: %s.bin was not baked for %s, or its meshes are skinned or without CPU-side data\n", path, model.name.c_str());
+		return false;
+	}
+
+	std::string pngPath = std::string(path) + ".png";
+	Image image;
+	if (!texture::loadImage(pngPath.c_str(), true, image) || image.width != layout.width || image.height != layout.height)
+	{
+		printf("Error: could not load %s\n", pngPath.c_str());
+		return false;
+	}
+
+	memory::ScopedOwner owner(model.name);
+	unsigned int vertexCount = 0;
+	for (unsigned int i = 0; i < model.meshes.size(); ++i)
+	{
+		Mesh &mesh = model.meshes[i];
+		const LightmapMesh &lightmapMesh = layout.meshes[i];
+		std::vector<Vertex> vertices(lightmapMesh.remap.size());
+		for (unsigned int j = 0; j < vertices.size(); ++j)
+			vertices[j] = mesh.vertices[lightmapMesh.remap[j]];
+
+		// the triangles keep their order, the hierarchy stays and is only
+		// accounted for again
+		destroyMesh(mesh);
+		mesh.vertices.swap(vertices);
+		mesh.indices = lightmapMesh.indices;
+		setupMesh(mesh);
+		if (!mesh.bvh.triangles.empty())
+			memory::allocate(memory::CPU_MESH, memory::pointerKey(mesh.bvh.triangles.data()), bvhBytes(mesh.bvh));
+
+		glGenBuffers(1, &(mesh.lightmapVbo));
+		glBindVertexArray(mesh.vao);
+		glBindBuffer(GL_ARRAY_BUFFER, mesh.lightmapVbo);
+		glBufferData(GL_ARRAY_BUFFER, lightmapMesh.coords.size() * sizeof(glm::vec2), lightmapMesh.coords.data(), GL_STATIC_DRAW);
+		glEnableVertexAttribArray(6);
+		glVertexAttribPointer(6, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), (void*)0);
+		glBindVertexArray(0);
+		memory::allocate(memory::VERTEX_BUFFER, mesh.lightmapVbo, lightmapMesh.coords.size() * sizeof(glm::vec2));
+		vertexCount += mesh.vertexCount;
+	}
+
+	if (model.lightmap)
+	{
+		memory::release(memory::TEXTURE, model.lightmap);
+		glDeleteTextures(1, &(model.lightmap));
+	}
+	glGenTextures(1, &(model.lightmap));
+	glBindTexture(GL_TEXTURE_2D, model.lightmap);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, image.width, image.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image.pixels.data());
+	// no mips, they would bleed the charts into each other
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	memory::allocate(memory::TEXTURE, model.lightmap, memory::textureBytes(image.width, image.height, 1, 4, false));
+
+	printf("lightmap: %s, %dx%d, %u vertices after chart splits\n", path, image.width, image.height, vertexCount);
+	return true;
+}
@@ -0,0 +1,79 @@
+#ifndef LIGHTMAP_H
+#define LIGHTMAP_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+struct Model;
+struct SceneBvh;
+
+// Baked static lighting. The baker (src/tools/baker.cpp) traces the sun and
+// ambient occlusion into a texture offline, on every core, and the runtime
+// samples it in place of the directional light of
+// phong_combined_fragment.glsl.
+//
+// Lightmap coordinates come from charts: connected triangles facing the same
+// major axis are projected onto that axis' plane and packed into one atlas
+// per model. Vertices on chart borders are split, so the meshes get new
+// vertices; their triangles keep their order, so mesh hierarchies and
+// triangle indices stay valid.
+
+struct LightmapMesh
+{
+	unsigned int sourceVertexCount;
+	// source vertex of every lightmap vertex
+	std::vector<unsigned int> remap;
+	// atlas coordinates in [0, 1]
+	std::vector<glm::vec2> coords;
+	// into the lightmap vertices, in the source triangle order
+	std::vector<unsigned int> indices;
+};
+
+struct LightmapLayout
+{
+	int width, height;
+	std::vector<LightmapMesh> meshes;
+	unsigned int charts;
+	float texelsPerUnit;
+};
+
+struct LightmapSettings
+{
+	int size;
+	// the way the light travels, like the directionalLightDir uniform
+	glm::vec3 sunDirection;
+	glm::vec3 sunColor;
+	// shadow rays per texel, jittered over a disk sunRadius degrees wide
+	unsigned int sunSamples;
+	float sunRadius;
+	unsigned int aoSamples;
+	// object space, 0 for a tenth of the model diagonal
+	float aoDistance;
+};
+
+struct LightmapStats
+{
+	unsigned int texels;
+	unsigned long long rays;
+	double rasterMs, bakeMs;
+	// millions of rays per second
+	double rate;
+};
+
+LightmapSettings defaultLightmapSettings();
+
+// needs the CPU-side mesh data, false when the charts do not fit the size
+bool buildLightmapLayout(LightmapLayout &layout, const Model &model, int size);
+// RGBA8, rows bottom to top: rgb is the sun with shadows, a the ambient
+// occlusion. bvh holds the model placed at the origin.
+LightmapStats bakeLightmap(const LightmapLayout &layout, const Model &model, const SceneBvh &bvh, const LightmapSettings &settings, std::vector<unsigned char> &pixels);
+
+// path.bin holds the layout, path.png the pixels
+bool writeLightmap(const char* path, const LightmapLayout &layout, const std::vector<unsigned char> &pixels);
+bool readLightmapLayout(const char* path, LightmapLayout &layout);
+// Swaps the meshes for their lightmap vertices, adds the coordinates at
+// attribute 6 and uploads the texture. Needs the CPU-side mesh data, the
+// layout must come from the same model file.
+bool applyLightmap(Model &model, const char* path);
+
+#endif
@@ -0,0 +1,37 @@
+#include <glad/glad.h>
+
+#include "lights.h"
+
+static void setVec3(unsigned int shader, const char* name, glm::vec3 value)
+{
+	glUniform3f(glGetUniformLocation(shader, name), value.x, value.y, value.z);
+}
+
+void setLightUniforms(unsigned int shader, const Lights &lights)
+{
+	glUniform1ui(glGetUniformLocation(shader, "material.shininess"), lights.shininess);
+
+	setVec3(shader, "directionalLight.ambient", lights.directional.ambient);
+	setVec3(shader, "directionalLight.diffuse", lights.directional.diffuse);
+	setVec3(shader, "directionalLight.specular", lights.directional.specular);
+	setVec3(shader, "directionalLightDir", lights.directional.direction);
+
+	setVec3(shader, "pointLight.ambient", lights.point.ambient);
+	setVec3(shader, "pointLight.diffuse", lights.point.diffuse);
+	setVec3(shader, "pointLight.specular", lights.point.specular);
+	setVec3(shader, "pointLightPos", lights.point.position);
+	glUniform1f(glGetUniformLocation(shader, "pointLight.constant"), lights.point.constant);
+	glUniform1f(glGetUniformLocation(shader, "pointLight.linear"), lights.point.linear);
+	glUniform1f(glGetUniformLocation(shader, "pointLight.quadratic"), lights.point.quadratic);
+
+	setVec3(shader, "spotLight.ambient", lights.spot.ambient);
+	setVec3(shader, "spotLight.diffuse", lights.spot.diffuse);
+	setVec3(shader, "spotLight.specular", lights.spot.specular);
+	setVec3(shader, "spotLightPos", lights.spot.position);
+	setVec3(shader, "spotLightDir", lights.spot.direction);
+	glUniform1f(glGetUniformLocation(shader, "spotLight.cutoffAngle"), lights.spot.cutoff);
+	glUniform1f(glGetUniformLocation(shader, "spotLight.outerCutoffAngle"), lights.spot.outerCutoff);
+	glUniform1f(glGetUniformLocation(shader, "spotLight.constant"), lights.spot.constant);
+	glUniform1f(glGetUniformLocation(shader, "spotLight.linear"), lights.spot.linear);
+	glUniform1f(glGetUniformLocation(shader, "spotLight.quadratic"), lights.spot.quadratic);
+}
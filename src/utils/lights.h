@@ -0,0 +1,41 @@
+#ifndef LIGHTS_H
+#define LIGHTS_H
+
+#include <glm/glm.hpp>
+
+// The lights of phong_combined_fragment.glsl in world space, for renderers
+// that don't go through its uniforms. Cutoffs are cosines like the uniforms.
+struct DirectionalLight
+{
+	glm::vec3 direction;
+	glm::vec3 ambient, diffuse, specular;
+};
+
+struct PointLight
+{
+	glm::vec3 position;
+	glm::vec3 ambient, diffuse, specular;
+	float constant, linear, quadratic;
+};
+
+struct SpotLight
+{
+	glm::vec3 position, direction;
+	glm::vec3 ambient, diffuse, specular;
+	float cutoff, outerCutoff;
+	float constant, linear, quadratic;
+};
+
+struct Lights
+{
+	DirectionalLight directional;
+	PointLight point;
+	SpotLight spot;
+	unsigned int shininess;
+};
+
+// sets the light and shininess uniforms of a program built from
+// phong_combined_fragment.glsl, the program must be in use
+void setLightUniforms(unsigned int shader, const Lights &lights);
+
+#endif
@@ -0,0 +1,185 @@
+#include "memory.h"
+
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+
+namespace memory
+{
+	struct Allocation
+	{
+		unsigned int owner;
+		size_t bytes;
+	};
+
+	struct State
+	{
+		std::mutex mutex;
+		std::vector<std::string> ownerNames;
+		std::vector<Usage> ownerUsages;
+		Usage total;
+		std::map<std::pair<int, unsigned long long>, Allocation> allocations;
+
+		State()
+		{
+			memset(&total, 0, sizeof(total));
+		}
+	};
+
+	static State &state()
+	{
+		static State instance;
+		return instance;
+	}
+
+	// per thread, so a model loading on a loader thread is not charged for
+	// what the render thread allocates meanwhile
+	static thread_local std::string currentOwner = "unowned";
+
+	static const char* names[CATEGORY_COUNT] = { "vertex buffers", "index buffers", "other buffers", "textures", "CPU mesh copies" };
+
+	const char* categoryName(Category category)
+	{
+		return names[category];
+	}
+
+	static unsigned int ownerIndex(State &s, const std::string &name)
+	{
+		for (unsigned int i = 0; i < s.ownerNames.size(); ++i)
+		{
+			if (s.ownerNames[i] == name)
+				return i;
+		}
+
+		Usage usage;
+		memset(&usage, 0, sizeof(usage));
+		s.ownerNames.push_back(name);
+		s.ownerUsages.push_back(usage);
+		return s.ownerNames.size() - 1;
+	}
+
+	static void add(Usage &usage, Category category, size_t bytes)
+	{
+		usage.current[category] += bytes;
+		usage.currentTotal += bytes;
+		usage.allocations++;
+		if (usage.current[category] > usage.peak[category])
+			usage.peak[category] = usage.current[category];
+		if (usage.currentTotal > usage.peakTotal)
+			usage.peakTotal = usage.currentTotal;
+	}
+
+	static void remove(Usage &usage, Category category, size_t bytes)
+	{
+		usage.current[category] -= bytes;
+		usage.currentTotal -= bytes;
+		usage.allocations--;
+	}
+
+	static void releaseLocked(State &s, Category category, unsigned long long key)
+	{
+		std::map<std::pair<int, unsigned long long>, Allocation>::iterator it = s.allocations.find(std::make_pair((int)category, key));
+		if (it == s.allocations.end())
+			return;
+
+		remove(s.ownerUsages[it->second.owner], category, it->second.bytes);
+		remove(s.total, category, it->second.bytes);
+		s.allocations.erase(it);
+	}
+
+	void allocate(Category category, unsigned long long key, size_t bytes)
+	{
+		State &s = state();
+		std::lock_guard<std::mutex> lock(s.mutex);
+		releaseLocked(s, category, key);
+
+		Allocation allocation;
+		allocation.owner = ownerIndex(s, currentOwner);
+		allocation.bytes = bytes;
+		s.allocations[std::make_pair((int)category, key)] = allocation;
+		add(s.ownerUsages[allocation.owner], category, bytes);
+		add(s.total, category, bytes);
+	}
+
+	void release(Category category, unsigned long long key)
+	{
+		State &s = state();
+		std::lock_guard<std::mutex> lock(s.mutex);
+		releaseLocked(s, category, key);
+	}
+
+	ScopedOwner::ScopedOwner(const std::string &owner)
+	{
+		previous = currentOwner;
+		currentOwner = owner;
+	}
+
+	ScopedOwner::~ScopedOwner()
+	{
+		currentOwner = previous;
+	}
+
+	Usage total()
+	{
+		State &s = state();
+		std::lock_guard<std::mutex> lock(s.mutex);
+		return s.total;
+	}
+
+	void owners(std::vector<std::string> &ownerNames, std::vector<Usage> &usages)
+	{
+		State &s = state();
+		std::lock_guard<std::mutex> lock(s.mutex);
+		ownerNames = s.ownerNames;
+		usages = s.ownerUsages;
+	}
+
+	static void printUsage(FILE* file, const char* name, const Usage &usage)
+	{
+		fprintf(file, "%s: %.2f MB current, %.2f MB peak, %u allocations\n", name, usage.currentTotal / 1048576.0, usage.peakTotal / 1048576.0, usage.allocations);
+		for (int c = 0; c < CATEGORY_COUNT; ++c)
+			fprintf(file, "  %-16s %10.2f MB current %10.2f MB peak\n", names[c], usage.current[c] / 1048576.0, usage.peak[c] / 1048576.0);
+	}
+
+	bool dump(const char* path)
+	{
+		FILE* file = fopen(path, "w");
+		if (file == NULL)
+		{
+			printf("Error: Can't open file '%s'.\n", path);
+			return false;
+		}
+
+		State &s = state();
+		std::lock_guard<std::mutex> lock(s.mutex);
+		printUsage(file, "total", s.total);
+		for (unsigned int i = 0; i < s.ownerNames.size(); ++i)
+			printUsage(file, s.ownerNames[i].c_str(), s.ownerUsages[i]);
+
+		fprintf(file, "\nlive allocations:\n");
+		std::map<std::pair<int, unsigned long long>, Allocation>::const_iterator it;
+		for (it = s.allocations.begin(); it != s.allocations.end(); ++it)
+		{
+			fprintf(file, "%-16s %#18llx %12zu bytes  %s\n", names[it->first.first], it->first.second, it->second.bytes, s.ownerNames[it->second.owner].c_str());
+		}
+
+		fclose(file);
+		printf("memory: dumped to %s\n", path);
+		return true;
+	}
+
+	size_t textureBytes(int width, int height, int layers, int bytesPerTexel, bool mipmapped)
+	{
+		size_t bytes = 0;
+		for (;;)
+		{
+			bytes += (size_t)width * height * layers * bytesPerTexel;
+			if (!mipmapped || (width == 1 && height == 1))
+				break;
+			width = width > 1 ? width / 2 : 1;
+			height = height > 1 ? height / 2 : 1;
+		}
+		return bytes;
+	}
+}
@@ -0,0 +1,60 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <vector>
+#include <string>
+#include <cstddef>
+
+// Accounting of GPU buffers, textures and CPU-side copies. Every allocation
+// is registered with a category, a key (GL name or pointer) and its size and
+// charged to the calling thread's current owner, usually the model path set
+// around its load.
+namespace memory
+{
+	enum Category
+	{
+		VERTEX_BUFFER,
+		INDEX_BUFFER,
+		// storage, indirect and pixel buffers
+		OTHER_BUFFER,
+		TEXTURE,
+		CPU_MESH,
+		CATEGORY_COUNT
+	};
+
+	struct Usage
+	{
+		size_t current[CATEGORY_COUNT];
+		size_t peak[CATEGORY_COUNT];
+		size_t currentTotal, peakTotal;
+		unsigned int allocations;
+	};
+
+	const char* categoryName(Category category);
+
+	// a second allocate with the same key replaces the first
+	void allocate(Category category, unsigned long long key, size_t bytes);
+	void release(Category category, unsigned long long key);
+	inline unsigned long long pointerKey(const void* pointer)
+	{
+		return (unsigned long long)(size_t)pointer;
+	}
+
+	// owner charged for new allocations, restored when the scope ends
+	struct ScopedOwner
+	{
+		std::string previous;
+		ScopedOwner(const std::string &owner);
+		~ScopedOwner();
+	};
+
+	Usage total();
+	void owners(std::vector<std::string> &names, std::vector<Usage> &usages);
+	// per owner and category plus every live allocation
+	bool dump(const char* path);
+
+	// sum of the mip chain of a texture, layers times width times height at level 0
+	size_t textureBytes(int width, int height, int layers, int bytesPerTexel, bool mipmapped);
+}
+
+#endif
@@ -0,0 +1,219 @@
+#include <glad/glad.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "meshlet.h"
+#include "frustum.h"
+#include "jobs.h"
+
+static void finishMeshlet(std::vector<Meshlet> &meshlets, const Vertex* vertices, const unsigned int* indices, unsigned int first, unsigned int last)
+{
+	Meshlet meshlet;
+	meshlet.firstIndex = first;
+	meshlet.indexCount = last - first;
+
+	glm::vec3 boundsMin(1e30f), boundsMax(-1e30f);
+	for (unsigned int i = first; i < last; ++i)
+	{
+		boundsMin = glm::min(boundsMin, vertices[indices[i]].position);
+		boundsMax = glm::max(boundsMax, vertices[indices[i]].position);
+	}
+	meshlet.center = (boundsMin + boundsMax) * 0.5f;
+	meshlet.radius = 0.0f;
+	for (unsigned int i = first; i < last; ++i)
+	{
+		meshlet.radius = std::max(meshlet.radius, glm::length(vertices[indices[i]].position - meshlet.center));
+	}
+
+	// face normals, the vertex normals may be smoothed across the silhouette
+	glm::vec3 normals[MESHLET_MAX_TRIANGLES];
+	unsigned int normalCount = 0;
+	glm::vec3 axis(0.0f);
+	for (unsigned int i = first; i + 2 < last; i += 3)
+	{
+		const glm::vec3 &a = vertices[indices[i]].position;
+		glm::vec3 normal = glm::cross(vertices[indices[i + 1]].position - a, vertices[indices[i + 2]].position - a);
+		float length = glm::length(normal);
+		if (length <= 1e-12f)
+			continue;
+		normals[normalCount] = normal / length;
+		axis += normals[normalCount++];
+	}
+
+	meshlet.coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+	meshlet.coneCutoff = 1.0f;
+	float axisLength = glm::length(axis);
+	if (normalCount > 0 && axisLength > 1e-6f)
+	{
+		axis /= axisLength;
+		float minDot = 1.0f;
+		for (unsigned int i = 0; i < normalCount; ++i)
+		{
+			minDot = std::min(minDot, glm::dot(axis, normals[i]));
+		}
+
+		meshlet.coneAxis = axis;
+		// past roughly 85 degrees the cone is too wide to ever pass the test
+		if (minDot > 0.1f)
+			meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+	}
+
+	meshlets.push_back(meshlet);
+}
+
+void buildMeshlets(std::vector<Meshlet> &meshlets, const Vertex* vertices, unsigned int vertexCount, const unsigned int* indices, unsigned int indexCount)
+{
+	meshlets.clear();
+	if (indexCount < 3)
+		return;
+	meshlets.reserve(indexCount / 3 / (MESHLET_MAX_TRIANGLES / 2) + 1);
+
+	// meshlet number that last used each vertex, so counting is O(1) per index
+	std::vector<unsigned int> marker(vertexCount, 0xffffffff);
+	unsigned int current = 0, first = 0, meshletVertices = 0;
+
+	for (unsigned int i = 0; i + 2 < indexCount; i += 3)
+	{
+		unsigned int a = indices[i], b = indices[i + 1], c = indices[i + 2];
+		unsigned int added = (marker[a] != current) + (marker[b] != current && b != a) + (marker[c] != current && c != a && c != b);
+		if (meshletVertices + added > MESHLET_MAX_VERTICES || (i - first) / 3 + 1 > MESHLET_MAX_TRIANGLES)
+		{
+			finishMeshlet(meshlets, vertices, indices, first, i);
+			current++;
+			first = i;
+			meshletVertices = 0;
+			added = 1 + (b != a) + (c != a && c != b);
+		}
+
+		marker[a] = marker[b] = marker[c] = current;
+		meshletVertices += added;
+	}
+
+	finishMeshlet(meshlets, vertices, indices, first, indexCount - indexCount % 3);
+}
+
+struct CullContext
+{
+	const Model* model;
+	MeshletCuller* culler;
+	Frustum frustum;
+	glm::vec3 camera;
+};
+
+static void cullRange(unsigned int first, unsigned int last, void* data)
+{
+	CullContext &context = *(CullContext*)data;
+	const std::vector<unsigned int> &firstMeshlet = context.culler->firstMeshlet;
+
+	unsigned int mesh = std::upper_bound(firstMeshlet.begin(), firstMeshlet.end(), first) - firstMeshlet.begin() - 1;
+	for (unsigned int i = first; i < last; ++i)
+	{
+		while (i >= firstMeshlet[mesh + 1])
+			mesh++;
+
+		const Meshlet &meshlet = context.model->meshes[mesh].meshlets[i - firstMeshlet[mesh]];
+		unsigned char result = MESHLET_VISIBLE;
+		glm::vec3 toCenter = meshlet.center - context.camera;
+		if (glm::dot(toCenter, meshlet.coneAxis) >= meshlet.coneCutoff * glm::length(toCenter) + meshlet.radius)
+			result = MESHLET_BACKFACING;
+		else if (!sphereInFrustum(context.frustum, meshlet.center, meshlet.radius))
+			result = MESHLET_OFFSCREEN;
+		context.culler->results[i] = result;
+	}
+}
+
+void cullMeshlets(MeshletCuller &culler, const Model &model, const glm::mat4 &mvp, const glm::mat4 &transform, glm::vec3 cameraPosition)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	unsigned int meshCount = model.meshes.size();
+	culler.firstMeshlet.resize(meshCount + 1);
+	culler.firstMeshlet[0] = 0;
+	for (unsigned int i = 0; i < meshCount; ++i)
+	{
+		culler.firstMeshlet[i + 1] = culler.firstMeshlet[i] + model.meshes[i].meshlets.size();
+	}
+	unsigned int total = culler.firstMeshlet[meshCount];
+	culler.results.resize(total);
+
+	// everything in object space, back-facing is kept by affine transforms
+	CullContext context;
+	context.model = &model;
+	context.culler = &culler;
+	extractFrustum(context.frustum, mvp);
+	context.camera = glm::vec3(glm::inverse(transform) * glm::vec4(cameraPosition, 1.0f));
+	jobs::parallelFor(total, 256, cullRange, &context);
+
+	MeshletStats &stats = culler.stats;
+	stats.meshlets = total;
+	stats.backfacing = 0;
+	stats.offscreen = 0;
+	stats.trianglesTotal = 0;
+	stats.trianglesSubmitted = 0;
+
+	culler.counts.clear();
+	culler.offsets.clear();
+	culler.firstDraw.resize(meshCount);
+	culler.drawCount.resize(meshCount);
+	for (unsigned int m = 0; m < meshCount; ++m)
+	{
+		const std::vector<Meshlet> &meshlets = model.meshes[m].meshlets;
+		culler.firstDraw[m] = culler.counts.size();
+
+		unsigned int rangeStart = 0, rangeEnd = 0;
+		for (unsigned int i = 0; i < meshlets.size(); ++i)
+		{
+			const Meshlet &meshlet = meshlets[i];
+			unsigned char result = culler.results[culler.firstMeshlet[m] + i];
+			stats.trianglesTotal += meshlet.indexCount / 3;
+			stats.backfacing += result == MESHLET_BACKFACING;
+			stats.offscreen += result == MESHLET_OFFSCREEN;
+			if (result != MESHLET_VISIBLE)
+				continue;
+
+			stats.trianglesSubmitted += meshlet.indexCount / 3;
+			// neighbours in the index buffer merge into one range
+			if (rangeEnd != rangeStart && rangeEnd == meshlet.firstIndex)
+			{
+				rangeEnd += meshlet.indexCount;
+				continue;
+			}
+			if (rangeEnd != rangeStart)
+			{
+				culler.counts.push_back(rangeEnd - rangeStart);
+				culler.offsets.push_back((const void*)(rangeStart * sizeof(unsigned int)));
+			}
+			rangeStart = meshlet.firstIndex;
+			rangeEnd = meshlet.firstIndex + meshlet.indexCount;
+		}
+		if (rangeEnd != rangeStart)
+		{
+			culler.counts.push_back(rangeEnd - rangeStart);
+			culler.offsets.push_back((const void*)(rangeStart * sizeof(unsigned int)));
+		}
+
+		culler.drawCount[m] = culler.counts.size() - culler.firstDraw[m];
+	}
+
+	stats.cullMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void drawMeshlets(MeshletCuller &culler, Model &model, unsigned int &shader, const std::vector<unsigned char>* meshVisible)
+{
+	glUseProgram(shader);
+	bindMaterials(model, shader);
+	for (unsigned int i = 0; i < model.meshes.size() && i < culler.drawCount.size(); ++i)
+	{
+		if (culler.drawCount[i] == 0 || (meshVisible && !(*meshVisible)[i]))
+			continue;
+
+		Mesh &mesh = model.meshes[i];
+		glVertexAttribI1i(3, mesh.material);
+		glBindVertexArray(mesh.vao);
+		glMultiDrawElements(GL_TRIANGLES, &culler.counts[culler.firstDraw[i]], GL_UNSIGNED_INT, &culler.offsets[culler.firstDraw[i]], culler.drawCount[i]);
+		glBindVertexArray(0);
+
+		renderStats.drawCalls++;
+	}
+}
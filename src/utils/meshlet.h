@@ -0,0 +1,56 @@
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "model.h"
+
+// Meshes are cut into small clusters at load time so that the parts of a big
+// mesh facing away from the camera or lying off screen can be skipped. The
+// index buffer keeps its order, a meshlet is just the next run of triangles
+// that fits the vertex and triangle limits, so nothing is reordered or
+// copied. Culled clusters leave gaps, the remaining runs are drawn with one
+// glMultiDrawElements per mesh. The back-facing test assumes counter-clockwise
+// front faces and back-face culling, the caller enables GL_CULL_FACE around
+// drawMeshlets so double-sided geometry looks the same with or without it.
+const unsigned int MESHLET_MAX_VERTICES = 64;
+const unsigned int MESHLET_MAX_TRIANGLES = 124;
+
+void buildMeshlets(std::vector<Meshlet> &meshlets, const Vertex* vertices, unsigned int vertexCount, const unsigned int* indices, unsigned int indexCount);
+
+struct MeshletStats
+{
+	unsigned int meshlets;
+	unsigned int backfacing;
+	unsigned int offscreen;
+	unsigned int trianglesTotal;
+	unsigned int trianglesSubmitted;
+	float cullMs;
+};
+
+enum MeshletResult
+{
+	MESHLET_VISIBLE,
+	MESHLET_OFFSCREEN,
+	MESHLET_BACKFACING
+};
+
+struct MeshletCuller
+{
+	// index of the first meshlet of every mesh in results
+	std::vector<unsigned int> firstMeshlet;
+	std::vector<unsigned char> results;
+	// merged index ranges, firstDraw/drawCount per mesh
+	std::vector<int> counts;
+	std::vector<const void*> offsets;
+	std::vector<unsigned int> firstDraw, drawCount;
+	MeshletStats stats;
+};
+
+// mvp and the camera position in world space; clusters are tested on the job system
+void cullMeshlets(MeshletCuller &culler, const Model &model, const glm::mat4 &mvp, const glm::mat4 &transform, glm::vec3 cameraPosition);
+// meshVisible, when given, skips meshes with a zero flag like drawModel
+void drawMeshlets(MeshletCuller &culler, Model &model, unsigned int &shader, const std::vector<unsigned char>* meshVisible = NULL);
+
+#endif
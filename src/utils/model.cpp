@@ -1,22 +1,54 @@
 #include <assimp/cimport.h>        // Plain-C interface
 #include <assimp/postprocess.h>
 #include <glad/glad.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <strings.h>
 
 #include "./model.h"
 #include "./texture.h"
+#include "./objloader.h"
+#include "./jobs.h"
+#include "./meshlet.h"
+#include "./texture_stream.h"
+#include "./memory.h"
+
+static void releaseCpuCopies(Mesh &mesh)
+{
+	memory::release(memory::CPU_MESH, memory::pointerKey(mesh.vertices.data()));
+	memory::release(memory::CPU_MESH, memory::pointerKey(mesh.indices.data()));
+}
 
 void destroyMesh(Mesh &mesh)
 {
+	releaseCpuCopies(mesh);
+	memory::release(memory::CPU_MESH, memory::pointerKey(mesh.meshlets.data()));
+	memory::release(memory::CPU_MESH, memory::pointerKey(mesh.bvh.triangles.data()));
+	// never uploaded with MODEL_NO_GPU
+	if (mesh.vao == 0)
+		return;
+	memory::release(memory::VERTEX_BUFFER, mesh.vbo);
+	memory::release(memory::INDEX_BUFFER, mesh.ebo);
 	glDeleteVertexArrays(1, &(mesh.vao));
 	glDeleteBuffers(1, &(mesh.vbo));
 	glDeleteBuffers(1, &(mesh.ebo));
-	for (unsigned int i = 0; i < mesh.textures.size(); ++i)
+	if (mesh.lightmapVbo)
 	{
-		glDeleteTextures(1, &(mesh.textures[i].id));
+		memory::release(memory::VERTEX_BUFFER, mesh.lightmapVbo);
+		glDeleteBuffers(1, &(mesh.lightmapVbo));
+		mesh.lightmapVbo = 0;
+	}
+	if (mesh.skinVbo)
+	{
+		memory::release(memory::VERTEX_BUFFER, mesh.skinVbo);
+		glDeleteBuffers(1, &(mesh.skinVbo));
+		mesh.skinVbo = 0;
 	}
 }
 
-void setupMesh(Mesh &mesh)
+static void uploadBuffers(Mesh &mesh, const Vertex* vertices, unsigned int vertexCount, const unsigned int* indices, unsigned int indexCount)
 {
 	glGenVertexArrays(1, &(mesh.vao));
 	glGenBuffers(1, &(mesh.vbo));
@@ -25,10 +57,13 @@ void setupMesh(Mesh &mesh)
 	glBindVertexArray(mesh.vao);
 
 	glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
-	glBufferData(GL_ARRAY_BUFFER, mesh.vertices.size() * sizeof(Vertex), &(mesh.vertices[0]), GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(Vertex), vertices, GL_STATIC_DRAW);
 
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ebo);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indices.size() * sizeof(unsigned int), &(mesh.indices[0]), GL_STATIC_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(unsigned int), indices, GL_STATIC_DRAW);
+
+	memory::allocate(memory::VERTEX_BUFFER, mesh.vbo, vertexCount * sizeof(Vertex));
+	memory::allocate(memory::INDEX_BUFFER, mesh.ebo, indexCount * sizeof(unsigned int));
 
 	glEnableVertexAttribArray(0);
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
@@ -40,34 +75,143 @@ void setupMesh(Mesh &mesh)
 	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, textureCoords));
 }
 
-void drawMesh(Mesh &mesh, unsigned int &shader)
+void setupMesh(Mesh &mesh, bool upload)
 {
-	glUseProgram(shader);
-	unsigned int diffuseN = 0, specularN = 0;
-	for (unsigned int i = 0; i < mesh.textures.size(); ++i)
+	setupMesh(mesh, mesh.vertices.data(), mesh.vertices.size(), mesh.indices.data(), mesh.indices.size(), upload);
+}
+
+void setupMesh(Mesh &mesh, const Vertex* vertices, unsigned int vertexCount, const unsigned int* indices, unsigned int indexCount, bool upload)
+{
+	mesh.vertexCount = vertexCount;
+	mesh.indexCount = indexCount;
+
+	mesh.boundsMin = glm::vec3(vertexCount ? 1e30f : 0.0f);
+	mesh.boundsMax = glm::vec3(vertexCount ? -1e30f : 0.0f);
+	for (unsigned int i = 0; i < vertexCount; ++i)
 	{
-		glActiveTexture(GL_TEXTURE0 + i);
-		bool isDiffuse = mesh.textures[i].type == DIFFUSE;
-		std::string name(isDiffuse ? "diffuse_" : "specular_");
-		name += std::to_string(isDiffuse ? diffuseN : specularN);
-		glUniform1i(glGetUniformLocation(shader, ("material." + name).c_str()), i);
-		glBindTexture(GL_TEXTURE_2D, mesh.textures[i].id);
-		diffuseN += isDiffuse ? 1 : 0;
-		specularN += isDiffuse ? 0 : 1;
+		mesh.boundsMin = glm::min(mesh.boundsMin, vertices[i].position);
+		mesh.boundsMax = glm::max(mesh.boundsMax, vertices[i].position);
 	}
-	glActiveTexture(GL_TEXTURE0);
+	buildMeshlets(mesh.meshlets, vertices, vertexCount, indices, indexCount);
 
+	double worldArea = 0.0, uvArea = 0.0;
+	for (unsigned int i = 0; i + 2 < indexCount; i += 3)
+	{
+		const Vertex &a = vertices[indices[i]], &b = vertices[indices[i + 1]], &c = vertices[indices[i + 2]];
+		worldArea += glm::length(glm::cross(b.position - a.position, c.position - a.position));
+		glm::vec2 uv1 = b.textureCoords - a.textureCoords, uv2 = c.textureCoords - a.textureCoords;
+		uvArea += std::fabs(uv1.x * uv2.y - uv1.y * uv2.x);
+	}
+	mesh.uvDensity = worldArea > 0.0 ? (float)std::sqrt(uvArea / worldArea) : 0.0f;
+
+	if (!mesh.meshlets.empty())
+		memory::allocate(memory::CPU_MESH, memory::pointerKey(mesh.meshlets.data()), mesh.meshlets.capacity() * sizeof(Meshlet));
+	// uploading from the mesh's own vectors means they stay around
+	if (!mesh.vertices.empty() && vertices == mesh.vertices.data())
+		memory::allocate(memory::CPU_MESH, memory::pointerKey(mesh.vertices.data()), mesh.vertices.capacity() * sizeof(Vertex));
+	if (!mesh.indices.empty() && indices == mesh.indices.data())
+		memory::allocate(memory::CPU_MESH, memory::pointerKey(mesh.indices.data()), mesh.indices.capacity() * sizeof(unsigned int));
+	if (upload)
+		uploadBuffers(mesh, vertices, vertexCount, indices, indexCount);
+}
+
+void uploadMesh(Mesh &mesh)
+{
+	uploadBuffers(mesh, mesh.vertices.data(), mesh.vertices.size(), mesh.indices.data(), mesh.indices.size());
+}
+
+void releaseMeshData(Mesh &mesh)
+{
+	releaseCpuCopies(mesh);
+	// swap with empty vectors, clear() keeps the capacity
+	std::vector<Vertex>().swap(mesh.vertices);
+	std::vector<unsigned int>().swap(mesh.indices);
+}
+
+void releaseModelData(Model &model, const std::vector<unsigned char> &keep)
+{
+	for (unsigned int i = 0; i < model.meshes.size(); ++i)
+	{
+		if (i < keep.size() && keep[i])
+			continue;
+		releaseMeshData(model.meshes[i]);
+		model.cpuDataReleased = true;
+	}
+}
+
+RenderStats renderStats;
+
+void resetRenderStats()
+{
+	renderStats.drawCalls = 0;
+	renderStats.textureBinds = 0;
+	renderStats.perMeshTextureBinds = 0;
+}
+
+static void drawMeshMaterial(Mesh &mesh)
+{
+	// attribute 3 is never enabled on mesh VAOs, so this sets its constant value
+	glVertexAttribI1i(3, mesh.material);
 	glBindVertexArray(mesh.vao);
-	glDrawElements(GL_TRIANGLES, mesh.indices.size(), GL_UNSIGNED_INT, 0);
+	glDrawElements(GL_TRIANGLES, mesh.indexCount, GL_UNSIGNED_INT, 0);
 	glBindVertexArray(0);
+
+	renderStats.drawCalls++;
+	renderStats.perMeshTextureBinds += mesh.textures.size();
+}
+
+void drawMesh(Mesh &mesh, unsigned int &shader)
+{
+	glUseProgram(shader);
+	drawMeshMaterial(mesh);
+}
+
+void bindMaterials(Model &model, unsigned int shader)
+{
+	glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT_MATERIALS);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, model.textureArray);
+	glUniform1i(glGetUniformLocation(shader, "material.textures"), TEXTURE_UNIT_MATERIALS);
+	// keeps the unused emission sampler off the array's unit
+	glUniform1i(glGetUniformLocation(shader, "material.emission"), TEXTURE_UNIT_EMISSION);
+	if (!model.materials.empty())
+		glUniform2iv(glGetUniformLocation(shader, "materialLayers"), model.materials.size(), &(model.materials[0].diffuseLayer));
+	// the baked directional light replaces the live one, see lightmap.h
+	// and its sampler stays off the array's unit even when unused
+	glUniform1i(glGetUniformLocation(shader, "useLightmap"), model.lightmap != 0);
+	glUniform1i(glGetUniformLocation(shader, "lightmap"), TEXTURE_UNIT_LIGHTMAP);
+	if (model.lightmap)
+	{
+		glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT_LIGHTMAP);
+		glBindTexture(GL_TEXTURE_2D, model.lightmap);
+		glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT_MATERIALS);
+	}
+
+	renderStats.textureBinds++;
+}
+
+void drawModel(Model &model, unsigned int &shader, const std::vector<unsigned char>* visible)
+{
+	glUseProgram(shader);
+	bindMaterials(model, shader);
+	for (unsigned int i = 0; i < model.meshes.size(); ++i)
+	{
+		if (visible && !(*visible)[i])
+			continue;
+		drawMeshMaterial(model.meshes[i]);
+	}
 }
 
-void drawModel(Model &model, unsigned int &shader)
+void modelBounds(const Model &model, glm::vec3 &boundsMin, glm::vec3 &boundsMax)
 {
+	boundsMin = glm::vec3(1e30f);
+	boundsMax = glm::vec3(-1e30f);
 	for (unsigned int i = 0; i < model.meshes.size(); ++i)
 	{
-		drawMesh(model.meshes[i], shader);
+		boundsMin = glm::min(boundsMin, model.meshes[i].boundsMin);
+		boundsMax = glm::max(boundsMax, model.meshes[i].boundsMax);
 	}
+	if (model.meshes.empty())
+		boundsMin = boundsMax = glm::vec3(0.0f);
 }
 
 void destroyModel(Model &model)
@@ -76,117 +220,314 @@ void destroyModel(Model &model)
 	{
 		destroyMesh(model.meshes[i]);
 	}
+	if (model.textureArray)
+	{
+		memory::release(memory::TEXTURE, model.textureArray);
+		glDeleteTextures(1, &(model.textureArray));
+		model.textureArray = 0;
+	}
+	if (model.lightmap)
+	{
+		memory::release(memory::TEXTURE, model.lightmap);
+		glDeleteTextures(1, &(model.lightmap));
+		model.lightmap = 0;
+	}
 }
 
-std::vector<Texture> loadMaterialTextures(Model &model, aiMaterial *mat, aiTextureType assimpType, TextureType type)
+Texture loadSharedTexture(Model &model, const char* path, TextureType type)
 {
-	std::vector<Texture> textures;
-	for (unsigned int i = 0; i < mat->GetTextureCount(assimpType); ++i)
+	for (unsigned int i = 0; i < model.sharedTextures.size(); ++i)
 	{
-		aiString str;
-		mat->GetTexture(assimpType, i, &str);
-		bool skip = false;
-		for (unsigned int j = 0; j < model.sharedTextures.size(); ++j)
+		if (std::strcmp(model.sharedTextures[i].path.data(), path) == 0)
+			return model.sharedTextures[i];
+	}
+
+	Texture texture;
+	texture.id = 0;
+	texture.type = type;
+	texture.path = path;
+	texture.layer = model.sharedTextures.size();
+	model.sharedTextures.push_back(texture);
+
+	return texture;
+}
+
+struct TextureDecode
+{
+	Model* model;
+	std::vector<Image> images;
+};
+
+static void decodeTextures(unsigned int first, unsigned int last, void* context)
+{
+	TextureDecode &decode = *(TextureDecode*)context;
+	for (unsigned int i = first; i < last; ++i)
+	{
+		std::string fullPath = decode.model->texturesDir + decode.model->sharedTextures[i].path;
+		texture::loadImage(fullPath.c_str(), true, decode.images[i]);
+	}
+}
+
+// MAX_MATERIALS when the table is full
+static unsigned int findMaterial(Model &model, int diffuseLayer, int specularLayer)
+{
+	for (unsigned int i = 0; i < model.materials.size(); ++i)
+	{
+		if (model.materials[i].diffuseLayer == diffuseLayer && model.materials[i].specularLayer == specularLayer)
+			return i;
+	}
+
+	if (model.materials.size() == MAX_MATERIALS)
+		return MAX_MATERIALS;
+
+	Material material = { diffuseLayer, specularLayer };
+	model.materials.push_back(material);
+	return model.materials.size() - 1;
+}
+
+void packModelTextures(Model &model, unsigned int flags)
+{
+	std::vector<Image> images;
+	decodeModelTextures(model, images, flags);
+	createModelTextures(model, images);
+}
+
+void decodeModelTextures(Model &model, std::vector<Image> &images, unsigned int flags)
+{
+	TextureDecode decode;
+	decode.model = &model;
+	decode.images.resize(model.sharedTextures.size());
+	for (unsigned int i = 0; i < model.sharedTextures.size(); ++i)
+	{
+		printf("load texture: %s%s\n", model.texturesDir.c_str(), model.sharedTextures[i].path.c_str());
+	}
+	jobs::parallelFor(decode.images.size(), 1, decodeTextures, &decode);
+
+	// the largest size, so no texture loses detail; smaller ones are scaled up
+	int width = 1, height = 1;
+	unsigned int upscaled = 0;
+	for (unsigned int i = 0; i < decode.images.size(); ++i)
+	{
+		width = std::max(width, decode.images[i].width);
+		height = std::max(height, decode.images[i].height);
+	}
+	for (unsigned int i = 0; i < decode.images.size(); ++i)
+	{
+		if (decode.images[i].width > 0 && (decode.images[i].width != width || decode.images[i].height != height))
+			upscaled++;
+	}
+	if (upscaled)
+		printf("load texture: %u of %u textures scaled up to %dx%d for the shared array\n", upscaled, (unsigned int)decode.images.size(), width, height);
+
+	model.textureWidth = width;
+	model.textureHeight = height;
+	model.textureTopLevel = (flags & MODEL_STREAM_TEXTURES) ? streamBaseLevel(width, height) : 0;
+	for (unsigned int i = 0; i < decode.images.size(); ++i)
+	{
+		texture::resizeImage(decode.images[i], width, height);
+		// streamed arrays start at the coarse base level
+		for (int level = 1; level <= model.textureTopLevel; ++level)
+			texture::resizeImage(decode.images[i], mipSize(width, level), mipSize(height, level));
+	}
+	images.swap(decode.images);
+}
+
+void createModelTextures(Model &model, const std::vector<Image> &images)
+{
+	if (model.textureArray != 0)
+	{
+		memory::release(memory::TEXTURE, model.textureArray);
+		glDeleteTextures(1, &(model.textureArray));
+	}
+	model.textureArray = texture::createArray(images);
+	finishModelTextures(model);
+}
+
+void finishModelTextures(Model &model)
+{
+	for (unsigned int i = 0; i < model.sharedTextures.size(); ++i)
+	{
+		model.sharedTextures[i].id = model.textureArray;
+	}
+	for (unsigned int i = 0; i < model.meshes.size(); ++i)
+	{
+		for (unsigned int j = 0; j < model.meshes[i].textures.size(); ++j)
+			model.meshes[i].textures[j].id = model.textureArray;
+	}
+	assignMaterials(model);
+}
+
+void assignMaterials(Model &model)
+{
+	model.materials.clear();
+	unsigned int overflow = 0;
+	for (unsigned int i = 0; i < model.meshes.size(); ++i)
+	{
+		Mesh &mesh = model.meshes[i];
+		int diffuseLayer = -1, specularLayer = -1;
+		for (unsigned int j = 0; j < mesh.textures.size(); ++j)
 		{
-			if (std::strcmp(model.sharedTextures[j].path.data(), str.C_Str()) == 0)
-			{
-				textures.push_back(model.sharedTextures[j]);
-				skip = true;
-				break;
-			}
+			if (mesh.textures[j].type == DIFFUSE && diffuseLayer < 0)
+				diffuseLayer = mesh.textures[j].layer;
+			if (mesh.textures[j].type == SPECULAR && specularLayer < 0)
+				specularLayer = mesh.textures[j].layer;
 		}
-		
-		if (!skip)
+		mesh.material = findMaterial(model, diffuseLayer, specularLayer);
+		if (mesh.material == MAX_MATERIALS)
 		{
-			Texture texture;
-			std::string fullPath = model.texturesDir + str.C_Str();
-			printf("load texture: %s\n", fullPath.c_str());
-			texture.id = texture::loadTexture(fullPath.c_str(), true);
-			texture.type = type;
-			texture.path = str.C_Str();
-			textures.push_back(texture);
-			model.sharedTextures.push_back(texture);
+			overflow++;
+			mesh.material = MAX_MATERIALS - 1;
 		}
 	}
+	if (overflow)
+		printf("Warning: %s needs more than %u materials, %u meshes are drawn with the textures of material %u\n", model.name.c_str(), MAX_MATERIALS, overflow, MAX_MATERIALS - 1);
+}
 
-	return textures;
+void loadMaterialTextures(Model &model, aiMaterial *mat, aiTextureType assimpType, TextureType type, std::vector<Texture> &textures)
+{
+	for (unsigned int i = 0; i < mat->GetTextureCount(assimpType); ++i)
+	{
+		aiString str;
+		mat->GetTexture(assimpType, i, &str);
+		textures.push_back(loadSharedTexture(model, str.C_Str(), type));
+	}
 }
 
-Mesh processMesh(Model &model, aiMesh *mesh, const aiScene* scene)
+static void convertVertices(aiMesh *mesh, Vertex* vertices)
 {
-	Mesh m;
 	for (unsigned int i = 0; i < mesh->mNumVertices; ++i)
 	{
-		Vertex vertex;
-		glm::vec3 position;
-		position.x = mesh->mVertices[i].x;
-		position.y = mesh->mVertices[i].y;
-		position.z = mesh->mVertices[i].z;
-		vertex.position = position;
+		Vertex &vertex = vertices[i];
+		vertex.position = glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
 
-		glm::vec3 normal;
-		normal.x = mesh->mNormals[i].x;
-		normal.y = mesh->mNormals[i].y;
-		normal.z = mesh->mNormals[i].z;
-		vertex.normal = normal;
+		if (mesh->mNormals)
+			vertex.normal = glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z);
+		else
+			vertex.normal = glm::vec3(0.0f, 0.0f, 0.0f);
 
 		if (mesh->mTextureCoords[0])
-		{
-			glm::vec2 vec;
-			vec.x = mesh->mTextureCoords[0][i].x;
-			vec.y = mesh->mTextureCoords[0][i].y;
-			vertex.textureCoords = vec;
-		}
+			vertex.textureCoords = glm::vec2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y);
 		else
-		{
 			vertex.textureCoords = glm::vec2(0.0f, 0.0f);
-		}
-
-		m.vertices.push_back(vertex);
 	}
+}
 
+// returns the number of indices written, points and lines
+// left over by triangulation are skipped
+static unsigned int convertIndices(aiMesh *mesh, unsigned int* indices)
+{
+	unsigned int count = 0;
 	for (unsigned int i = 0; i < mesh->mNumFaces; ++i)
 	{
-		aiFace face = mesh->mFaces[i];
-		for (unsigned int j = 0; j < face.mNumIndices; ++j)
+		const aiFace &face = mesh->mFaces[i];
+		if (face.mNumIndices != 3)
+			continue;
+
+		indices[count++] = face.mIndices[0];
+		indices[count++] = face.mIndices[1];
+		indices[count++] = face.mIndices[2];
+	}
+
+	return count;
+}
+
+static void setupSkin(Mesh &mesh, const SkinVertex* skin, unsigned int vertexCount)
+{
+	glGenBuffers(1, &(mesh.skinVbo));
+	glBindVertexArray(mesh.vao);
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.skinVbo);
+	glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(SkinVertex), skin, GL_STATIC_DRAW);
+	memory::allocate(memory::VERTEX_BUFFER, mesh.skinVbo, vertexCount * sizeof(SkinVertex));
+
+	glEnableVertexAttribArray(4);
+	glVertexAttribIPointer(4, SKIN_INFLUENCES, GL_UNSIGNED_SHORT, sizeof(SkinVertex), (void*)offsetof(SkinVertex, joints));
+
+	glEnableVertexAttribArray(5);
+	glVertexAttribPointer(5, SKIN_INFLUENCES, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(SkinVertex), (void*)offsetof(SkinVertex, weights));
+	glBindVertexArray(0);
+}
+
+void processMesh(Model &model, Mesh &m, aiMesh *mesh, ModelImport &import)
+{
+	const aiScene* scene = import.scene;
+	if (import.flags & MODEL_RELEASE_CPU_DATA)
+	{
+		resetArena(import.arena);
+		Vertex* vertices = arenaAlloc<Vertex>(import.arena, mesh->mNumVertices);
+		unsigned int* indices = arenaAlloc<unsigned int>(import.arena, mesh->mNumFaces * 3);
+		convertVertices(mesh, vertices);
+		unsigned int indexCount = convertIndices(mesh, indices);
+		setupMesh(m, vertices, mesh->mNumVertices, indices, indexCount);
+	}
+	else
+	{
+		// exact sizes up front, no reallocation while filling
+		m.vertices.resize(mesh->mNumVertices);
+		m.indices.resize(mesh->mNumFaces * 3);
+		convertVertices(mesh, m.vertices.data());
+		m.indices.resize(convertIndices(mesh, m.indices.data()));
+		setupMesh(m, !(import.flags & MODEL_NO_GPU));
+	}
+
+	if (!model.skeleton.names.empty() && !(import.flags & MODEL_NO_GPU))
+	{
+		// after the vertices, the arena is only reset per mesh
+		SkinVertex* skin;
+		std::vector<SkinVertex> skinVertices;
+		if (import.flags & MODEL_RELEASE_CPU_DATA)
+		{
+			skin = arenaAlloc<SkinVertex>(import.arena, mesh->mNumVertices);
+		}
+		else
 		{
-			m.indices.push_back(face.mIndices[j]);
+			skinVertices.resize(mesh->mNumVertices);
+			skin = skinVertices.data();
 		}
+		importSkin(skin, mesh, model.skeleton, import.joint);
+		setupSkin(m, skin, mesh->mNumVertices);
 	}
 
 	if(mesh->mMaterialIndex >= 0)
 	{
 		aiMaterial *material = scene->mMaterials[mesh->mMaterialIndex];
-
-		std::vector<Texture> diffuseMaps = loadMaterialTextures(model, material, aiTextureType_DIFFUSE, DIFFUSE);
-		m.textures.insert(m.textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-
-		std::vector<Texture> specularMaps = loadMaterialTextures(model, material, aiTextureType_SPECULAR, SPECULAR);
-		m.textures.insert(m.textures.end(), specularMaps.begin(), specularMaps.end());
+		loadMaterialTextures(model, material, aiTextureType_DIFFUSE, DIFFUSE, m.textures);
+		loadMaterialTextures(model, material, aiTextureType_SPECULAR, SPECULAR, m.textures);
 	}
-
-	setupMesh(m);
-
-	return m;
 }
 
-void processNode(Model &model, aiNode *node, const aiScene *scene)
+void processNode(Model &model, aiNode *node, ModelImport &import)
 {
+	import.joint = findJoint(model.skeleton, node->mName.C_Str());
 	// process all the node's meshes (if any)
 	for (unsigned int i = 0; i < node->mNumMeshes; ++i)
 	{
-		aiMesh *mesh = scene->mMeshes[node->mMeshes[i]];
-		model.meshes.push_back(processMesh(model, mesh, scene));
+		aiMesh *mesh = import.scene->mMeshes[node->mMeshes[i]];
+		// build the mesh in place, model.meshes is reserved up front
+		model.meshes.push_back(Mesh());
+		processMesh(model, model.meshes.back(), mesh, import);
 	}
 	// then do the same for each of its children
 	for (unsigned int i = 0; i < node->mNumChildren; ++i)
 	{
-		processNode(model, node->mChildren[i], scene);
+		processNode(model, node->mChildren[i], import);
 	}
 }
 
-bool loadModel(Model &model, const char* path, const char* texturesDir)
+static unsigned int countMeshes(aiNode *node)
 {
+	unsigned int count = node->mNumMeshes;
+	for (unsigned int i = 0; i < node->mNumChildren; ++i)
+	{
+		count += countMeshes(node->mChildren[i]);
+	}
+
+	return count;
+}
+
+static bool loadAssimp(Model &model, const char* path, unsigned int flags)
+{
+	unsigned long long allocationsBefore = heapAllocations();
+
 	const aiScene* scene = aiImportFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
 	if (scene == NULL)
 	{
@@ -194,10 +535,124 @@ bool loadModel(Model &model, const char* path, const char* texturesDir)
 		return false;
 	}
 
-	model.texturesDir = texturesDir;
-	processNode(model, scene->mRootNode, scene);
+	ModelImport import;
+	import.scene = scene;
+	import.flags = flags;
+	import.joint = -1;
+	importSkeleton(model.skeleton, scene);
+
+	size_t stagingSize = 0;
+	for (unsigned int i = 0; i < scene->mNumMeshes; ++i)
+	{
+		aiMesh *mesh = scene->mMeshes[i];
+		// three alignment paddings at most
+		size_t skinSize = model.skeleton.names.empty() ? 0 : sizeof(SkinVertex);
+		size_t size = mesh->mNumVertices * (sizeof(Vertex) + skinSize) + mesh->mNumFaces * 3 * sizeof(unsigned int) + 48;
+		if (size > stagingSize)
+			stagingSize = size;
+	}
+	initArena(import.arena, (flags & MODEL_RELEASE_CPU_DATA) ? stagingSize : 0);
+
+	model.meshes.reserve(model.meshes.size() + countMeshes(scene->mRootNode));
+	processNode(model, scene->mRootNode, import);
+	importAnimations(model.animations, model.skeleton, scene);
+	if (!model.skeleton.names.empty())
+		printf("  skeleton: %u joints, %u animations\n", (unsigned int)model.skeleton.names.size(), (unsigned int)model.animations.size());
 
 	aiReleaseImport(scene);
 
+	printf("  assimp: staging arena %zu KB in %u allocations, %llu heap allocations\n",
+		import.arena.peak / 1024, import.arena.allocations, heapAllocations() - allocationsBefore);
+
+	destroyArena(import.arena);
+
+	return true;
+}
+
+static bool hasExtension(const char* path, const char* extension)
+{
+	size_t length = std::strlen(path), extensionLength = std::strlen(extension);
+	return length >= extensionLength && strcasecmp(path + length - extensionLength, extension) == 0;
+}
+
+struct BvhBuildContext
+{
+	Model* model;
+	unsigned int firstMesh;
+};
+
+static void buildMeshBvhs(unsigned int first, unsigned int last, void* data)
+{
+	BvhBuildContext* context = (BvhBuildContext*)data;
+	for (unsigned int i = first; i < last; ++i)
+	{
+		Mesh &mesh = context->model->meshes[context->firstMesh + i];
+		if (!mesh.vertices.empty())
+			buildMeshBvh(mesh.bvh, mesh.vertices.data(), mesh.indices.data(), mesh.indices.size());
+	}
+}
+
+// one job per mesh, large meshes split their build further
+static void buildModelBvh(Model &model, unsigned int firstMesh)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	BvhBuildContext context = { &model, firstMesh };
+	jobs::parallelFor(model.meshes.size() - firstMesh, 1, buildMeshBvhs, &context);
+
+	unsigned int nodes = 0, triangles = 0, skipped = 0;
+	size_t bytes = 0;
+	for (unsigned int i = firstMesh; i < model.meshes.size(); ++i)
+	{
+		const MeshBvh &bvh = model.meshes[i].bvh;
+		if (model.meshes[i].vertices.empty())
+			skipped++;
+		if (bvh.triangles.empty())
+			continue;
+		memory::allocate(memory::CPU_MESH, memory::pointerKey(bvh.triangles.data()), bvhBytes(bvh));
+		nodes += bvh.nodes.size();
+		triangles += bvh.triangles.size();
+		bytes += bvhBytes(bvh);
+	}
+	printf("bvh: %u triangles, %u nodes, %.1f MB in %.1f ms, %u workers\n", triangles, nodes, bytes / 1048576.0f,
+		std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(), jobs::workerCount());
+	if (skipped)
+		printf("Warning: %u meshes without CPU-side data have no bvh\n", skipped);
+}
+
+bool loadModel(Model &model, const char* path, const char* texturesDir, unsigned int flags)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	unsigned int firstMesh = model.meshes.size();
+	model.name = path;
+	model.texturesDir = texturesDir;
+	memory::ScopedOwner owner(model.name);
+
+	bool loaded = false;
+	if (!(flags & MODEL_FORCE_ASSIMP) && hasExtension(path, ".obj"))
+		loaded = loadObj(model, path, flags);
+	if (!loaded)
+		loaded = loadAssimp(model, path, flags);
+	if (!loaded)
+		return false;
+	if (flags & MODEL_RELEASE_CPU_DATA)
+		model.cpuDataReleased = true;
+
+	if (!(flags & MODEL_NO_GPU))
+		packModelTextures(model, flags);
+	if (flags & MODEL_BUILD_BVH)
+		buildModelBvh(model, firstMesh);
+
+	unsigned int vertexCount = 0, triangleCount = 0;
+	for (unsigned int i = firstMesh; i < model.meshes.size(); ++i)
+	{
+		vertexCount += model.meshes[i].vertexCount;
+		triangleCount += model.meshes[i].indexCount / 3;
+	}
+
+	printf("load model: %s, %u meshes, %u vertices, %u triangles in %.1f ms, peak RSS %ld MB\n",
+		path, (unsigned int)model.meshes.size() - firstMesh, vertexCount, triangleCount,
+		std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(),
+		peakResidentKB() / 1024);
+
 	return true;
 }
@@ -6,6 +6,12 @@
 #include <glm/glm.hpp>
 #include <assimp/scene.h>
 
+#include "arena.h"
+#include "animation.h"
+#include "bvh.h"
+
+struct Image;
+
 struct Vertex
 {
 	glm::vec3 position;
@@ -24,32 +30,167 @@ struct Texture
 	unsigned int id;
 	TextureType type;
 	std::string path;
+	// layer of the model texture array
+	unsigned int layer;
+};
+
+// must match MAX_MATERIALS in phong_combined_fragment.glsl
+const unsigned int MAX_MATERIALS = 64;
+
+// texture units of the programs built on phong_combined_fragment.glsl. Every
+// sampler gets its own, a 2D and a buffer sampler on one unit fail the draw.
+enum TextureUnit
+{
+	TEXTURE_UNIT_MATERIALS = 0,
+	TEXTURE_UNIT_EMISSION = 1,
+	// skinning palette, see drawCrowd
+	TEXTURE_UNIT_PALETTE = 2,
+	TEXTURE_UNIT_LIGHTMAP = 3
+};
+
+// texture array layers, -1 when the material has no such map
+struct Material
+{
+	int diffuseLayer;
+	int specularLayer;
+};
+
+struct RenderStats
+{
+	unsigned int drawCalls;
+	unsigned int textureBinds;
+	// binds the old per-mesh diffuse_N/specular_N path would have made
+	unsigned int perMeshTextureBinds;
+};
+
+extern RenderStats renderStats;
+void resetRenderStats();
+
+// A contiguous range of the mesh index buffer, see meshlet.h. The sphere
+// and normal cone are in object space.
+struct Meshlet
+{
+	unsigned int firstIndex, indexCount;
+	glm::vec3 center;
+	float radius;
+	glm::vec3 coneAxis;
+	// 1 when the normals spread too far to ever cull the cluster as back-facing
+	float coneCutoff;
 };
 
+// CPU-side copies, empty when the model was loaded with MODEL_RELEASE_CPU_DATA
 struct Mesh
 {
 	std::vector<Vertex> vertices;
 	std::vector<unsigned int> indices;
 	std::vector<Texture> textures;
+	// index into Model::materials
+	unsigned int material;
+	unsigned int vertexCount, indexCount;
 	unsigned int vao, vbo, ebo;
+	// object space, filled by setupMesh
+	glm::vec3 boundsMin, boundsMax;
+	// built by setupMesh, kept with MODEL_RELEASE_CPU_DATA
+	std::vector<Meshlet> meshlets;
+	// texture coordinate units per object space unit, for texture streaming
+	float uvDensity;
+	// SkinVertex buffer at attributes 4 and 5 of the VAO, 0 for static meshes
+	unsigned int skinVbo;
+	// empty unless loaded with MODEL_BUILD_BVH
+	MeshBvh bvh;
+	// lightmap coordinates at attribute 6 of the VAO, see lightmap.h
+	unsigned int lightmapVbo;
 };
 
-void setupMesh(Mesh &mesh);
+// upload false only fills the bounds, meshlets and uv density
+void setupMesh(Mesh &mesh, bool upload = true);
+void setupMesh(Mesh &mesh, const Vertex* vertices, unsigned int vertexCount, const unsigned int* indices, unsigned int indexCount, bool upload = true);
+// the GL half of setupMesh, from the mesh's own vectors
+void uploadMesh(Mesh &mesh);
+void releaseMeshData(Mesh &mesh);
 void destroyMesh(Mesh &mesh);
 void drawMesh(Mesh &mesh, unsigned int &shader);
 
+// All material textures of a model live in one texture array, so drawing a
+// whole model needs a single texture bind; meshes select their layers
+// through a material index. Layers take the size of the largest texture,
+// smaller textures are scaled up rather than the large ones down.
 struct Model
 {
 	std::vector<Mesh> meshes;
+	// the path it was loaded from, owner in the memory accounting
+	std::string name;
 	std::string texturesDir;
 	std::vector<Texture> sharedTextures;
+	std::vector<Material> materials;
+	unsigned int textureArray = 0;
+	// full resolution of the array layers and the mip level that is
+	// currently level 0 of textureArray, above 0 while textures stream
+	int textureWidth = 0, textureHeight = 0;
+	int textureTopLevel = 0;
+	// empty unless the file has bones, see animation.h
+	Skeleton skeleton;
+	std::vector<Animation> animations;
+	// baked static lighting, 0 without one, see lightmap.h
+	unsigned int lightmap = 0;
+	// some meshes dropped their CPU-side copies after upload, so later users
+	// of a shared model can't rely on them
+	bool cpuDataReleased = false;
+};
+
+enum ModelLoadFlags
+{
+	// stage vertices in the load arena and upload from there, so meshes
+	// never hold CPU-side copies
+	MODEL_RELEASE_CPU_DATA = 1,
+	// skip the native OBJ importer
+	MODEL_FORCE_ASSIMP = 2,
+	// upload only the coarse mips, see texture_stream.h
+	MODEL_STREAM_TEXTURES = 4,
+	// build a ray query hierarchy per mesh, see bvh.h. Needs the CPU-side
+	// mesh data, so it does nothing together with MODEL_RELEASE_CPU_DATA
+	MODEL_BUILD_BVH = 8,
+	// CPU-side data only, no GL calls and no textures, for offline tools
+	// that run without a context
+	MODEL_NO_GPU = 16
+};
+
+struct ModelImport
+{
+	const aiScene* scene;
+	unsigned int flags;
+	// joint of the node whose meshes are being processed, -1 without a skeleton
+	int joint;
+	// staging memory, sized for the largest mesh of the file
+	Arena arena;
 };
 
-void drawModel(Model &model, unsigned int &shader);
+void bindMaterials(Model &model, unsigned int shader);
+// visible, when given, holds one flag per mesh and skips the zero entries
+void drawModel(Model &model, unsigned int &shader, const std::vector<unsigned char>* visible = NULL);
+void modelBounds(const Model &model, glm::vec3 &boundsMin, glm::vec3 &boundsMax);
 void destroyModel(Model &model);
-std::vector<Texture> loadMaterialTextures(Model &model, aiMaterial *mat, aiTextureType assimpType, TextureType type);
-Mesh processMesh(Model &model, aiMesh *mesh, const aiScene* scene);
-void processNode(Model &model, aiNode *node, const aiScene *scene);
-bool loadModel(Model &model, const char* path, const char* texturesDir);
+// registers texturesDir + path once per model, the image is loaded by packModelTextures
+Texture loadSharedTexture(Model &model, const char* path, TextureType type);
+void loadMaterialTextures(Model &model, aiMaterial *mat, aiTextureType assimpType, TextureType type, std::vector<Texture> &textures);
+// decodes every registered texture on the job system, packs them into the
+// model texture array and builds the material table
+void packModelTextures(Model &model, unsigned int flags = 0);
+// the two halves of packModelTextures: decoding needs no GL and may run on a
+// loader thread, creating the array must run on the GL thread
+void decodeModelTextures(Model &model, std::vector<Image> &images, unsigned int flags = 0);
+void createModelTextures(Model &model, const std::vector<Image> &images);
+// the rest of createModelTextures for a textureArray filled elsewhere, e.g.
+// a few images per frame: points the meshes at it and builds the materials
+void finishModelTextures(Model &model);
+// the material table from the meshes' texture layers, part of
+// createModelTextures; needs no GL, e.g. for the CPU renderer with MODEL_NO_GPU
+void assignMaterials(Model &model);
+void processMesh(Model &model, Mesh &m, aiMesh *mesh, ModelImport &import);
+void processNode(Model &model, aiNode *node, ModelImport &import);
+bool loadModel(Model &model, const char* path, const char* texturesDir, unsigned int flags = 0);
+// drops the CPU-side copies of the meshes whose keep entry is 0, only for
+// the sole user of the model since nothing can get them back
+void releaseModelData(Model &model, const std::vector<unsigned char> &keep);
 
 #endif
@@ -0,0 +1,702 @@
+#include "objloader.h"
+#include "jobs.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// relative (negative) indices are resolved after all chunks are parsed
+const unsigned char RELATIVE_POSITION = 1;
+const unsigned char RELATIVE_TEXCOORD = 2;
+const unsigned char RELATIVE_NORMAL = 4;
+
+struct ObjCorner
+{
+	// 0-based, -1 when missing; chunk-local when the matching relative bit is set
+	int v, t, n;
+	unsigned char relative;
+};
+
+struct ObjMaterialUse
+{
+	unsigned int triangle;
+	std::string name;
+};
+
+struct ObjChunk
+{
+	const char* begin;
+	const char* end;
+	std::vector<float> positions, texCoords, normals;
+	// three per triangle
+	std::vector<ObjCorner> corners;
+	std::vector<ObjMaterialUse> materials;
+	std::string materialLibrary;
+	unsigned int positionBase, texCoordBase, normalBase;
+};
+
+struct ObjRange
+{
+	unsigned int chunk, first, last;
+};
+
+// triangles of one material deduplicated together, a material with many
+// triangles is split into several blocks so it still uses all workers
+struct ObjBlock
+{
+	unsigned int group;
+	std::vector<ObjRange> ranges;
+	std::vector<Vertex> vertices;
+	std::vector<unsigned int> indices;
+	unsigned int vertexOffset, indexOffset;
+};
+
+struct ObjGroup
+{
+	std::string material;
+	std::vector<ObjRange> ranges;
+	unsigned int mesh;
+};
+
+struct ObjFile
+{
+	std::vector<ObjChunk> chunks;
+	std::vector<float> positions, texCoords, normals;
+	std::vector<ObjGroup> groups;
+	std::vector<ObjBlock> blocks;
+	Model* model;
+};
+
+const size_t MIN_CHUNK_SIZE = 1 << 20;
+const unsigned int BLOCK_TRIANGLES = 1 << 16;
+
+static const double POWERS_OF_TEN[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+	1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static bool isSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+static const char* skipSpaces(const char* p, const char* end)
+{
+	while (p < end && isSpace(*p))
+		++p;
+	return p;
+}
+
+static const char* skipLine(const char* p, const char* end)
+{
+	const char* newline = (const char*)memchr(p, '\n', end - p);
+	return newline != NULL ? newline + 1 : end;
+}
+
+// Decimal mantissa times an exact power of ten, which is correctly rounded
+// for the short numbers exporters write. Anything longer goes to strtod.
+static const char* parseFloat(const char* p, const char* end, float &value)
+{
+	p = skipSpaces(p, end);
+	const char* start = p;
+
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+	{
+		negative = *p == '-';
+		++p;
+	}
+
+	unsigned long long mantissa = 0;
+	int digits = 0, exponent = 0;
+	for (; p < end && *p >= '0' && *p <= '9'; ++p, ++digits)
+		mantissa = mantissa * 10 + (*p - '0');
+	if (p < end && *p == '.')
+	{
+		for (++p; p < end && *p >= '0' && *p <= '9'; ++p, ++digits, --exponent)
+			mantissa = mantissa * 10 + (*p - '0');
+	}
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		++p;
+		bool negativeExponent = false;
+		if (p < end && (*p == '-' || *p == '+'))
+		{
+			negativeExponent = *p == '-';
+			++p;
+		}
+		int e = 0;
+		for (; p < end && *p >= '0' && *p <= '9'; ++p)
+			e = e * 10 + (*p - '0');
+		exponent += negativeExponent ? -e : e;
+	}
+
+	if (digits > 18 || exponent < -22 || exponent > 22)
+	{
+		char buffer[64];
+		size_t length = p - start < 63 ? p - start : 63;
+		memcpy(buffer, start, length);
+		buffer[length] = '\0';
+		value = (float)strtod(buffer, NULL);
+		return p;
+	}
+
+	double result = (double)mantissa;
+	result = exponent < 0 ? result / POWERS_OF_TEN[-exponent] : result * POWERS_OF_TEN[exponent];
+	value = (float)(negative ? -result : result);
+
+	return p;
+}
+
+static const char* parseInt(const char* p, const char* end, int &value)
+{
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+	{
+		negative = *p == '-';
+		++p;
+	}
+
+	int result = 0;
+	for (; p < end && *p >= '0' && *p <= '9'; ++p)
+		result = result * 10 + (*p - '0');
+	value = negative ? -result : result;
+
+	return p;
+}
+
+// OBJ indices are 1-based, negative ones count back from the last element
+static int toIndex(int raw, unsigned int localCount, unsigned char bit, unsigned char &relative)
+{
+	if (raw > 0)
+		return raw - 1;
+	if (raw < 0)
+	{
+		relative |= bit;
+		return (int)localCount + raw;
+	}
+
+	return -1;
+}
+
+static const char* parseCorner(const char* p, const char* end, ObjChunk &chunk, ObjCorner &corner)
+{
+	int raw = 0;
+	corner.relative = 0;
+	corner.t = -1;
+	corner.n = -1;
+
+	p = parseInt(p, end, raw);
+	corner.v = toIndex(raw, chunk.positions.size() / 3, RELATIVE_POSITION, corner.relative);
+	if (p < end && *p == '/')
+	{
+		++p;
+		if (p < end && *p != '/')
+		{
+			p = parseInt(p, end, raw);
+			corner.t = toIndex(raw, chunk.texCoords.size() / 2, RELATIVE_TEXCOORD, corner.relative);
+		}
+		if (p < end && *p == '/')
+		{
+			p = parseInt(p + 1, end, raw);
+			corner.n = toIndex(raw, chunk.normals.size() / 3, RELATIVE_NORMAL, corner.relative);
+		}
+	}
+
+	return p;
+}
+
+static std::string parseName(const char* p, const char* end)
+{
+	p = skipSpaces(p, end);
+	const char* last = p;
+	while (last < end && *last != '\n')
+		++last;
+	while (last > p && isSpace(last[-1]))
+		--last;
+
+	return std::string(p, last);
+}
+
+static void parseChunk(ObjChunk &chunk)
+{
+	const char* p = chunk.begin;
+	const char* end = chunk.end;
+	while (p < end)
+	{
+		p = skipSpaces(p, end);
+		if (p >= end)
+			break;
+
+		if (p[0] == 'v' && p + 1 < end && isSpace(p[1]))
+		{
+			float x, y, z;
+			p = parseFloat(p + 2, end, x);
+			p = parseFloat(p, end, y);
+			p = parseFloat(p, end, z);
+			chunk.positions.push_back(x);
+			chunk.positions.push_back(y);
+			chunk.positions.push_back(z);
+		}
+		else if (p[0] == 'v' && p + 2 < end && p[1] == 't' && isSpace(p[2]))
+		{
+			float u, v;
+			p = parseFloat(p + 3, end, u);
+			p = parseFloat(p, end, v);
+			// same orientation as aiProcess_FlipUVs
+			chunk.texCoords.push_back(u);
+			chunk.texCoords.push_back(1.0f - v);
+		}
+		else if (p[0] == 'v' && p + 2 < end && p[1] == 'n' && isSpace(p[2]))
+		{
+			float x, y, z;
+			p = parseFloat(p + 3, end, x);
+			p = parseFloat(p, end, y);
+			p = parseFloat(p, end, z);
+			chunk.normals.push_back(x);
+			chunk.normals.push_back(y);
+			chunk.normals.push_back(z);
+		}
+		else if (p[0] == 'f' && p + 1 < end && isSpace(p[1]))
+		{
+			// fan triangulation: (0, i - 1, i)
+			ObjCorner first = ObjCorner(), previous = ObjCorner(), corner;
+			unsigned int count = 0;
+			p = skipSpaces(p + 1, end);
+			while (p < end && *p != '\n')
+			{
+				p = parseCorner(p, end, chunk, corner);
+				if (count == 0)
+					first = corner;
+				else if (count >= 2)
+				{
+					chunk.corners.push_back(first);
+					chunk.corners.push_back(previous);
+					chunk.corners.push_back(corner);
+				}
+				previous = corner;
+				++count;
+				p = skipSpaces(p, end);
+				// stray characters, e.g. a comment at the end of the line
+				if (p < end && *p != '\n' && *p != '-' && (*p < '0' || *p > '9'))
+					break;
+			}
+		}
+		else if (end - p > 7 && strncmp(p, "usemtl", 6) == 0 && isSpace(p[6]))
+		{
+			ObjMaterialUse use;
+			use.triangle = chunk.corners.size() / 3;
+			use.name = parseName(p + 7, end);
+			chunk.materials.push_back(use);
+		}
+		else if (end - p > 7 && strncmp(p, "mtllib", 6) == 0 && isSpace(p[6]) && chunk.materialLibrary.empty())
+		{
+			chunk.materialLibrary = parseName(p + 7, end);
+		}
+
+		// comments, groups, smoothing groups, lines and points are ignored
+		p = skipLine(p, end);
+	}
+}
+
+static void parseChunks(unsigned int first, unsigned int last, void* context)
+{
+	ObjFile &file = *(ObjFile*)context;
+	for (unsigned int i = first; i < last; ++i)
+	{
+		parseChunk(file.chunks[i]);
+	}
+}
+
+// turns chunk-local indices into file indices and merges the
+// attribute arrays of all chunks into one
+static void resolveChunks(unsigned int first, unsigned int last, void* context)
+{
+	ObjFile &file = *(ObjFile*)context;
+	for (unsigned int i = first; i < last; ++i)
+	{
+		ObjChunk &chunk = file.chunks[i];
+		for (unsigned int j = 0; j < chunk.corners.size(); ++j)
+		{
+			ObjCorner &corner = chunk.corners[j];
+			if (corner.relative & RELATIVE_POSITION)
+				corner.v += chunk.positionBase;
+			if (corner.relative & RELATIVE_TEXCOORD)
+				corner.t += chunk.texCoordBase;
+			if (corner.relative & RELATIVE_NORMAL)
+				corner.n += chunk.normalBase;
+		}
+
+		if (!chunk.positions.empty())
+			memcpy(&file.positions[chunk.positionBase * 3], chunk.positions.data(), chunk.positions.size() * sizeof(float));
+		if (!chunk.texCoords.empty())
+			memcpy(&file.texCoords[chunk.texCoordBase * 2], chunk.texCoords.data(), chunk.texCoords.size() * sizeof(float));
+		if (!chunk.normals.empty())
+			memcpy(&file.normals[chunk.normalBase * 3], chunk.normals.data(), chunk.normals.size() * sizeof(float));
+
+		std::vector<float>().swap(chunk.positions);
+		std::vector<float>().swap(chunk.texCoords);
+		std::vector<float>().swap(chunk.normals);
+	}
+}
+
+static unsigned long long hashCorner(const ObjCorner &corner)
+{
+	unsigned long long h = (unsigned int)corner.v;
+	h = h * 0x9E3779B97F4A7C15ull ^ (unsigned int)corner.t;
+	h = h * 0x9E3779B97F4A7C15ull ^ (unsigned int)corner.n;
+	return h ^ (h >> 29);
+}
+
+static Vertex makeVertex(const ObjFile &file, const ObjCorner &corner)
+{
+	Vertex vertex;
+	unsigned int positionCount = file.positions.size() / 3;
+	unsigned int texCoordCount = file.texCoords.size() / 2;
+	unsigned int normalCount = file.normals.size() / 3;
+
+	if (corner.v >= 0 && (unsigned int)corner.v < positionCount)
+		vertex.position = glm::vec3(file.positions[corner.v * 3], file.positions[corner.v * 3 + 1], file.positions[corner.v * 3 + 2]);
+	else
+		vertex.position = glm::vec3(0.0f, 0.0f, 0.0f);
+
+	if (corner.n >= 0 && (unsigned int)corner.n < normalCount)
+		vertex.normal = glm::vec3(file.normals[corner.n * 3], file.normals[corner.n * 3 + 1], file.normals[corner.n * 3 + 2]);
+	else
+		vertex.normal = glm::vec3(0.0f, 0.0f, 0.0f);
+
+	if (corner.t >= 0 && (unsigned int)corner.t < texCoordCount)
+		vertex.textureCoords = glm::vec2(file.texCoords[corner.t * 2], file.texCoords[corner.t * 2 + 1]);
+	else
+		vertex.textureCoords = glm::vec2(0.0f, 0.0f);
+
+	return vertex;
+}
+
+// one open addressing table per block, sized for the worst case
+// of every corner being unique
+static void buildBlocks(unsigned int first, unsigned int last, void* context)
+{
+	ObjFile &file = *(ObjFile*)context;
+	std::vector<ObjCorner> keys;
+	std::vector<int> slots;
+	for (unsigned int i = first; i < last; ++i)
+	{
+		ObjBlock &block = file.blocks[i];
+		unsigned int cornerCount = 0;
+		for (unsigned int r = 0; r < block.ranges.size(); ++r)
+			cornerCount += (block.ranges[r].last - block.ranges[r].first) * 3;
+
+		unsigned int capacity = 16;
+		while (capacity < cornerCount * 2)
+			capacity <<= 1;
+		slots.assign(capacity, -1);
+		keys.clear();
+		keys.reserve(cornerCount);
+		block.indices.resize(cornerCount);
+		block.vertices.reserve(cornerCount);
+
+		unsigned int index = 0;
+		for (unsigned int r = 0; r < block.ranges.size(); ++r)
+		{
+			const ObjRange &range = block.ranges[r];
+			const ObjChunk &chunk = file.chunks[range.chunk];
+			for (unsigned int c = range.first * 3; c < range.last * 3; ++c)
+			{
+				const ObjCorner &corner = chunk.corners[c];
+				unsigned int slot = hashCorner(corner) & (capacity - 1);
+				while (slots[slot] >= 0)
+				{
+					const ObjCorner &key = keys[slots[slot]];
+					if (key.v == corner.v && key.t == corner.t && key.n == corner.n)
+						break;
+					slot = (slot + 1) & (capacity - 1);
+				}
+
+				if (slots[slot] < 0)
+				{
+					slots[slot] = keys.size();
+					keys.push_back(corner);
+					block.vertices.push_back(makeVertex(file, corner));
+				}
+				block.indices[index++] = slots[slot];
+			}
+		}
+	}
+}
+
+static void copyBlocks(unsigned int first, unsigned int last, void* context)
+{
+	ObjFile &file = *(ObjFile*)context;
+	for (unsigned int i = first; i < last; ++i)
+	{
+		ObjBlock &block = file.blocks[i];
+		Mesh &mesh = file.model->meshes[file.groups[block.group].mesh];
+		memcpy(&mesh.vertices[block.vertexOffset], block.vertices.data(), block.vertices.size() * sizeof(Vertex));
+		for (unsigned int j = 0; j < block.indices.size(); ++j)
+		{
+			mesh.indices[block.indexOffset + j] = block.indices[j] + block.vertexOffset;
+		}
+		std::vector<Vertex>().swap(block.vertices);
+		std::vector<unsigned int>().swap(block.indices);
+	}
+}
+
+struct ObjMaterial
+{
+	std::string name;
+	std::string diffuse;
+	std::string specular;
+};
+
+// texture statements may carry options, the path is the last token
+static std::string lastToken(const std::string &line)
+{
+	size_t end = line.find_last_not_of(" \t\r");
+	if (end == std::string::npos)
+		return std::string();
+	size_t start = line.find_last_of(" \t", end);
+	start = start == std::string::npos ? 0 : start + 1;
+	return line.substr(start, end - start + 1);
+}
+
+static void loadMaterialLibrary(const std::string &path, std::vector<ObjMaterial> &materials)
+{
+	FILE* file = fopen(path.c_str(), "r");
+	if (file == NULL)
+	{
+		printf("Error: Can't open material library '%s'.\n", path.c_str());
+		return;
+	}
+
+	char buffer[1024];
+	while (fgets(buffer, sizeof(buffer), file))
+	{
+		const char* p = skipSpaces(buffer, buffer + strlen(buffer));
+		std::string line(p);
+		if (!line.empty() && line[line.size() - 1] == '\n')
+			line.erase(line.size() - 1);
+
+		if (line.compare(0, 7, "newmtl ") == 0)
+		{
+			ObjMaterial material;
+			material.name = parseName(line.c_str() + 7, line.c_str() + line.size());
+			materials.push_back(material);
+		}
+		else if (!materials.empty() && line.compare(0, 7, "map_Kd ") == 0)
+			materials.back().diffuse = lastToken(line);
+		else if (!materials.empty() && line.compare(0, 7, "map_Ks ") == 0)
+			materials.back().specular = lastToken(line);
+	}
+
+	fclose(file);
+}
+
+static unsigned int findGroup(ObjFile &file, const std::string &material)
+{
+	for (unsigned int i = 0; i < file.groups.size(); ++i)
+	{
+		if (file.groups[i].material == material)
+			return i;
+	}
+
+	ObjGroup group;
+	group.material = material;
+	file.groups.push_back(group);
+	return file.groups.size() - 1;
+}
+
+static void addRange(ObjFile &file, unsigned int group, unsigned int chunk, unsigned int first, unsigned int last)
+{
+	if (first < last)
+	{
+		ObjRange range = { chunk, first, last };
+		file.groups[group].ranges.push_back(range);
+	}
+}
+
+bool loadObj(Model &model, const char* path, unsigned int flags)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0)
+	{
+		close(fd);
+		return false;
+	}
+
+	size_t size = info.st_size;
+	const char* data = (const char*)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return false;
+	madvise((void*)data, size, MADV_SEQUENTIAL);
+
+	ObjFile file;
+	file.model = &model;
+
+	// line-aligned chunks, a few per worker so stealing can balance them
+	unsigned int chunkCount = jobs::workerCount() * 4;
+	if (chunkCount == 0)
+		chunkCount = 1;
+	size_t chunkSize = size / chunkCount;
+	if (chunkSize < MIN_CHUNK_SIZE)
+		chunkSize = MIN_CHUNK_SIZE;
+
+	const char* end = data + size;
+	for (const char* p = data; p < end;)
+	{
+		const char* chunkEnd = (size_t)(end - p) > chunkSize ? skipLine(p + chunkSize, end) : end;
+		file.chunks.push_back(ObjChunk());
+		file.chunks.back().begin = p;
+		file.chunks.back().end = chunkEnd;
+		p = chunkEnd;
+	}
+
+	jobs::parallelFor(file.chunks.size(), 1, parseChunks, &file);
+
+	unsigned int positions = 0, texCoords = 0, normals = 0;
+	for (unsigned int i = 0; i < file.chunks.size(); ++i)
+	{
+		ObjChunk &chunk = file.chunks[i];
+		chunk.positionBase = positions;
+		chunk.texCoordBase = texCoords;
+		chunk.normalBase = normals;
+		positions += chunk.positions.size() / 3;
+		texCoords += chunk.texCoords.size() / 2;
+		normals += chunk.normals.size() / 3;
+	}
+	file.positions.resize(positions * 3);
+	file.texCoords.resize(texCoords * 2);
+	file.normals.resize(normals * 3);
+
+	jobs::parallelFor(file.chunks.size(), 1, resolveChunks, &file);
+
+	munmap((void*)data, size);
+
+	// split triangles into per-material ranges, material state carries over chunk borders
+	std::string materialLibrary;
+	unsigned int group = findGroup(file, std::string());
+	for (unsigned int i = 0; i < file.chunks.size(); ++i)
+	{
+		ObjChunk &chunk = file.chunks[i];
+		if (materialLibrary.empty())
+			materialLibrary = chunk.materialLibrary;
+
+		unsigned int first = 0;
+		for (unsigned int j = 0; j < chunk.materials.size(); ++j)
+		{
+			addRange(file, group, i, first, chunk.materials[j].triangle);
+			first = chunk.materials[j].triangle;
+			group = findGroup(file, chunk.materials[j].name);
+		}
+		addRange(file, group, i, first, chunk.corners.size() / 3);
+	}
+
+	for (unsigned int g = 0; g < file.groups.size(); ++g)
+	{
+		const std::vector<ObjRange> &ranges = file.groups[g].ranges;
+		unsigned int triangles = BLOCK_TRIANGLES;
+		for (unsigned int r = 0; r < ranges.size(); ++r)
+		{
+			for (unsigned int first = ranges[r].first; first < ranges[r].last;)
+			{
+				if (triangles == BLOCK_TRIANGLES)
+				{
+					file.blocks.push_back(ObjBlock());
+					file.blocks.back().group = g;
+					triangles = 0;
+				}
+
+				unsigned int last = ranges[r].last - first > BLOCK_TRIANGLES - triangles ? first + BLOCK_TRIANGLES - triangles : ranges[r].last;
+				ObjRange range = { ranges[r].chunk, first, last };
+				file.blocks.back().ranges.push_back(range);
+				triangles += last - first;
+				first = last;
+			}
+		}
+	}
+
+	jobs::parallelFor(file.blocks.size(), 1, buildBlocks, &file);
+
+	for (unsigned int g = 0; g < file.groups.size(); ++g)
+	{
+		file.groups[g].mesh = ~0u;
+	}
+
+	unsigned int meshCount = 0;
+	for (unsigned int b = 0; b < file.blocks.size(); ++b)
+	{
+		if (file.groups[file.blocks[b].group].mesh == ~0u)
+			file.groups[file.blocks[b].group].mesh = meshCount++;
+	}
+
+	std::vector<unsigned int> vertexCounts(meshCount, 0), indexCounts(meshCount, 0);
+	for (unsigned int b = 0; b < file.blocks.size(); ++b)
+	{
+		ObjBlock &block = file.blocks[b];
+		unsigned int mesh = file.groups[block.group].mesh;
+		block.vertexOffset = vertexCounts[mesh];
+		block.indexOffset = indexCounts[mesh];
+		vertexCounts[mesh] += block.vertices.size();
+		indexCounts[mesh] += block.indices.size();
+	}
+
+	unsigned int firstMesh = model.meshes.size();
+	model.meshes.resize(firstMesh + meshCount);
+	for (unsigned int g = 0; g < file.groups.size(); ++g)
+	{
+		if (file.groups[g].mesh == ~0u)
+			continue;
+		file.groups[g].mesh += firstMesh;
+		Mesh &mesh = model.meshes[file.groups[g].mesh];
+		mesh.vertices.resize(vertexCounts[file.groups[g].mesh - firstMesh]);
+		mesh.indices.resize(indexCounts[file.groups[g].mesh - firstMesh]);
+	}
+
+	jobs::parallelFor(file.blocks.size(), 1, copyBlocks, &file);
+
+	std::vector<ObjMaterial> materials;
+	if (!materialLibrary.empty())
+	{
+		std::string directory(path);
+		size_t slash = directory.find_last_of('/');
+		directory = slash == std::string::npos ? std::string() : directory.substr(0, slash + 1);
+		loadMaterialLibrary(directory + materialLibrary, materials);
+	}
+
+	// GL calls stay on the calling thread
+	for (unsigned int g = 0; g < file.groups.size(); ++g)
+	{
+		if (file.groups[g].mesh == ~0u)
+			continue;
+
+		Mesh &mesh = model.meshes[file.groups[g].mesh];
+		setupMesh(mesh, !(flags & MODEL_NO_GPU));
+		if (flags & MODEL_RELEASE_CPU_DATA)
+			releaseMeshData(mesh);
+
+		for (unsigned int m = 0; m < materials.size(); ++m)
+		{
+			if (materials[m].name != file.groups[g].material)
+				continue;
+			if (!materials[m].diffuse.empty())
+				mesh.textures.push_back(loadSharedTexture(model, materials[m].diffuse.c_str(), DIFFUSE));
+			if (!materials[m].specular.empty())
+				mesh.textures.push_back(loadSharedTexture(model, materials[m].specular.c_str(), SPECULAR));
+			break;
+		}
+	}
+
+	printf("  obj: %u chunks, %u positions, %u blocks on %u workers\n",
+		(unsigned int)file.chunks.size(), positions, (unsigned int)file.blocks.size(), jobs::workerCount());
+
+	return true;
+}
@@ -0,0 +1,14 @@
+#ifndef OBJLOADER_H
+#define OBJLOADER_H
+
+#include "model.h"
+
+// Wavefront OBJ/MTL importer that bypasses Assimp. The file is mapped into
+// memory, split into line-aligned chunks and parsed on all workers; faces are
+// fan-triangulated and split into one Mesh per material, with the same
+// vertex layout and UV orientation loadModel produces through Assimp.
+// Returns false when the file can't be read, loadModel then falls back to
+// Assimp.
+bool loadObj(Model &model, const char* path, unsigned int flags);
+
+#endif
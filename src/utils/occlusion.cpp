@@ -0,0 +1,318 @@
+#include "occlusion.h"
+#include "jobs.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+void initOcclusion(OcclusionBuffer &buffer, int width, int height)
+{
+	buffer.width = width;
+	buffer.height = height;
+	buffer.depth.assign(width * height, 1.0f);
+	buffer.tileMax.assign((width / OCCLUSION_TILE) * (height / OCCLUSION_TILE), 1.0f);
+	buffer.bands.resize(height / OCCLUSION_BAND);
+	buffer.viewProj = glm::mat4(1.0f);
+}
+
+void beginOcclusion(OcclusionBuffer &buffer, const glm::mat4 &viewProj)
+{
+	buffer.viewProj = viewProj;
+	buffer.triangles.clear();
+	for (unsigned int i = 0; i < buffer.bands.size(); ++i)
+	{
+		buffer.bands[i].clear();
+	}
+
+	buffer.stats.occluderTriangles = 0;
+	buffer.stats.tested = 0;
+	buffer.stats.occluded = 0;
+	buffer.stats.rasterizeMs = 0.0f;
+	buffer.stats.testMs = 0.0f;
+}
+
+static float elapsedMs(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void addOccluder(OcclusionBuffer &buffer, const Mesh &mesh, const glm::mat4 &model)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	glm::mat4 mvp = buffer.viewProj * model;
+
+	std::vector<glm::vec4> clip(mesh.vertices.size());
+	for (unsigned int i = 0; i < mesh.vertices.size(); ++i)
+	{
+		clip[i] = mvp * glm::vec4(mesh.vertices[i].position, 1.0f);
+	}
+
+	const float nearW = 1e-3f;
+	for (unsigned int i = 0; i + 2 < mesh.indices.size(); i += 3)
+	{
+		const glm::vec4 &a = clip[mesh.indices[i]];
+		const glm::vec4 &b = clip[mesh.indices[i + 1]];
+		const glm::vec4 &c = clip[mesh.indices[i + 2]];
+		// triangles crossing the camera plane would need clipping,
+		// dropping them only makes the buffer less occluding
+		if (a.w < nearW || b.w < nearW || c.w < nearW)
+			continue;
+
+		float screen[9];
+		const glm::vec4* corners[3] = { &a, &b, &c };
+		float minY = 1e30f, maxY = -1e30f;
+		for (unsigned int k = 0; k < 3; ++k)
+		{
+			const glm::vec4 &v = *corners[k];
+			screen[k * 3] = (v.x / v.w * 0.5f + 0.5f) * buffer.width;
+			screen[k * 3 + 1] = (v.y / v.w * 0.5f + 0.5f) * buffer.height;
+			screen[k * 3 + 2] = v.z / v.w * 0.5f + 0.5f;
+			minY = std::min(minY, screen[k * 3 + 1]);
+			maxY = std::max(maxY, screen[k * 3 + 1]);
+		}
+
+		if (maxY < 0.0f || minY >= buffer.height)
+			continue;
+
+		unsigned int index = buffer.triangles.size() / 9;
+		buffer.triangles.insert(buffer.triangles.end(), screen, screen + 9);
+
+		int firstBand = std::max(0, (int)minY / OCCLUSION_BAND);
+		int lastBand = std::min((int)buffer.bands.size() - 1, (int)maxY / OCCLUSION_BAND);
+		for (int band = firstBand; band <= lastBand; ++band)
+		{
+			buffer.bands[band].push_back(index);
+		}
+	}
+
+	buffer.stats.rasterizeMs += elapsedMs(start);
+}
+
+// Edge functions are positive inside a counter-clockwise triangle, depth is
+// interpolated from two of them, so both are a plane equation in x and y.
+static void rasterizeTriangle(OcclusionBuffer &buffer, const float* t, int bandY0, int bandY1)
+{
+	float x0 = t[0], y0 = t[1], z0 = t[2];
+	float x1 = t[3], y1 = t[4], z1 = t[5];
+	float x2 = t[6], y2 = t[7], z2 = t[8];
+
+	float area = (x1 - x0) * (y2 - y0) - (x2 - x0) * (y1 - y0);
+	if (std::fabs(area) < 1e-8f)
+		return;
+	if (area < 0.0f)
+	{
+		std::swap(x1, x2);
+		std::swap(y1, y2);
+		std::swap(z1, z2);
+		area = -area;
+	}
+
+	int minX = std::max(0, (int)std::floor(std::min(x0, std::min(x1, x2))));
+	int maxX = std::min(buffer.width - 1, (int)std::ceil(std::max(x0, std::max(x1, x2))));
+	int minY = std::max(bandY0, (int)std::floor(std::min(y0, std::min(y1, y2))));
+	int maxY = std::min(bandY1 - 1, (int)std::ceil(std::max(y0, std::max(y1, y2))));
+	if (minX > maxX || minY > maxY)
+		return;
+	minX &= ~3;
+
+	// E(x, y) = a * x + b * y + c for edges 0-1, 1-2 and 2-0
+	float a01 = y0 - y1, b01 = x1 - x0, c01 = -(b01 * y0 + a01 * x0);
+	float a12 = y1 - y2, b12 = x2 - x1, c12 = -(b12 * y1 + a12 * x1);
+	float a20 = y2 - y0, b20 = x0 - x2, c20 = -(b20 * y2 + a20 * x2);
+
+	// z = z0 + E20 * k1 + E01 * k2
+	float k1 = (z1 - z0) / area;
+	float k2 = (z2 - z0) / area;
+
+	for (int y = minY; y <= maxY; ++y)
+	{
+		float py = y + 0.5f;
+		float* row = &buffer.depth[y * buffer.width];
+#ifdef __SSE2__
+		__m128 px = _mm_add_ps(_mm_set1_ps(minX + 0.5f), _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f));
+		__m128 step = _mm_set1_ps(4.0f);
+		__m128 e01 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a01), px), _mm_set1_ps(b01 * py + c01));
+		__m128 e12 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a12), px), _mm_set1_ps(b12 * py + c12));
+		__m128 e20 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a20), px), _mm_set1_ps(b20 * py + c20));
+		__m128 step01 = _mm_mul_ps(_mm_set1_ps(a01), step);
+		__m128 step12 = _mm_mul_ps(_mm_set1_ps(a12), step);
+		__m128 step20 = _mm_mul_ps(_mm_set1_ps(a20), step);
+		__m128 zero = _mm_setzero_ps();
+
+		for (int x = minX; x <= maxX; x += 4)
+		{
+			__m128 inside = _mm_and_ps(_mm_cmpge_ps(e01, zero), _mm_and_ps(_mm_cmpge_ps(e12, zero), _mm_cmpge_ps(e20, zero)));
+			if (_mm_movemask_ps(inside) != 0)
+			{
+				__m128 z = _mm_add_ps(_mm_set1_ps(z0), _mm_add_ps(_mm_mul_ps(e20, _mm_set1_ps(k1)), _mm_mul_ps(e01, _mm_set1_ps(k2))));
+				z = _mm_max_ps(z, zero);
+				__m128 old = _mm_loadu_ps(row + x);
+				__m128 nearest = _mm_min_ps(old, z);
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, old)));
+			}
+			e01 = _mm_add_ps(e01, step01);
+			e12 = _mm_add_ps(e12, step12);
+			e20 = _mm_add_ps(e20, step20);
+		}
+#else
+		for (int x = minX; x <= maxX; ++x)
+		{
+			float px = x + 0.5f;
+			float e01 = a01 * px + b01 * py + c01;
+			float e12 = a12 * px + b12 * py + c12;
+			float e20 = a20 * px + b20 * py + c20;
+			if (e01 < 0.0f || e12 < 0.0f || e20 < 0.0f)
+				continue;
+			float z = std::max(0.0f, z0 + e20 * k1 + e01 * k2);
+			row[x] = std::min(row[x], z);
+		}
+#endif
+	}
+}
+
+static void rasterizeBands(unsigned int first, unsigned int last, void* context)
+{
+	OcclusionBuffer &buffer = *(OcclusionBuffer*)context;
+	int tilesX = buffer.width / OCCLUSION_TILE;
+	for (unsigned int band = first; band < last; ++band)
+	{
+		int y0 = band * OCCLUSION_BAND, y1 = y0 + OCCLUSION_BAND;
+		std::fill(buffer.depth.begin() + y0 * buffer.width, buffer.depth.begin() + y1 * buffer.width, 1.0f);
+
+		const std::vector<unsigned int> &triangles = buffer.bands[band];
+		for (unsigned int i = 0; i < triangles.size(); ++i)
+		{
+			rasterizeTriangle(buffer, &buffer.triangles[triangles[i] * 9], y0, y1);
+		}
+
+		for (int ty = y0 / OCCLUSION_TILE; ty < y1 / OCCLUSION_TILE; ++ty)
+		{
+			for (int tx = 0; tx < tilesX; ++tx)
+			{
+				float maxDepth = 0.0f;
+				for (int y = ty * OCCLUSION_TILE; y < (ty + 1) * OCCLUSION_TILE; ++y)
+				{
+					const float* row = &buffer.depth[y * buffer.width + tx * OCCLUSION_TILE];
+					for (int x = 0; x < OCCLUSION_TILE; ++x)
+						maxDepth = std::max(maxDepth, row[x]);
+				}
+				buffer.tileMax[ty * tilesX + tx] = maxDepth;
+			}
+		}
+	}
+}
+
+void rasterizeOccluders(OcclusionBuffer &buffer)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	buffer.stats.occluderTriangles = buffer.triangles.size() / 9;
+	jobs::parallelFor(buffer.bands.size(), 1, rasterizeBands, &buffer);
+	buffer.stats.rasterizeMs += elapsedMs(start);
+}
+
+static bool testBounds(const OcclusionBuffer &buffer, glm::vec3 boundsMin, glm::vec3 boundsMax, const glm::mat4 &mvp)
+{
+	float minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f, minZ = 1e30f;
+	for (unsigned int i = 0; i < 8; ++i)
+	{
+		glm::vec4 corner((i & 1) ? boundsMax.x : boundsMin.x, (i & 2) ? boundsMax.y : boundsMin.y, (i & 4) ? boundsMax.z : boundsMin.z, 1.0f);
+		glm::vec4 clip = mvp * corner;
+		// bounds reaching behind the camera are never occluded
+		if (clip.w < 1e-5f)
+			return false;
+
+		float x = (clip.x / clip.w * 0.5f + 0.5f) * buffer.width;
+		float y = (clip.y / clip.w * 0.5f + 0.5f) * buffer.height;
+		minX = std::min(minX, x);
+		maxX = std::max(maxX, x);
+		minY = std::min(minY, y);
+		maxY = std::max(maxY, y);
+		minZ = std::min(minZ, clip.z / clip.w * 0.5f + 0.5f);
+	}
+
+	int x0 = std::max(0, (int)std::floor(minX)), x1 = std::min(buffer.width - 1, (int)std::ceil(maxX));
+	int y0 = std::max(0, (int)std::floor(minY)), y1 = std::min(buffer.height - 1, (int)std::ceil(maxY));
+	// off screen, that is the frustum culler's business
+	if (x0 > x1 || y0 > y1)
+		return false;
+
+	int tilesX = buffer.width / OCCLUSION_TILE;
+	for (int ty = y0 / OCCLUSION_TILE; ty <= y1 / OCCLUSION_TILE; ++ty)
+	{
+		for (int tx = x0 / OCCLUSION_TILE; tx <= x1 / OCCLUSION_TILE; ++tx)
+		{
+			if (buffer.tileMax[ty * tilesX + tx] < minZ)
+				continue;
+
+			// tile only partly covered, look at the pixels under the bounds
+			int px0 = std::max(x0, tx * OCCLUSION_TILE), px1 = std::min(x1, tx * OCCLUSION_TILE + OCCLUSION_TILE - 1);
+			int py0 = std::max(y0, ty * OCCLUSION_TILE), py1 = std::min(y1, ty * OCCLUSION_TILE + OCCLUSION_TILE - 1);
+			for (int y = py0; y <= py1; ++y)
+			{
+				for (int x = px0; x <= px1; ++x)
+				{
+					if (buffer.depth[y * buffer.width + x] >= minZ)
+						return false;
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+bool isOccluded(OcclusionBuffer &buffer, glm::vec3 boundsMin, glm::vec3 boundsMax, const glm::mat4 &model)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	bool occluded = testBounds(buffer, boundsMin, boundsMax, buffer.viewProj * model);
+
+	buffer.stats.tested++;
+	buffer.stats.occluded += occluded ? 1 : 0;
+	buffer.stats.testMs += elapsedMs(start);
+
+	return occluded;
+}
+
+void cullMeshes(OcclusionBuffer &buffer, const Model &model, const glm::mat4 &transform, std::vector<unsigned char> &visible)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	glm::mat4 mvp = buffer.viewProj * transform;
+
+	visible.resize(model.meshes.size());
+	for (unsigned int i = 0; i < model.meshes.size(); ++i)
+	{
+		bool occluded = testBounds(buffer, model.meshes[i].boundsMin, model.meshes[i].boundsMax, mvp);
+		visible[i] = occluded ? 0 : 1;
+		buffer.stats.occluded += occluded ? 1 : 0;
+	}
+
+	buffer.stats.tested += model.meshes.size();
+	buffer.stats.testMs += elapsedMs(start);
+}
+
+static const Model* sortModel;
+
+static bool largerMesh(unsigned int a, unsigned int b)
+{
+	const Mesh &ma = sortModel->meshes[a], &mb = sortModel->meshes[b];
+	return glm::length(ma.boundsMax - ma.boundsMin) > glm::length(mb.boundsMax - mb.boundsMin);
+}
+
+void selectOccluders(const Model &model, unsigned int count, std::vector<unsigned int> &occluders)
+{
+	occluders.clear();
+	for (unsigned int i = 0; i < model.meshes.size(); ++i)
+	{
+		if (!model.meshes[i].vertices.empty())
+			occluders.push_back(i);
+	}
+
+	sortModel = &model;
+	std::sort(occluders.begin(), occluders.end(), largerMesh);
+	if (occluders.size() > count)
+		occluders.resize(count);
+}
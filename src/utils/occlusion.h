@@ -0,0 +1,56 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "model.h"
+
+// Software occlusion culling. A few large occluder meshes are rasterized on
+// the CPU into a low resolution depth buffer (SSE, horizontal bands spread
+// over the job system), then a max depth per 8x8 tile is built on top of it.
+// A mesh is occluded when the nearest point of its bounds lies behind every
+// occluder depth under its screen rectangle. No GL calls, so it also runs on
+// machines without a GPU.
+const int OCCLUSION_TILE = 8;
+const int OCCLUSION_BAND = 16;
+
+struct OcclusionStats
+{
+	unsigned int occluderTriangles;
+	unsigned int tested;
+	unsigned int occluded;
+	float rasterizeMs;
+	float testMs;
+};
+
+struct OcclusionBuffer
+{
+	int width, height;
+	// post-projection depth in [0, 1], 1 where no occluder was drawn
+	std::vector<float> depth;
+	// max depth of each OCCLUSION_TILE square
+	std::vector<float> tileMax;
+	glm::mat4 viewProj;
+	// screen space x, y, z for three vertices per triangle
+	std::vector<float> triangles;
+	// triangle indices touching each band
+	std::vector<std::vector<unsigned int> > bands;
+	OcclusionStats stats;
+};
+
+// width must be a multiple of 4, both a multiple of OCCLUSION_BAND
+void initOcclusion(OcclusionBuffer &buffer, int width, int height);
+void beginOcclusion(OcclusionBuffer &buffer, const glm::mat4 &viewProj);
+// needs the CPU-side copy of the mesh
+void addOccluder(OcclusionBuffer &buffer, const Mesh &mesh, const glm::mat4 &model);
+void rasterizeOccluders(OcclusionBuffer &buffer);
+
+bool isOccluded(OcclusionBuffer &buffer, glm::vec3 boundsMin, glm::vec3 boundsMax, const glm::mat4 &model);
+// visible[i] is 0 for every occluded mesh of the model
+void cullMeshes(OcclusionBuffer &buffer, const Model &model, const glm::mat4 &transform, std::vector<unsigned char> &visible);
+
+// indices of the `count` largest meshes that still have CPU-side data
+void selectOccluders(const Model &model, unsigned int count, std::vector<unsigned int> &occluders);
+
+#endif
@@ -0,0 +1,270 @@
+#include <glad/glad.h>
+#include <cstddef>
+#include <vector>
+
+#include "particles.h"
+#include "shader.h"
+#include "memory.h"
+
+bool particleComputeSupported()
+{
+#ifdef GL_VERSION_4_3
+	return GLAD_GL_VERSION_4_3 != 0;
+#else
+	return false;
+#endif
+}
+
+unsigned int createParticleUpdateProgram(bool compute)
+{
+#ifdef GL_VERSION_4_3
+	if (compute)
+	{
+		const char* paths[] = { "./src/shaders/particle_compute.glsl", "./src/shaders/particle_common.glsl" };
+		unsigned int cs = shader::loadFromFiles(paths, 2, GL_COMPUTE_SHADER);
+		unsigned int program = shader::createComputeProgram(cs);
+		glDeleteShader(cs);
+		return program;
+	}
+#endif
+
+	const char* paths[] = { "./src/shaders/particle_update_vertex.glsl", "./src/shaders/particle_common.glsl" };
+	const char* varyings[] = { "PositionLife", "VelocitySpawned" };
+	unsigned int vs = shader::loadFromFiles(paths, 2, GL_VERTEX_SHADER);
+	unsigned int program = shader::createFeedbackProgram(vs, varyings, 2);
+	glDeleteShader(vs);
+	return program;
+}
+
+ParticleEmitter defaultEmitter()
+{
+	ParticleEmitter emitter;
+	emitter.position = glm::vec3(0.0f, 3.0f, 0.0f);
+	emitter.spread = 0.4f;
+	emitter.speed = 6.0f;
+	emitter.lifetime = 4.0f;
+	emitter.gravity = glm::vec3(0.0f, -9.81f, 0.0f);
+	emitter.drag = 0.1f;
+	emitter.floorHeight = -2.0f;
+	emitter.size = 0.02f;
+	emitter.startColor = glm::vec3(1.0f, 0.6f, 0.2f);
+	emitter.endColor = glm::vec3(0.3f, 0.1f, 0.6f);
+	return emitter;
+}
+
+static void setStateAttributes(unsigned int buffer, unsigned int firstLocation, unsigned int divisor)
+{
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glEnableVertexAttribArray(firstLocation);
+	glVertexAttribPointer(firstLocation, 4, GL_FLOAT, GL_FALSE, sizeof(Particle), (void*)offsetof(Particle, positionLife));
+	glVertexAttribDivisor(firstLocation, divisor);
+	glEnableVertexAttribArray(firstLocation + 1);
+	glVertexAttribPointer(firstLocation + 1, 4, GL_FLOAT, GL_FALSE, sizeof(Particle), (void*)offsetof(Particle, velocitySpawned));
+	glVertexAttribDivisor(firstLocation + 1, divisor);
+}
+
+void initParticles(ParticleSystem &particles, unsigned int count, bool compute, const ParticleEmitter &emitter)
+{
+	particles.count = count;
+	particles.compute = compute;
+	particles.current = 0;
+	particles.frame = 0;
+	particles.stats = ParticleStats();
+	for (unsigned int i = 0; i < PARTICLE_QUERY_FRAMES; ++i)
+	{
+		particles.queryCounts[i] = 0;
+		particles.queryDrawn[i] = false;
+	}
+
+	// the only upload the particles ever get: dead at the emitter, dying one
+	// after the other over the first lifetime so spawning does not come in a burst
+	std::vector<Particle> initial(count);
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		initial[i].positionLife = glm::vec4(emitter.position, emitter.lifetime * (i + 1) / count);
+		initial[i].velocitySpawned = glm::vec4(0.0f, 0.0f, 0.0f, -1.0f);
+	}
+
+	unsigned int bufferCount = compute ? 1 : 2;
+	glGenBuffers(bufferCount, particles.buffers);
+	glGenVertexArrays(bufferCount, particles.drawVaos);
+	if (!compute)
+		glGenVertexArrays(2, particles.updateVaos);
+	else
+		particles.buffers[1] = particles.drawVaos[1] = particles.updateVaos[0] = particles.updateVaos[1] = 0;
+
+	memory::ScopedOwner owner("particles");
+	for (unsigned int i = 0; i < bufferCount; ++i)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, particles.buffers[i]);
+		glBufferData(GL_ARRAY_BUFFER, count * sizeof(Particle), i == 0 ? initial.data() : NULL, GL_DYNAMIC_COPY);
+		memory::allocate(memory::VERTEX_BUFFER, particles.buffers[i], count * sizeof(Particle));
+	}
+
+	// triangle strip corners, shared by every instance
+	const float corners[] = { -1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f };
+	glGenBuffers(1, &particles.quadVbo);
+	glBindBuffer(GL_ARRAY_BUFFER, particles.quadVbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+	memory::allocate(memory::VERTEX_BUFFER, particles.quadVbo, sizeof(corners));
+
+	for (unsigned int i = 0; i < bufferCount; ++i)
+	{
+		glBindVertexArray(particles.drawVaos[i]);
+		glBindBuffer(GL_ARRAY_BUFFER, particles.quadVbo);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+		setStateAttributes(particles.buffers[i], 1, 1);
+
+		if (!compute)
+		{
+			glBindVertexArray(particles.updateVaos[i]);
+			setStateAttributes(particles.buffers[i], 0, 0);
+		}
+	}
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glGenQueries(PARTICLE_QUERY_FRAMES * 2, &particles.queries[0][0]);
+}
+
+void destroyParticles(ParticleSystem &particles)
+{
+	unsigned int bufferCount = particles.compute ? 1 : 2;
+	for (unsigned int i = 0; i < bufferCount; ++i)
+		memory::release(memory::VERTEX_BUFFER, particles.buffers[i]);
+	memory::release(memory::VERTEX_BUFFER, particles.quadVbo);
+
+	glDeleteQueries(PARTICLE_QUERY_FRAMES * 2, &particles.queries[0][0]);
+	glDeleteBuffers(1, &particles.quadVbo);
+	glDeleteBuffers(bufferCount, particles.buffers);
+	glDeleteVertexArrays(bufferCount, particles.drawVaos);
+	if (!particles.compute)
+		glDeleteVertexArrays(2, particles.updateVaos);
+	particles.count = 0;
+}
+
+// results of the slot about to be reused, PARTICLE_QUERY_FRAMES frames old
+static void collectQueries(ParticleSystem &particles, unsigned int slot)
+{
+	if (particles.queryCounts[slot] == 0)
+		return;
+
+	int available = 0;
+	unsigned int last = particles.queryDrawn[slot] ? 1 : 0;
+	glGetQueryObjectiv(particles.queries[slot][last], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (available)
+	{
+		GLuint64 updateNs = 0, drawNs = 0;
+		glGetQueryObjectui64v(particles.queries[slot][0], GL_QUERY_RESULT, &updateNs);
+		if (particles.queryDrawn[slot])
+			glGetQueryObjectui64v(particles.queries[slot][1], GL_QUERY_RESULT, &drawNs);
+
+		ParticleStats &stats = particles.stats;
+		stats.updateMs = updateNs / 1e6f;
+		stats.drawMs = drawNs / 1e6f;
+		stats.measuredFrames++;
+		stats.measuredParticles += particles.queryCounts[slot];
+		stats.updateTotalMs += updateNs / 1e6;
+		stats.drawTotalMs += drawNs / 1e6;
+	}
+	particles.queryCounts[slot] = 0;
+	particles.queryDrawn[slot] = false;
+}
+
+static void setUpdateUniforms(unsigned int program, const ParticleEmitter &emitter, float deltaTime, unsigned int frame)
+{
+	glUniform1f(glGetUniformLocation(program, "deltaTime"), deltaTime);
+	// a different random stream per frame, hashed with the particle index
+	glUniform1ui(glGetUniformLocation(program, "frameSeed"), frame * 2654435761u);
+	glUniform3fv(glGetUniformLocation(program, "emitterPosition"), 1, &emitter.position.x);
+	glUniform1f(glGetUniformLocation(program, "emitterSpread"), emitter.spread);
+	glUniform1f(glGetUniformLocation(program, "emitterSpeed"), emitter.speed);
+	glUniform1f(glGetUniformLocation(program, "lifetime"), emitter.lifetime);
+	glUniform3fv(glGetUniformLocation(program, "gravity"), 1, &emitter.gravity.x);
+	glUniform1f(glGetUniformLocation(program, "drag"), emitter.drag);
+	glUniform1f(glGetUniformLocation(program, "floorHeight"), emitter.floorHeight);
+}
+
+void updateParticles(ParticleSystem &particles, unsigned int updateProgram, const ParticleEmitter &emitter, float deltaTime)
+{
+	unsigned int slot = particles.frame % PARTICLE_QUERY_FRAMES;
+	collectQueries(particles, slot);
+	if (particles.count == 0)
+		return;
+
+	glBeginQuery(GL_TIME_ELAPSED, particles.queries[slot][0]);
+	glUseProgram(updateProgram);
+	setUpdateUniforms(updateProgram, emitter, deltaTime, particles.frame);
+
+#ifdef GL_VERSION_4_3
+	if (particles.compute)
+	{
+		glUniform1ui(glGetUniformLocation(updateProgram, "particleCount"), particles.count);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particles.buffers[0]);
+		glDispatchCompute((particles.count + 255) / 256, 1, 1);
+		// the draw reads the same buffer as instanced attributes
+		glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+	}
+	else
+#endif
+	{
+		unsigned int next = 1 - particles.current;
+		glEnable(GL_RASTERIZER_DISCARD);
+		glBindVertexArray(particles.updateVaos[particles.current]);
+		glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, particles.buffers[next]);
+		glBeginTransformFeedback(GL_POINTS);
+		glDrawArrays(GL_POINTS, 0, particles.count);
+		glEndTransformFeedback();
+		glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+		glBindVertexArray(0);
+		glDisable(GL_RASTERIZER_DISCARD);
+		particles.current = next;
+	}
+	glEndQuery(GL_TIME_ELAPSED);
+
+	particles.queryCounts[slot] = particles.count;
+	particles.frame++;
+}
+
+void drawParticles(ParticleSystem &particles, unsigned int drawProgram, const ParticleEmitter &emitter, const glm::mat4 &view, const glm::mat4 &proj)
+{
+	if (particles.count == 0)
+		return;
+
+	// the slot of the update that just ran
+	unsigned int slot = (particles.frame + PARTICLE_QUERY_FRAMES - 1) % PARTICLE_QUERY_FRAMES;
+	bool timed = particles.queryCounts[slot] != 0 && !particles.queryDrawn[slot];
+	if (timed)
+		glBeginQuery(GL_TIME_ELAPSED, particles.queries[slot][1]);
+
+	glUseProgram(drawProgram);
+	glUniformMatrix4fv(glGetUniformLocation(drawProgram, "view"), 1, GL_FALSE, &view[0][0]);
+	glUniformMatrix4fv(glGetUniformLocation(drawProgram, "proj"), 1, GL_FALSE, &proj[0][0]);
+	glUniform1f(glGetUniformLocation(drawProgram, "size"), emitter.size);
+	glUniform1f(glGetUniformLocation(drawProgram, "lifetime"), emitter.lifetime);
+	glUniform3fv(glGetUniformLocation(drawProgram, "startColor"), 1, &emitter.startColor.x);
+	glUniform3fv(glGetUniformLocation(drawProgram, "endColor"), 1, &emitter.endColor.x);
+
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE);
+	glDepthMask(GL_FALSE);
+	glBindVertexArray(particles.drawVaos[particles.current]);
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, particles.count);
+	glBindVertexArray(0);
+	glDepthMask(GL_TRUE);
+	glDisable(GL_BLEND);
+
+	if (timed)
+	{
+		glEndQuery(GL_TIME_ELAPSED);
+		particles.queryDrawn[slot] = true;
+	}
+}
+
+double particleThroughput(const ParticleStats &stats)
+{
+	if (stats.updateTotalMs <= 0.0)
+		return 0.0;
+	return stats.measuredParticles / (stats.updateTotalMs * 1000.0);
+}
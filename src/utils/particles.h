@@ -0,0 +1,84 @@
+#ifndef PARTICLES_H
+#define PARTICLES_H
+
+#include <glm/glm.hpp>
+
+// GPU particle system. The state lives in vertex buffers and never comes
+// back to the CPU: a vertex shader advances it through transform feedback
+// into a second buffer, ping-ponging every frame, or a compute shader
+// updates it in place when GL 4.3 is there. The same buffer is then drawn
+// as instanced camera facing quads.
+
+// must match particle_update_vertex.glsl and particle_compute.glsl
+struct Particle
+{
+	// xyz position, w remaining life in seconds
+	glm::vec4 positionLife;
+	// xyz velocity, w negative until the particle first spawns
+	glm::vec4 velocitySpawned;
+};
+
+struct ParticleEmitter
+{
+	glm::vec3 position;
+	// half angle of the emission cone around +y, in radians
+	float spread;
+	float speed;
+	float lifetime;
+	glm::vec3 gravity;
+	float drag;
+	// particles bounce off the plane y = floorHeight
+	float floorHeight;
+	float size;
+	glm::vec3 startColor, endColor;
+};
+
+// timer queries are read this many frames late so they never stall
+const unsigned int PARTICLE_QUERY_FRAMES = 3;
+
+struct ParticleStats
+{
+	// GPU time of the last measured frame
+	float updateMs;
+	float drawMs;
+	// totals over every measured frame, for the throughput report
+	unsigned int measuredFrames;
+	unsigned long long measuredParticles;
+	double updateTotalMs, drawTotalMs;
+};
+
+struct ParticleSystem
+{
+	unsigned int count;
+	bool compute;
+	// transform feedback reads buffers[current] and writes the other one,
+	// the compute path only uses buffers[0]
+	unsigned int buffers[2];
+	unsigned int updateVaos[2];
+	unsigned int drawVaos[2];
+	unsigned int quadVbo;
+	unsigned int current;
+	unsigned int frame;
+	// update and draw query per frame in flight
+	unsigned int queries[PARTICLE_QUERY_FRAMES][2];
+	// particles updated in the frame of each slot, zero when it holds no result
+	unsigned int queryCounts[PARTICLE_QUERY_FRAMES];
+	bool queryDrawn[PARTICLE_QUERY_FRAMES];
+	ParticleStats stats;
+};
+
+bool particleComputeSupported();
+// the update program for either path, particle_common.glsl appended
+unsigned int createParticleUpdateProgram(bool compute);
+ParticleEmitter defaultEmitter();
+// count particles, spawning spread evenly over the first lifetime. The
+// update program passed later has to be built for the same path.
+void initParticles(ParticleSystem &particles, unsigned int count, bool compute, const ParticleEmitter &emitter);
+void destroyParticles(ParticleSystem &particles);
+void updateParticles(ParticleSystem &particles, unsigned int updateProgram, const ParticleEmitter &emitter, float deltaTime);
+// additive, depth tested but not written, call after the opaque geometry
+void drawParticles(ParticleSystem &particles, unsigned int drawProgram, const ParticleEmitter &emitter, const glm::mat4 &view, const glm::mat4 &proj);
+// update throughput over every measured frame, in millions of particles per second
+double particleThroughput(const ParticleStats &stats);
+
+#endif
@@ -0,0 +1,163 @@
+#include "png.h"
+
+#include <cstdio>
+#include <cstring>
+
+struct CrcTable
+{
+	unsigned int values[256];
+
+	CrcTable()
+	{
+		for (unsigned int i = 0; i < 256; ++i)
+		{
+			unsigned int c = i;
+			for (int k = 0; k < 8; ++k)
+				c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+			values[i] = c;
+		}
+	}
+};
+
+static unsigned int crc32(unsigned int crc, const unsigned char* data, size_t size)
+{
+	// initialized once, thread-safe since C++11
+	static const CrcTable table;
+	const unsigned int* crcTable = table.values;
+
+	crc = ~crc;
+	for (size_t i = 0; i < size; ++i)
+		crc = crcTable[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+static void putBigEndian(std::vector<unsigned char> &out, unsigned int value)
+{
+	out.push_back(value >> 24);
+	out.push_back(value >> 16);
+	out.push_back(value >> 8);
+	out.push_back(value);
+}
+
+static void beginChunk(std::vector<unsigned char> &out, const char* type, unsigned int size)
+{
+	putBigEndian(out, size);
+	out.insert(out.end(), type, type + 4);
+}
+
+// crc covers the type and data, which start at `start`
+static void endChunk(std::vector<unsigned char> &out, size_t start)
+{
+	putBigEndian(out, crc32(0, &out[start + 4], out.size() - start - 4));
+}
+
+void encodePng(const unsigned char* pixels, int width, int height, int channels, std::vector<unsigned char> &out)
+{
+	static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	static const unsigned char colorTypes[5] = { 0, 0, 4, 2, 6 };
+
+	size_t rowSize = (size_t)width * channels + 1;
+	size_t rawSize = rowSize * height;
+	size_t blocks = (rawSize + 65534) / 65535;
+	size_t idatSize = 2 + rawSize + blocks * 5 + 4;
+
+	out.clear();
+	out.reserve(8 + 25 + 12 + idatSize + 12);
+	out.insert(out.end(), signature, signature + 8);
+
+	size_t start = out.size();
+	beginChunk(out, "IHDR", 13);
+	putBigEndian(out, width);
+	putBigEndian(out, height);
+	out.push_back(8);
+	out.push_back(colorTypes[channels]);
+	out.push_back(0);
+	out.push_back(0);
+	out.push_back(0);
+	endChunk(out, start);
+
+	start = out.size();
+	beginChunk(out, "IDAT", idatSize);
+	// zlib header, no compression
+	out.push_back(0x78);
+	out.push_back(0x01);
+
+	unsigned int adlerA = 1, adlerB = 0;
+	size_t remaining = rawSize, row = 0, column = 0;
+	while (remaining > 0)
+	{
+		unsigned int blockSize = remaining > 65535 ? 65535 : remaining;
+		remaining -= blockSize;
+		out.push_back(remaining == 0 ? 1 : 0);
+		out.push_back(blockSize & 0xff);
+		out.push_back(blockSize >> 8);
+		out.push_back(~blockSize & 0xff);
+		out.push_back((~blockSize >> 8) & 0xff);
+
+		// block boundaries fall anywhere inside a row, filter bytes included
+		size_t blockStart = out.size();
+		out.resize(blockStart + blockSize);
+		unsigned char* dest = &out[blockStart];
+		while (blockSize > 0)
+		{
+			if (column == 0)
+			{
+				*dest++ = 0;
+				column = 1;
+				blockSize--;
+				continue;
+			}
+			size_t count = rowSize - column;
+			if (count > blockSize)
+				count = blockSize;
+			memcpy(dest, pixels + row * (rowSize - 1) + column - 1, count);
+			dest += count;
+			blockSize -= count;
+			column += count;
+			if (column == rowSize)
+			{
+				column = 0;
+				row++;
+			}
+		}
+
+		// adler32 in runs short enough not to overflow before the modulo
+		const unsigned char* data = &out[blockStart];
+		size_t size = out.size() - blockStart;
+		while (size > 0)
+		{
+			size_t run = size < 5552 ? size : 5552;
+			size -= run;
+			for (size_t i = 0; i < run; ++i)
+			{
+				adlerA += data[i];
+				adlerB += adlerA;
+			}
+			data += run;
+			adlerA %= 65521;
+			adlerB %= 65521;
+		}
+	}
+	putBigEndian(out, (adlerB << 16) | adlerA);
+	endChunk(out, start);
+
+	start = out.size();
+	beginChunk(out, "IEND", 0);
+	endChunk(out, start);
+}
+
+bool writePng(const char* path, const unsigned char* pixels, int width, int height, int channels)
+{
+	FILE* file = fopen(path, "wb");
+	if (file == NULL)
+	{
+		printf("Error: Can't open file '%s'.\n", path);
+		return false;
+	}
+
+	std::vector<unsigned char> png;
+	encodePng(pixels, width, height, channels, png);
+	bool written = fwrite(png.data(), 1, png.size(), file) == png.size();
+	fclose(file);
+	return written;
+}
@@ -0,0 +1,12 @@
+#ifndef PNG_H
+#define PNG_H
+
+#include <vector>
+
+// Minimal PNG writer, 8 bits per channel, no filtering and stored (not
+// compressed) deflate blocks. Made for speed and no dependencies, files are
+// about the size of the raw pixels. rows are top to bottom.
+void encodePng(const unsigned char* pixels, int width, int height, int channels, std::vector<unsigned char> &out);
+bool writePng(const char* path, const unsigned char* pixels, int width, int height, int channels);
+
+#endif
@@ -0,0 +1,139 @@
+#include "resources.h"
+
+#include <cstdio>
+
+void initResources(ResourceManager &resources)
+{
+	resources.slots.clear();
+	resources.freeSlots.clear();
+	resources.byPath.clear();
+	resources.streamer = NULL;
+	resources.stats = ResourceStats();
+}
+
+static void unload(ResourceManager &resources, ModelHandle handle)
+{
+	ModelSlot &slot = resources.slots[handle];
+	if (resources.streamer)
+		removeStreamedModel(*resources.streamer, *slot.model);
+	destroyModel(*slot.model);
+	delete slot.model;
+	slot.model = NULL;
+	slot.references = 0;
+	resources.byPath.erase(slot.path);
+	slot.path.clear();
+	resources.freeSlots.push_back(handle);
+	resources.stats.loaded--;
+	resources.stats.unloads++;
+}
+
+void destroyResources(ResourceManager &resources)
+{
+	for (unsigned int i = 0; i < resources.slots.size(); ++i)
+	{
+		ModelSlot &slot = resources.slots[i];
+		if (slot.model == NULL)
+			continue;
+		printf("Warning: %s still has %u references at shutdown\n", slot.path.c_str(), slot.references);
+		resources.stats.references -= slot.references;
+		unload(resources, i);
+	}
+	initResources(resources);
+}
+
+ModelHandle acquireModel(ResourceManager &resources, const char* path, const char* texturesDir, unsigned int flags)
+{
+	std::map<std::string, ModelHandle>::iterator found = resources.byPath.find(path);
+	if (found != resources.byPath.end())
+	{
+		const Model &model = *resources.slots[found->second].model;
+		if (model.cpuDataReleased && !(flags & MODEL_RELEASE_CPU_DATA))
+			printf("Warning: %s is shared without its CPU-side mesh data, it was released after upload\n", path);
+		resources.stats.hits++;
+		retainModel(resources, found->second);
+		return found->second;
+	}
+
+	Model* model = new Model();
+	if (!loadModel(*model, path, texturesDir, flags))
+	{
+		destroyModel(*model);
+		delete model;
+		return NO_MODEL;
+	}
+	return addModel(resources, path, model);
+}
+
+ModelHandle findModel(const ResourceManager &resources, const char* path)
+{
+	std::map<std::string, ModelHandle>::const_iterator found = resources.byPath.find(path);
+	return found != resources.byPath.end() ? found->second : NO_MODEL;
+}
+
+ModelHandle addModel(ResourceManager &resources, const char* path, Model* model)
+{
+	ModelHandle handle;
+	if (!resources.freeSlots.empty())
+	{
+		handle = resources.freeSlots.back();
+		resources.freeSlots.pop_back();
+	}
+	else
+	{
+		handle = resources.slots.size();
+		resources.slots.push_back(ModelSlot());
+	}
+
+	ModelSlot &slot = resources.slots[handle];
+	slot.model = model;
+	slot.path = path;
+	slot.references = 1;
+	modelBounds(*model, slot.boundsMin, slot.boundsMax);
+	resources.byPath[slot.path] = handle;
+
+	resources.stats.loaded++;
+	resources.stats.references++;
+	resources.stats.loads++;
+	return handle;
+}
+
+void retainModel(ResourceManager &resources, ModelHandle handle)
+{
+	resources.slots[handle].references++;
+	resources.stats.references++;
+}
+
+void releaseModel(ResourceManager &resources, ModelHandle handle)
+{
+	ModelSlot &slot = resources.slots[handle];
+	if (slot.references == 0)
+	{
+		printf("Warning: model handle %u released more often than acquired\n", handle);
+		return;
+	}
+	resources.stats.references--;
+	if (--slot.references == 0)
+		unload(resources, handle);
+}
+
+Model &getModel(ResourceManager &resources, ModelHandle handle)
+{
+	return *resources.slots[handle].model;
+}
+
+unsigned int createInstance(Scene &scene, ResourceManager &resources, ModelHandle handle, glm::vec3 position, glm::vec3 rotation, glm::vec3 scale)
+{
+	retainModel(resources, handle);
+	unsigned int entity = createEntity(scene, position, rotation, scale, handle);
+	const ModelSlot &slot = resources.slots[handle];
+	setBounds(scene, entity, slot.boundsMin, slot.boundsMax);
+	return entity;
+}
+
+void destroyInstance(Scene &scene, ResourceManager &resources, unsigned int entity)
+{
+	ModelHandle handle = scene.renderable[entity];
+	destroyEntity(scene, entity);
+	if (handle != NO_MODEL)
+		releaseModel(resources, handle);
+}
@@ -0,0 +1,70 @@
+#ifndef RESOURCES_H
+#define RESOURCES_H
+
+#include <vector>
+#include <string>
+#include <map>
+#include <glm/glm.hpp>
+
+#include "model.h"
+#include "scene.h"
+#include "texture_stream.h"
+
+// Models shared by path. The first acquire of a path loads it, later ones
+// only add a reference, and the last release destroys it, so placing an
+// asset many times costs one import and one copy of its buffers and
+// textures. Handles index slots, reused after their model is released.
+typedef unsigned int ModelHandle;
+const ModelHandle NO_MODEL = NO_RENDERABLE;
+
+struct ModelSlot
+{
+	// heap allocated so references stay valid while slots grow
+	Model* model;
+	std::string path;
+	unsigned int references;
+	// object space, for the bounds of new instances
+	glm::vec3 boundsMin, boundsMax;
+};
+
+struct ResourceStats
+{
+	unsigned int loaded;
+	unsigned int references;
+	unsigned int loads;
+	// acquires served by an already loaded model
+	unsigned int hits;
+	unsigned int unloads;
+};
+
+struct ResourceManager
+{
+	std::vector<ModelSlot> slots;
+	std::vector<ModelHandle> freeSlots;
+	std::map<std::string, ModelHandle> byPath;
+	// optional, unloaded models are removed from it before they are destroyed
+	TextureStreamer* streamer;
+	ResourceStats stats;
+};
+
+void initResources(ResourceManager &resources);
+// destroys the models still referenced and reports them
+void destroyResources(ResourceManager &resources);
+// NO_MODEL when the load fails. texturesDir and flags only matter for the
+// first acquire of a path.
+ModelHandle acquireModel(ResourceManager &resources, const char* path, const char* texturesDir, unsigned int flags = 0);
+// NO_MODEL when the path is not loaded, adds no reference
+ModelHandle findModel(const ResourceManager &resources, const char* path);
+// takes over a model loaded elsewhere, e.g. on a loader thread, as path
+// with one reference; the path must not be loaded yet
+ModelHandle addModel(ResourceManager &resources, const char* path, Model* model);
+void retainModel(ResourceManager &resources, ModelHandle handle);
+void releaseModel(ResourceManager &resources, ModelHandle handle);
+Model &getModel(ResourceManager &resources, ModelHandle handle);
+
+// An instance is a scene entity whose renderable is the model handle: a
+// transform, bounds and the handle, holding one reference to the model.
+unsigned int createInstance(Scene &scene, ResourceManager &resources, ModelHandle handle, glm::vec3 position, glm::vec3 rotation, glm::vec3 scale);
+void destroyInstance(Scene &scene, ResourceManager &resources, unsigned int entity);
+
+#endif
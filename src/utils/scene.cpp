@@ -0,0 +1,302 @@
+#include "scene.h"
+#include "jobs.h"
+
+#include <cmath>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+unsigned int createEntity(Scene &scene, glm::vec3 position, glm::vec3 rotation, glm::vec3 scale, unsigned int renderable)
+{
+	unsigned int entity;
+	if (!scene.freeEntities.empty())
+	{
+		entity = scene.freeEntities.back();
+		scene.freeEntities.pop_back();
+	}
+	else
+	{
+		entity = scene.positionX.size();
+		unsigned int count = entity + 1;
+		scene.positionX.resize(count);
+		scene.positionY.resize(count);
+		scene.positionZ.resize(count);
+		scene.rotationX.resize(count);
+		scene.rotationY.resize(count);
+		scene.rotationZ.resize(count);
+		scene.scaleX.resize(count);
+		scene.scaleY.resize(count);
+		scene.scaleZ.resize(count);
+		scene.boundsMin.resize(count);
+		scene.boundsMax.resize(count);
+		scene.renderable.resize(count);
+		scene.alive.resize(count);
+		scene.world.resize(count);
+		scene.normal.resize(count);
+		scene.worldBoundsMin.resize(count);
+		scene.worldBoundsMax.resize(count);
+	}
+
+	setPosition(scene, entity, position);
+	setRotation(scene, entity, rotation);
+	setScale(scene, entity, scale);
+	setBounds(scene, entity, glm::vec3(0.0f), glm::vec3(0.0f));
+	scene.renderable[entity] = renderable;
+	scene.alive[entity] = 1;
+
+	scene.world[entity] = glm::mat4(1.0f);
+	scene.normal[entity] = glm::mat3(1.0f);
+	scene.worldBoundsMin[entity] = position;
+	scene.worldBoundsMax[entity] = position;
+
+	return entity;
+}
+
+void destroyEntity(Scene &scene, unsigned int entity)
+{
+	if (!scene.alive[entity])
+		return;
+	// transforms still run over the slot, so it keeps a valid scale
+	scene.alive[entity] = 0;
+	scene.renderable[entity] = NO_RENDERABLE;
+	scene.freeEntities.push_back(entity);
+}
+
+unsigned int entityCount(const Scene &scene)
+{
+	return scene.positionX.size();
+}
+
+glm::vec3 getPosition(const Scene &scene, unsigned int entity)
+{
+	return glm::vec3(scene.positionX[entity], scene.positionY[entity], scene.positionZ[entity]);
+}
+
+glm::vec3 getRotation(const Scene &scene, unsigned int entity)
+{
+	return glm::vec3(scene.rotationX[entity], scene.rotationY[entity], scene.rotationZ[entity]);
+}
+
+glm::vec3 getScale(const Scene &scene, unsigned int entity)
+{
+	return glm::vec3(scene.scaleX[entity], scene.scaleY[entity], scene.scaleZ[entity]);
+}
+
+void setPosition(Scene &scene, unsigned int entity, glm::vec3 position)
+{
+	scene.positionX[entity] = position.x;
+	scene.positionY[entity] = position.y;
+	scene.positionZ[entity] = position.z;
+}
+
+void setRotation(Scene &scene, unsigned int entity, glm::vec3 rotation)
+{
+	scene.rotationX[entity] = rotation.x;
+	scene.rotationY[entity] = rotation.y;
+	scene.rotationZ[entity] = rotation.z;
+}
+
+void setScale(Scene &scene, unsigned int entity, glm::vec3 scale)
+{
+	scene.scaleX[entity] = scale.x;
+	scene.scaleY[entity] = scale.y;
+	scene.scaleZ[entity] = scale.z;
+}
+
+void setBounds(Scene &scene, unsigned int entity, glm::vec3 min, glm::vec3 max)
+{
+	scene.boundsMin[entity] = min;
+	scene.boundsMax[entity] = max;
+}
+
+static const float DEG_TO_RAD = 0.017453292519943295f;
+
+// world bounds of a local box: transformed center plus extents
+// projected on the absolute values of the world axes
+static void updateBounds(Scene &scene, unsigned int e)
+{
+	const glm::mat4 &m = scene.world[e];
+	glm::vec3 center = (scene.boundsMin[e] + scene.boundsMax[e]) * 0.5f;
+	glm::vec3 extent = (scene.boundsMax[e] - scene.boundsMin[e]) * 0.5f;
+
+	glm::vec3 worldCenter = glm::vec3(m * glm::vec4(center, 1.0f));
+	glm::vec3 worldExtent;
+	for (unsigned int i = 0; i < 3; ++i)
+	{
+		worldExtent[i] = std::fabs(m[0][i]) * extent.x + std::fabs(m[1][i]) * extent.y + std::fabs(m[2][i]) * extent.z;
+	}
+
+	scene.worldBoundsMin[e] = worldCenter - worldExtent;
+	scene.worldBoundsMax[e] = worldCenter + worldExtent;
+}
+
+// world = T * Rz * Ry * Rx * S, normal = Rz * Ry * Rx * S^-1
+static void updateTransform(Scene &scene, unsigned int e)
+{
+	float sx = std::sin(scene.rotationX[e] * DEG_TO_RAD), cx = std::cos(scene.rotationX[e] * DEG_TO_RAD);
+	float sy = std::sin(scene.rotationY[e] * DEG_TO_RAD), cy = std::cos(scene.rotationY[e] * DEG_TO_RAD);
+	float sz = std::sin(scene.rotationZ[e] * DEG_TO_RAD), cz = std::cos(scene.rotationZ[e] * DEG_TO_RAD);
+
+	glm::vec3 c0(cz * cy, sz * cy, -sy);
+	glm::vec3 c1(cz * sy * sx - sz * cx, sz * sy * sx + cz * cx, cy * sx);
+	glm::vec3 c2(cz * sy * cx + sz * sx, sz * sy * cx - cz * sx, cy * cx);
+
+	glm::mat4 &world = scene.world[e];
+	world[0] = glm::vec4(c0 * scene.scaleX[e], 0.0f);
+	world[1] = glm::vec4(c1 * scene.scaleY[e], 0.0f);
+	world[2] = glm::vec4(c2 * scene.scaleZ[e], 0.0f);
+	world[3] = glm::vec4(scene.positionX[e], scene.positionY[e], scene.positionZ[e], 1.0f);
+
+	glm::mat3 &normal = scene.normal[e];
+	normal[0] = c0 / scene.scaleX[e];
+	normal[1] = c1 / scene.scaleY[e];
+	normal[2] = c2 / scene.scaleZ[e];
+
+	updateBounds(scene, e);
+}
+
+#ifdef __SSE2__
+// four sines and cosines at once: reduce to [-pi/4, pi/4] by quadrant,
+// then minimax polynomials (cephes single precision coefficients)
+static void sincos4(__m128 x, __m128 &s, __m128 &c)
+{
+	const __m128 twoOverPi = _mm_set1_ps(0.63661977236758134f);
+	__m128i quadrant = _mm_cvtps_epi32(_mm_mul_ps(x, twoOverPi));
+	__m128 j = _mm_cvtepi32_ps(quadrant);
+
+	// x - j * pi/2 in three steps to keep precision
+	x = _mm_sub_ps(x, _mm_mul_ps(j, _mm_set1_ps(1.5703125f)));
+	x = _mm_sub_ps(x, _mm_mul_ps(j, _mm_set1_ps(4.837512969970703125e-4f)));
+	x = _mm_sub_ps(x, _mm_mul_ps(j, _mm_set1_ps(7.54978995489188216e-8f)));
+
+	__m128 x2 = _mm_mul_ps(x, x);
+
+	__m128 sinPoly = _mm_set1_ps(-1.9515295891e-4f);
+	sinPoly = _mm_add_ps(_mm_mul_ps(sinPoly, x2), _mm_set1_ps(8.3321608736e-3f));
+	sinPoly = _mm_add_ps(_mm_mul_ps(sinPoly, x2), _mm_set1_ps(-1.6666654611e-1f));
+	sinPoly = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(sinPoly, x2), x), x);
+
+	__m128 cosPoly = _mm_set1_ps(2.443315711809948e-5f);
+	cosPoly = _mm_add_ps(_mm_mul_ps(cosPoly, x2), _mm_set1_ps(-1.388731625493765e-3f));
+	cosPoly = _mm_add_ps(_mm_mul_ps(cosPoly, x2), _mm_set1_ps(4.166664568298827e-2f));
+	cosPoly = _mm_mul_ps(_mm_mul_ps(cosPoly, x2), x2);
+	cosPoly = _mm_add_ps(_mm_sub_ps(cosPoly, _mm_mul_ps(x2, _mm_set1_ps(0.5f))), _mm_set1_ps(1.0f));
+
+	// odd quadrants swap sine and cosine
+	const __m128i one = _mm_set1_epi32(1);
+	const __m128i two = _mm_set1_epi32(2);
+	__m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(quadrant, one), one));
+	__m128 sinResult = _mm_or_ps(_mm_and_ps(swap, cosPoly), _mm_andnot_ps(swap, sinPoly));
+	__m128 cosResult = _mm_or_ps(_mm_and_ps(swap, sinPoly), _mm_andnot_ps(swap, cosPoly));
+
+	// sine is negative in quadrants 2 and 3, cosine in 1 and 2
+	__m128 sinSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(quadrant, two), 30));
+	__m128 cosSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(quadrant, one), two), 30));
+
+	s = _mm_xor_ps(sinResult, sinSign);
+	c = _mm_xor_ps(cosResult, cosSign);
+}
+
+static void updateTransforms4(Scene &scene, unsigned int e)
+{
+	const __m128 toRadians = _mm_set1_ps(DEG_TO_RAD);
+	__m128 sx, cx, sy, cy, sz, cz;
+	sincos4(_mm_mul_ps(_mm_loadu_ps(&scene.rotationX[e]), toRadians), sx, cx);
+	sincos4(_mm_mul_ps(_mm_loadu_ps(&scene.rotationY[e]), toRadians), sy, cy);
+	sincos4(_mm_mul_ps(_mm_loadu_ps(&scene.rotationZ[e]), toRadians), sz, cz);
+
+	__m128 szsy = _mm_mul_ps(sz, sy);
+	__m128 czsy = _mm_mul_ps(cz, sy);
+
+	// rotation matrix, one lane per entity
+	__m128 r00 = _mm_mul_ps(cz, cy);
+	__m128 r10 = _mm_mul_ps(sz, cy);
+	__m128 r20 = _mm_sub_ps(_mm_setzero_ps(), sy);
+	__m128 r01 = _mm_sub_ps(_mm_mul_ps(czsy, sx), _mm_mul_ps(sz, cx));
+	__m128 r11 = _mm_add_ps(_mm_mul_ps(szsy, sx), _mm_mul_ps(cz, cx));
+	__m128 r21 = _mm_mul_ps(cy, sx);
+	__m128 r02 = _mm_add_ps(_mm_mul_ps(czsy, cx), _mm_mul_ps(sz, sx));
+	__m128 r12 = _mm_sub_ps(_mm_mul_ps(szsy, cx), _mm_mul_ps(cz, sx));
+	__m128 r22 = _mm_mul_ps(cy, cx);
+
+	__m128 scaleX = _mm_loadu_ps(&scene.scaleX[e]);
+	__m128 scaleY = _mm_loadu_ps(&scene.scaleY[e]);
+	__m128 scaleZ = _mm_loadu_ps(&scene.scaleZ[e]);
+
+	__m128 columns[4][4] = {
+		{ _mm_mul_ps(r00, scaleX), _mm_mul_ps(r10, scaleX), _mm_mul_ps(r20, scaleX), _mm_setzero_ps() },
+		{ _mm_mul_ps(r01, scaleY), _mm_mul_ps(r11, scaleY), _mm_mul_ps(r21, scaleY), _mm_setzero_ps() },
+		{ _mm_mul_ps(r02, scaleZ), _mm_mul_ps(r12, scaleZ), _mm_mul_ps(r22, scaleZ), _mm_setzero_ps() },
+		{ _mm_loadu_ps(&scene.positionX[e]), _mm_loadu_ps(&scene.positionY[e]), _mm_loadu_ps(&scene.positionZ[e]), _mm_set1_ps(1.0f) }
+	};
+
+	// transpose lanes into per-entity columns and store them straight into the matrices
+	for (unsigned int c = 0; c < 4; ++c)
+	{
+		_MM_TRANSPOSE4_PS(columns[c][0], columns[c][1], columns[c][2], columns[c][3]);
+		for (unsigned int k = 0; k < 4; ++k)
+		{
+			_mm_storeu_ps(&(scene.world[e + k][c][0]), columns[c][k]);
+		}
+	}
+
+	__m128 inverseX = _mm_div_ps(_mm_set1_ps(1.0f), scaleX);
+	__m128 inverseY = _mm_div_ps(_mm_set1_ps(1.0f), scaleY);
+	__m128 inverseZ = _mm_div_ps(_mm_set1_ps(1.0f), scaleZ);
+
+	float normal[9][4];
+	_mm_storeu_ps(normal[0], _mm_mul_ps(r00, inverseX));
+	_mm_storeu_ps(normal[1], _mm_mul_ps(r10, inverseX));
+	_mm_storeu_ps(normal[2], _mm_mul_ps(r20, inverseX));
+	_mm_storeu_ps(normal[3], _mm_mul_ps(r01, inverseY));
+	_mm_storeu_ps(normal[4], _mm_mul_ps(r11, inverseY));
+	_mm_storeu_ps(normal[5], _mm_mul_ps(r21, inverseY));
+	_mm_storeu_ps(normal[6], _mm_mul_ps(r02, inverseZ));
+	_mm_storeu_ps(normal[7], _mm_mul_ps(r12, inverseZ));
+	_mm_storeu_ps(normal[8], _mm_mul_ps(r22, inverseZ));
+
+	for (unsigned int k = 0; k < 4; ++k)
+	{
+		glm::mat3 &n = scene.normal[e + k];
+		for (unsigned int i = 0; i < 9; ++i)
+		{
+			n[i / 3][i % 3] = normal[i][k];
+		}
+		updateBounds(scene, e + k);
+	}
+}
+#endif
+
+void updateTransforms(Scene &scene, unsigned int first, unsigned int last)
+{
+	unsigned int e = first;
+#ifdef __SSE2__
+	for (; e + 4 <= last; e += 4)
+	{
+		updateTransforms4(scene, e);
+	}
+#endif
+	for (; e < last; ++e)
+	{
+		updateTransform(scene, e);
+	}
+}
+
+// ranges are multiples of 4 so only the very last one needs the scalar tail
+static const unsigned int UPDATE_GRAIN = 4096;
+
+static void updateRange(unsigned int first, unsigned int last, void* context)
+{
+	Scene &scene = *(Scene*)context;
+	unsigned int end = last * UPDATE_GRAIN;
+	if (end > entityCount(scene))
+		end = entityCount(scene);
+	updateTransforms(scene, first * UPDATE_GRAIN, end);
+}
+
+void updateTransforms(Scene &scene)
+{
+	unsigned int batches = (entityCount(scene) + UPDATE_GRAIN - 1) / UPDATE_GRAIN;
+	jobs::parallelFor(batches, 1, updateRange, &scene);
+}
@@ -0,0 +1,52 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+const unsigned int NO_RENDERABLE = 0xffffffff;
+
+// Entity storage as structure of arrays: an entity is an index into every
+// array. Transform inputs are split per component so updateTransforms can
+// process four entities per SSE instruction.
+struct Scene
+{
+	std::vector<float> positionX, positionY, positionZ;
+	// euler angles in degrees, applied around X, then Y, then Z
+	std::vector<float> rotationX, rotationY, rotationZ;
+	std::vector<float> scaleX, scaleY, scaleZ;
+	// local space bounds
+	std::vector<glm::vec3> boundsMin, boundsMax;
+	// model handle, see resources.h, or NO_RENDERABLE
+	std::vector<unsigned int> renderable;
+	// destroyed entities keep their slot until createEntity reuses it
+	std::vector<unsigned char> alive;
+	std::vector<unsigned int> freeEntities;
+
+	// written by updateTransforms
+	std::vector<glm::mat4> world;
+	std::vector<glm::mat3> normal;
+	std::vector<glm::vec3> worldBoundsMin, worldBoundsMax;
+};
+
+unsigned int createEntity(Scene &scene, glm::vec3 position, glm::vec3 rotation, glm::vec3 scale, unsigned int renderable);
+// marks the slot free, its renderable becomes NO_RENDERABLE
+void destroyEntity(Scene &scene, unsigned int entity);
+// slots, including destroyed ones
+unsigned int entityCount(const Scene &scene);
+
+glm::vec3 getPosition(const Scene &scene, unsigned int entity);
+glm::vec3 getRotation(const Scene &scene, unsigned int entity);
+glm::vec3 getScale(const Scene &scene, unsigned int entity);
+void setPosition(Scene &scene, unsigned int entity, glm::vec3 position);
+void setRotation(Scene &scene, unsigned int entity, glm::vec3 rotation);
+void setScale(Scene &scene, unsigned int entity, glm::vec3 scale);
+void setBounds(Scene &scene, unsigned int entity, glm::vec3 min, glm::vec3 max);
+
+// Rebuilds world matrices, normal matrices (inverse transpose of the world
+// 3x3) and world bounds of entities in [first, last).
+void updateTransforms(Scene &scene, unsigned int first, unsigned int last);
+// same for every entity, spread over the job system
+void updateTransforms(Scene &scene);
+
+#endif
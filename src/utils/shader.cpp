@@ -65,10 +65,76 @@ namespace shader
 	return shader;
     }
 
+    unsigned int loadFromFiles(const char* const* paths, unsigned int count, GLenum type)
+    {
+	const char* sources[8];
+	if (count > 8)
+	    count = 8;
+	for (unsigned int i = 0; i < count; ++i)
+	{
+	    sources[i] = readFile(paths[i]);
+	    if (sources[i] == NULL)
+		sources[i] = (const char*)calloc(1, 1);
+	}
+
+	unsigned int shader = glCreateShader(type);
+	glShaderSource(shader, count, sources, NULL);
+	glCompileShader(shader);
+
+	int success;
+	char log[512];
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+	if (!success)
+	{
+	    glGetShaderInfoLog(shader, 512, NULL, log);
+	    printf("Error: shader compilation failed (%s)\n%s\n", paths[0], log);
+	}
+
+	for (unsigned int i = 0; i < count; ++i)
+	    free((void*)sources[i]);
+	return shader;
+    }
+
     unsigned int createProgram(unsigned int vertex, unsigned int fragment)
     {
 	unsigned int program = glCreateProgram();
 	link(&program, &vertex, &fragment);
 	return program;
     }
+
+    unsigned int createComputeProgram(unsigned int compute)
+    {
+	unsigned int program = glCreateProgram();
+	glAttachShader(program, compute);
+	glLinkProgram(program);
+
+	int success;
+	char log[512];
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	if (!success)
+	{
+	    glGetProgramInfoLog(program, 512, NULL, log);
+	    printf("Error: compute program compilation failed\n%s\n", log);
+	}
+	return program;
+    }
+
+    unsigned int createFeedbackProgram(unsigned int vertex, const char* const* varyings, unsigned int count)
+    {
+	unsigned int program = glCreateProgram();
+	glAttachShader(program, vertex);
+	// has to be set before linking
+	glTransformFeedbackVaryings(program, count, varyings, GL_INTERLEAVED_ATTRIBS);
+	glLinkProgram(program);
+
+	int success;
+	char log[512];
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	if (!success)
+	{
+	    glGetProgramInfoLog(program, 512, NULL, log);
+	    printf("Error: feedback program compilation failed\n%s\n", log);
+	}
+	return program;
+    }
 }
@@ -10,6 +10,11 @@ namespace shader
     void load(unsigned int*, const char*);
     void link(unsigned int*, unsigned int*, unsigned int*);
     unsigned int loadFromFile(const char*, GLenum type);
+    // the sources are concatenated in order, only the first has a #version
+    unsigned int loadFromFiles(const char* const* paths, unsigned int count, GLenum type);
     unsigned int createProgram(unsigned int vertex, unsigned int fragment);
+    unsigned int createComputeProgram(unsigned int compute);
+    // vertex only program whose outputs are captured interleaved by transform feedback
+    unsigned int createFeedbackProgram(unsigned int vertex, const char* const* varyings, unsigned int count);
 }
 #endif
@@ -0,0 +1,739 @@
+#include <glad/glad.h>
+
+#include "softraster.h"
+#include "jobs.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Four pixels per lane group. With SSE2 these are plain intrinsics, the
+// fallback does the same work one lane at a time.
+#ifdef __SSE2__
+typedef __m128 Float4;
+
+static inline Float4 set1(float v) { return _mm_set1_ps(v); }
+static inline Float4 ramp(float v) { return _mm_add_ps(_mm_set1_ps(v), _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f)); }
+static inline Float4 add(Float4 a, Float4 b) { return _mm_add_ps(a, b); }
+static inline Float4 sub(Float4 a, Float4 b) { return _mm_sub_ps(a, b); }
+static inline Float4 mul(Float4 a, Float4 b) { return _mm_mul_ps(a, b); }
+static inline Float4 div(Float4 a, Float4 b) { return _mm_div_ps(a, b); }
+static inline Float4 min(Float4 a, Float4 b) { return _mm_min_ps(a, b); }
+static inline Float4 max(Float4 a, Float4 b) { return _mm_max_ps(a, b); }
+static inline Float4 sqrt(Float4 a) { return _mm_sqrt_ps(a); }
+static inline Float4 greaterEqual(Float4 a, Float4 b) { return _mm_cmpge_ps(a, b); }
+static inline Float4 less(Float4 a, Float4 b) { return _mm_cmplt_ps(a, b); }
+static inline Float4 both(Float4 a, Float4 b) { return _mm_and_ps(a, b); }
+static inline Float4 select(Float4 mask, Float4 a, Float4 b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+static inline int laneMask(Float4 mask) { return _mm_movemask_ps(mask); }
+static inline Float4 load(const float* p) { return _mm_loadu_ps(p); }
+static inline void store(float* p, Float4 v) { _mm_storeu_ps(p, v); }
+static inline float lane(Float4 v, int i) { float f[4]; _mm_storeu_ps(f, v); return f[i]; }
+static inline Float4 fromLanes(const float* f) { return _mm_loadu_ps(f); }
+#else
+struct Float4 { float v[4]; };
+
+static inline Float4 set1(float f) { Float4 r = { { f, f, f, f } }; return r; }
+static inline Float4 ramp(float f) { Float4 r = { { f, f + 1.0f, f + 2.0f, f + 3.0f } }; return r; }
+#define LANEWISE(name, expr) \
+	static inline Float4 name(Float4 a, Float4 b) { Float4 r; for (int i = 0; i < 4; ++i) r.v[i] = (expr); return r; }
+LANEWISE(add, a.v[i] + b.v[i])
+LANEWISE(sub, a.v[i] - b.v[i])
+LANEWISE(mul, a.v[i] * b.v[i])
+LANEWISE(div, a.v[i] / b.v[i])
+LANEWISE(min, std::min(a.v[i], b.v[i]))
+LANEWISE(max, std::max(a.v[i], b.v[i]))
+// masks are 1 or 0 per lane
+LANEWISE(greaterEqual, a.v[i] >= b.v[i] ? 1.0f : 0.0f)
+LANEWISE(less, a.v[i] < b.v[i] ? 1.0f : 0.0f)
+LANEWISE(both, a.v[i] != 0.0f && b.v[i] != 0.0f ? 1.0f : 0.0f)
+#undef LANEWISE
+static inline Float4 sqrt(Float4 a) { Float4 r; for (int i = 0; i < 4; ++i) r.v[i] = std::sqrt(a.v[i]); return r; }
+static inline Float4 select(Float4 mask, Float4 a, Float4 b) { Float4 r; for (int i = 0; i < 4; ++i) r.v[i] = mask.v[i] != 0.0f ? a.v[i] : b.v[i]; return r; }
+static inline int laneMask(Float4 mask) { int m = 0; for (int i = 0; i < 4; ++i) m |= mask.v[i] != 0.0f ? 1 << i : 0; return m; }
+static inline Float4 load(const float* p) { Float4 r; for (int i = 0; i < 4; ++i) r.v[i] = p[i]; return r; }
+static inline void store(float* p, Float4 v) { for (int i = 0; i < 4; ++i) p[i] = v.v[i]; }
+static inline float lane(Float4 v, int i) { return v.v[i]; }
+static inline Float4 fromLanes(const float* f) { return load(f); }
+#endif
+
+struct Vec4x3
+{
+	Float4 x, y, z;
+};
+
+static inline Vec4x3 splat(glm::vec3 v)
+{
+	Vec4x3 r = { set1(v.x), set1(v.y), set1(v.z) };
+	return r;
+}
+
+static inline Vec4x3 add(const Vec4x3 &a, const Vec4x3 &b)
+{
+	Vec4x3 r = { add(a.x, b.x), add(a.y, b.y), add(a.z, b.z) };
+	return r;
+}
+
+static inline Vec4x3 sub(const Vec4x3 &a, const Vec4x3 &b)
+{
+	Vec4x3 r = { sub(a.x, b.x), sub(a.y, b.y), sub(a.z, b.z) };
+	return r;
+}
+
+static inline Vec4x3 mul(const Vec4x3 &a, const Vec4x3 &b)
+{
+	Vec4x3 r = { mul(a.x, b.x), mul(a.y, b.y), mul(a.z, b.z) };
+	return r;
+}
+
+static inline Vec4x3 scale(const Vec4x3 &a, Float4 s)
+{
+	Vec4x3 r = { mul(a.x, s), mul(a.y, s), mul(a.z, s) };
+	return r;
+}
+
+static inline Float4 dot(const Vec4x3 &a, const Vec4x3 &b)
+{
+	return add(mul(a.x, b.x), add(mul(a.y, b.y), mul(a.z, b.z)));
+}
+
+static inline Float4 length(const Vec4x3 &a)
+{
+	return sqrt(dot(a, a));
+}
+
+static inline Vec4x3 normalize(const Vec4x3 &a)
+{
+	return scale(a, div(set1(1.0f), max(length(a), set1(1e-20f))));
+}
+
+static float elapsedMs(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void initSoftRenderer(SoftRenderer &renderer, int width, int height)
+{
+	renderer.width = width;
+	renderer.height = height;
+	renderer.tilesX = (width + SOFT_TILE - 1) / SOFT_TILE;
+	renderer.tilesY = (height + SOFT_TILE - 1) / SOFT_TILE;
+	renderer.color.assign(width * height, 0xff000000u);
+	renderer.depth.assign(width * height, 1.0f);
+	renderer.bins.resize(SOFT_BIN_CHUNKS * renderer.tilesX * renderer.tilesY);
+	renderer.clippedVertices.resize(SOFT_BIN_CHUNKS);
+	renderer.clippedTriangles.resize(SOFT_BIN_CHUNKS);
+
+	renderer.texture = 0;
+	renderer.framebuffer = 0;
+
+	renderer.stats.triangles = 0;
+	renderer.stats.binned = 0;
+	renderer.stats.transformMs = 0.0f;
+	renderer.stats.binMs = 0.0f;
+	renderer.stats.rasterMs = 0.0f;
+}
+
+void destroySoftRenderer(SoftRenderer &renderer)
+{
+	if (!renderer.texture)
+		return;
+	glDeleteFramebuffers(1, &renderer.framebuffer);
+	glDeleteTextures(1, &renderer.texture);
+	renderer.framebuffer = 0;
+	renderer.texture = 0;
+}
+
+struct SoftTextureDecode
+{
+	const Model* model;
+	SoftTextures* textures;
+};
+
+static void decodeSoftTextures(unsigned int first, unsigned int last, void* context)
+{
+	SoftTextureDecode &decode = *(SoftTextureDecode*)context;
+	for (unsigned int i = first; i < last; ++i)
+	{
+		Image &image = decode.textures->layers[i];
+		std::string fullPath = decode.model->texturesDir + decode.model->sharedTextures[i].path;
+		if (!texture::loadImage(fullPath.c_str(), true, image))
+		{
+			// same as a missing map, a white texel
+			image.width = image.height = 1;
+			image.pixels.assign(4, 255);
+		}
+		if (decode.model->textureWidth > 0)
+			texture::resizeImage(image, decode.model->textureWidth, decode.model->textureHeight);
+	}
+}
+
+void loadSoftTextures(SoftTextures &textures, const Model &model)
+{
+	SoftTextureDecode decode;
+	decode.model = &model;
+	decode.textures = &textures;
+	textures.layers.clear();
+	textures.layers.resize(model.sharedTextures.size());
+	jobs::parallelFor(textures.layers.size(), 1, decodeSoftTextures, &decode);
+}
+
+void softClear(SoftRenderer &renderer, glm::vec3 color)
+{
+	glm::vec3 c = glm::clamp(color, 0.0f, 1.0f) * 255.0f + 0.5f;
+	unsigned int packed = (unsigned int)c.x | ((unsigned int)c.y << 8) | ((unsigned int)c.z << 16) | 0xff000000u;
+	std::fill(renderer.color.begin(), renderer.color.end(), packed);
+	std::fill(renderer.depth.begin(), renderer.depth.end(), 1.0f);
+}
+
+// lights moved to view space, as phong_combined_vertex.glsl hands them over
+struct ViewLights
+{
+	glm::vec3 directionalDir;
+	glm::vec3 pointPos;
+	glm::vec3 spotPos, spotDir;
+};
+
+struct SoftDraw
+{
+	SoftRenderer* renderer;
+	const Model* model;
+	const SoftTextures* textures;
+	const Lights* lights;
+	ViewLights view;
+	glm::mat4 modelView, mvp;
+	glm::mat3 normalMatrix;
+	// prefix sums over the meshes, meshes without CPU data add nothing
+	std::vector<unsigned int> firstVertex, firstTriangle;
+};
+
+static unsigned int findMesh(const std::vector<unsigned int> &prefix, unsigned int index)
+{
+	return std::upper_bound(prefix.begin(), prefix.end(), index) - prefix.begin() - 1;
+}
+
+static void transformVertices(unsigned int first, unsigned int last, void* context)
+{
+	SoftDraw &draw = *(SoftDraw*)context;
+	unsigned int meshIndex = findMesh(draw.firstVertex, first);
+	for (unsigned int i = first; i < last; ++i)
+	{
+		while (i >= draw.firstVertex[meshIndex + 1])
+			meshIndex++;
+
+		const Vertex &v = draw.model->meshes[meshIndex].vertices[i - draw.firstVertex[meshIndex]];
+		SoftVertex &out = draw.renderer->vertices[i];
+		glm::vec4 position(v.position, 1.0f);
+		out.clip = draw.mvp * position;
+		out.viewPosition = glm::vec3(draw.modelView * position);
+		out.normal = draw.normalMatrix * v.normal;
+		out.textureCoords = v.textureCoords;
+	}
+}
+
+static inline const SoftVertex &cornerVertex(const SoftRenderer &renderer, unsigned int chunk, unsigned int index)
+{
+	return (index & SOFT_CLIPPED) ? renderer.clippedVertices[chunk][index & ~SOFT_CLIPPED] : renderer.vertices[index];
+}
+
+// Sets up a triangle from the corners in tri.vertices, false when it is
+// culled. Counter-clockwise after the setup, so all three edge functions are
+// positive inside.
+static bool setupTriangle(const SoftRenderer &renderer, unsigned int chunk, SoftTriangle &tri)
+{
+	float x[3], y[3];
+	for (unsigned int k = 0; k < 3; ++k)
+	{
+		const glm::vec4 &clip = cornerVertex(renderer, chunk, tri.vertices[k]).clip;
+		if (clip.w < 1e-5f)
+			return false;
+
+		float invW = 1.0f / clip.w;
+		x[k] = (clip.x * invW * 0.5f + 0.5f) * renderer.width;
+		y[k] = (clip.y * invW * 0.5f + 0.5f) * renderer.height;
+		tri.z[k] = clip.z * invW * 0.5f + 0.5f;
+		tri.invW[k] = invW;
+	}
+
+	float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+	if (std::fabs(area) < 1e-8f)
+		return false;
+	if (area < 0.0f)
+	{
+		std::swap(x[1], x[2]);
+		std::swap(y[1], y[2]);
+		std::swap(tri.z[1], tri.z[2]);
+		std::swap(tri.invW[1], tri.invW[2]);
+		std::swap(tri.vertices[1], tri.vertices[2]);
+		area = -area;
+	}
+
+	tri.minX = std::max(0, (int)std::floor(std::min(x[0], std::min(x[1], x[2]))));
+	tri.maxX = std::min(renderer.width - 1, (int)std::ceil(std::max(x[0], std::max(x[1], x[2]))));
+	tri.minY = std::max(0, (int)std::floor(std::min(y[0], std::min(y[1], y[2]))));
+	tri.maxY = std::min(renderer.height - 1, (int)std::ceil(std::max(y[0], std::max(y[1], y[2]))));
+	if (tri.minX > tri.maxX || tri.minY > tri.maxY)
+		return false;
+
+	for (unsigned int k = 0; k < 3; ++k)
+	{
+		unsigned int i1 = (k + 1) % 3, i2 = (k + 2) % 3;
+		tri.a[k] = y[i1] - y[i2];
+		tri.b[k] = x[i2] - x[i1];
+		tri.c[k] = -(tri.b[k] * y[i1] + tri.a[k] * x[i1]);
+		// widened by a few ulps of the largest term, so rounding can't open
+		// cracks along edges shared with a neighbour
+		tri.c[k] += (std::fabs(tri.a[k]) * renderer.width + std::fabs(tri.b[k]) * renderer.height) * 1e-6f;
+	}
+	tri.invArea = 1.0f / area;
+	return true;
+}
+
+static void binTriangle(const SoftRenderer &renderer, std::vector<unsigned int>* bins, const SoftTriangle &tri, unsigned int entry)
+{
+	for (int ty = tri.minY / SOFT_TILE; ty <= tri.maxY / SOFT_TILE; ++ty)
+	{
+		for (int tx = tri.minX / SOFT_TILE; tx <= tri.maxX / SOFT_TILE; ++tx)
+		{
+			bins[ty * renderer.tilesX + tx].push_back(entry);
+		}
+	}
+}
+
+// Clips triangle t against the near plane z = -w before the divide, every
+// attribute is linear in clip space. Writes the corners of the clipped
+// polygon, new vertices go to the chunk, and returns their count: 0 when the
+// triangle is behind the plane, 3 or 4 otherwise.
+static unsigned int clipNear(SoftRenderer &renderer, unsigned int chunk, const unsigned int corners[3], unsigned int polygon[4])
+{
+	float distance[3];
+	unsigned int outside = 0;
+	for (unsigned int k = 0; k < 3; ++k)
+	{
+		const glm::vec4 &clip = renderer.vertices[corners[k]].clip;
+		distance[k] = clip.z + clip.w;
+		outside += distance[k] < 0.0f;
+	}
+	if (outside == 3)
+		return 0;
+
+	unsigned int count = 0;
+	for (unsigned int k = 0; k < 3; ++k)
+	{
+		unsigned int next = (k + 1) % 3;
+		if (distance[k] >= 0.0f)
+			polygon[count++] = corners[k];
+		if ((distance[k] >= 0.0f) == (distance[next] >= 0.0f))
+			continue;
+
+		const SoftVertex &a = renderer.vertices[corners[k]];
+		const SoftVertex &b = renderer.vertices[corners[next]];
+		float t = distance[k] / (distance[k] - distance[next]);
+		SoftVertex v;
+		v.clip = a.clip + (b.clip - a.clip) * t;
+		v.viewPosition = a.viewPosition + (b.viewPosition - a.viewPosition) * t;
+		v.normal = a.normal + (b.normal - a.normal) * t;
+		v.textureCoords = a.textureCoords + (b.textureCoords - a.textureCoords) * t;
+		std::vector<SoftVertex> &clipped = renderer.clippedVertices[chunk];
+		polygon[count++] = clipped.size() | SOFT_CLIPPED;
+		clipped.push_back(v);
+	}
+	return count;
+}
+
+static void binTriangles(unsigned int first, unsigned int last, void* context)
+{
+	SoftDraw &draw = *(SoftDraw*)context;
+	SoftRenderer &renderer = *draw.renderer;
+	unsigned int tileCount = renderer.tilesX * renderer.tilesY;
+	unsigned int triangleCount = renderer.triangles.size();
+
+	for (unsigned int chunk = first; chunk < last; ++chunk)
+	{
+		std::vector<unsigned int>* bins = &renderer.bins[chunk * tileCount];
+		for (unsigned int i = 0; i < tileCount; ++i)
+		{
+			bins[i].clear();
+		}
+		renderer.clippedVertices[chunk].clear();
+		renderer.clippedTriangles[chunk].clear();
+
+		unsigned int begin = (unsigned long long)triangleCount * chunk / SOFT_BIN_CHUNKS;
+		unsigned int end = (unsigned long long)triangleCount * (chunk + 1) / SOFT_BIN_CHUNKS;
+		unsigned int meshIndex = findMesh(draw.firstTriangle, begin);
+		for (unsigned int t = begin; t < end; ++t)
+		{
+			while (t >= draw.firstTriangle[meshIndex + 1])
+				meshIndex++;
+			const Mesh &mesh = draw.model->meshes[meshIndex];
+			const unsigned int* indices = &mesh.indices[(t - draw.firstTriangle[meshIndex]) * 3];
+			unsigned int corners[3];
+			bool crossing = false;
+			for (unsigned int k = 0; k < 3; ++k)
+			{
+				corners[k] = indices[k] + draw.firstVertex[meshIndex];
+				const glm::vec4 &clip = renderer.vertices[corners[k]].clip;
+				crossing = crossing || clip.z < -clip.w;
+			}
+
+			const Material &material = draw.model->materials[mesh.material];
+			SoftTriangle &tri = renderer.triangles[t];
+			tri.diffuseLayer = material.diffuseLayer;
+			tri.specularLayer = material.specularLayer;
+			if (!crossing)
+			{
+				std::copy(corners, corners + 3, tri.vertices);
+				if (setupTriangle(renderer, chunk, tri))
+					binTriangle(renderer, bins, tri, t);
+				continue;
+			}
+
+			// a fan over the clipped polygon, the second triangle lives in the chunk
+			unsigned int polygon[4];
+			unsigned int count = clipNear(renderer, chunk, corners, polygon);
+			for (unsigned int k = 0; k + 2 < count; ++k)
+			{
+				SoftTriangle piece = tri;
+				piece.vertices[0] = polygon[0];
+				piece.vertices[1] = polygon[k + 1];
+				piece.vertices[2] = polygon[k + 2];
+				if (!setupTriangle(renderer, chunk, piece))
+					continue;
+				if (k == 0)
+				{
+					tri = piece;
+					binTriangle(renderer, bins, tri, t);
+				}
+				else
+				{
+					std::vector<SoftTriangle> &clipped = renderer.clippedTriangles[chunk];
+					binTriangle(renderer, bins, piece, clipped.size() | SOFT_CLIPPED);
+					clipped.push_back(piece);
+				}
+			}
+		}
+	}
+}
+
+// bilinear with repeat wrapping, like the array sampler
+static glm::vec3 sampleImage(const Image &image, float u, float v)
+{
+	float fx = u * image.width - 0.5f, fy = v * image.height - 0.5f;
+	float x0f = std::floor(fx), y0f = std::floor(fy);
+	float tx = fx - x0f, ty = fy - y0f;
+	int x0 = (int)x0f % image.width, y0 = (int)y0f % image.height;
+	if (x0 < 0)
+		x0 += image.width;
+	if (y0 < 0)
+		y0 += image.height;
+	int x1 = (x0 + 1) % image.width, y1 = (y0 + 1) % image.height;
+
+	const unsigned char* p00 = &image.pixels[(y0 * image.width + x0) * 4];
+	const unsigned char* p10 = &image.pixels[(y0 * image.width + x1) * 4];
+	const unsigned char* p01 = &image.pixels[(y1 * image.width + x0) * 4];
+	const unsigned char* p11 = &image.pixels[(y1 * image.width + x1) * 4];
+	glm::vec3 result;
+	for (int c = 0; c < 3; ++c)
+	{
+		float top = p00[c] + (p10[c] - p00[c]) * tx;
+		float bottom = p01[c] + (p11[c] - p01[c]) * tx;
+		result[c] = (top + (bottom - top) * ty) * (1.0f / 255.0f);
+	}
+	return result;
+}
+
+// one texture sample per covered lane, missing maps give `fallback`
+static Vec4x3 sampleLayer(const SoftTextures &textures, int layer, glm::vec3 fallback, Float4 u, Float4 v, int mask)
+{
+	if (layer < 0 || layer >= (int)textures.layers.size())
+		return splat(fallback);
+
+	const Image &image = textures.layers[layer];
+	float r[4] = { 0.0f }, g[4] = { 0.0f }, b[4] = { 0.0f };
+	for (int i = 0; i < 4; ++i)
+	{
+		if (!(mask & (1 << i)))
+			continue;
+		glm::vec3 texel = sampleImage(image, lane(u, i), lane(v, i));
+		r[i] = texel.x;
+		g[i] = texel.y;
+		b[i] = texel.z;
+	}
+	Vec4x3 result = { fromLanes(r), fromLanes(g), fromLanes(b) };
+	return result;
+}
+
+static Float4 power(Float4 base, unsigned int exponent)
+{
+	Float4 result = set1(1.0f);
+	while (exponent)
+	{
+		if (exponent & 1)
+			result = mul(result, base);
+		base = mul(base, base);
+		exponent >>= 1;
+	}
+	return result;
+}
+
+struct Surface
+{
+	Vec4x3 position, normal, viewDirection;
+	Vec4x3 diffuseSample, specularSample;
+	unsigned int shininess;
+};
+
+// diffuse + specular of one light, the ambient term is added by the caller
+static Vec4x3 directLight(const Surface &s, const Vec4x3 &lightDirection, glm::vec3 diffuse, glm::vec3 specular)
+{
+	Float4 nDotL = dot(s.normal, lightDirection);
+	Float4 diff = max(nDotL, set1(0.0f));
+
+	// reflect(-L, n) = 2 * dot(n, L) * n - L
+	Vec4x3 reflected = sub(scale(s.normal, mul(set1(2.0f), nDotL)), lightDirection);
+	Float4 spec = power(max(dot(s.viewDirection, reflected), set1(0.0f)), s.shininess);
+
+	return add(mul(scale(s.diffuseSample, diff), splat(diffuse)), mul(scale(s.specularSample, spec), splat(specular)));
+}
+
+static Float4 attenuation(Float4 distance, float constant, float linear, float quadratic)
+{
+	return div(set1(1.0f), add(set1(constant), add(mul(set1(linear), distance), mul(set1(quadratic), mul(distance, distance)))));
+}
+
+static Vec4x3 shade(const SoftDraw &draw, const Surface &s)
+{
+	const Lights &lights = *draw.lights;
+
+	const DirectionalLight &directional = lights.directional;
+	Vec4x3 color = add(mul(s.diffuseSample, splat(directional.ambient)),
+		directLight(s, splat(draw.view.directionalDir), directional.diffuse, directional.specular));
+
+	const PointLight &point = lights.point;
+	Vec4x3 toPoint = sub(splat(draw.view.pointPos), s.position);
+	Float4 pointDistance = length(toPoint);
+	Vec4x3 pointColor = add(mul(s.diffuseSample, splat(point.ambient)),
+		directLight(s, normalize(toPoint), point.diffuse, point.specular));
+	color = add(color, scale(pointColor, attenuation(pointDistance, point.constant, point.linear, point.quadratic)));
+
+	const SpotLight &spot = lights.spot;
+	Vec4x3 toSpot = sub(splat(draw.view.spotPos), s.position);
+	Float4 spotDistance = length(toSpot);
+	Vec4x3 spotDirection = normalize(toSpot);
+	Float4 theta = dot(spotDirection, splat(draw.view.spotDir));
+	float epsilon = spot.cutoff - spot.outerCutoff;
+	if (std::fabs(epsilon) < 1e-6f)
+		epsilon = 1e-6f;
+	Float4 intensity = min(max(div(sub(theta, set1(spot.outerCutoff)), set1(epsilon)), set1(0.0f)), set1(1.0f));
+	Float4 spotAttenuation = attenuation(spotDistance, spot.constant, spot.linear, spot.quadratic);
+	Vec4x3 spotColor = add(mul(s.diffuseSample, splat(spot.ambient)),
+		scale(directLight(s, spotDirection, spot.diffuse, spot.specular), intensity));
+	color = add(color, scale(spotColor, spotAttenuation));
+
+	return color;
+}
+
+static Float4 interpolate(Float4 p0, Float4 p1, Float4 p2, float v0, float v1, float v2)
+{
+	return add(mul(p0, set1(v0)), add(mul(p1, set1(v1)), mul(p2, set1(v2))));
+}
+
+static void storeColor(unsigned int* row, const Vec4x3 &color, int mask)
+{
+	float r[4], g[4], b[4];
+	store(r, color.x);
+	store(g, color.y);
+	store(b, color.z);
+	for (int i = 0; i < 4; ++i)
+	{
+		if (!(mask & (1 << i)))
+			continue;
+		unsigned int cr = (unsigned int)(std::min(std::max(r[i], 0.0f), 1.0f) * 255.0f + 0.5f);
+		unsigned int cg = (unsigned int)(std::min(std::max(g[i], 0.0f), 1.0f) * 255.0f + 0.5f);
+		unsigned int cb = (unsigned int)(std::min(std::max(b[i], 0.0f), 1.0f) * 255.0f + 0.5f);
+		row[i] = cr | (cg << 8) | (cb << 16) | 0xff000000u;
+	}
+}
+
+// draws the part of the triangle inside [x0, x1) x [y0, y1)
+static void rasterizeTriangle(const SoftDraw &draw, unsigned int chunk, const SoftTriangle &tri, int x0, int y0, int x1, int y1)
+{
+	SoftRenderer &renderer = *draw.renderer;
+	int minX = std::max(tri.minX, x0) & ~3;
+	int maxX = std::min(tri.maxX, x1 - 1);
+	int minY = std::max(tri.minY, y0);
+	int maxY = std::min(tri.maxY, y1 - 1);
+
+	const SoftVertex &v0 = cornerVertex(renderer, chunk, tri.vertices[0]);
+	const SoftVertex &v1 = cornerVertex(renderer, chunk, tri.vertices[1]);
+	const SoftVertex &v2 = cornerVertex(renderer, chunk, tri.vertices[2]);
+	Float4 zero = set1(0.0f);
+	Float4 rowEnd = set1((float)x1);
+
+	for (int y = minY; y <= maxY; ++y)
+	{
+		float py = y + 0.5f;
+		float* depthRow = &renderer.depth[y * renderer.width];
+		unsigned int* colorRow = &renderer.color[y * renderer.width];
+
+		for (int x = minX; x <= maxX; x += 4)
+		{
+			Float4 px = ramp(x + 0.5f);
+			Float4 e0 = add(mul(set1(tri.a[0]), px), set1(tri.b[0] * py + tri.c[0]));
+			Float4 e1 = add(mul(set1(tri.a[1]), px), set1(tri.b[1] * py + tri.c[1]));
+			Float4 e2 = add(mul(set1(tri.a[2]), px), set1(tri.b[2] * py + tri.c[2]));
+			// lanes past the tile belong to the neighbouring job
+			Float4 inside = both(less(px, rowEnd), both(greaterEqual(e0, zero), both(greaterEqual(e1, zero), greaterEqual(e2, zero))));
+			if (laneMask(inside) == 0)
+				continue;
+
+			Float4 l0 = mul(e0, set1(tri.invArea));
+			Float4 l1 = mul(e1, set1(tri.invArea));
+			Float4 l2 = mul(e2, set1(tri.invArea));
+			Float4 z = interpolate(l0, l1, l2, tri.z[0], tri.z[1], tri.z[2]);
+			// x + 3 can be past the tile, whose pixels another job owns
+			float oldDepth[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+			int lanes = std::min(4, x1 - x);
+			std::copy(depthRow + x, depthRow + x + lanes, oldDepth);
+			Float4 pass = both(inside, less(z, load(oldDepth)));
+			int mask = laneMask(pass);
+			if (mask == 0)
+				continue;
+
+			float newDepth[4];
+			store(newDepth, select(pass, z, load(oldDepth)));
+			std::copy(newDepth, newDepth + lanes, depthRow + x);
+
+			// perspective correct weights
+			Float4 w0 = mul(l0, set1(tri.invW[0]));
+			Float4 w1 = mul(l1, set1(tri.invW[1]));
+			Float4 w2 = mul(l2, set1(tri.invW[2]));
+			Float4 invSum = div(set1(1.0f), add(w0, add(w1, w2)));
+			w0 = mul(w0, invSum);
+			w1 = mul(w1, invSum);
+			w2 = mul(w2, invSum);
+
+			Surface s;
+			s.position.x = interpolate(w0, w1, w2, v0.viewPosition.x, v1.viewPosition.x, v2.viewPosition.x);
+			s.position.y = interpolate(w0, w1, w2, v0.viewPosition.y, v1.viewPosition.y, v2.viewPosition.y);
+			s.position.z = interpolate(w0, w1, w2, v0.viewPosition.z, v1.viewPosition.z, v2.viewPosition.z);
+			Vec4x3 normal;
+			normal.x = interpolate(w0, w1, w2, v0.normal.x, v1.normal.x, v2.normal.x);
+			normal.y = interpolate(w0, w1, w2, v0.normal.y, v1.normal.y, v2.normal.y);
+			normal.z = interpolate(w0, w1, w2, v0.normal.z, v1.normal.z, v2.normal.z);
+			s.normal = normalize(normal);
+			s.viewDirection = normalize(sub(splat(glm::vec3(0.0f)), s.position));
+			Float4 u = interpolate(w0, w1, w2, v0.textureCoords.x, v1.textureCoords.x, v2.textureCoords.x);
+			Float4 v = interpolate(w0, w1, w2, v0.textureCoords.y, v1.textureCoords.y, v2.textureCoords.y);
+			s.diffuseSample = sampleLayer(*draw.textures, tri.diffuseLayer, glm::vec3(1.0f), u, v, mask);
+			s.specularSample = sampleLayer(*draw.textures, tri.specularLayer, glm::vec3(0.0f), u, v, mask);
+			s.shininess = draw.lights->shininess;
+
+			storeColor(colorRow + x, shade(draw, s), mask);
+		}
+	}
+}
+
+static void rasterizeTiles(unsigned int first, unsigned int last, void* context)
+{
+	SoftDraw &draw = *(SoftDraw*)context;
+	SoftRenderer &renderer = *draw.renderer;
+	unsigned int tileCount = renderer.tilesX * renderer.tilesY;
+
+	for (unsigned int tile = first; tile < last; ++tile)
+	{
+		int x0 = (tile % renderer.tilesX) * SOFT_TILE, y0 = (tile / renderer.tilesX) * SOFT_TILE;
+		int x1 = std::min(x0 + SOFT_TILE, renderer.width), y1 = std::min(y0 + SOFT_TILE, renderer.height);
+		// chunks in order keep the submission order of the triangles
+		for (unsigned int chunk = 0; chunk < SOFT_BIN_CHUNKS; ++chunk)
+		{
+			const std::vector<unsigned int> &bin = renderer.bins[chunk * tileCount + tile];
+			for (unsigned int i = 0; i < bin.size(); ++i)
+			{
+				unsigned int entry = bin[i];
+				const SoftTriangle &tri = (entry & SOFT_CLIPPED) ? renderer.clippedTriangles[chunk][entry & ~SOFT_CLIPPED] : renderer.triangles[entry];
+				rasterizeTriangle(draw, chunk, tri, x0, y0, x1, y1);
+			}
+		}
+	}
+}
+
+void softDrawModel(SoftRenderer &renderer, const Model &model, const SoftTextures &textures, const glm::mat4 &transform, const glm::mat4 &view, const glm::mat4 &proj, const Lights &lights)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	SoftDraw draw;
+	draw.renderer = &renderer;
+	draw.model = &model;
+	draw.textures = &textures;
+	draw.lights = &lights;
+	draw.modelView = view * transform;
+	draw.mvp = proj * draw.modelView;
+	draw.normalMatrix = glm::transpose(glm::inverse(glm::mat3(draw.modelView)));
+	draw.view.directionalDir = glm::normalize(glm::mat3(view) * glm::normalize(-lights.directional.direction));
+	draw.view.pointPos = glm::vec3(view * glm::vec4(lights.point.position, 1.0f));
+	draw.view.spotPos = glm::vec3(view * glm::vec4(lights.spot.position, 1.0f));
+	draw.view.spotDir = glm::normalize(glm::mat3(view) * glm::normalize(-lights.spot.direction));
+
+	draw.firstVertex.resize(model.meshes.size() + 1);
+	draw.firstTriangle.resize(model.meshes.size() + 1);
+	draw.firstVertex[0] = draw.firstTriangle[0] = 0;
+	for (unsigned int i = 0; i < model.meshes.size(); ++i)
+	{
+		const Mesh &mesh = model.meshes[i];
+		bool hasData = !mesh.vertices.empty() && !mesh.indices.empty();
+		draw.firstVertex[i + 1] = draw.firstVertex[i] + (hasData ? mesh.vertices.size() : 0);
+		draw.firstTriangle[i + 1] = draw.firstTriangle[i] + (hasData ? mesh.indices.size() / 3 : 0);
+	}
+
+	unsigned int vertexCount = draw.firstVertex.back();
+	unsigned int triangleCount = draw.firstTriangle.back();
+	renderer.vertices.resize(vertexCount);
+	renderer.triangles.resize(triangleCount);
+	jobs::parallelFor(vertexCount, 4096, transformVertices, &draw);
+	renderer.stats.transformMs = elapsedMs(start);
+
+	start = std::chrono::steady_clock::now();
+	jobs::parallelFor(SOFT_BIN_CHUNKS, 1, binTriangles, &draw);
+	renderer.stats.triangles = triangleCount;
+	renderer.stats.binned = 0;
+	for (unsigned int i = 0; i < renderer.bins.size(); ++i)
+	{
+		renderer.stats.binned += renderer.bins[i].size();
+	}
+	renderer.stats.binMs = elapsedMs(start);
+
+	start = std::chrono::steady_clock::now();
+	jobs::parallelFor(renderer.tilesX * renderer.tilesY, 1, rasterizeTiles, &draw);
+	renderer.stats.rasterMs = elapsedMs(start);
+}
+
+void softPresent(SoftRenderer &renderer)
+{
+	GLint readFramebuffer = 0;
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFramebuffer);
+	if (!renderer.texture)
+	{
+		glGenTextures(1, &renderer.texture);
+		glBindTexture(GL_TEXTURE_2D, renderer.texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, renderer.width, renderer.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glGenFramebuffers(1, &renderer.framebuffer);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, renderer.framebuffer);
+		glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, renderer.texture, 0);
+	}
+
+	glBindTexture(GL_TEXTURE_2D, renderer.texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, renderer.width, renderer.height, GL_RGBA, GL_UNSIGNED_BYTE, renderer.color.data());
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, renderer.framebuffer);
+	glBlitFramebuffer(0, 0, renderer.width, renderer.height, 0, 0, renderer.width, renderer.height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+}
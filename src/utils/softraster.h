@@ -0,0 +1,88 @@
+#ifndef SOFTRASTER_H
+#define SOFTRASTER_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "model.h"
+#include "texture.h"
+#include "lights.h"
+
+// CPU rendering backend for machines without a GPU. Draws the same Model
+// data with the Phong model of phong_combined_fragment.glsl into an RGBA8
+// framebuffer (rows bottom to top, like GL). Vertices are transformed and
+// triangles set up and binned into SOFT_TILE squares on the job system,
+// then every tile is rasterized and shaded by one job, 4 pixels at a time
+// with SSE. Needs the CPU-side mesh data. Triangles crossing the near plane
+// are clipped in homogeneous space like GL does, into one or two triangles;
+// textures are sampled bilinear from level 0 only.
+const int SOFT_TILE = 64;
+// triangle ranges binned in parallel, each keeps its own tile lists
+const unsigned int SOFT_BIN_CHUNKS = 64;
+// set on bin entries and triangle corners that index the chunk's own
+// clipped triangles and vertices rather than the shared arrays
+const unsigned int SOFT_CLIPPED = 0x80000000u;
+
+// texture array layers of a model, decoded to CPU memory
+struct SoftTextures
+{
+	std::vector<Image> layers;
+};
+
+struct SoftVertex
+{
+	glm::vec4 clip;
+	glm::vec3 viewPosition;
+	glm::vec3 normal;
+	glm::vec2 textureCoords;
+};
+
+struct SoftTriangle
+{
+	// edge functions a * x + b * y + c, edge i is opposite vertex i
+	float a[3], b[3], c[3];
+	float invArea;
+	float z[3], invW[3];
+	unsigned int vertices[3];
+	int minX, minY, maxX, maxY;
+	int diffuseLayer, specularLayer;
+};
+
+struct SoftStats
+{
+	unsigned int triangles;
+	unsigned int binned;
+	float transformMs, binMs, rasterMs;
+};
+
+struct SoftRenderer
+{
+	int width, height;
+	int tilesX, tilesY;
+	std::vector<unsigned int> color;
+	std::vector<float> depth;
+
+	std::vector<SoftVertex> vertices;
+	std::vector<SoftTriangle> triangles;
+	// SOFT_BIN_CHUNKS * tile count lists of triangle indices
+	std::vector<std::vector<unsigned int> > bins;
+	// per bin chunk, made by near plane clipping
+	std::vector<std::vector<SoftVertex> > clippedVertices;
+	std::vector<std::vector<SoftTriangle> > clippedTriangles;
+
+	// for presenting through GL, created by the first softPresent so the
+	// renderer itself runs without a context
+	unsigned int texture, framebuffer;
+
+	SoftStats stats;
+};
+
+void initSoftRenderer(SoftRenderer &renderer, int width, int height);
+void destroySoftRenderer(SoftRenderer &renderer);
+void loadSoftTextures(SoftTextures &textures, const Model &model);
+void softClear(SoftRenderer &renderer, glm::vec3 color);
+void softDrawModel(SoftRenderer &renderer, const Model &model, const SoftTextures &textures, const glm::mat4 &transform, const glm::mat4 &view, const glm::mat4 &proj, const Lights &lights);
+// uploads the framebuffer and blits it into the bound draw framebuffer
+void softPresent(SoftRenderer &renderer);
+
+#endif
@@ -2,20 +2,40 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 #include <glad/glad.h>
+#include "memory.h"
+#include <algorithm>
 #include <cstdio>
+#include <cstring>
 
 namespace texture
 {
+	// stbi_set_flip_vertically_on_load is global state, and images are
+	// decoded on job workers and loader threads at once
+	static void flipRows(unsigned char* data, int width, int height, int components)
+	{
+		size_t stride = (size_t)width * components;
+		std::vector<unsigned char> row(stride);
+		for (int y = 0; y < height / 2; ++y)
+		{
+			unsigned char* top = data + y * stride;
+			unsigned char* bottom = data + (height - 1 - y) * stride;
+			std::memcpy(row.data(), top, stride);
+			std::memcpy(top, bottom, stride);
+			std::memcpy(bottom, row.data(), stride);
+		}
+	}
+
 	unsigned int loadTexture(const char* path, bool flip)
 	{
 		unsigned int textureID;
 		glGenTextures(1, &textureID);
 
 		int width, height, nrComponents;
-		stbi_set_flip_vertically_on_load(flip);
 		unsigned char *data = stbi_load(path, &width, &height, &nrComponents, 0);
 		if (data)
 		{
+			if (flip)
+				flipRows(data, width, height, nrComponents);
 			GLenum format;
 			if (nrComponents == 1)
 				format = GL_RED;
@@ -27,6 +47,7 @@ namespace texture
 			glBindTexture(GL_TEXTURE_2D, textureID);
 			glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
 			glGenerateMipmap(GL_TEXTURE_2D);
+			memory::allocate(memory::TEXTURE, textureID, memory::textureBytes(width, height, 1, nrComponents, true));
 
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -59,13 +80,15 @@ namespace texture
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filtering_mode);
 
 		int width, height, nChannels;
-		stbi_set_flip_vertically_on_load(flip);
 		unsigned char* data = stbi_load(path, &width, &height, &nChannels, 0);
 
 		if (data)
 		{
+			if (flip)
+				flipRows(data, width, height, nChannels);
 			glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
 			glGenerateMipmap(GL_TEXTURE_2D);
+			memory::allocate(memory::TEXTURE, texture, memory::textureBytes(width, height, 1, nChannels, true));
 		}
 		else
 		{
@@ -76,4 +99,125 @@ namespace texture
 		glBindTexture(GL_TEXTURE_2D, 0);
 		return texture;
 	}
+
+	bool loadImage(const char* path, bool flip, Image &image)
+	{
+		int nrComponents;
+		unsigned char *data = stbi_load(path, &image.width, &image.height, &nrComponents, 4);
+		if (!data)
+		{
+			printf("Failed to load texture: %s\n", path);
+			image.width = image.height = 0;
+			image.pixels.clear();
+			return false;
+		}
+
+		if (flip)
+			flipRows(data, image.width, image.height, 4);
+		image.pixels.assign(data, data + image.width * image.height * 4);
+		stbi_image_free(data);
+		return true;
+	}
+
+	// bilinear, good enough to bring odd-sized material textures to the array size
+	void resizeImage(Image &image, int width, int height)
+	{
+		if (image.width == width && image.height == height)
+			return;
+
+		std::vector<unsigned char> resized(width * height * 4);
+		if (image.width > 0 && image.height > 0)
+		{
+			float scaleX = (float)image.width / width;
+			float scaleY = (float)image.height / height;
+			for (int y = 0; y < height; ++y)
+			{
+				float sy = (y + 0.5f) * scaleY - 0.5f;
+				int y0 = sy < 0.0f ? 0 : (int)sy;
+				int y1 = y0 + 1 < image.height ? y0 + 1 : y0;
+				float fy = sy < 0.0f ? 0.0f : sy - y0;
+				for (int x = 0; x < width; ++x)
+				{
+					float sx = (x + 0.5f) * scaleX - 0.5f;
+					int x0 = sx < 0.0f ? 0 : (int)sx;
+					int x1 = x0 + 1 < image.width ? x0 + 1 : x0;
+					float fx = sx < 0.0f ? 0.0f : sx - x0;
+
+					const unsigned char* p00 = &image.pixels[(y0 * image.width + x0) * 4];
+					const unsigned char* p10 = &image.pixels[(y0 * image.width + x1) * 4];
+					const unsigned char* p01 = &image.pixels[(y1 * image.width + x0) * 4];
+					const unsigned char* p11 = &image.pixels[(y1 * image.width + x1) * 4];
+					for (int c = 0; c < 4; ++c)
+					{
+						float top = p00[c] + (p10[c] - p00[c]) * fx;
+						float bottom = p01[c] + (p11[c] - p01[c]) * fx;
+						resized[(y * width + x) * 4 + c] = (unsigned char)(top + (bottom - top) * fy + 0.5f);
+					}
+				}
+			}
+		}
+
+		image.pixels.swap(resized);
+		image.width = width;
+		image.height = height;
+	}
+
+	unsigned int createArray(const std::vector<Image> &images)
+	{
+		unsigned int textureID;
+		glGenTextures(1, &textureID);
+		if (images.empty())
+			return textureID;
+
+		int width = images[0].width, height = images[0].height;
+		glBindTexture(GL_TEXTURE_2D_ARRAY, textureID);
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, width, height, images.size(), 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		for (unsigned int i = 0; i < images.size(); ++i)
+		{
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, images[i].pixels.data());
+		}
+		glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+		memory::allocate(memory::TEXTURE, textureID, memory::textureBytes(width, height, images.size(), 4, true));
+
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+		return textureID;
+	}
+
+	unsigned int allocateArray(int width, int height, int layers, int levels)
+	{
+		unsigned int textureID;
+		glGenTextures(1, &textureID);
+		if (layers == 0)
+			return textureID;
+
+		glBindTexture(GL_TEXTURE_2D_ARRAY, textureID);
+		for (int level = 0; level < levels; ++level)
+		{
+			int levelWidth = std::max(width >> level, 1), levelHeight = std::max(height >> level, 1);
+			glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, levelWidth, levelHeight, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		}
+		memory::allocate(memory::TEXTURE, textureID, memory::textureBytes(width, height, layers, 4, levels > 1));
+
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+		return textureID;
+	}
+
+	void uploadArrayImage(unsigned int array, int layer, int level, const Image &image)
+	{
+		glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, image.width, image.height, 1, GL_RGBA, GL_UNSIGNED_BYTE, image.pixels.data());
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	}
 }
@@ -1,10 +1,31 @@
 #ifndef TEXTURE_H
 #define TEXTURE_H
 
+#include <vector>
+
+// decoded RGBA8 pixels, rows bottom to top when loaded with flip
+struct Image
+{
+	std::vector<unsigned char> pixels;
+	int width;
+	int height;
+};
+
 namespace texture
 {
 	unsigned int loadTexture(const char* path, bool flip);
     unsigned int loadFromFile(const char* path, unsigned int format, bool flip, int wrapping_mode, int filtering_mode);
+
+	// safe to call from worker threads, no GL calls
+	bool loadImage(const char* path, bool flip, Image &image);
+	void resizeImage(Image &image, int width, int height);
+
+	// one layer per image, all images must have the same size
+	unsigned int createArray(const std::vector<Image> &images);
+	// storage for levels mips of every layer, filled by uploadArrayImage, e.g.
+	// a few images per frame
+	unsigned int allocateArray(int width, int height, int layers, int levels);
+	void uploadArrayImage(unsigned int array, int layer, int level, const Image &image);
 }
 
 #endif
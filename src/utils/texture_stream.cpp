@@ -0,0 +1,394 @@
+#include <glad/glad.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#include "texture_stream.h"
+#include "memory.h"
+
+int mipLevels(int width, int height)
+{
+	int levels = 1;
+	for (int size = std::max(width, height); size > 1; size >>= 1)
+		levels++;
+	return levels;
+}
+
+int streamBaseLevel(int width, int height)
+{
+	int level = 0;
+	while (std::max(mipSize(width, level), mipSize(height, level)) > STREAM_BASE_SIZE)
+		level++;
+	return level;
+}
+
+bool streamingSupported()
+{
+#ifdef GL_VERSION_4_3
+	return GLAD_GL_VERSION_4_3 != 0;
+#else
+	return false;
+#endif
+}
+
+size_t residentTextureBytes(const Model &model)
+{
+	int levels = mipLevels(model.textureWidth, model.textureHeight);
+	size_t bytes = 0;
+	for (int level = model.textureTopLevel; level < levels; ++level)
+		bytes += (size_t)mipSize(model.textureWidth, level) * mipSize(model.textureHeight, level) * 4;
+	return bytes * model.sharedTextures.size();
+}
+
+static void loaderLoop(TextureStreamer* streamer)
+{
+	for (;;)
+	{
+		StreamRequest* request;
+		{
+			std::unique_lock<std::mutex> lock(streamer->mutex);
+			while (streamer->requests.empty() && !streamer->stopping)
+				streamer->wake.wait(lock);
+			if (streamer->stopping)
+				break;
+			request = streamer->requests.front();
+			streamer->requests.erase(streamer->requests.begin());
+		}
+
+		// same steps as packModelTextures, then halve down to the wanted levels
+		int count = request->last - request->first;
+		request->images.resize(request->paths.size() * count);
+		for (unsigned int i = 0; i < request->paths.size(); ++i)
+		{
+			Image image;
+			texture::loadImage(request->paths[i].c_str(), true, image);
+			texture::resizeImage(image, request->width, request->height);
+			for (int level = 0; level < request->last; ++level)
+			{
+				if (level > 0)
+					texture::resizeImage(image, mipSize(request->width, level), mipSize(request->height, level));
+				if (level >= request->first)
+					request->images[i * count + level - request->first] = image;
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(streamer->mutex);
+		streamer->done.push_back(request);
+	}
+}
+
+void initStreamer(TextureStreamer &streamer, size_t budgetBytes)
+{
+	streamer.budgetBytes = budgetBytes;
+	streamer.frame = 0;
+	streamer.stopping = false;
+	streamer.stats.residentBytes = 0;
+	streamer.stats.loads = 0;
+	streamer.stats.evictions = 0;
+	streamer.stats.pending = 0;
+	streamer.loader = std::thread(loaderLoop, &streamer);
+}
+
+void shutdownStreamer(TextureStreamer &streamer)
+{
+	{
+		std::lock_guard<std::mutex> lock(streamer.mutex);
+		streamer.stopping = true;
+	}
+	streamer.wake.notify_all();
+	streamer.loader.join();
+
+	for (unsigned int i = 0; i < streamer.requests.size(); ++i)
+		delete streamer.requests[i];
+	for (unsigned int i = 0; i < streamer.done.size(); ++i)
+		delete streamer.done[i];
+	for (unsigned int i = 0; i < streamer.textures.size(); ++i)
+		delete streamer.textures[i];
+	streamer.requests.clear();
+	streamer.done.clear();
+	streamer.textures.clear();
+}
+
+void addStreamedModel(TextureStreamer &streamer, Model &model)
+{
+	if (model.sharedTextures.empty())
+		return;
+
+	StreamedTexture* texture = new StreamedTexture();
+	texture->model = &model;
+	for (unsigned int i = 0; i < model.sharedTextures.size(); ++i)
+		texture->paths.push_back(model.texturesDir + model.sharedTextures[i].path);
+	texture->levels = mipLevels(model.textureWidth, model.textureHeight);
+	texture->baseLevel = model.textureTopLevel;
+	texture->wantedLevel = model.textureTopLevel;
+	texture->loading = false;
+	texture->lastUsed = streamer.frame;
+	streamer.textures.push_back(texture);
+}
+
+static StreamedTexture* findTexture(TextureStreamer &streamer, const Model &model)
+{
+	for (unsigned int i = 0; i < streamer.textures.size(); ++i)
+	{
+		if (streamer.textures[i]->model == &model)
+			return streamer.textures[i];
+	}
+	return NULL;
+}
+
+static void eraseTexture(TextureStreamer &streamer, StreamedTexture* texture)
+{
+	streamer.textures.erase(std::find(streamer.textures.begin(), streamer.textures.end(), texture));
+	delete texture;
+}
+
+void removeStreamedModel(TextureStreamer &streamer, Model &model)
+{
+	StreamedTexture* texture = findTexture(streamer, model);
+	if (!texture)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(streamer.mutex);
+		for (unsigned int i = 0; i < streamer.requests.size(); )
+		{
+			if (streamer.requests[i]->texture != texture)
+			{
+				++i;
+				continue;
+			}
+			delete streamer.requests[i];
+			streamer.requests.erase(streamer.requests.begin() + i);
+			texture->loading = false;
+			streamer.stats.pending--;
+		}
+		for (unsigned int i = 0; i < streamer.done.size(); )
+		{
+			if (streamer.done[i]->texture != texture)
+			{
+				++i;
+				continue;
+			}
+			delete streamer.done[i];
+			streamer.done.erase(streamer.done.begin() + i);
+			texture->loading = false;
+			streamer.stats.pending--;
+		}
+	}
+
+	// a load on the loader thread still points at the texture
+	if (texture->loading)
+		texture->model = NULL;
+	else
+		eraseTexture(streamer, texture);
+}
+
+void requestTextureDetail(TextureStreamer &streamer, Model &model, const glm::mat4 &transform, glm::vec3 cameraPosition, float fovY, int screenHeight)
+{
+	StreamedTexture* texture = findTexture(streamer, model);
+	if (!texture)
+		return;
+
+	float scale = std::max(glm::length(glm::vec3(transform[0])), std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+	// screen pixels covered by one world unit at distance 1
+	float pixelsPerUnit = screenHeight / (2.0f * std::tan(fovY * 0.5f));
+	int textureSize = std::max(model.textureWidth, model.textureHeight);
+
+	int wanted = texture->levels - 1;
+	for (unsigned int i = 0; i < model.meshes.size(); ++i)
+	{
+		const Mesh &mesh = model.meshes[i];
+		if (mesh.uvDensity <= 0.0f || scale <= 0.0f)
+			continue;
+
+		glm::vec3 center = glm::vec3(transform * glm::vec4((mesh.boundsMin + mesh.boundsMax) * 0.5f, 1.0f));
+		float radius = glm::length(mesh.boundsMax - mesh.boundsMin) * 0.5f * scale;
+		float distance = std::max(glm::length(center - cameraPosition) - radius, 0.1f);
+
+		// texels per screen pixel at level 0, each level halves it
+		float texelsPerPixel = mesh.uvDensity * textureSize / scale / (pixelsPerUnit / distance);
+		int level = texelsPerPixel > 1.0f ? (int)std::floor(std::log2(texelsPerPixel)) : 0;
+		wanted = std::min(wanted, level);
+	}
+
+	texture->wantedLevel = std::min(wanted, texture->baseLevel);
+	texture->lastUsed = streamer.frame;
+}
+
+// new array with `top` as level 0, the levels both arrays share are copied on
+// the GPU, finer ones come from images
+static void reallocate(StreamedTexture &texture, int top, const StreamRequest* request)
+{
+	Model &model = *texture.model;
+	int width = model.textureWidth, height = model.textureHeight;
+	int layers = model.sharedTextures.size();
+	int oldTop = model.textureTopLevel;
+
+	unsigned int array;
+	glGenTextures(1, &array);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+	for (int level = top; level < texture.levels; ++level)
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, level - top, GL_RGBA8, mipSize(width, level), mipSize(height, level), layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, texture.levels - 1 - top);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	// only reached when streamingSupported()
+#ifdef GL_VERSION_4_3
+	for (int level = std::max(top, oldTop); level < texture.levels; ++level)
+	{
+		glCopyImageSubData(model.textureArray, GL_TEXTURE_2D_ARRAY, level - oldTop, 0, 0, 0,
+			array, GL_TEXTURE_2D_ARRAY, level - top, 0, 0, 0,
+			mipSize(width, level), mipSize(height, level), layers);
+	}
+#endif
+
+	if (request)
+	{
+		int count = request->last - request->first;
+		for (int level = top; level < oldTop; ++level)
+		{
+			for (int layer = 0; layer < layers; ++layer)
+			{
+				const Image &image = request->images[layer * count + level - request->first];
+				glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level - top, 0, 0, layer, image.width, image.height, 1, GL_RGBA, GL_UNSIGNED_BYTE, image.pixels.data());
+			}
+		}
+	}
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	memory::release(memory::TEXTURE, model.textureArray);
+	glDeleteTextures(1, &model.textureArray);
+	model.textureArray = array;
+	model.textureTopLevel = top;
+	memory::ScopedOwner owner(model.name);
+	memory::allocate(memory::TEXTURE, array, residentTextureBytes(model));
+	for (unsigned int i = 0; i < model.sharedTextures.size(); ++i)
+		model.sharedTextures[i].id = array;
+	for (unsigned int i = 0; i < model.meshes.size(); ++i)
+	{
+		for (unsigned int j = 0; j < model.meshes[i].textures.size(); ++j)
+			model.meshes[i].textures[j].id = array;
+	}
+}
+
+// the cost of one more level on top of what is resident
+static size_t nextLevelBytes(const StreamedTexture &texture)
+{
+	const Model &model = *texture.model;
+	int level = model.textureTopLevel - 1;
+	return (size_t)mipSize(model.textureWidth, level) * mipSize(model.textureHeight, level) * 4 * model.sharedTextures.size();
+}
+
+static size_t totalResident(TextureStreamer &streamer)
+{
+	size_t bytes = 0;
+	for (unsigned int i = 0; i < streamer.textures.size(); ++i)
+	{
+		if (streamer.textures[i]->model)
+			bytes += residentTextureBytes(*streamer.textures[i]->model);
+	}
+	return bytes;
+}
+
+// unneeded levels go first, then the least recently used
+static StreamedTexture* evictionCandidate(TextureStreamer &streamer)
+{
+	StreamedTexture* best = NULL;
+	for (unsigned int i = 0; i < streamer.textures.size(); ++i)
+	{
+		StreamedTexture* texture = streamer.textures[i];
+		if (!texture->model || texture->model->textureTopLevel >= texture->baseLevel)
+			continue;
+		if (!best)
+		{
+			best = texture;
+			continue;
+		}
+
+		bool unneeded = texture->model->textureTopLevel < texture->wantedLevel;
+		bool bestUnneeded = best->model->textureTopLevel < best->wantedLevel;
+		if (unneeded != bestUnneeded ? unneeded : texture->lastUsed < best->lastUsed)
+			best = texture;
+	}
+	return best;
+}
+
+void updateStreamer(TextureStreamer &streamer)
+{
+	std::vector<StreamRequest*> done;
+	{
+		std::lock_guard<std::mutex> lock(streamer.mutex);
+		done.swap(streamer.done);
+	}
+
+	for (unsigned int i = 0; i < done.size(); ++i)
+	{
+		StreamedTexture &texture = *done[i]->texture;
+		if (!texture.model)
+		{
+			eraseTexture(streamer, &texture);
+			streamer.stats.pending--;
+			delete done[i];
+			continue;
+		}
+		// levels evicted while loading leave a gap the request can't fill
+		if (done[i]->last == texture.model->textureTopLevel)
+		{
+			reallocate(texture, done[i]->first, done[i]);
+			streamer.stats.loads++;
+		}
+		texture.loading = false;
+		streamer.stats.pending--;
+		delete done[i];
+	}
+
+	size_t resident = totalResident(streamer);
+	while (resident > streamer.budgetBytes)
+	{
+		StreamedTexture* victim = evictionCandidate(streamer);
+		if (!victim)
+			break;
+		reallocate(*victim, victim->model->textureTopLevel + 1, NULL);
+		streamer.stats.evictions++;
+		resident = totalResident(streamer);
+	}
+
+	// one level at a time, the most wanted first; only while it fits the
+	// budget without evicting something used this frame
+	StreamedTexture* next = NULL;
+	for (unsigned int i = 0; i < streamer.textures.size(); ++i)
+	{
+		StreamedTexture* texture = streamer.textures[i];
+		if (!texture->model)
+			continue;
+		int missing = texture->model->textureTopLevel - texture->wantedLevel;
+		if (texture->loading || missing <= 0 || texture->lastUsed != streamer.frame)
+			continue;
+		if (!next || missing > next->model->textureTopLevel - next->wantedLevel)
+			next = texture;
+	}
+
+	if (next && resident + nextLevelBytes(*next) <= streamer.budgetBytes)
+	{
+		StreamRequest* request = new StreamRequest();
+		request->texture = next;
+		request->width = next->model->textureWidth;
+		request->height = next->model->textureHeight;
+		request->first = next->model->textureTopLevel - 1;
+		request->last = next->model->textureTopLevel;
+		request->paths = next->paths;
+		next->loading = true;
+		streamer.stats.pending++;
+		{
+			std::lock_guard<std::mutex> lock(streamer.mutex);
+			streamer.requests.push_back(request);
+		}
+		streamer.wake.notify_all();
+	}
+
+	streamer.stats.residentBytes = resident;
+	streamer.frame++;
+}
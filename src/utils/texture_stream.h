@@ -0,0 +1,92 @@
+#ifndef TEXTURE_STREAM_H
+#define TEXTURE_STREAM_H
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <glm/glm.hpp>
+
+#include "model.h"
+#include "texture.h"
+
+// Mip streaming for model texture arrays. A model loaded with
+// MODEL_STREAM_TEXTURES only uploads the mips from streamBaseLevel down.
+// Every frame the wanted level is estimated from each mesh's texel density
+// on screen; finer levels are decoded one at a time on a loader thread and
+// the array is reallocated one level larger, the resident levels are copied
+// over on the GPU. When the resident total exceeds the budget, the least
+// recently used arrays drop their finest level again. Needs GL 4.3 for
+// glCopyImageSubData.
+
+// largest side of the always resident base level
+const int STREAM_BASE_SIZE = 128;
+
+inline int mipSize(int size, int level)
+{
+	return (size >> level) > 0 ? size >> level : 1;
+}
+
+int mipLevels(int width, int height);
+int streamBaseLevel(int width, int height);
+
+struct StreamedTexture
+{
+	// NULL once removed while a load was on the loader thread, the texture
+	// goes away when that load comes back
+	Model* model;
+	std::vector<std::string> paths;
+	int levels, baseLevel;
+	int wantedLevel;
+	// a finer level is on the loader thread
+	bool loading;
+	unsigned long long lastUsed;
+};
+
+struct StreamRequest
+{
+	StreamedTexture* texture;
+	int width, height;
+	// levels first..last-1 of every layer, first being the finest
+	int first, last;
+	std::vector<std::string> paths;
+	std::vector<Image> images;
+};
+
+struct StreamStats
+{
+	size_t residentBytes;
+	unsigned int loads;
+	unsigned int evictions;
+	unsigned int pending;
+};
+
+struct TextureStreamer
+{
+	std::vector<StreamedTexture*> textures;
+	size_t budgetBytes;
+	unsigned long long frame;
+
+	std::thread loader;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::vector<StreamRequest*> requests, done;
+	bool stopping;
+
+	StreamStats stats;
+};
+
+bool streamingSupported();
+void initStreamer(TextureStreamer &streamer, size_t budgetBytes);
+void shutdownStreamer(TextureStreamer &streamer);
+void addStreamedModel(TextureStreamer &streamer, Model &model);
+// before the model is destroyed, drops its queued loads
+void removeStreamedModel(TextureStreamer &streamer, Model &model);
+// call for every model drawn this frame
+void requestTextureDetail(TextureStreamer &streamer, Model &model, const glm::mat4 &transform, glm::vec3 cameraPosition, float fovY, int screenHeight);
+// uploads finished levels, evicts over budget and starts new loads
+void updateStreamer(TextureStreamer &streamer);
+size_t residentTextureBytes(const Model &model);
+
+#endif
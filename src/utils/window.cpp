@@ -3,13 +3,20 @@
 
 void size_callback(GLFWwindow* window, int width, int height);
 
-Window::Window(unsigned int width, unsigned int height)
+Window::Window(unsigned int width, unsigned int height, bool visible)
 {
     glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    // 4.3 for compute and indirect draws, 3.3 still runs everything else
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, visible ? GLFW_TRUE : GLFW_FALSE);
     this->raw = glfwCreateWindow(width, height, "LearnOpenGL", NULL, NULL);
+    if (this->raw == NULL)
+    {
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	this->raw = glfwCreateWindow(width, height, "LearnOpenGL", NULL, NULL);
+    }
     if (this->raw == NULL)
 	return;
     glfwMakeContextCurrent(this->raw);
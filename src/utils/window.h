@@ -8,7 +8,8 @@ struct Window;
 struct Window
 {
   GLFWwindow* raw;
-  Window(unsigned int, unsigned int);
+  // hidden windows only provide a context, render into a framebuffer object
+  Window(unsigned int, unsigned int, bool visible = true);
   ~Window();
 };
 
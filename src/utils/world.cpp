@@ -0,0 +1,599 @@
+#include "world.h"
+#include "model.h"
+#include "scene.h"
+#include "resources.h"
+#include "memory.h"
+#include "texture_stream.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+#include <sys/stat.h>
+
+// loads waiting for upload before the loader thread pauses; their CPU copies
+// are accounted but cannot be unloaded yet
+static const unsigned int WORLD_MAX_DONE = 4;
+// seconds the velocity estimate takes to follow the camera
+static const float WORLD_VELOCITY_SMOOTHING = 0.25f;
+// samples along the predicted path, bounds the prefetch of a fast camera
+static const int WORLD_MAX_PATH_SAMPLES = 32;
+
+static std::string resolvePath(const std::string &directory, const char* path)
+{
+	if (path[0] == '/')
+		return path;
+	return directory + "/" + path;
+}
+
+static std::string tilePath(const WorldStreamer &world, unsigned int tile)
+{
+	char name[64];
+	snprintf(name, sizeof(name), "/tile_%u_%u.txt", tile % world.countX, tile / world.countX);
+	return world.directory + name;
+}
+
+// a missing tile file is an empty tile
+static void readTile(const WorldStreamer &world, TileLoad &load, std::vector<std::string> &texturesDirs)
+{
+	FILE* file = fopen(tilePath(world, load.tile).c_str(), "r");
+	if (!file)
+		return;
+
+	char line[1024];
+	while (fgets(line, sizeof(line), file))
+	{
+		char path[512], textures[512];
+		TileInstance instance;
+		WorldLight light;
+		if (sscanf(line, "model %511s %511s", path, textures) == 2)
+		{
+			load.modelPaths.push_back(resolvePath(world.directory, path));
+			// loadModel appends the texture file names directly
+			texturesDirs.push_back(resolvePath(world.directory, textures) + "/");
+		}
+		else if (sscanf(line, "instance %u %f %f %f %f %f %f %f %f %f", &instance.model,
+			&instance.position.x, &instance.position.y, &instance.position.z,
+			&instance.rotation.x, &instance.rotation.y, &instance.rotation.z,
+			&instance.scale.x, &instance.scale.y, &instance.scale.z) == 10)
+		{
+			load.instances.push_back(instance);
+		}
+		else if (sscanf(line, "light %f %f %f %f %f %f",
+			&light.position.x, &light.position.y, &light.position.z,
+			&light.color.x, &light.color.y, &light.color.z) == 6)
+		{
+			load.lights.push_back(light);
+		}
+	}
+	fclose(file);
+
+	unsigned int kept = 0;
+	for (unsigned int i = 0; i < load.instances.size(); ++i)
+	{
+		if (load.instances[i].model < load.modelPaths.size())
+			load.instances[kept++] = load.instances[i];
+		else
+			printf("Warning: instance of model %u in %s, which has %u models\n", load.instances[i].model, tilePath(world, load.tile).c_str(), (unsigned int)load.modelPaths.size());
+	}
+	load.instances.resize(kept);
+}
+
+// halves every decoded layer down to 1x1 on the loader thread, so the GL
+// thread only copies and never runs glGenerateMipmap over a whole array
+static void buildMipChains(const Model &model, StreamedModel &streamed)
+{
+	if (streamed.images.empty())
+		return;
+	streamed.levels = mipLevels(model.textureWidth, model.textureHeight);
+	std::vector<Image> chains(streamed.images.size() * streamed.levels);
+	for (unsigned int i = 0; i < streamed.images.size(); ++i)
+	{
+		Image &image = streamed.images[i];
+		for (int level = 0; level < streamed.levels; ++level)
+		{
+			if (level > 0)
+				texture::resizeImage(image, mipSize(model.textureWidth, level), mipSize(model.textureHeight, level));
+			chains[i * streamed.levels + level] = image;
+		}
+	}
+	streamed.images.swap(chains);
+}
+
+// Never touches the scene, the resource manager or GL, and never runs jobs.
+static void loaderLoop(WorldStreamer* world)
+{
+	while (true)
+	{
+		TileLoad* load = new TileLoad();
+		{
+			std::unique_lock<std::mutex> lock(world->mutex);
+			world->wake.wait(lock, [world] { return world->stopping || (!world->requests.empty() && world->done.size() < WORLD_MAX_DONE); });
+			if (world->stopping)
+			{
+				delete load;
+				return;
+			}
+			load->tile = world->requests.front();
+			world->requests.pop_front();
+		}
+
+		std::vector<std::string> texturesDirs;
+		readTile(*world, *load, texturesDirs);
+
+		for (unsigned int i = 0; i < load->modelPaths.size(); ++i)
+		{
+			const std::string &path = load->modelPaths[i];
+			{
+				std::lock_guard<std::mutex> lock(world->mutex);
+				if (!world->knownPaths.insert(path).second)
+					continue;
+			}
+
+			StreamedModel streamed;
+			streamed.path = path;
+			streamed.model = new Model();
+			streamed.levels = 0;
+			streamed.uploadedMeshes = 0;
+			streamed.uploadedImages = 0;
+			streamed.texturesUploaded = false;
+			if (!loadModel(*streamed.model, path.c_str(), texturesDirs[i].c_str(), MODEL_NO_GPU))
+			{
+				printf("Warning: could not load %s for %s\n", path.c_str(), tilePath(*world, load->tile).c_str());
+				destroyModel(*streamed.model);
+				delete streamed.model;
+				// stays known, so it is not retried by every tile using it
+				std::lock_guard<std::mutex> lock(world->mutex);
+				world->failedPaths.insert(path);
+				continue;
+			}
+			decodeModelTextures(*streamed.model, streamed.images);
+			buildMipChains(*streamed.model, streamed);
+			load->models.push_back(streamed);
+		}
+
+		std::lock_guard<std::mutex> lock(world->mutex);
+		world->done.push_back(load);
+	}
+}
+
+bool openWorld(WorldStreamer &world, const char* directory, float loadRadius, size_t uploadBudget, size_t memoryBudget)
+{
+	world.directory = directory;
+	while (world.directory.size() > 1 && world.directory[world.directory.size() - 1] == '/')
+		world.directory.erase(world.directory.size() - 1);
+
+	std::string path = world.directory + "/world.txt";
+	FILE* file = fopen(path.c_str(), "r");
+	if (!file)
+	{
+		printf("Failed to open %s\n", path.c_str());
+		return false;
+	}
+
+	world.countX = world.countZ = 0;
+	world.tileSize = 0.0f;
+	world.origin = glm::vec2(0.0f);
+	char line[256];
+	while (fgets(line, sizeof(line), file))
+	{
+		if (sscanf(line, "tiles %d %d", &world.countX, &world.countZ) == 2)
+			continue;
+		if (sscanf(line, "size %f", &world.tileSize) == 1)
+			continue;
+		sscanf(line, "origin %f %f", &world.origin.x, &world.origin.y);
+	}
+	fclose(file);
+
+	// tile indices are unsigned ints
+	if (world.countX <= 0 || world.countZ <= 0 || world.tileSize <= 0.0f || (double)world.countX * world.countZ > UINT_MAX)
+	{
+		printf("%s needs tiles and size\n", path.c_str());
+		return false;
+	}
+
+	world.tiles.clear();
+	world.loadRadius = loadRadius;
+	world.prefetchSeconds = 2.0f;
+	world.uploadBudget = uploadBudget;
+	world.memoryBudget = memoryBudget;
+	world.lastCamera = world.velocity = glm::vec3(0.0f);
+	world.hasCamera = false;
+	world.frame = 0;
+	world.requests.clear();
+	world.done.clear();
+	world.knownPaths.clear();
+	world.failedPaths.clear();
+	world.stopping = false;
+	world.stats = WorldStats();
+
+	world.loader = std::thread(loaderLoop, &world);
+	printf("World %s: %d x %d tiles of %.1f\n", world.directory.c_str(), world.countX, world.countZ, world.tileSize);
+	return true;
+}
+
+static void unloadTile(WorldStreamer &world, Scene &scene, ResourceManager &resources, std::map<unsigned int, WorldTile>::iterator tile)
+{
+	for (unsigned int i = 0; i < tile->second.entities.size(); ++i)
+		destroyInstance(scene, resources, tile->second.entities[i]);
+
+	// models no other tile uses are gone now, the loader must bring them back
+	{
+		std::lock_guard<std::mutex> lock(world.mutex);
+		for (unsigned int i = 0; i < tile->second.modelPaths.size(); ++i)
+		{
+			const std::string &path = tile->second.modelPaths[i];
+			if (findModel(resources, path.c_str()) == NO_MODEL && !world.failedPaths.count(path))
+				world.knownPaths.erase(path);
+		}
+	}
+	world.tiles.erase(tile);
+	world.stats.tileUnloads++;
+}
+
+static void destroyLoad(TileLoad* load)
+{
+	for (unsigned int i = 0; i < load->models.size(); ++i)
+	{
+		destroyModel(*load->models[i].model);
+		delete load->models[i].model;
+	}
+	delete load;
+}
+
+void closeWorld(WorldStreamer &world, Scene &scene, ResourceManager &resources)
+{
+	{
+		std::lock_guard<std::mutex> lock(world.mutex);
+		world.stopping = true;
+	}
+	world.wake.notify_all();
+	if (world.loader.joinable())
+		world.loader.join();
+
+	for (unsigned int i = 0; i < world.done.size(); ++i)
+		destroyLoad(world.done[i]);
+	world.done.clear();
+	world.requests.clear();
+
+	while (!world.tiles.empty())
+		unloadTile(world, scene, resources, world.tiles.begin());
+}
+
+// Uploads meshes, then the texture array one mip of one layer at a time,
+// until the frame's budget is spent; at least one step runs each frame
+// however large it is. True when the whole load is on the GPU.
+static bool uploadLoad(TileLoad &load, size_t budget, size_t &spent)
+{
+	for (unsigned int i = 0; i < load.models.size(); ++i)
+	{
+		StreamedModel &streamed = load.models[i];
+		Model &model = *streamed.model;
+		memory::ScopedOwner owner(model.name);
+
+		while (streamed.uploadedMeshes < model.meshes.size())
+		{
+			Mesh &mesh = model.meshes[streamed.uploadedMeshes];
+			size_t bytes = mesh.vertices.size() * sizeof(Vertex) + mesh.indices.size() * sizeof(unsigned int);
+			if (spent > 0 && spent + bytes > budget)
+				return false;
+			uploadMesh(mesh);
+			// streamed models are only drawn, the GL copy is all they need
+			releaseMeshData(mesh);
+			model.cpuDataReleased = true;
+			spent += bytes;
+			streamed.uploadedMeshes++;
+		}
+
+		if (streamed.texturesUploaded)
+			continue;
+		// owned by the model from here, so destroyModel frees a partial upload
+		if (model.textureArray == 0)
+		{
+			unsigned int layers = streamed.levels > 0 ? streamed.images.size() / streamed.levels : 0;
+			model.textureArray = texture::allocateArray(model.textureWidth, model.textureHeight, layers, streamed.levels);
+		}
+		while (streamed.uploadedImages < streamed.images.size())
+		{
+			Image &image = streamed.images[streamed.uploadedImages];
+			size_t bytes = image.pixels.size();
+			if (spent > 0 && spent + bytes > budget)
+				return false;
+			texture::uploadArrayImage(model.textureArray, streamed.uploadedImages / streamed.levels, streamed.uploadedImages % streamed.levels, image);
+			std::vector<unsigned char>().swap(image.pixels);
+			spent += bytes;
+			streamed.uploadedImages++;
+		}
+		finishModelTextures(model);
+		std::vector<Image>().swap(streamed.images);
+		streamed.texturesUploaded = true;
+	}
+	return true;
+}
+
+static void installTile(WorldStreamer &world, Scene &scene, ResourceManager &resources, TileLoad* load)
+{
+	WorldTile &tile = world.tiles[load->tile];
+
+	// A model can be missing when the tile that loaded it was unloaded while
+	// this one was on the loader thread; read the tile again.
+	bool missing = false;
+	for (unsigned int i = 0; i < load->modelPaths.size() && !missing; ++i)
+	{
+		const std::string &path = load->modelPaths[i];
+		if (findModel(resources, path.c_str()) != NO_MODEL)
+			continue;
+		bool loaded = false;
+		for (unsigned int j = 0; j < load->models.size(); ++j)
+			loaded = loaded || load->models[j].path == path;
+		std::lock_guard<std::mutex> lock(world.mutex);
+		missing = !loaded && !world.failedPaths.count(path);
+	}
+	if (missing)
+	{
+		std::lock_guard<std::mutex> lock(world.mutex);
+		for (unsigned int i = 0; i < load->models.size(); ++i)
+			world.knownPaths.erase(load->models[i].path);
+		tile.state = TILE_QUEUED;
+		world.requests.push_front(load->tile);
+		destroyLoad(load);
+		world.wake.notify_one();
+		return;
+	}
+
+	// the tile's instances hold the models, the adoption references go below
+	std::vector<ModelHandle> adopted;
+	for (unsigned int i = 0; i < load->models.size(); ++i)
+	{
+		StreamedModel &streamed = load->models[i];
+		// acquired outside the world under the same path meanwhile
+		if (findModel(resources, streamed.path.c_str()) != NO_MODEL)
+		{
+			destroyModel(*streamed.model);
+			delete streamed.model;
+			continue;
+		}
+		adopted.push_back(addModel(resources, streamed.path.c_str(), streamed.model));
+	}
+
+	for (unsigned int i = 0; i < load->instances.size(); ++i)
+	{
+		const TileInstance &instance = load->instances[i];
+		ModelHandle handle = findModel(resources, load->modelPaths[instance.model].c_str());
+		if (handle == NO_MODEL)
+			continue;
+		tile.entities.push_back(createInstance(scene, resources, handle, instance.position, instance.rotation, instance.scale));
+	}
+	for (unsigned int i = 0; i < adopted.size(); ++i)
+		releaseModel(resources, adopted[i]);
+
+	tile.modelPaths.swap(load->modelPaths);
+	tile.lights.swap(load->lights);
+	tile.state = TILE_RESIDENT;
+	world.stats.tileLoads++;
+	// the models now belong to the resource manager
+	delete load;
+}
+
+// tiles whose centers are in range of the camera or of its predicted path,
+// with their distance to the camera
+static void collectWanted(const WorldStreamer &world, glm::vec3 camera, std::vector<std::pair<float, unsigned int> > &wanted)
+{
+	glm::vec2 start(camera.x, camera.z);
+	glm::vec2 end = start + glm::vec2(world.velocity.x, world.velocity.z) * world.prefetchSeconds;
+	int samples = std::min(WORLD_MAX_PATH_SAMPLES, (int)std::ceil(glm::length(end - start) / world.tileSize) + 1);
+
+	std::vector<unsigned int> tiles;
+	for (int s = 0; s < samples; ++s)
+	{
+		glm::vec2 point = samples > 1 ? start + (end - start) * ((float)s / (samples - 1)) : start;
+		glm::vec2 low = (point - world.loadRadius - world.origin) / world.tileSize;
+		glm::vec2 high = (point + world.loadRadius - world.origin) / world.tileSize;
+		int x0 = std::max(0, (int)std::floor(low.x)), x1 = std::min(world.countX - 1, (int)std::floor(high.x));
+		int z0 = std::max(0, (int)std::floor(low.y)), z1 = std::min(world.countZ - 1, (int)std::floor(high.y));
+		for (int z = z0; z <= z1; ++z)
+		{
+			for (int x = x0; x <= x1; ++x)
+			{
+				glm::vec2 center = world.origin + (glm::vec2((float)x, (float)z) + 0.5f) * world.tileSize;
+				if (glm::length(center - point) <= world.loadRadius)
+					tiles.push_back((unsigned int)z * world.countX + x);
+			}
+		}
+	}
+	std::sort(tiles.begin(), tiles.end());
+	tiles.erase(std::unique(tiles.begin(), tiles.end()), tiles.end());
+
+	wanted.clear();
+	for (unsigned int i = 0; i < tiles.size(); ++i)
+	{
+		glm::vec2 center = world.origin + (glm::vec2((float)(tiles[i] % world.countX), (float)(tiles[i] / world.countX)) + 0.5f) * world.tileSize;
+		wanted.push_back(std::make_pair(glm::length(center - start), tiles[i]));
+	}
+	std::sort(wanted.begin(), wanted.end());
+}
+
+void updateWorld(WorldStreamer &world, Scene &scene, ResourceManager &resources, glm::vec3 cameraPosition, float deltaTime)
+{
+	world.frame++;
+	if (world.hasCamera && deltaTime > 0.0f)
+	{
+		glm::vec3 velocity = (cameraPosition - world.lastCamera) / deltaTime;
+		world.velocity += (velocity - world.velocity) * std::min(1.0f, deltaTime / WORLD_VELOCITY_SMOOTHING);
+	}
+	world.lastCamera = cameraPosition;
+	world.hasCamera = true;
+
+	std::vector<std::pair<float, unsigned int> > wanted;
+	collectWanted(world, cameraPosition, wanted);
+	for (unsigned int i = 0; i < wanted.size(); ++i)
+	{
+		std::map<unsigned int, WorldTile>::iterator found = world.tiles.find(wanted[i].second);
+		if (found != world.tiles.end())
+			found->second.lastWanted = world.frame;
+	}
+
+	// requests follow the wanted tiles, nearest first; tiles out of range are
+	// dropped unless the loader thread already has them
+	{
+		std::lock_guard<std::mutex> lock(world.mutex);
+		for (unsigned int i = 0; i < world.requests.size(); ++i)
+		{
+			std::map<unsigned int, WorldTile>::iterator tile = world.tiles.find(world.requests[i]);
+			if (tile->second.lastWanted == world.frame)
+				tile->second.requestFrame = world.frame;
+			else
+				world.tiles.erase(tile);
+		}
+		world.requests.clear();
+		for (unsigned int i = 0; i < wanted.size(); ++i)
+		{
+			std::map<unsigned int, WorldTile>::iterator found = world.tiles.find(wanted[i].second);
+			if (found == world.tiles.end())
+			{
+				WorldTile &tile = world.tiles[wanted[i].second];
+				tile.state = TILE_QUEUED;
+				tile.lastWanted = world.frame;
+				tile.requestFrame = world.frame;
+			}
+			// queued but taken by the loader thread, or further along
+			else if (found->second.requestFrame != world.frame)
+				continue;
+			world.requests.push_back(wanted[i].second);
+		}
+	}
+	world.wake.notify_one();
+
+	auto start = std::chrono::high_resolution_clock::now();
+	size_t spent = 0;
+	while (true)
+	{
+		TileLoad* load;
+		{
+			std::lock_guard<std::mutex> lock(world.mutex);
+			if (world.done.empty())
+				break;
+			load = world.done.front();
+		}
+		// installed even when out of range by now, unloading follows the budget
+		world.tiles[load->tile].state = TILE_LOADED;
+		if (!uploadLoad(*load, world.uploadBudget, spent))
+			break;
+		{
+			std::lock_guard<std::mutex> lock(world.mutex);
+			world.done.pop_front();
+		}
+		world.wake.notify_one();
+		installTile(world, scene, resources, load);
+	}
+	world.stats.uploadedBytes = spent;
+	world.stats.uploadMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	world.stats.maxUploadMs = std::max(world.stats.maxUploadMs, world.stats.uploadMs);
+
+	world.stats.overBudget = false;
+	while (memory::total().currentTotal > world.memoryBudget)
+	{
+		std::map<unsigned int, WorldTile>::iterator victim = world.tiles.end();
+		for (std::map<unsigned int, WorldTile>::iterator it = world.tiles.begin(); it != world.tiles.end(); ++it)
+		{
+			if (it->second.state != TILE_RESIDENT || it->second.lastWanted == world.frame)
+				continue;
+			if (victim == world.tiles.end() || it->second.lastWanted < victim->second.lastWanted)
+				victim = it;
+		}
+		if (victim == world.tiles.end())
+		{
+			world.stats.overBudget = true;
+			break;
+		}
+		unloadTile(world, scene, resources, victim);
+	}
+
+	world.stats.resident = world.stats.queued = world.stats.loaded = 0;
+	for (std::map<unsigned int, WorldTile>::iterator it = world.tiles.begin(); it != world.tiles.end(); ++it)
+	{
+		if (it->second.state == TILE_RESIDENT)
+			world.stats.resident++;
+		else if (it->second.state == TILE_QUEUED)
+			world.stats.queued++;
+		else
+			world.stats.loaded++;
+	}
+	world.stats.wanted = wanted.size();
+}
+
+bool nearestWorldLight(const WorldStreamer &world, glm::vec3 position, WorldLight &light)
+{
+	float best = -1.0f;
+	for (std::map<unsigned int, WorldTile>::const_iterator it = world.tiles.begin(); it != world.tiles.end(); ++it)
+	{
+		for (unsigned int i = 0; i < it->second.lights.size(); ++i)
+		{
+			float distance = glm::length(it->second.lights[i].position - position);
+			if (best < 0.0f || distance < best)
+			{
+				best = distance;
+				light = it->second.lights[i];
+			}
+		}
+	}
+	return best >= 0.0f;
+}
+
+bool writeTestWorld(const char* directory, int tiles, float tileSize, const char* modelPath, const char* texturesDir, unsigned int instancesPerTile)
+{
+	// the tiles name the model from inside the world directory
+	char model[PATH_MAX], textures[PATH_MAX];
+	if (!realpath(modelPath, model) || !realpath(texturesDir, textures))
+	{
+		printf("Failed to resolve %s or %s\n", modelPath, texturesDir);
+		return false;
+	}
+	mkdir(directory, 0755);
+
+	std::string path = std::string(directory) + "/world.txt";
+	FILE* file = fopen(path.c_str(), "w");
+	if (!file)
+	{
+		printf("Failed to write %s\n", path.c_str());
+		return false;
+	}
+	float origin = -0.5f * tiles * tileSize;
+	fprintf(file, "tiles %d %d\nsize %g\norigin %g %g\n", tiles, tiles, tileSize, origin, origin);
+	fclose(file);
+
+	srand(1);
+	for (int z = 0; z < tiles; ++z)
+	{
+		for (int x = 0; x < tiles; ++x)
+		{
+			char name[64];
+			snprintf(name, sizeof(name), "/tile_%d_%d.txt", x, z);
+			path = std::string(directory) + name;
+			file = fopen(path.c_str(), "w");
+			if (!file)
+			{
+				printf("Failed to write %s\n", path.c_str());
+				return false;
+			}
+
+			fprintf(file, "model %s %s\n", model, textures);
+			glm::vec2 corner(origin + x * tileSize, origin + z * tileSize);
+			for (unsigned int i = 0; i < instancesPerTile; ++i)
+			{
+				float px = corner.x + tileSize * (rand() / (float)RAND_MAX);
+				float pz = corner.y + tileSize * (rand() / (float)RAND_MAX);
+				float yaw = 360.0f * (rand() / (float)RAND_MAX);
+				fprintf(file, "instance 0 %g 0 %g 0 %g 0 1 1 1\n", px, pz, yaw);
+			}
+			glm::vec3 color(rand() / (float)RAND_MAX, rand() / (float)RAND_MAX, rand() / (float)RAND_MAX);
+			fprintf(file, "light %g 3 %g %g %g %g\n", corner.x + 0.5f * tileSize, corner.y + 0.5f * tileSize, 0.5f + 0.5f * color.x, 0.5f + 0.5f * color.y, 0.5f + 0.5f * color.z);
+			fclose(file);
+		}
+	}
+	printf("Wrote %d x %d tiles to %s\n", tiles, tiles, directory);
+	return true;
+}
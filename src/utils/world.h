@@ -0,0 +1,156 @@
+#ifndef WORLD_H
+#define WORLD_H
+
+#include <vector>
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <glm/glm.hpp>
+
+#include "texture.h"
+
+struct Model;
+struct Scene;
+struct ResourceManager;
+
+// Streaming worlds. A world is a directory holding world.txt and one text
+// file per occupied tile of a grid on the xz plane:
+//
+//   world.txt            tiles <countX> <countZ>
+//                        size <tile side>
+//                        origin <x> <z>
+//   tile_<x>_<z>.txt     model <path> <textures dir>
+//                        instance <model> <position> <rotation> <scale>
+//                        light <position> <color>
+//
+// instance refers to the tile's model lines in order and takes rotations in
+// degrees like the scene, paths are relative to the world directory. Tile
+// files may be missing, empty tiles cost nothing.
+//
+// Tiles around the camera and around where its velocity takes it are read,
+// and their new models loaded and decoded, on a loader thread; the GL thread
+// uploads them under a per frame byte budget and places the instances through
+// the resource manager, so models shared between tiles load once. When the
+// accounted memory exceeds the budget, the tiles wanted least recently are
+// unloaded.
+
+struct WorldLight
+{
+	glm::vec3 position;
+	glm::vec3 color;
+};
+
+struct TileInstance
+{
+	unsigned int model;
+	glm::vec3 position, rotation, scale;
+};
+
+// loaded without GL on the loader thread, uploaded on the GL thread
+struct StreamedModel
+{
+	std::string path;
+	Model* model;
+	// the full mip chain of every layer, levels images per layer
+	std::vector<Image> images;
+	int levels;
+	unsigned int uploadedMeshes;
+	// into images, the array is allocated with the first one
+	unsigned int uploadedImages;
+	bool texturesUploaded;
+};
+
+struct TileLoad
+{
+	unsigned int tile;
+	std::vector<std::string> modelPaths;
+	std::vector<TileInstance> instances;
+	std::vector<WorldLight> lights;
+	// the models that were neither loaded nor on their way
+	std::vector<StreamedModel> models;
+};
+
+enum TileState
+{
+	// requested, on the loader thread or waiting for upload
+	TILE_QUEUED,
+	// read and loaded, uploading
+	TILE_LOADED,
+	TILE_RESIDENT
+};
+
+struct WorldTile
+{
+	TileState state;
+	std::vector<std::string> modelPaths;
+	std::vector<unsigned int> entities;
+	std::vector<WorldLight> lights;
+	// frame it was last in range, for the unload order
+	unsigned long long lastWanted;
+	// frame it was last put in WorldStreamer::requests
+	unsigned long long requestFrame;
+};
+
+struct WorldStats
+{
+	unsigned int resident, queued, loaded;
+	unsigned int wanted;
+	unsigned int tileLoads, tileUnloads;
+	// meshes and textures uploaded this frame
+	size_t uploadedBytes;
+	float uploadMs, maxUploadMs;
+	// every wanted tile is resident and still over the budget
+	bool overBudget;
+};
+
+struct WorldStreamer
+{
+	std::string directory;
+	int countX, countZ;
+	float tileSize;
+	glm::vec2 origin;
+	// only the tiles that are not unloaded, by z * countX + x
+	std::map<unsigned int, WorldTile> tiles;
+
+	// tiles whose center is this close to the camera or its predicted path
+	float loadRadius;
+	// seconds of camera motion to prefetch along
+	float prefetchSeconds;
+	size_t uploadBudget;
+	size_t memoryBudget;
+
+	glm::vec3 lastCamera, velocity;
+	bool hasCamera;
+	unsigned long long frame;
+
+	std::thread loader;
+	std::mutex mutex;
+	std::condition_variable wake;
+	// tile indices, nearest first
+	std::deque<unsigned int> requests;
+	std::deque<TileLoad*> done;
+	// models loaded or on their way, the loader thread skips them
+	std::set<std::string> knownPaths;
+	std::set<std::string> failedPaths;
+	bool stopping;
+
+	WorldStats stats;
+};
+
+// false when world.txt is missing or malformed
+bool openWorld(WorldStreamer &world, const char* directory, float loadRadius, size_t uploadBudget, size_t memoryBudget);
+// unloads every tile and stops the loader thread
+void closeWorld(WorldStreamer &world, Scene &scene, ResourceManager &resources);
+// once per frame on the GL thread, before the scene transforms are updated
+void updateWorld(WorldStreamer &world, Scene &scene, ResourceManager &resources, glm::vec3 cameraPosition, float deltaTime);
+// false without resident lights
+bool nearestWorldLight(const WorldStreamer &world, glm::vec3 position, WorldLight &light);
+
+// a tiles x tiles grid of instances of one model, with a light per tile
+bool writeTestWorld(const char* directory, int tiles, float tileSize, const char* modelPath, const char* texturesDir, unsigned int instancesPerTile);
+
+#endif